@@ -0,0 +1,467 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+/* C++17 channel addresses at compile time.
+ *
+ * librecast::group("name") is the group address lc_channel_new(ctx, "name")
+ * uses, computed by a constexpr BLAKE3 or BLAKE2b (whichever the library was
+ * built with - USE_LIBSODIUM selects BLAKE2b, as for the library), so well
+ * known channels need no hashing at runtime:
+ *
+ *	constexpr auto news = librecast::group("news");
+ *	lc_channel_t *chan = librecast::channel_init(ctx, news);
+ *
+ *	switch (librecast::group::from(msg->dst).key()) {
+ *	case news.key(): ...
+ *	}
+ *
+ * librecast::channel_map<N> is a constexpr perfect hash of N channel names,
+ * for demultiplexing received messages by destination address */
+
+#ifndef _LIBRECAST_CHANNEL_HPP
+#define _LIBRECAST_CHANNEL_HPP 1
+
+#if __cplusplus < 201703L
+#error "librecast/channel.hpp requires C++17"
+#endif
+
+extern "C" {
+#include <librecast/net.h>
+}
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+namespace librecast {
+
+namespace detail {
+
+constexpr uint32_t rotr32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+constexpr uint64_t rotr64(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+/* BLAKE3, default (unkeyed) hash, 32 byte output */
+class blake3 {
+	static constexpr uint32_t IV[8] = {
+		0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+		0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+	};
+	static constexpr uint8_t PERM[16] = { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 };
+	enum : uint32_t { CHUNK_START = 1, CHUNK_END = 2, PARENT = 4, ROOT = 8 };
+	static constexpr size_t BLOCK_LEN = 64;
+	static constexpr size_t CHUNK_LEN = 1024;
+
+	struct words { uint32_t w[16] = {}; };
+	struct cv_t { uint32_t w[8] = {}; };
+
+	static constexpr void g(uint32_t *s, int a, int b, int c, int d, uint32_t x, uint32_t y)
+	{
+		s[a] = s[a] + s[b] + x;
+		s[d] = rotr32(s[d] ^ s[a], 16);
+		s[c] = s[c] + s[d];
+		s[b] = rotr32(s[b] ^ s[c], 12);
+		s[a] = s[a] + s[b] + y;
+		s[d] = rotr32(s[d] ^ s[a], 8);
+		s[c] = s[c] + s[d];
+		s[b] = rotr32(s[b] ^ s[c], 7);
+	}
+
+	static constexpr words compress(const cv_t &cv, const words &block, uint64_t counter,
+			uint32_t len, uint32_t flags)
+	{
+		words st{}, m = block;
+		for (int i = 0; i < 8; i++) st.w[i] = cv.w[i];
+		for (int i = 0; i < 4; i++) st.w[8 + i] = IV[i];
+		st.w[12] = (uint32_t)counter;
+		st.w[13] = (uint32_t)(counter >> 32);
+		st.w[14] = len;
+		st.w[15] = flags;
+		for (int r = 0; r < 7; r++) {
+			uint32_t *s = st.w;
+			g(s, 0, 4, 8, 12, m.w[0], m.w[1]);
+			g(s, 1, 5, 9, 13, m.w[2], m.w[3]);
+			g(s, 2, 6, 10, 14, m.w[4], m.w[5]);
+			g(s, 3, 7, 11, 15, m.w[6], m.w[7]);
+			g(s, 0, 5, 10, 15, m.w[8], m.w[9]);
+			g(s, 1, 6, 11, 12, m.w[10], m.w[11]);
+			g(s, 2, 7, 8, 13, m.w[12], m.w[13]);
+			g(s, 3, 4, 9, 14, m.w[14], m.w[15]);
+			words p{};
+			for (int i = 0; i < 16; i++) p.w[i] = m.w[PERM[i]];
+			m = p;
+		}
+		for (int i = 0; i < 8; i++) {
+			st.w[i] ^= st.w[i + 8];
+			st.w[i + 8] ^= cv.w[i];
+		}
+		return st;
+	}
+
+	static constexpr cv_t first8(const words &w)
+	{
+		cv_t cv{};
+		for (int i = 0; i < 8; i++) cv.w[i] = w.w[i];
+		return cv;
+	}
+
+	static constexpr cv_t parent(const cv_t &l, const cv_t &r, uint32_t flags)
+	{
+		words block{};
+		for (int i = 0; i < 8; i++) {
+			block.w[i] = l.w[i];
+			block.w[8 + i] = r.w[i];
+		}
+		return first8(compress(key(), block, 0, BLOCK_LEN, PARENT | flags));
+	}
+
+	static constexpr cv_t key()
+	{
+		cv_t k{};
+		for (int i = 0; i < 8; i++) k.w[i] = IV[i];
+		return k;
+	}
+
+	/* current chunk */
+	cv_t cv = key();
+	uint64_t chunk = 0;
+	uint8_t buf[BLOCK_LEN] = {};
+	size_t buflen = 0;
+	size_t blocks = 0; /* compressed in this chunk */
+	/* completed chunks, merged as a binary tree */
+	cv_t stack[54] = {};
+	size_t depth = 0;
+
+	constexpr words block() const
+	{
+		words b{};
+		for (size_t i = 0; i < BLOCK_LEN; i++) b.w[i / 4] |= (uint32_t)buf[i] << (8 * (i % 4));
+		return b;
+	}
+
+	constexpr uint32_t start() const { return blocks ? 0 : (uint32_t)CHUNK_START; }
+
+	constexpr size_t chunk_len() const { return blocks * BLOCK_LEN + buflen; }
+
+	constexpr void push_chunk()
+	{
+		cv_t c = first8(compress(cv, block(), chunk, buflen, start() | CHUNK_END));
+		uint64_t total = ++chunk;
+		while (!(total & 1)) {
+			c = parent(stack[--depth], c, 0);
+			total >>= 1;
+		}
+		stack[depth++] = c;
+		cv = key();
+		blocks = 0;
+		buflen = 0;
+		for (auto &b : buf) b = 0;
+	}
+
+public:
+	constexpr void update(const uint8_t *in, size_t len)
+	{
+		while (len) {
+			if (chunk_len() == CHUNK_LEN) push_chunk();
+			if (buflen == BLOCK_LEN) {
+				cv = first8(compress(cv, block(), chunk, BLOCK_LEN, start()));
+				blocks++;
+				buflen = 0;
+				for (auto &b : buf) b = 0;
+			}
+			buf[buflen++] = *in++;
+			len--;
+		}
+	}
+
+	constexpr void final(uint8_t out[32]) const
+	{
+		/* output of the last chunk, folded up the tree, then finalized as root */
+		cv_t in = cv;
+		words b = block();
+		uint32_t len = (uint32_t)buflen;
+		uint32_t flags = start() | CHUNK_END;
+		uint64_t counter = chunk;
+		for (size_t i = depth; i > 0; i--) {
+			cv_t right = first8(compress(in, b, counter, len, flags));
+			words pb{};
+			for (int j = 0; j < 8; j++) {
+				pb.w[j] = stack[i - 1].w[j];
+				pb.w[8 + j] = right.w[j];
+			}
+			in = key();
+			b = pb;
+			len = BLOCK_LEN;
+			flags = PARENT;
+			counter = 0;
+		}
+		words root = compress(in, b, counter, len, flags | ROOT);
+		for (int i = 0; i < 32; i++) out[i] = (uint8_t)(root.w[i / 4] >> (8 * (i % 4)));
+	}
+};
+
+/* BLAKE2b, unkeyed, 32 byte output - crypto_generichash() */
+class blake2b {
+	static constexpr uint64_t IV[8] = {
+		0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+		0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+		0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+	};
+	static constexpr uint8_t SIGMA[12][16] = {
+		{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+		{ 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+		{ 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+		{ 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+		{ 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+		{ 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+		{ 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+		{ 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+		{ 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+		{ 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 },
+		{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+		{ 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+	};
+	static constexpr size_t BLOCK_LEN = 128;
+
+	uint64_t h[8] = {
+		IV[0] ^ 0x01010000 ^ 32, IV[1], IV[2], IV[3], IV[4], IV[5], IV[6], IV[7],
+	};
+	uint64_t t = 0;
+	uint8_t buf[BLOCK_LEN] = {};
+	size_t buflen = 0;
+
+	static constexpr void g(uint64_t *v, int a, int b, int c, int d, uint64_t x, uint64_t y)
+	{
+		v[a] = v[a] + v[b] + x;
+		v[d] = rotr64(v[d] ^ v[a], 32);
+		v[c] = v[c] + v[d];
+		v[b] = rotr64(v[b] ^ v[c], 24);
+		v[a] = v[a] + v[b] + y;
+		v[d] = rotr64(v[d] ^ v[a], 16);
+		v[c] = v[c] + v[d];
+		v[b] = rotr64(v[b] ^ v[c], 63);
+	}
+
+	constexpr void compress(bool last)
+	{
+		uint64_t m[16] = {}, v[16] = {};
+		for (size_t i = 0; i < BLOCK_LEN; i++) m[i / 8] |= (uint64_t)buf[i] << (8 * (i % 8));
+		for (int i = 0; i < 8; i++) {
+			v[i] = h[i];
+			v[i + 8] = IV[i];
+		}
+		v[12] ^= t;
+		if (last) v[14] = ~v[14];
+		for (int r = 0; r < 12; r++) {
+			const uint8_t *s = SIGMA[r];
+			g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+			g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+			g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+			g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+			g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+			g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+			g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+			g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+		}
+		for (int i = 0; i < 8; i++) h[i] ^= v[i] ^ v[i + 8];
+	}
+
+public:
+	constexpr void update(const uint8_t *in, size_t len)
+	{
+		while (len) {
+			/* the last block is compressed by final(), so only full
+			 * blocks with more to come are compressed here */
+			if (buflen == BLOCK_LEN) {
+				t += BLOCK_LEN;
+				compress(false);
+				buflen = 0;
+				for (auto &b : buf) b = 0;
+			}
+			buf[buflen++] = *in++;
+			len--;
+		}
+	}
+
+	constexpr void final(uint8_t out[32])
+	{
+		t += buflen;
+		compress(true);
+		for (int i = 0; i < 32; i++) out[i] = (uint8_t)(h[i / 8] >> (8 * (i % 8)));
+	}
+};
+
+#ifdef USE_LIBSODIUM
+using hash = blake2b;
+#else
+using hash = blake3;
+#endif
+
+/* lc_hashgroup(): hash name then flags (unsigned int, host byte order), and
+ * XOR bytes 2 - 15 of the hash into base */
+template <typename H>
+constexpr void hashgroup(const uint8_t base[16], std::string_view name, uint32_t flags, uint8_t out[16])
+{
+	H h{};
+	uint8_t f[4] = {}, md[32] = {};
+	uint8_t s[64] = {};
+	size_t off = 0;
+	while (off < name.size()) {
+		size_t n = (name.size() - off < sizeof s) ? name.size() - off : sizeof s;
+		for (size_t i = 0; i < n; i++) s[i] = (uint8_t)name[off + i];
+		h.update(s, n);
+		off += n;
+	}
+	for (int i = 0; i < 4; i++) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		f[i] = (uint8_t)(flags >> (8 * (3 - i)));
+#else
+		f[i] = (uint8_t)(flags >> (8 * i));
+#endif
+	}
+	h.update(f, sizeof f);
+	h.final(md);
+	for (int i = 0; i < 16; i++) out[i] = (i < 2) ? base[i] : base[i] ^ md[i];
+}
+
+} /* namespace detail */
+
+/* IPv6 group address of a channel */
+class group {
+	uint8_t a[16] = {};
+
+public:
+	/* DEFAULT_ADDR (ff1e::), the base lc_channel_new() hashes onto */
+	static constexpr uint8_t default_base[16] = { 0xff, 0x1e };
+
+	constexpr group() = default;
+
+	/* group lc_channel_new(ctx, name) would use */
+	constexpr explicit group(std::string_view name)
+	{
+		detail::hashgroup<detail::hash>(default_base, name, 0, a);
+	}
+
+	/* as above, with the hash named explicitly, to match a library built
+	 * the other way */
+	template <typename H>
+	static constexpr group hashed(std::string_view name)
+	{
+		group g;
+		detail::hashgroup<H>(default_base, name, 0, g.a);
+		return g;
+	}
+
+	static group from(const struct in6_addr &addr)
+	{
+		group g;
+		std::memcpy(g.a, &addr, sizeof g.a);
+		return g;
+	}
+
+	constexpr uint8_t operator[](size_t i) const { return a[i]; }
+
+	constexpr bool operator==(const group &o) const
+	{
+		for (int i = 0; i < 16; i++) if (a[i] != o.a[i]) return false;
+		return true;
+	}
+
+	constexpr bool operator!=(const group &o) const { return !(*this == o); }
+
+	/* low 64 bits of the address as a number, for switch tables.  Channels
+	 * differ here unless their hashes collide in 64 bits */
+	constexpr uint64_t key() const
+	{
+		uint64_t k = 0;
+		for (int i = 8; i < 16; i++) k = (k << 8) | a[i];
+		return k;
+	}
+
+	struct in6_addr in6addr() const
+	{
+		struct in6_addr addr;
+		std::memcpy(&addr, a, sizeof addr);
+		return addr;
+	}
+
+	struct sockaddr_in6 sockaddr(in_port_t port = LC_DEFAULT_PORT) const
+	{
+		struct sockaddr_in6 sa = {};
+		sa.sin6_family = AF_INET6;
+		sa.sin6_port = htons(port);
+		std::memcpy(&sa.sin6_addr, a, sizeof a);
+		return sa;
+	}
+};
+
+/* channel on group g, without hashing - as lc_channel_new() for its name */
+inline lc_channel_t *channel_init(lc_ctx_t *ctx, const group &g, in_port_t port = LC_DEFAULT_PORT)
+{
+	struct sockaddr_in6 sa = g.sockaddr(port);
+	return lc_channel_init(ctx, &sa);
+}
+
+/* perfect hash of N channel names, built at compile time.  find() returns
+ * the index of the name whose group is addr, or -1 */
+template <size_t N>
+class channel_map {
+	static constexpr size_t bits()
+	{
+		size_t b = 1;
+		while (((size_t)1 << b) < 2 * N) b++;
+		return b;
+	}
+	static constexpr size_t SLOTS = (size_t)1 << bits();
+
+	group grp[N] = {};
+	int slot[SLOTS] = {};
+	uint64_t mul = 0;
+
+	constexpr size_t index(uint64_t key) const { return (size_t)((key * mul) >> (64 - bits())); }
+
+public:
+	constexpr explicit channel_map(const std::string_view (&names)[N])
+	{
+		for (size_t i = 0; i < N; i++) grp[i] = group(names[i]);
+		/* odd multipliers until every key has a slot of its own */
+		for (uint64_t seed = 1; seed < 1u << 16; seed++) {
+			bool ok = true;
+			mul = (seed * 0x9e3779b97f4a7c15ULL) | 1;
+			for (auto &s : slot) s = -1;
+			for (size_t i = 0; i < N && ok; i++) {
+				size_t j = index(grp[i].key());
+				if (slot[j] >= 0) ok = false;
+				else slot[j] = (int)i;
+			}
+			if (ok) return;
+		}
+		throw std::logic_error("channel_map: duplicate channel names");
+	}
+
+	constexpr size_t size() const { return N; }
+
+	constexpr const group &operator[](size_t i) const { return grp[i]; }
+
+	constexpr int find(const group &g) const
+	{
+		int i = slot[index(g.key())];
+		return (i >= 0 && grp[i] == g) ? i : -1;
+	}
+
+	int find(const struct in6_addr &addr) const { return find(group::from(addr)); }
+};
+
+namespace literals {
+
+/* "name"_group */
+constexpr group operator""_group(const char *s, size_t len)
+{
+	return group(std::string_view(s, len));
+}
+
+} /* namespace literals */
+
+} /* namespace librecast */
+
+#endif /* _LIBRECAST_CHANNEL_HPP */
@@ -66,7 +66,12 @@
 	X(-56, LC_ERROR_THREAD_JOIN,        "Failed to join thread") \
 	X(-57, LC_ERROR_INVALID_OPCODE,     "Invalid opcode") \
 	X(-58, LC_ERROR_QUERY_REQUIRED,     "Librecast query required for this operation") \
-	X(-59, LC_ERROR_SETSOCKOPT,         "Unable to set socket option")
+	X(-59, LC_ERROR_SETSOCKOPT,         "Unable to set socket option") \
+	X(-60, LC_ERROR_NET_DROP,           "Packets dropped by kernel (receive buffer full)") \
+	X(-61, LC_ERROR_EVENT_LOOP,         "Event loop error") \
+	X(-62, LC_ERROR_THREAD_CREATE,      "Unable to create thread") \
+	X(-63, LC_ERROR_SOURCE_FILTER,      "Source filter mode conflicts with channel membership") \
+	X(-64, LC_ERROR_NOT_SUPPORTED,      "Not supported on this platform")
 #undef X
 
 #define LC_ERROR_MSG(code, name, msg) case code: return msg;
@@ -16,21 +16,144 @@ lc_ctx_t *lc_ctx_new();
 /* destroy librecast context and clean up */
 void lc_ctx_free(lc_ctx_t *ctx);
 
+/* start nthreads threads running an epoll event loop for ctx. Sockets passed
+ * to lc_socket_listen() from now on are served by the loop threads instead of
+ * a thread each. nthreads may be 0 if lc_ctx_run() will be called (Linux) */
+int lc_ctx_loop_start(lc_ctx_t *ctx, int nthreads);
+
+/* run ctx event loop in the calling thread, until lc_ctx_loop_stop() */
+int lc_ctx_run(lc_ctx_t *ctx);
+
+/* stop all threads running the ctx event loop, and wait for them to finish.
+ * Sockets stay registered, and are served again when the loop is restarted.
+ * Must not be called from a listener callback */
+int lc_ctx_loop_stop(lc_ctx_t *ctx);
+
+/* hand messages received by listeners in ctx to a pool of nworkers threads,
+ * which run the callbacks. Messages for each channel (key =
+ * LC_WORKERS_CHANNEL) or each sender on each channel (LC_WORKERS_SOURCE) are
+ * delivered in order, one at a time, while others run in parallel, so a slow
+ * callback doesn't hold up the socket.  nworkers = 0 calls back from the
+ * listener (default). Call before lc_socket_listen() */
+int lc_ctx_workers(lc_ctx_t *ctx, int nworkers, lc_workers_key_t key);
+
+/* keep a cache of multicast interfaces in ctx, which joins and parts use
+ * instead of listing interfaces each time, and a thread to update it as
+ * interfaces come and go.  Channels, ranges and topics joined on sockets
+ * without an interface set (lc_socket_bind()) are joined on new interfaces, and
+ * parted from interfaces that go away.  on = 0 stops it.  Linux only */
+int lc_ctx_ifmonitor(lc_ctx_t *ctx, int on);
+
+/* copy up to n interface indexes cached by lc_ctx_ifmonitor() into ifx.
+ * Returns number of interfaces cached, or -1 if there is no cache */
+ssize_t lc_ctx_iflist(lc_ctx_t *ctx, unsigned int ifx[], size_t n);
+
+/* pace channel joins in ctx, to avoid a storm of MLD reports when joining many
+ * groups at once.  lc_channel_join() and lc_channel_join_many() queue the join
+ * and return 0, and a thread joins at up to rate channels per second, in bursts
+ * of up to burst.  Queued channels join in priority order (see
+ * lc_channel_join_prio()), first come first served within a priority, and fn,
+ * if set, is called from that thread with each channel and the result of its
+ * join.  Parting a queued channel cancels its join.  rate = 0 stops pacing,
+ * joining anything still queued at once.  Channels on socket groups, ranges
+ * and topics aren't paced */
+int lc_ctx_join_pace(lc_ctx_t *ctx, unsigned int rate, unsigned int burst, lc_join_fn_t *fn,
+		void *arg);
+
+/* copy paced join stats into stats */
+int lc_ctx_join_stats(lc_ctx_t *ctx, lc_join_stats_t *stats);
+
+/* copy stats for up to n workers into stats. Returns number of workers */
+int lc_ctx_workers_stats(lc_ctx_t *ctx, lc_worker_stats_t *stats, int n);
+
+/* initialize thread attributes: any CPU, any node, normal scheduling,
+ * default stack */
+void lc_thread_attr_init(lc_thread_attr_t *attr);
+
+/* add cpu to the CPUs attr allows */
+int lc_thread_attr_setcpu(lc_thread_attr_t *attr, int cpu);
+
+/* set placement of threads the context creates from now on: listener threads
+ * (unless set per socket), event loop threads and workers. Threads on a NUMA
+ * node allocate their buffers from it.  attr is copied. NULL = default */
+int lc_ctx_thread_attr(lc_ctx_t *ctx, const lc_thread_attr_t *attr);
+
+/* remember the addresses of up to entries channel names, so channels created
+ * by name again aren't hashed again. 0 = forget (default).  Call before
+ * creating channels from other threads */
+int lc_ctx_intern(lc_ctx_t *ctx, size_t entries);
+
+/* memory held by the context for channels and sockets.  Channels and sockets
+ * freed are reused by the context, and only returned to the system by
+ * lc_ctx_free() */
+int lc_ctx_mem_stats(lc_ctx_t *ctx, lc_mem_stats_t *stats);
+
+/* set placement of socket listener thread, overriding the context. Messages
+ * received are allocated on the listener's node.  attr is copied.  NULL =
+ * use context default.  Must be set before lc_socket_listen(), which returns
+ * LC_ERROR_THREAD_CREATE if the thread can't be placed as requested (eg.
+ * realtime priority without CAP_SYS_NICE) */
+int lc_socket_thread_attr(lc_socket_t *sock, const lc_thread_attr_t *attr);
+
 /* create librecast socket */
 lc_socket_t *lc_socket_new(lc_ctx_t *ctx);
 
+/* create librecast socket on interface ifx which sends and receives through
+ * memory-mapped AF_PACKET (TPACKET_V3) rings, bypassing the UDP stack.
+ * The kernel filters frames to the channels joined, and the listener
+ * dispatches messages straight from the ring. Linux only, requires
+ * CAP_NET_RAW.  Returns NULL and sets errno on failure */
+lc_socket_t *lc_socket_packet_new(lc_ctx_t *ctx, unsigned int ifx);
+
 /* bind socket to interface with index idx. 0 = ALL (default) */
 int lc_socket_bind(lc_socket_t *sock, unsigned int ifx);
 
 /* close socket */
 void lc_socket_close(lc_socket_t *sock);
 
+/* create a group of n sockets, which share the traffic on the channels bound
+ * to the group between them.  Each socket has a kernel filter which accepts
+ * its share of packets, selected by mode:
+ *   LC_FANOUT_HASH - hash of sender address and port. Messages from each
+ *                    sender arrive in order, on the same socket
+ *   LC_FANOUT_CPU  - CPU which received the packet, modulo n
+ * Socket i's listener thread is pinned to CPU i (modulo CPUs available).
+ * Returns NULL and sets errno on failure */
+lc_socket_group_t *lc_socket_group_new(lc_ctx_t *ctx, int n, lc_fanout_t mode);
+
+/* stop listening, and close all sockets in group. Called by lc_ctx_free() */
+void lc_socket_group_free(lc_socket_group_t *grp);
+
+/* return socket i of group, or NULL if out of range */
+lc_socket_t *lc_socket_group_socket(lc_socket_group_t *grp, int i);
+
+/* bind channel to all sockets in group. The channel sends on the first.
+ * Ordered channels (lc_channel_ordered) need a single socket, and are refused */
+int lc_socket_group_bind(lc_socket_group_t *grp, lc_channel_t *chan);
+
+/* join / part channel on all sockets in group */
+int lc_socket_group_join(lc_socket_group_t *grp, lc_channel_t *chan);
+int lc_socket_group_part(lc_socket_group_t *grp, lc_channel_t *chan);
+
+/* listen on all sockets in group, as lc_socket_listen(). Callbacks are made
+ * from each socket's listener thread concurrently */
+int lc_socket_group_listen(lc_socket_group_t *grp, void (*callback_msg)(lc_message_t*),
+		void (*callback_err)(int));
+
+/* stop listening on all sockets in group */
+int lc_socket_group_listen_cancel(lc_socket_group_t *grp);
+
 /* Create a new channel by hashing s of length len */
 lc_channel_t *lc_channel_nnew(lc_ctx_t *ctx, unsigned char *s, size_t len);
 
 /* Create a new channel from the hash of s which must be a NUL-terminated string */
 lc_channel_t *lc_channel_new(lc_ctx_t *ctx, char *s);
 
+/* create n channels, as lc_channel_new() for each of names, storing them in
+ * out.  The channels are allocated in one block and added to ctx in one step.
+ * Returns 0 on success, or error (no channels created) */
+int lc_channel_new_many(lc_ctx_t *ctx, char *names[], size_t n, lc_channel_t *out[]);
+
 /* copy a channel into ctx */
 lc_channel_t *lc_channel_copy(lc_ctx_t *ctx, lc_channel_t *chan);
 
@@ -40,29 +163,221 @@ lc_channel_t * lc_channel_sideband(lc_channel_t *base, uint64_t band);
 /* create side channel from base by hashing additional key material */
 lc_channel_t * lc_channel_sidehash(lc_channel_t *base, unsigned char *key, size_t keylen);
 
+/* create range standing for every side band channel of base (see
+ * lc_channel_sideband()), without allocating a channel per band. Memory used
+ * grows only with the number of bands joined */
+lc_range_t *lc_range_new(lc_channel_t *base);
+
+/* part any bands joined and free range.  Free before closing its socket */
+void lc_range_free(lc_range_t *range);
+
+/* bind range to socket, for sending, joining and receiving */
+int lc_range_bind(lc_socket_t *sock, lc_range_t *range);
+
+/* join / part band of range */
+int lc_range_join(lc_range_t *range, uint64_t band);
+int lc_range_part(lc_range_t *range, uint64_t band);
+
+/* number of bands joined */
+size_t lc_range_joined(lc_range_t *range);
+
+/* bytes used by range */
+size_t lc_range_bytes(lc_range_t *range);
+
+/* group address of band */
+void lc_range_addr(lc_range_t *range, uint64_t band, struct in6_addr *addr);
+
+/* messages received on any band of range by the socket listener are passed to
+ * fn with their band, instead of the socket callback.  fn = NULL to use the
+ * socket callback.  Call before lc_socket_listen() */
+int lc_range_listen(lc_range_t *range, lc_range_fn_t *fn, void *arg);
+
+/* direct indexed demux: messages on bands below n are passed to the range
+ * callback with table[band] as arg, instead of the arg given to
+ * lc_range_listen().  table is not copied.  Call before lc_socket_listen() */
+int lc_range_table(lc_range_t *range, void *table[], size_t n);
+
+/* send to band of range, as lc_channel_send() */
+ssize_t lc_range_send(lc_range_t *range, uint64_t band, const void *buf, size_t len, int flags);
+
+/* send message to band of range, as lc_msg_send(). Sequence numbers are
+ * shared by all bands of the range */
+ssize_t lc_range_msg_send(lc_range_t *range, uint64_t band, lc_message_t *msg);
+
+/* topic space: any number of topics hashed onto shards groups, which are
+ * side bands 0 to shards - 1 of base.  Messages carry a 32 bit topic tag.
+ * Receivers join only the shards of the topics they subscribe to, and drop
+ * other topics on those shards - in the kernel where possible.  Fewer shards
+ * use fewer switch and NIC multicast filter entries, but deliver more
+ * unwanted messages; see lc_topics_waste() */
+lc_topics_t *lc_topics_new(lc_channel_t *base, unsigned int shards);
+
+/* unsubscribe from everything and free topic space. Free before closing its
+ * socket */
+void lc_topics_free(lc_topics_t *t);
+
+/* bind topic space to socket, for sending and receiving.  A socket has one
+ * topic space */
+int lc_topics_bind(lc_socket_t *sock, lc_topics_t *t);
+
+/* subscribe to / unsubscribe from topic, joining / parting its shard as
+ * needed.  Topic messages received by the socket listener have their tag
+ * stripped into msg->topic, and go to the socket callback */
+int lc_topics_subscribe(lc_topics_t *t, const char *topic);
+int lc_topics_unsubscribe(lc_topics_t *t, const char *topic);
+
+/* send data tagged with topic to its shard */
+ssize_t lc_topics_send(lc_topics_t *t, const char *topic, const void *buf, size_t len);
+
+/* tag of topic, as found in msg->topic */
+uint32_t lc_topic_tag(const char *topic);
+
+/* shard topic is sent on */
+unsigned int lc_topics_shard(lc_topics_t *t, const char *topic);
+
+/* drop unsubscribed topics with a kernel socket filter (default 1), or in the
+ * listener only (0).  Not available on socket group or packet sockets, or
+ * beyond a few thousand topics, where the listener drops them */
+int lc_topics_filter(lc_topics_t *t, int enable);
+
+/* fetch topic space statistics */
+int lc_topics_stats(lc_topics_t *t, lc_topic_stats_t *stats);
+
+/* expected fraction of messages received on the shards joined that are for
+ * topics not subscribed, with traffic spread evenly over topics active topics
+ * hashed onto shards, subscribing to subscribed of them.  This is the traffic
+ * the network and NIC deliver, whether or not the kernel filter drops it */
+double lc_topics_waste(unsigned int shards, size_t topics, size_t subscribed);
+
 /* create random channel */
 lc_channel_t *lc_channel_random(lc_ctx_t *ctx);
 
-/* bind channel to socket */
+/* deliver messages received on chan to listener callbacks in sender order.
+ * Out of order messages are held for up to hold ms, in a buffer of depth
+ * messages.  When either is exceeded, the missing messages are skipped and
+ * msg->gap of the next message delivered is set to the number skipped.
+ * depth = 0 disables. Call before lc_socket_listen() */
+int lc_channel_ordered(lc_channel_t *chan, unsigned int depth, unsigned int hold);
+
+/* bind channel to socket.  A channel bound to another socket is unbound
+ * from it first */
 int lc_channel_bind(lc_socket_t *sock, lc_channel_t *chan);
 
-/* unbind channel from socket */
+/* messages received on chan by the socket listener are passed to fn with arg,
+ * instead of the socket callback.  fn = NULL to use the socket callback.
+ * Call before lc_socket_listen() */
+int lc_channel_listen(lc_channel_t *chan, lc_channel_fn_t *fn, void *arg);
+
+/* unbind channel from socket, parting the group if joined */
 int lc_channel_unbind(lc_channel_t *chan);
 
-/* join librecast channel */
+/* join librecast channel.  Channels and ranges on one socket may share a
+ * group - joins are counted, and the group is left when the last parts */
 int lc_channel_join(lc_channel_t *chan);
 
-/* leave a librecast channel */
+/* join channel, as lc_channel_join().  If joins are paced, channels with higher
+ * prio join first (lc_channel_join() is prio 0) */
+int lc_channel_join_prio(lc_channel_t *chan, int prio);
+
+/* join n channels, as lc_channel_join() for each, finding interfaces once for
+ * all of them.  If rc is not NULL, the result for chan[i] is stored in rc[i].
+ * Returns 0 if all were joined, or the first error */
+int lc_channel_join_many(lc_channel_t *chan[], size_t n, int rc[]);
+
+/* part n channels, as lc_channel_join_many() */
+int lc_channel_part_many(lc_channel_t *chan[], size_t n, int rc[]);
+
+/* leave a librecast channel, including any sources joined or blocked */
 int lc_channel_part(lc_channel_t *chan);
 
+/* source specific multicast (SSM).  Receive chan only from src - the kernel
+ * and network drop other senders.  Joins (S,G) on each interface, as
+ * lc_channel_join().  May be called for several sources.  Returns
+ * LC_ERROR_SOURCE_FILTER if chan is joined for any source (lc_channel_join()).
+ * Source filters apply to a socket's membership of a group, so they also
+ * return LC_ERROR_SOURCE_FILTER while another channel or range on the socket
+ * has the group joined, and joining a filtered group does the same */
+int lc_channel_join_source(lc_channel_t *chan, const struct in6_addr *src);
+
+/* stop receiving chan from src.  Parting the last source leaves the group */
+int lc_channel_part_source(lc_channel_t *chan, const struct in6_addr *src);
+
+/* drop chan from src, on a channel joined for any source (lc_channel_join()).
+ * Returns LC_ERROR_SOURCE_FILTER if it isn't */
+int lc_channel_block_source(lc_channel_t *chan, const struct in6_addr *src);
+
+/* receive chan from a source blocked with lc_channel_block_source() again */
+int lc_channel_unblock_source(lc_channel_t *chan, const struct in6_addr *src);
+
+/* replace the source filter of chan with n sources, in one call per interface:
+ * LC_FILTER_INCLUDE receives only from src (n = 0 parts chan), LC_FILTER_EXCLUDE
+ * joins for any source except src.  Linux limits sources per socket and group
+ * to net.ipv6.mld_max_msf (default 64) - raise it for large lists.  Not
+ * supported on AF_PACKET sockets (lc_socket_packet_new()), which see all
+ * senders */
+int lc_channel_filter(lc_channel_t *chan, lc_filter_mode_t mode, const struct in6_addr src[],
+		size_t n);
+
+/* make sock elastic: joins the kernel refuses because sock holds too many
+ * memberships (Linux charges them to net.core.optmem_max, a few thousand
+ * groups) spill onto more kernel sockets, up to max (0 = default 256), opened
+ * as needed on the same port.  Receives, listeners and lc_socket_fd() cover
+ * them all, so one lc_socket_t can hold 100k+ channels.  Sending, source
+ * specific joins and topic filters use sock's own kernel socket.  Call before
+ * lc_socket_listen().  Not for AF_PACKET sockets or socket group members */
+int lc_socket_elastic(lc_socket_t *sock, unsigned int max);
+
+/* kernel sockets sock is using: 1 unless elastic */
+int lc_socket_elastic_count(lc_socket_t *sock);
+
+/* choose the interfaces sock sends out of.  LC_SEND_DEFAULT sends once, out
+ * of the interface bound (lc_socket_bind()) or the one the kernel routes to.
+ * LC_SEND_ALL sends a copy out of every multicast interface, and
+ * LC_SEND_LIST out of each of the n interfaces in ifx, overriding
+ * lc_socket_bind() for sends.  Copies are sent with one sendmmsg(), each with
+ * its IPV6_PKTINFO interface.  LC_SEND_ALL takes interfaces from the context
+ * cache, following them as they change, if lc_ctx_ifmonitor() is on,
+ * otherwise lists them once, now.  Sends return the bytes in one copy if any
+ * was sent.  lc_channel_sendmsg() with its own msg_control sends once.  With
+ * loopback on, local receivers get a copy per interface - see
+ * lc_socket_dedup().  Not for AF_PACKET sockets */
+int lc_socket_send_policy(lc_socket_t *sock, lc_send_policy_t policy, const unsigned int ifx[],
+		size_t n);
+
 /* blocking socket recv() */
 ssize_t lc_socket_recv(lc_socket_t *sock, void *buf, size_t len, int flags);
 
-/* non-blocking socket listener, with callbacks */
+/* non-blocking socket listener, with callbacks. Runs a thread for the socket,
+ * or if lc_ctx_loop_start() has been called, registers with the ctx event loop
+ * (see above). Callbacks for each socket run on one thread at a time */
 int lc_socket_listen(lc_socket_t *sock, void (*callback_msg)(lc_message_t*),
 			                void (*callback_err)(int));
 
-/* stop listening on socket */
+/* drop messages seen in the last window ms (up to entries per window), entries = 0 disables */
+int lc_socket_dedup(lc_socket_t *sock, size_t entries, unsigned int window);
+
+/* fetch duplicate filter statistics */
+int lc_socket_dedup_stats(lc_socket_t *sock, lc_dedup_stats_t *stats);
+
+/* keep per-sender receive statistics (received, lost, duplicate and
+ * reordered messages) for up to max senders, keyed on channel, source address
+ * and source port. The sender least recently heard from is evicted when the
+ * table is full. max = 0 disables.  Call before lc_socket_listen() */
+int lc_socket_senders(lc_socket_t *sock, size_t max);
+
+/* fetch stats for sender src on channel chan */
+int lc_socket_sender_stats(lc_socket_t *sock, lc_channel_t *chan, struct sockaddr_in6 *src,
+		lc_sender_stats_t *stats);
+
+/* copy stats for up to n senders to stats array, most recently heard from
+ * first. Returns number of entries copied, or -1 on error */
+ssize_t lc_socket_senders_list(lc_socket_t *sock, lc_sender_stats_t *stats, size_t n);
+
+/* stop listening on socket, waiting for callbacks in the worker pool to
+ * finish.  Called from one of the socket's own callbacks, it returns at once:
+ * the listener stops as the callback returns, and messages already with
+ * other workers may still be delivered.  The listener thread is then joined
+ * by lc_socket_close(), or another cancel */
 int lc_socket_listen_cancel(lc_socket_t *sock);
 
 /* send to all channels bound to a socket */
@@ -76,6 +391,36 @@ ssize_t lc_channel_sendmsg(lc_channel_t *chan, struct msghdr *msg, int flags);
 
 /* blocking message receive */
 ssize_t lc_msg_recv(lc_socket_t *sock, lc_message_t *msg);
+
+/* non-blocking message receive. Returns -1 with errno EAGAIN if no message is
+ * waiting */
+ssize_t lc_msg_tryrecv(lc_socket_t *sock, lc_message_t *msg);
+
+/* receive message, waiting up to timeout ms (0 = don't wait, -1 = forever).
+ * Returns -1 with errno EAGAIN on timeout */
+ssize_t lc_msg_recv_timeout(lc_socket_t *sock, lc_message_t *msg, int timeout);
+
+/* return file descriptor to poll (POLLIN / EPOLLIN) for messages on sock, for
+ * use with an external event loop.  This is the AF_PACKET ring for sockets
+ * created with lc_socket_packet_new(), an epoll set of all its UDP sockets
+ * for elastic sockets (lc_socket_elastic()), otherwise the UDP socket.  Readable
+ * does not guarantee a message (it may be for a group not joined), so read
+ * with lc_msg_tryrecv() or lc_socket_drain(); with edge-triggered polling,
+ * read until EAGAIN / lc_socket_drain() returns less than max */
+int lc_socket_fd(lc_socket_t *sock);
+
+/* read up to max waiting messages without blocking, and dispatch each as the
+ * listener would (dedup, ordering, opcode handlers, worker pool), calling
+ * callback_msg, or callback_err on error.  Call when lc_socket_fd() is
+ * readable.  Returns number of messages read, -1 if the read failed (errno
+ * set), or LC_ERROR_SOCKET_LISTENING if sock has a listener */
+ssize_t lc_socket_drain(lc_socket_t *sock, void (*callback_msg)(lc_message_t*),
+		void (*callback_err)(int), int max);
+
+/* ms until messages held on ordered channels bound to sock are due for
+ * release by lc_socket_drain() (0 = now), or -1 if none are held. Use as the
+ * poll timeout */
+int lc_socket_timeout(lc_socket_t *sock);
 ssize_t lc_socket_recvmsg(lc_socket_t *sock, struct msghdr *msg, int flags);
 
 /* send a message to a channel */
@@ -86,6 +431,27 @@ ssize_t lc_msg_sendto(int sock, const void *buf, size_t len, struct sockaddr_in6
 int lc_socket_getopt(lc_socket_t *sock, int optname, void *optval, socklen_t *optlen);
 int lc_socket_setopt(lc_socket_t *sock, int optname, const void *optval, socklen_t optlen);
 
+/* set socket receive buffer to size bytes.  If max > size, the buffer is
+ * doubled, up to max, each time the kernel reports packets dropped.
+ * SO_RCVBUFFORCE is used where permitted (CAP_NET_ADMIN) */
+int lc_socket_rcvbuf(lc_socket_t *sock, int size, int max);
+
+/* low latency receive.  busy_us > 0 sets SO_BUSY_POLL (and
+ * SO_PREFER_BUSY_POLL where available), so blocking receives poll the device
+ * queue for up to busy_us before sleeping.  Returns LC_ERROR_NOT_SUPPORTED
+ * where the platform has no SO_BUSY_POLL.  Raising it above the
+ * net.core.busy_read sysctl requires CAP_NET_ADMIN.  spin_us > 0 makes the
+ * listener thread spin on non-blocking receives, and block only once no
+ * message has arrived for spin_us, so a busy socket never sleeps and an idle
+ * one stops burning CPU.  Spinning applies to listener threads, not the event
+ * loop.  (0, 0) = blocking (default).  Set before lc_socket_listen() */
+int lc_socket_busy_poll(lc_socket_t *sock, int busy_us, int spin_us);
+
+/* number of packets dropped by the kernel on this socket, as reported with
+ * the last message received. The listener reports new drops by calling
+ * callback_err with LC_ERROR_NET_DROP */
+uint64_t lc_socket_drops(lc_socket_t *sock);
+
 /* turn socket loopback on (val = 1) or off (val = 0)*/
 int lc_socket_loop(lc_socket_t *sock, int val);
 
@@ -137,19 +503,24 @@ lc_ctx_t *lc_channel_ctx(lc_channel_t *chan);
 /* return socket bound to this channel */
 lc_socket_t *lc_channel_socket(lc_channel_t *chan);
 
-/* return socket address for this channel */
+/* return socket address for this channel.  Channels are indexed by their
+ * group address, so it must not be changed */
 struct sockaddr_in6 *lc_channel_sockaddr(lc_channel_t *chan);
 
-/* return struct in6_addr for this channel */
+/* return struct in6_addr for this channel, as lc_channel_sockaddr() */
 struct in6_addr *lc_channel_in6addr(lc_channel_t *chan);
 
+/* return a channel in ctx with group address addr, or NULL if none */
+lc_channel_t *lc_channel_by_address(lc_ctx_t *lctx, struct in6_addr *addr);
+
 /* return channel uri */
 char *lc_channel_uri(lc_channel_t *chan);
 
 /* create new channel from grp address and service */
 lc_channel_t * lc_channel_init(lc_ctx_t *ctx, struct sockaddr_in6 *sa);
 
-/* free channel */
+/* free channel. Safe while listeners in the same context are running - the
+ * memory is reclaimed once no callback can still be using it */
 void lc_channel_free(lc_channel_t *chan);
 
 /* get some random bytes */
@@ -23,11 +23,16 @@ typedef uint64_t lc_len_t;
 typedef struct lc_ctx_t lc_ctx_t;
 typedef struct lc_socket_t lc_socket_t;
 typedef struct lc_channel_t lc_channel_t;
+typedef struct lc_socket_group_s lc_socket_group_t;
+typedef struct lc_range_s lc_range_t;
+typedef struct lc_topics_s lc_topics_t;
 typedef struct lc_msg_head_t lc_msg_head_t;
 typedef struct lc_query_t lc_query_t;
 typedef struct lc_query_param_t lc_query_param_t;
 typedef void *lc_free_fn_t(void *msg, void *hint);
 
+/* LC_OP_MAX sizes lc_op_handler[], so keeps its value.  Opcodes added after
+ * it have no handler */
 #define LC_OPCODES(X) \
 	X(0x0, LC_OP_DATA, "DATA", lc_op_data) \
 	X(0x1, LC_OP_PING, "PING", lc_op_ping) \
@@ -36,7 +41,8 @@ typedef void *lc_free_fn_t(void *msg, void *hint);
 	X(0x4, LC_OP_SET,  "SET",  lc_op_set)  \
 	X(0x5, LC_OP_DEL,  "DEL",  lc_op_del)  \
 	X(0x6, LC_OP_RET,  "RET",  lc_op_ret)  \
-	X(0x7, LC_OP_MAX,  "MAX",  lc_op_data)
+	X(0x7, LC_OP_MAX,  "MAX",  lc_op_data) \
+	X(0x8, LC_OP_TOPIC, "TOPIC", lc_op_topic)
 #undef X
 
 #define LC_OPCODE_ENUM(code, name, text, f) name = code,
@@ -93,8 +99,21 @@ typedef struct lc_message_t {
 	char dstaddr[INET6_ADDRSTRLEN];
 	void *hint;
 	void *data;
+	/* new fields go last, so existing offsets stay put */
+	in_port_t srcport; /* source port, network byte order */
+	lc_seq_t gap; /* messages skipped before this one (ordered channels) */
+	uint32_t topic; /* topic tag (LC_OP_TOPIC), see lc_topic_tag() */
 } lc_message_t;
 
+/* callback for messages received on a channel, see lc_channel_listen() */
+typedef void lc_channel_fn_t(lc_message_t *msg, void *arg);
+
+/* called when a paced join is applied, with its result, see lc_ctx_join_pace() */
+typedef void lc_join_fn_t(lc_channel_t *chan, int rc, void *arg);
+
+/* callback for messages received on a channel range, with the band */
+typedef void lc_range_fn_t(lc_message_t *msg, uint64_t band, void *arg);
+
 typedef struct lc_messagelist_t {
 	char *hash;
 	uint64_t timestamp;
@@ -107,6 +126,90 @@ typedef struct {
 	void    *data;
 } lc_val_t;
 
+typedef struct lc_dedup_stats_s {
+	uint64_t msgs; /* messages checked */
+	uint64_t dups; /* duplicates dropped */
+	size_t mem;    /* bytes used by duplicate filter */
+} lc_dedup_stats_t;
+
+typedef struct lc_sender_stats_s {
+	struct in6_addr grp; /* channel group address */
+	struct in6_addr src; /* sender address */
+	in_port_t port;      /* sender port, network byte order */
+	lc_seq_t seq;        /* highest sequence number received */
+	uint64_t received;   /* messages received (excluding duplicates) */
+	uint64_t lost;       /* gaps in sequence, less any filled late */
+	uint64_t dups;       /* duplicate messages */
+	uint64_t reordered;  /* messages received out of order */
+	uint64_t lastseen;   /* time last message received (ns since epoch) */
+} lc_sender_stats_t;
+
+typedef enum {
+	LC_WORKERS_CHANNEL = 0, /* messages on each channel delivered in order */
+	LC_WORKERS_SOURCE = 1,  /* messages from each sender on each channel in order */
+} lc_workers_key_t;
+
+typedef enum {
+	LC_FANOUT_HASH = 0, /* by sender address and port - each sender stays on one socket */
+	LC_FANOUT_CPU = 1,  /* by CPU the packet was received on */
+} lc_fanout_t;
+
+typedef enum {
+	LC_FILTER_INCLUDE = 0, /* receive only from sources listed (SSM) */
+	LC_FILTER_EXCLUDE = 1, /* receive from any source except those listed */
+} lc_filter_mode_t;
+
+typedef enum {
+	LC_SEND_DEFAULT = 0, /* one copy, out of the interface bound or the kernel's choice */
+	LC_SEND_ALL = 1,     /* a copy out of every multicast interface */
+	LC_SEND_LIST = 2,    /* a copy out of each interface listed */
+} lc_send_policy_t;
+
+#define LC_CPUS_MAX 1024
+
+/* placement of threads created by the library - initialize with
+ * lc_thread_attr_init() */
+typedef struct lc_thread_attr_s {
+	uint64_t cpus[LC_CPUS_MAX / 64]; /* CPUs to run on, bit n = CPU n. None set = any */
+	int node;         /* NUMA node to run on and allocate memory from, -1 = any */
+	int priority;     /* SCHED_FIFO priority (1-99), 0 = normal scheduling */
+	size_t stacksize; /* thread stack size in bytes, 0 = default */
+} lc_thread_attr_t;
+
+typedef struct lc_worker_stats_s {
+	uint64_t msgs;    /* messages delivered */
+	uint64_t stolen;  /* times worker took over a busy worker's shard */
+	uint64_t busy;    /* time (ns) spent in callbacks */
+	uint64_t elapsed; /* time (ns) since worker started - busy / elapsed = utilisation */
+	size_t depth;     /* messages waiting in this worker's shards */
+} lc_worker_stats_t;
+
+typedef struct lc_topic_stats_s {
+	unsigned int shards; /* groups the topic space is spread over */
+	unsigned int joined; /* shards joined */
+	size_t topics;       /* topics subscribed */
+	uint64_t msgs;       /* topic messages delivered */
+	uint64_t wasted;     /* topic messages received but not subscribed, dropped */
+	int filter;          /* kernel drops unsubscribed topics before they are received */
+} lc_topic_stats_t;
+
+typedef struct lc_join_stats_s {
+	size_t queued;        /* joins waiting */
+	size_t queued_max;    /* most joins waiting at once */
+	uint64_t joined;      /* joins applied */
+	uint64_t latency;     /* mean time (ns) from queued to applied */
+	uint64_t latency_max; /* longest time (ns) from queued to applied */
+} lc_join_stats_t;
+
+typedef struct lc_mem_stats_s {
+	size_t chan_size;  /* bytes per channel */
+	size_t chan_used;  /* channels allocated */
+	size_t chan_bytes; /* bytes held for channels, including free slots */
+	size_t sock_size;  /* bytes per socket */
+	size_t sock_used;  /* sockets allocated */
+	size_t sock_bytes; /* bytes held for sockets, including free slots */
+} lc_mem_stats_t;
+
 /* structure to pass to socket listening thread */
 typedef struct lc_socket_call_s {
 	lc_socket_t *sock;
@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "bandset.h"
+#include <stdlib.h>
+
+#define BANDSET_MIN 16 /* slots, power of 2 */
+
+/* slots hold bands, 0 = empty.  Band 0 is kept in a flag instead */
+struct lc_bandset_s {
+	uint64_t *slot;
+	size_t mask;   /* slots - 1 */
+	size_t count;  /* bands in slots */
+	int zero;      /* band 0 is in set */
+};
+
+static inline size_t lc_bandset_hash(uint64_t band)
+{
+	band ^= band >> 30; /* splitmix64 finalizer */
+	band *= 0xbf58476d1ce4e5b9ULL;
+	band ^= band >> 27;
+	band *= 0x94d049bb133111ebULL;
+	band ^= band >> 31;
+	return (size_t)band;
+}
+
+/* slot holding band, or the empty slot where it would go */
+static size_t lc_bandset_find(lc_bandset_t *set, uint64_t band)
+{
+	size_t i = lc_bandset_hash(band) & set->mask;
+	while (set->slot[i] && set->slot[i] != band) i = (i + 1) & set->mask;
+	return i;
+}
+
+static int lc_bandset_resize(lc_bandset_t *set, size_t slots)
+{
+	uint64_t *old = set->slot;
+	size_t oldslots = set->mask + 1;
+
+	if (!(set->slot = calloc(slots, sizeof(uint64_t)))) {
+		set->slot = old;
+		return -1;
+	}
+	set->mask = slots - 1;
+	for (size_t i = 0; i < oldslots; i++) {
+		if (old[i]) set->slot[lc_bandset_find(set, old[i])] = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+int lc_bandset_add(lc_bandset_t *set, uint64_t band)
+{
+	size_t i;
+
+	if (!band) {
+		if (set->zero) return 1;
+		set->zero = 1;
+		return 0;
+	}
+	i = lc_bandset_find(set, band);
+	if (set->slot[i]) return 1;
+	/* keep load under 3/4 */
+	if ((set->count + 1) * 4 > (set->mask + 1) * 3) {
+		if (lc_bandset_resize(set, (set->mask + 1) * 2)) return -1;
+		i = lc_bandset_find(set, band);
+	}
+	set->slot[i] = band;
+	set->count++;
+	return 0;
+}
+
+int lc_bandset_del(lc_bandset_t *set, uint64_t band)
+{
+	size_t i, j, k;
+
+	if (!band) {
+		if (!set->zero) return -1;
+		set->zero = 0;
+		return 0;
+	}
+	i = lc_bandset_find(set, band);
+	if (!set->slot[i]) return -1;
+	/* backward shift deletion - no tombstones */
+	for (j = i;;) {
+		set->slot[i] = 0;
+		do {
+			j = (j + 1) & set->mask;
+			if (!set->slot[j]) goto shifted;
+			k = lc_bandset_hash(set->slot[j]) & set->mask;
+		} while ((i <= j) ? (i < k && k <= j) : (i < k || k <= j));
+		set->slot[i] = set->slot[j];
+		i = j;
+	}
+shifted:
+	set->count--;
+	/* give memory back as bands are parted, under 1/8 full */
+	if (set->mask + 1 > BANDSET_MIN && set->count * 8 < set->mask + 1)
+		lc_bandset_resize(set, (set->mask + 1) / 2); /* keeps old slots on failure */
+	return 0;
+}
+
+int lc_bandset_has(lc_bandset_t *set, uint64_t band)
+{
+	if (!band) return set->zero;
+	return set->slot[lc_bandset_find(set, band)] != 0;
+}
+
+size_t lc_bandset_count(lc_bandset_t *set)
+{
+	return set->count + set->zero;
+}
+
+size_t lc_bandset_bytes(lc_bandset_t *set)
+{
+	return sizeof(lc_bandset_t) + (set->mask + 1) * sizeof(uint64_t);
+}
+
+void lc_bandset_each(lc_bandset_t *set, void (*fn)(uint64_t band, void *arg), void *arg)
+{
+	if (set->zero) fn(0, arg);
+	for (size_t i = 0; i <= set->mask; i++) {
+		if (set->slot[i]) fn(set->slot[i], arg);
+	}
+}
+
+void lc_bandset_free(lc_bandset_t *set)
+{
+	if (!set) return;
+	free(set->slot);
+	free(set);
+}
+
+lc_bandset_t *lc_bandset_new(void)
+{
+	lc_bandset_t *set;
+
+	if (!(set = calloc(1, sizeof(lc_bandset_t)))) return NULL;
+	if (!(set->slot = calloc(BANDSET_MIN, sizeof(uint64_t)))) {
+		free(set);
+		return NULL;
+	}
+	set->mask = BANDSET_MIN - 1;
+	return set;
+}
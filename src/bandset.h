@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _BANDSET_H
+#define _BANDSET_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* set of 64 bit band values, open addressed.  Grows and shrinks with the
+ * number of bands it holds.  Not thread safe - callers lock */
+typedef struct lc_bandset_s lc_bandset_t;
+
+lc_bandset_t *lc_bandset_new(void);
+
+void lc_bandset_free(lc_bandset_t *set);
+
+/* add band. Return 0 if added, 1 if already present, -1 if out of memory */
+int lc_bandset_add(lc_bandset_t *set, uint64_t band);
+
+/* remove band. Return 0 if removed, -1 if not present */
+int lc_bandset_del(lc_bandset_t *set, uint64_t band);
+
+/* return 1 if band is in set, 0 if not */
+int lc_bandset_has(lc_bandset_t *set, uint64_t band);
+
+/* number of bands in set */
+size_t lc_bandset_count(lc_bandset_t *set);
+
+/* bytes used by set */
+size_t lc_bandset_bytes(lc_bandset_t *set);
+
+/* call fn for each band in set. Don't modify set from fn */
+void lc_bandset_each(lc_bandset_t *set, void (*fn)(uint64_t band, void *arg), void *arg);
+
+#endif /* _BANDSET_H */
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "dedup.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEDUP_BITS_PER_ENTRY 16 /* ~0.05% false positives at capacity */
+#define DEDUP_HASHES 8
+
+struct lc_dedup_s {
+	uint64_t *gen[2];    /* current and previous generation */
+	uint64_t mask;       /* bits per generation - 1 */
+	size_t words;        /* 64-bit words per generation */
+	size_t entries;      /* max inserts per generation */
+	size_t count;        /* inserts into current generation */
+	uint64_t window;     /* generation lifetime (ms) */
+	uint64_t rotated;    /* time current generation was started (ms) */
+	uint64_t msgs;
+	uint64_t dups;
+};
+
+static uint64_t lc_dedup_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline uint64_t lc_dedup_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* hash (src, dst, seq, rnd), which identifies a single sent message */
+static void lc_dedup_hash(lc_message_t *msg, uint64_t *h1, uint64_t *h2)
+{
+	uint64_t w[4];
+	uint64_t h = msg->seq ^ 0x9e3779b97f4a7c15ULL;
+
+	memcpy(w, &msg->src, sizeof(struct in6_addr));
+	memcpy(w + 2, &msg->dst, sizeof(struct in6_addr));
+	for (int i = 0; i < 4; i++) h = lc_dedup_mix(h ^ w[i]);
+	*h1 = lc_dedup_mix(h ^ msg->rnd);
+	*h2 = lc_dedup_mix(*h1 ^ msg->seq) | 1; /* odd, so probes differ */
+}
+
+static int lc_dedup_test(uint64_t *bits, uint64_t mask, uint64_t h1, uint64_t h2)
+{
+	for (int i = 0; i < DEDUP_HASHES; i++) {
+		uint64_t b = (h1 + i * h2) & mask;
+		if (!(bits[b >> 6] & (1ULL << (b & 63)))) return 0;
+	}
+	return 1;
+}
+
+static void lc_dedup_set(uint64_t *bits, uint64_t mask, uint64_t h1, uint64_t h2)
+{
+	for (int i = 0; i < DEDUP_HASHES; i++) {
+		uint64_t b = (h1 + i * h2) & mask;
+		bits[b >> 6] |= 1ULL << (b & 63);
+	}
+}
+
+static void lc_dedup_rotate(lc_dedup_t *dd, uint64_t now)
+{
+	uint64_t *tmp = dd->gen[1];
+	dd->gen[1] = dd->gen[0];
+	dd->gen[0] = tmp;
+	memset(dd->gen[0], 0, dd->words * sizeof(uint64_t));
+	dd->count = 0;
+	dd->rotated = now;
+}
+
+int lc_dedup_check(lc_dedup_t *dd, lc_message_t *msg)
+{
+	uint64_t h1, h2, now = lc_dedup_now();
+
+	if (now - dd->rotated >= dd->window || dd->count >= dd->entries)
+		lc_dedup_rotate(dd, now);
+	dd->msgs++;
+	lc_dedup_hash(msg, &h1, &h2);
+	if (lc_dedup_test(dd->gen[0], dd->mask, h1, h2)
+	 || lc_dedup_test(dd->gen[1], dd->mask, h1, h2))
+	{
+		dd->dups++;
+		return 1;
+	}
+	lc_dedup_set(dd->gen[0], dd->mask, h1, h2);
+	dd->count++;
+	return 0;
+}
+
+void lc_dedup_stats(lc_dedup_t *dd, lc_dedup_stats_t *stats)
+{
+	stats->msgs = dd->msgs;
+	stats->dups = dd->dups;
+	stats->mem = sizeof(lc_dedup_t) + 2 * dd->words * sizeof(uint64_t);
+}
+
+void lc_dedup_free(lc_dedup_t *dd)
+{
+	if (!dd) return;
+	free(dd->gen[0]);
+	free(dd->gen[1]);
+	free(dd);
+}
+
+lc_dedup_t *lc_dedup_new(size_t entries, unsigned int window)
+{
+	lc_dedup_t *dd;
+	uint64_t bits = 64;
+
+	if (!entries || !window) return NULL;
+	while (bits < (uint64_t)entries * DEDUP_BITS_PER_ENTRY) bits <<= 1;
+	dd = calloc(1, sizeof(lc_dedup_t));
+	if (!dd) return NULL;
+	dd->words = bits / 64;
+	dd->gen[0] = calloc(dd->words, sizeof(uint64_t));
+	dd->gen[1] = calloc(dd->words, sizeof(uint64_t));
+	if (!dd->gen[0] || !dd->gen[1]) {
+		lc_dedup_free(dd);
+		return NULL;
+	}
+	dd->mask = bits - 1;
+	dd->entries = entries;
+	dd->window = window;
+	dd->rotated = lc_dedup_now();
+	return dd;
+}
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _DEDUP_H
+#define _DEDUP_H 1
+
+#include <librecast/types.h>
+
+/* time-windowed duplicate filter - a pair of rotating Bloom filters.
+ * Message ids are inserted into the current generation, and looked up in
+ * both. The older generation is discarded when the current generation is
+ * older than window ms or has seen its full quota of entries, so memory is
+ * fixed at creation time. */
+typedef struct lc_dedup_s lc_dedup_t;
+
+/* create filter sized for entries ids per window (ms) */
+lc_dedup_t *lc_dedup_new(size_t entries, unsigned int window);
+
+void lc_dedup_free(lc_dedup_t *dd);
+
+/* return 1 if msg has been seen before, otherwise remember msg and return 0 */
+int lc_dedup_check(lc_dedup_t *dd, lc_message_t *msg);
+
+void lc_dedup_stats(lc_dedup_t *dd, lc_dedup_stats_t *stats);
+
+#endif /* _DEDUP_H */
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "epoch.h"
+#include <sched.h>
+#include <stddef.h>
+
+#define EPOCH_BATCH 64 /* retired objects to build up before reclaiming */
+
+/* read sections this thread is inside, across all epochs */
+static __thread int depth;
+
+void lc_epoch_init(lc_epoch_t *ep)
+{
+	pthread_mutex_init(&ep->lock, NULL);
+	pthread_mutex_init(&ep->synclock, NULL);
+	ep->epoch = 0;
+	ep->readers[0] = ep->readers[1] = 0;
+	ep->retired = NULL;
+	ep->nretired = 0;
+}
+
+static void lc_epoch_free_list(lc_epoch_node_t *node)
+{
+	lc_epoch_node_t *next;
+
+	for (; node; node = next) {
+		next = node->next;
+		node->fn(node);
+	}
+}
+
+void lc_epoch_destroy(lc_epoch_t *ep)
+{
+	lc_epoch_free_list(ep->retired);
+	ep->retired = NULL;
+	ep->nretired = 0;
+	pthread_mutex_destroy(&ep->lock);
+	pthread_mutex_destroy(&ep->synclock);
+}
+
+int lc_epoch_hold(lc_epoch_t *ep)
+{
+	int e = __atomic_load_n(&ep->epoch, __ATOMIC_SEQ_CST) & 1;
+	__atomic_add_fetch(&ep->readers[e], 1, __ATOMIC_SEQ_CST);
+	/* look again: either the epoch hasn't moved, so any sync that flips it
+	 * from here sees us counted, or we synchronise with the flip, and so see
+	 * everything unlinked before it */
+	(void)__atomic_load_n(&ep->epoch, __ATOMIC_SEQ_CST);
+	return e;
+}
+
+void lc_epoch_release(lc_epoch_t *ep, int e)
+{
+	__atomic_sub_fetch(&ep->readers[e], 1, __ATOMIC_RELEASE);
+}
+
+int lc_epoch_enter(lc_epoch_t *ep)
+{
+	depth++;
+	return lc_epoch_hold(ep);
+}
+
+void lc_epoch_exit(lc_epoch_t *ep, int e)
+{
+	lc_epoch_release(ep, e);
+	depth--;
+}
+
+void lc_epoch_cleanup(void *arg)
+{
+	lc_epoch_cleanup_t *c = arg;
+	lc_epoch_exit(c->ep, c->e);
+}
+
+void lc_epoch_sync(lc_epoch_t *ep)
+{
+	unsigned int old;
+
+	/* twice, so references held from read sections of the old epoch, which
+	 * may have been counted against the new one, are waited for too.  One
+	 * sync at a time, or flips from another would leave one parity unchecked */
+	pthread_mutex_lock(&ep->synclock);
+	for (int i = 0; i < 2; i++) {
+		old = __atomic_fetch_add(&ep->epoch, 1, __ATOMIC_SEQ_CST) & 1;
+		while (__atomic_load_n(&ep->readers[old], __ATOMIC_ACQUIRE)) sched_yield();
+	}
+	pthread_mutex_unlock(&ep->synclock);
+}
+
+void lc_epoch_retire(lc_epoch_t *ep, lc_epoch_node_t *node, lc_epoch_free_fn_t *fn)
+{
+	node->fn = fn;
+	node->next = ep->retired;
+	ep->retired = node;
+	ep->nretired++;
+}
+
+void lc_epoch_unlock(lc_epoch_t *ep)
+{
+	lc_epoch_node_t *retired = NULL;
+
+	if (ep->nretired >= EPOCH_BATCH && !depth) {
+		retired = ep->retired;
+		ep->retired = NULL;
+		ep->nretired = 0;
+	}
+	pthread_mutex_unlock(&ep->lock);
+	if (!retired) return;
+	lc_epoch_sync(ep);
+	lc_epoch_free_list(retired);
+}
@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _EPOCH_H
+#define _EPOCH_H 1
+
+#include <pthread.h>
+
+/* epoch based reclamation (SRCU style) for lists with lock-free readers.
+ * Readers count themselves into the current epoch, which costs two atomic
+ * increments and no locks.  Writers serialise on the lock, unlink with
+ * atomic stores, and retire what they unlinked.  Retired objects are freed
+ * in batches, once every reader that might still see them has left:
+ * the epoch is flipped twice, waiting each time for the readers of the
+ * previous one to drain. */
+/* embedded in objects that are retired, so retiring never allocates */
+typedef struct lc_epoch_node_s lc_epoch_node_t;
+
+/* free the object node is embedded in */
+typedef void lc_epoch_free_fn_t(lc_epoch_node_t *node);
+
+struct lc_epoch_node_s {
+	lc_epoch_node_t *next;
+	lc_epoch_free_fn_t *fn;
+};
+
+typedef struct lc_epoch_s {
+	pthread_mutex_t lock;  /* writers */
+	pthread_mutex_t synclock;
+	unsigned int epoch;
+	long readers[2];       /* readers (and held references) per epoch parity */
+	lc_epoch_node_t *retired;
+	unsigned int nretired;
+} lc_epoch_t;
+
+void lc_epoch_init(lc_epoch_t *ep);
+
+/* free everything retired. There must be no readers */
+void lc_epoch_destroy(lc_epoch_t *ep);
+
+/* enter read section, returning the epoch to pass to lc_epoch_exit().
+ * Objects reachable from the list stay valid until then */
+int lc_epoch_enter(lc_epoch_t *ep);
+void lc_epoch_exit(lc_epoch_t *ep, int e);
+
+/* pthread cleanup handler, to leave a read section on cancellation */
+typedef struct lc_epoch_cleanup_s {
+	lc_epoch_t *ep;
+	int e;
+} lc_epoch_cleanup_t;
+void lc_epoch_cleanup(void *arg);
+
+/* take a reference on the current epoch, returning the epoch to pass to
+ * lc_epoch_release().  Called from inside a read section, it keeps what the
+ * section can see valid after it ends (eg. messages queued for another
+ * thread).  Unlike a read section, it may be released by any thread */
+int lc_epoch_hold(lc_epoch_t *ep);
+void lc_epoch_release(lc_epoch_t *ep, int e);
+
+/* wait until all readers that entered before now have left. Must not be
+ * called from inside a read section, or with ep->lock held */
+void lc_epoch_sync(lc_epoch_t *ep);
+
+/* free the object node is embedded in with fn, once no reader can see it.
+ * Call with ep->lock held, after unlinking the object */
+void lc_epoch_retire(lc_epoch_t *ep, lc_epoch_node_t *node, lc_epoch_free_fn_t *fn);
+
+/* release ep->lock, then reclaim retired objects if enough have built up.
+ * Reclamation is skipped while the calling thread is inside a read section
+ * (eg. a listener callback), as it would wait for itself */
+void lc_epoch_unlock(lc_epoch_t *ep);
+
+#endif /* _EPOCH_H */
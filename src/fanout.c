@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "fanout.h"
+#include <errno.h>
+
+#ifdef __linux__
+
+#include <linux/filter.h>
+#include <sys/socket.h>
+
+/* offsets of IPv6 source address words, relative to network header */
+#define OFF_SRC (SKF_NET_OFF + 8)
+
+int lc_fanout_filter(int fd, lc_fanout_t mode, unsigned int n, unsigned int i)
+{
+	/* flow hash: source address words ^ source port, mixed so the low bits
+	 * don't depend on the low bits of the address alone */
+	struct sock_filter hash[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, OFF_SRC),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, OFF_SRC + 4),
+		BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, OFF_SRC + 8),
+		BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, OFF_SRC + 12),
+		BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+		BPF_STMT(BPF_MISC | BPF_TAX, 0),
+		BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 0), /* UDP source port */
+		BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+		BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x9e3779b1),
+		BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, n),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, i, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+	/* CPU the packet was received on */
+	struct sock_filter cpu[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+		BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, n),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, i, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+	struct sock_fprog prog;
+
+	if (!n || i >= n) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (mode == LC_FANOUT_CPU) {
+		prog.len = sizeof cpu / sizeof cpu[0];
+		prog.filter = cpu;
+	}
+	else {
+		prog.len = sizeof hash / sizeof hash[0];
+		prog.filter = hash;
+	}
+	return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof prog);
+}
+
+#else /* !__linux__ */
+
+int lc_fanout_filter(int fd, lc_fanout_t mode, unsigned int n, unsigned int i)
+{
+	(void)fd; (void)mode; (void)n; (void)i;
+	errno = ENOTSUP;
+	return -1;
+}
+
+#endif /* __linux__ */
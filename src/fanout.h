@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _FANOUT_H
+#define _FANOUT_H 1
+
+#include <librecast/types.h>
+
+/* Attach kernel filter to socket fd, which is member i of a group of n, so it
+ * accepts only its share of packets, selected by mode (LC_FANOUT_HASH or
+ * LC_FANOUT_CPU).  Multicast is delivered to every socket bound to the port,
+ * whatever their reuseport group, so each socket drops the packets that
+ * belong to the others. Returns 0 on success, -1 on error (errno set) */
+int lc_fanout_filter(int fd, lc_fanout_t mode, unsigned int n, unsigned int i);
+
+#endif /* _FANOUT_H */
@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "grpset.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define GRPSET_MIN 16  /* slots, power of 2 */
+#define GRPSET_GROUP 8 /* tags compared at once, as bytes of a uint64_t */
+#define GRPSET_LO 0x0101010101010101ULL
+#define GRPSET_HI 0x8080808080808080ULL
+
+typedef struct lc_grpslot_s {
+	struct in6_addr grp;
+	uint32_t val;
+	uint32_t refs;
+} lc_grpslot_t;
+
+struct lc_grpset_s {
+	lc_grpslot_t *slot;
+	/* tag of each slot: 0 = empty, otherwise the high bit and 7 bits of the
+	 * hash.  The first GRPSET_GROUP - 1 are repeated after the last, so a
+	 * group of tags can be read from any slot without wrapping */
+	uint8_t *tag;
+	size_t mask;   /* slots - 1 */
+	size_t count;  /* groups in slots */
+};
+
+/* index from the low bits of the hash, tag from the high ones */
+static inline uint8_t lc_grpset_tag(uint64_t h)
+{
+	return 0x80 | (uint8_t)(h >> 57);
+}
+
+/* GRPSET_GROUP tags from t, the first in the low byte.  Compilers make this
+ * one load on little endian machines */
+static inline uint64_t lc_grpset_tags(const uint8_t *t)
+{
+	return (uint64_t)t[0] | (uint64_t)t[1] << 8 | (uint64_t)t[2] << 16
+		| (uint64_t)t[3] << 24 | (uint64_t)t[4] << 32 | (uint64_t)t[5] << 40
+		| (uint64_t)t[6] << 48 | (uint64_t)t[7] << 56;
+}
+
+/* high bit set in each zero byte of w.  It may be set in bytes above a zero
+ * byte too, but the lowest one set is always exact */
+static inline uint64_t lc_grpset_zero(uint64_t w)
+{
+	return (w - GRPSET_LO) & ~w & GRPSET_HI;
+}
+
+static inline void lc_grpset_settag(lc_grpset_t *set, size_t i, uint8_t tag)
+{
+	set->tag[i] = tag;
+	if (i < GRPSET_GROUP - 1) set->tag[set->mask + 1 + i] = tag;
+}
+
+/* slot holding grp, or the empty slot where it would go.  Compares a group
+ * of tags at a time, then addresses only where the tag matches, stopping at
+ * the first empty slot */
+static size_t lc_grpset_find(const lc_grpset_t *set, const struct in6_addr *grp)
+{
+	const uint64_t h = lc_grpset_hash(grp);
+	const uint64_t want = lc_grpset_tag(h) * GRPSET_LO;
+	uint64_t w, match, empty;
+	size_t i = h & set->mask, j;
+
+	for (;;) {
+		w = lc_grpset_tags(&set->tag[i]);
+		match = lc_grpset_zero(w ^ want);
+		if ((empty = lc_grpset_zero(w))) {
+			empty &= -empty;
+			match &= empty - 1; /* nothing past the empty slot */
+		}
+		for (; match; match &= match - 1) {
+			j = (i + (__builtin_ctzll(match) >> 3)) & set->mask;
+			if (!memcmp(&set->slot[j].grp, grp, sizeof(struct in6_addr))) return j;
+		}
+		if (empty) return (i + (__builtin_ctzll(empty) >> 3)) & set->mask;
+		i = (i + GRPSET_GROUP) & set->mask;
+	}
+}
+
+static int lc_grpset_alloc(lc_grpset_t *set, size_t slots)
+{
+	char *p;
+
+	if (!(p = calloc(1, slots * sizeof(lc_grpslot_t) + slots + GRPSET_GROUP - 1))) return -1;
+	set->slot = (lc_grpslot_t *)p;
+	set->tag = (uint8_t *)(p + slots * sizeof(lc_grpslot_t));
+	set->mask = slots - 1;
+	return 0;
+}
+
+static int lc_grpset_resize(lc_grpset_t *set, size_t slots)
+{
+	lc_grpslot_t *old = set->slot;
+	uint8_t *oldtag = set->tag;
+	size_t oldslots = set->mask + 1, j;
+
+	if (lc_grpset_alloc(set, slots)) return -1;
+	for (size_t i = 0; i < oldslots; i++) {
+		if (!oldtag[i]) continue;
+		j = lc_grpset_find(set, &old[i].grp);
+		set->slot[j] = old[i];
+		lc_grpset_settag(set, j, oldtag[i]);
+	}
+	free(old);
+	return 0;
+}
+
+/* find grp, adding it with val and no references if not present.  Return 0
+ * if added, 1 if already present, -1 if out of memory */
+static int lc_grpset_slot(lc_grpset_t *set, const struct in6_addr *grp, uint32_t val, size_t *pos)
+{
+	size_t i = lc_grpset_find(set, grp);
+
+	if (set->tag[i]) {
+		*pos = i;
+		return 1;
+	}
+	/* keep load under 3/4 */
+	if ((set->count + 1) * 4 > (set->mask + 1) * 3) {
+		if (lc_grpset_resize(set, (set->mask + 1) * 2)) return -1;
+		i = lc_grpset_find(set, grp);
+	}
+	set->slot[i].grp = *grp;
+	set->slot[i].val = val;
+	set->slot[i].refs = 0;
+	lc_grpset_settag(set, i, lc_grpset_tag(lc_grpset_hash(grp)));
+	set->count++;
+	*pos = i;
+	return 0;
+}
+
+/* remove slot i, shifting back those after it - no tombstones */
+static void lc_grpset_remove(lc_grpset_t *set, size_t i)
+{
+	size_t j, k;
+
+	for (j = i;;) {
+		lc_grpset_settag(set, i, 0);
+		do {
+			j = (j + 1) & set->mask;
+			if (!set->tag[j]) goto shifted;
+			k = lc_grpset_hash(&set->slot[j].grp) & set->mask;
+		} while ((i <= j) ? (i < k && k <= j) : (i < k || k <= j));
+		set->slot[i] = set->slot[j];
+		lc_grpset_settag(set, i, set->tag[j]);
+		i = j;
+	}
+shifted:
+	set->count--;
+	/* give memory back as groups are parted, under 1/8 full */
+	if (set->mask + 1 > GRPSET_MIN && set->count * 8 < set->mask + 1)
+		lc_grpset_resize(set, (set->mask + 1) / 2); /* keeps old slots on failure */
+}
+
+int lc_grpset_ref(lc_grpset_t *set, const struct in6_addr *grp, uint32_t val)
+{
+	size_t i;
+
+	if (lc_grpset_slot(set, grp, val, &i) == -1) return -1;
+	return (int)++set->slot[i].refs;
+}
+
+int lc_grpset_unref(lc_grpset_t *set, const struct in6_addr *grp)
+{
+	size_t i = lc_grpset_find(set, grp);
+
+	if (!set->tag[i]) return -1;
+	if (--set->slot[i].refs) return (int)set->slot[i].refs;
+	lc_grpset_remove(set, i);
+	return 0;
+}
+
+int lc_grpset_put(lc_grpset_t *set, const struct in6_addr *grp, uint32_t val)
+{
+	size_t i;
+	int rc;
+
+	if ((rc = lc_grpset_slot(set, grp, val, &i)) == -1) return -1;
+	set->slot[i].val = val;
+	if (!rc) set->slot[i].refs = 1;
+	return rc;
+}
+
+uint32_t lc_grpset_get(const lc_grpset_t *set, const struct in6_addr *grp, uint32_t *val)
+{
+	size_t i = lc_grpset_find(set, grp);
+
+	if (!set->tag[i]) return 0;
+	if (val) *val = set->slot[i].val;
+	return set->slot[i].refs;
+}
+
+size_t lc_grpset_count(const lc_grpset_t *set)
+{
+	return set->count;
+}
+
+void lc_grpset_free(lc_grpset_t *set)
+{
+	if (!set) return;
+	free(set->slot);
+	free(set);
+}
+
+lc_grpset_t *lc_grpset_new(void)
+{
+	lc_grpset_t *set;
+
+	if (!(set = calloc(1, sizeof(lc_grpset_t)))) return NULL;
+	if (lc_grpset_alloc(set, GRPSET_MIN)) {
+		free(set);
+		return NULL;
+	}
+	return set;
+}
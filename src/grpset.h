@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _GRPSET_H
+#define _GRPSET_H 1
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* reference counted map of multicast group address -> 32 bit value, open
+ * addressed.  Each slot has a tag byte, and lookups compare eight tags at a
+ * time, only comparing addresses where a tag matches.  Grows and shrinks with
+ * the number of groups it holds.  Not thread safe - callers lock */
+typedef struct lc_grpset_s lc_grpset_t;
+
+/* hash of a group address, also used to index channels by group */
+static inline uint64_t lc_grpset_hash(const struct in6_addr *grp)
+{
+	uint64_t h[2];
+
+	memcpy(h, grp, sizeof h);
+	h[0] ^= h[1];
+	h[0] ^= h[0] >> 30; /* splitmix64 finalizer */
+	h[0] *= 0xbf58476d1ce4e5b9ULL;
+	h[0] ^= h[0] >> 27;
+	h[0] *= 0x94d049bb133111ebULL;
+	h[0] ^= h[0] >> 31;
+	return h[0];
+}
+
+lc_grpset_t *lc_grpset_new(void);
+
+void lc_grpset_free(lc_grpset_t *set);
+
+/* add a reference to grp, adding it with val if not present.  Returns
+ * references to grp now, or -1 if out of memory */
+int lc_grpset_ref(lc_grpset_t *set, const struct in6_addr *grp, uint32_t val);
+
+/* drop a reference to grp, removing it with the last.  Returns references
+ * left, or -1 if not present */
+int lc_grpset_unref(lc_grpset_t *set, const struct in6_addr *grp);
+
+/* set val of grp, adding it with one reference if not present. Return 0 if
+ * added, 1 if already present, -1 if out of memory */
+int lc_grpset_put(lc_grpset_t *set, const struct in6_addr *grp, uint32_t val);
+
+/* references to grp, 0 if not present.  If present and val is not NULL, copy
+ * its value to val */
+uint32_t lc_grpset_get(const lc_grpset_t *set, const struct in6_addr *grp, uint32_t *val);
+
+/* number of groups in set */
+size_t lc_grpset_count(const lc_grpset_t *set);
+
+#endif /* _GRPSET_H */
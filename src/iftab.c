@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "iftab.h"
+#include <errno.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+lc_iftab_t *lc_iftab_new(void)
+{
+	struct ifaddrs *ifaddr, *ifa, *seen;
+	lc_iftab_t *tab = NULL, *tmp;
+	size_t max = 0;
+
+	if (getifaddrs(&ifaddr) == -1) return NULL;
+	if (!(tab = calloc(1, sizeof(lc_iftab_t)))) goto err_0;
+	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+		if ((ifa->ifa_flags & IFF_MULTICAST) != IFF_MULTICAST
+		  || ifa->ifa_addr == NULL
+		  || ifa->ifa_addr->sa_family != AF_INET6) continue;
+
+		/* getifaddrs() lists every address - first one of this interface? */
+		for (seen = ifaddr; seen != ifa; seen = seen->ifa_next) {
+			if (seen->ifa_addr && seen->ifa_addr->sa_family == AF_INET6
+			&& !strcmp(seen->ifa_name, ifa->ifa_name)) break;
+		}
+		if (seen != ifa) continue;
+
+		if (tab->n == max) {
+			max = (max) ? max * 2 : 4;
+			if (!(tmp = realloc(tab, sizeof(lc_iftab_t) + max * sizeof(unsigned int))))
+				goto err_1;
+			tab = tmp;
+		}
+		if ((tab->ifx[tab->n] = if_nametoindex(ifa->ifa_name))) tab->n++;
+	}
+	freeifaddrs(ifaddr);
+	return tab;
+err_1:
+	free(tab);
+err_0:
+	freeifaddrs(ifaddr);
+	errno = ENOMEM;
+	return NULL;
+}
+
+int lc_iftab_has(const lc_iftab_t *tab, unsigned int ifx)
+{
+	if (!tab) return 0;
+	for (size_t i = 0; i < tab->n; i++) {
+		if (tab->ifx[i] == ifx) return 1;
+	}
+	return 0;
+}
+
+#ifdef __linux__
+int lc_iftab_watch(void)
+{
+	struct sockaddr_nl sa = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = RTMGRP_LINK | RTMGRP_IPV6_IFADDR,
+	};
+	int sock;
+
+	if ((sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)) == -1) return -1;
+	if (bind(sock, (struct sockaddr *)&sa, sizeof sa) == -1) {
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+int lc_iftab_wait(int sock)
+{
+	char buf[8192];
+	int flags = 0;
+	ssize_t len;
+
+	/* we only care that something changed, not what - we list them again */
+	for (;;) {
+		len = recv(sock, buf, sizeof buf, flags);
+		if (len == -1) {
+			if (errno == EINTR) continue;
+			if (errno == ENOBUFS) return 1; /* overrun, changes lost */
+			return (flags) ? 1 : -1; /* nothing more waiting */
+		}
+		flags = MSG_DONTWAIT;
+	}
+}
+#else
+int lc_iftab_watch(void)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int lc_iftab_wait(int sock)
+{
+	(void)sock;
+	errno = ENOSYS;
+	return -1;
+}
+#endif
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _IFTAB_H
+#define _IFTAB_H 1
+
+#include <stddef.h>
+
+/* indexes of multicast interfaces with IPv6 addresses, each once */
+typedef struct lc_iftab_s {
+	size_t n;
+	unsigned int ifx[];
+} lc_iftab_t;
+
+/* list interfaces.  Returns NULL on error, with errno set.  free() when done */
+lc_iftab_t *lc_iftab_new(void);
+
+/* return 1 if ifx is in tab, 0 if not.  tab may be NULL (empty) */
+int lc_iftab_has(const lc_iftab_t *tab, unsigned int ifx);
+
+/* open a socket notified of interface and IPv6 address changes.  Returns the
+ * socket, or -1 on error (ENOSYS where not supported) */
+int lc_iftab_watch(void);
+
+/* block until notified on sock, then read any further notifications waiting.
+ * Returns 1 if interfaces may have changed, or -1 on error */
+int lc_iftab_wait(int sock);
+
+#endif /* _IFTAB_H */
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "intern.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NIL UINT32_MAX
+#define ARENA_CHUNK 65536 /* bytes of names per allocation */
+
+typedef struct lc_intern_entry_s {
+	struct in6_addr addr;
+	const unsigned char *name; /* in arena */
+	uint32_t len;
+	uint32_t hash;
+	uint32_t hnext; /* hash bucket chain */
+} lc_intern_entry_t;
+
+typedef struct lc_intern_arena_s lc_intern_arena_t;
+struct lc_intern_arena_s {
+	lc_intern_arena_t *next;
+	size_t used;
+	size_t size;
+	unsigned char data[];
+};
+
+struct lc_intern_s {
+	pthread_rwlock_t lock;
+	lc_intern_entry_t *tab;
+	uint32_t *bucket;
+	uint32_t mask;  /* buckets - 1 */
+	uint32_t max;
+	uint32_t used;
+	lc_intern_arena_t *arena; /* current chunk at head */
+};
+
+static uint32_t lc_intern_hash(const unsigned char *name, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++) h = (h ^ name[i]) * 1099511628211ULL; /* FNV-1a */
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+static uint32_t lc_intern_find(lc_intern_t *in, uint32_t hash, const unsigned char *name, size_t len)
+{
+	for (uint32_t i = in->bucket[hash & in->mask]; i != NIL; i = in->tab[i].hnext) {
+		lc_intern_entry_t *e = &in->tab[i];
+		if (e->hash == hash && e->len == len && !memcmp(e->name, name, len))
+			return i;
+	}
+	return NIL;
+}
+
+/* copy name into the arena */
+static unsigned char *lc_intern_copy(lc_intern_t *in, const unsigned char *name, size_t len)
+{
+	lc_intern_arena_t *a = in->arena;
+	unsigned char *p;
+
+	if (!a || a->size - a->used < len) {
+		size_t size = (len > ARENA_CHUNK) ? len : ARENA_CHUNK;
+		if (!(a = malloc(sizeof(lc_intern_arena_t) + size))) return NULL;
+		a->used = 0;
+		a->size = size;
+		a->next = in->arena;
+		in->arena = a;
+	}
+	p = a->data + a->used;
+	memcpy(p, name, len);
+	a->used += len;
+	return p;
+}
+
+int lc_intern_get(lc_intern_t *in, const unsigned char *name, size_t len, struct in6_addr *addr)
+{
+	uint32_t i;
+
+	pthread_rwlock_rdlock(&in->lock);
+	i = lc_intern_find(in, lc_intern_hash(name, len), name, len);
+	if (i != NIL) memcpy(addr, &in->tab[i].addr, sizeof(struct in6_addr));
+	pthread_rwlock_unlock(&in->lock);
+	return (i == NIL) ? -1 : 0;
+}
+
+int lc_intern_put(lc_intern_t *in, const unsigned char *name, size_t len, const struct in6_addr *addr)
+{
+	lc_intern_entry_t *e;
+	uint32_t hash = lc_intern_hash(name, len);
+	int rc = -1;
+
+	if (len > UINT32_MAX) return -1;
+	pthread_rwlock_wrlock(&in->lock);
+	if (lc_intern_find(in, hash, name, len) != NIL) {
+		rc = 0;
+		goto out;
+	}
+	if (in->used == in->max) goto out;
+	e = &in->tab[in->used];
+	if (!(e->name = lc_intern_copy(in, name, len))) goto out;
+	memcpy(&e->addr, addr, sizeof(struct in6_addr));
+	e->len = len;
+	e->hash = hash;
+	e->hnext = in->bucket[hash & in->mask];
+	in->bucket[hash & in->mask] = in->used++;
+	rc = 0;
+out:
+	pthread_rwlock_unlock(&in->lock);
+	return rc;
+}
+
+void lc_intern_free(lc_intern_t *in)
+{
+	lc_intern_arena_t *a;
+
+	if (!in) return;
+	while ((a = in->arena)) {
+		in->arena = a->next;
+		free(a);
+	}
+	pthread_rwlock_destroy(&in->lock);
+	free(in->bucket);
+	free(in->tab);
+	free(in);
+}
+
+lc_intern_t *lc_intern_new(size_t max)
+{
+	lc_intern_t *in;
+	uint32_t buckets = 1;
+
+	if (!max || max >= NIL / 2) return NULL;
+	while (buckets < max) buckets <<= 1;
+	if (!(in = calloc(1, sizeof(lc_intern_t)))) return NULL;
+	in->tab = malloc(max * sizeof(lc_intern_entry_t));
+	in->bucket = malloc(buckets * sizeof(uint32_t));
+	if (!in->tab || !in->bucket) {
+		free(in->tab);
+		free(in->bucket);
+		free(in);
+		return NULL;
+	}
+	memset(in->bucket, 0xff, buckets * sizeof(uint32_t)); /* NIL */
+	in->mask = buckets - 1;
+	in->max = max;
+	pthread_rwlock_init(&in->lock, NULL);
+	return in;
+}
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _INTERN_H
+#define _INTERN_H 1
+
+#include <librecast/types.h>
+#include <netinet/in.h>
+
+/* bounded table memoising channel name -> group address, so names seen
+ * before aren't hashed again.  Names are copied in.  When full, new names are
+ * not added.  Safe to use from several threads. */
+typedef struct lc_intern_s lc_intern_t;
+
+lc_intern_t *lc_intern_new(size_t max);
+
+void lc_intern_free(lc_intern_t *in);
+
+/* copy address for name into addr. Return 0 if found, -1 if not */
+int lc_intern_get(lc_intern_t *in, const unsigned char *name, size_t len, struct in6_addr *addr);
+
+/* remember addr for name. Return 0 on success, -1 if full or out of memory */
+int lc_intern_put(lc_intern_t *in, const unsigned char *name, size_t len, const struct in6_addr *addr);
+
+#endif /* _INTERN_H */
@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "joinq.h"
+#include "thread.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct lc_joinq_item_s {
+	void *obj;
+	uint64_t seq; /* order within priority */
+	uint64_t queued; /* time (ns) pushed */
+	int prio;
+} lc_joinq_item_t;
+
+struct lc_joinq_s {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	pthread_t thread;
+	lc_joinq_fn_t *fn;
+	void *arg;
+	lc_epoch_t *ep; /* entered from pop until applied, NULL = none */
+	lc_joinq_item_t *heap; /* binary heap, highest priority, then lowest seq, at top */
+	size_t len;
+	size_t max;
+	uint64_t seq;
+	unsigned int rate;
+	unsigned int burst;
+	double tokens;
+	uint64_t refilled; /* time (ns) tokens last added */
+	int stop;
+	lc_join_stats_t stats;
+	uint64_t latency; /* total (ns), for mean */
+};
+
+static uint64_t lc_joinq_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* a before b? */
+static inline int lc_joinq_before(const lc_joinq_item_t *a, const lc_joinq_item_t *b)
+{
+	return (a->prio != b->prio) ? a->prio > b->prio : a->seq < b->seq;
+}
+
+static void lc_joinq_up(lc_joinq_t *q, size_t i)
+{
+	lc_joinq_item_t item = q->heap[i];
+	while (i) {
+		size_t parent = (i - 1) / 2;
+		if (!lc_joinq_before(&item, &q->heap[parent])) break;
+		q->heap[i] = q->heap[parent];
+		i = parent;
+	}
+	q->heap[i] = item;
+}
+
+static void lc_joinq_down(lc_joinq_t *q, size_t i)
+{
+	lc_joinq_item_t item = q->heap[i];
+	for (;;) {
+		size_t c = 2 * i + 1;
+		if (c >= q->len) break;
+		if (c + 1 < q->len && lc_joinq_before(&q->heap[c + 1], &q->heap[c])) c++;
+		if (!lc_joinq_before(&q->heap[c], &item)) break;
+		q->heap[i] = q->heap[c];
+		i = c;
+	}
+	q->heap[i] = item;
+}
+
+static void lc_joinq_count(lc_joinq_t *q)
+{
+	q->stats.queued = q->len;
+}
+
+static lc_joinq_item_t lc_joinq_pop(lc_joinq_t *q)
+{
+	lc_joinq_item_t top = q->heap[0];
+	q->heap[0] = q->heap[--q->len];
+	if (q->len) lc_joinq_down(q, 0);
+	return top;
+}
+
+static void lc_joinq_refill(lc_joinq_t *q, uint64_t now)
+{
+	q->tokens += (double)(now - q->refilled) * q->rate / 1e9;
+	if (q->tokens > q->burst) q->tokens = q->burst;
+	q->refilled = now;
+}
+
+/* pop and apply the top item, with q->mtx held.  The epoch is entered before
+ * the pop, so an object cancelled once popped isn't freed under us */
+static void lc_joinq_apply(lc_joinq_t *q)
+{
+	lc_joinq_item_t item;
+	uint64_t latency;
+	int e = 0, rc;
+
+	if (q->ep) e = lc_epoch_enter(q->ep);
+	item = lc_joinq_pop(q);
+	lc_joinq_count(q);
+	pthread_mutex_unlock(&q->mtx);
+	rc = q->fn(item.obj, q->arg);
+	if (q->ep) lc_epoch_exit(q->ep, e);
+	latency = lc_joinq_now() - item.queued;
+	pthread_mutex_lock(&q->mtx);
+	if (rc) return;
+	q->tokens -= 1;
+	q->stats.joined++;
+	q->latency += latency;
+	q->stats.latency = q->latency / q->stats.joined;
+	if (latency > q->stats.latency_max) q->stats.latency_max = latency;
+}
+
+static void *lc_joinq_thread(void *arg)
+{
+	lc_joinq_t *q = arg;
+	struct timespec ts;
+	uint64_t now, wait;
+
+	pthread_mutex_lock(&q->mtx);
+	while (!q->stop) {
+		if (!q->len) {
+			pthread_cond_wait(&q->cond, &q->mtx);
+			continue;
+		}
+		now = lc_joinq_now();
+		lc_joinq_refill(q, now);
+		if (q->tokens < 1) {
+			/* sleep until the next token is due */
+			wait = (uint64_t)((1 - q->tokens) * 1e9 / q->rate) + 1;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			wait += ts.tv_nsec;
+			ts.tv_sec += wait / 1000000000ULL;
+			ts.tv_nsec = wait % 1000000000ULL;
+			pthread_cond_timedwait(&q->cond, &q->mtx, &ts);
+			continue;
+		}
+		lc_joinq_apply(q);
+	}
+	pthread_mutex_unlock(&q->mtx);
+	return NULL;
+}
+
+int lc_joinq_push(lc_joinq_t *q, void *obj, int prio)
+{
+	lc_joinq_item_t *heap;
+	size_t max;
+
+	pthread_mutex_lock(&q->mtx);
+	if (q->len == q->max) {
+		max = (q->max) ? q->max * 2 : 64;
+		if (!(heap = realloc(q->heap, max * sizeof(lc_joinq_item_t)))) {
+			pthread_mutex_unlock(&q->mtx);
+			return -1;
+		}
+		q->heap = heap;
+		q->max = max;
+	}
+	q->heap[q->len] = (lc_joinq_item_t){
+		.obj = obj,
+		.seq = q->seq++,
+		.queued = lc_joinq_now(),
+		.prio = prio,
+	};
+	lc_joinq_up(q, q->len++);
+	lc_joinq_count(q);
+	if (q->stats.queued > q->stats.queued_max) q->stats.queued_max = q->stats.queued;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->mtx);
+	return 0;
+}
+
+void lc_joinq_cancel(lc_joinq_t *q, void *obj)
+{
+	pthread_mutex_lock(&q->mtx);
+	for (size_t i = 0; i < q->len; i++) {
+		if (q->heap[i].obj != obj) continue;
+		q->heap[i] = q->heap[--q->len];
+		if (i < q->len) {
+			lc_joinq_up(q, i);
+			lc_joinq_down(q, i);
+		}
+		break;
+	}
+	lc_joinq_count(q);
+	pthread_mutex_unlock(&q->mtx);
+}
+
+void lc_joinq_rate(lc_joinq_t *q, unsigned int rate, unsigned int burst)
+{
+	pthread_mutex_lock(&q->mtx);
+	lc_joinq_refill(q, lc_joinq_now());
+	q->rate = rate;
+	q->burst = (burst) ? burst : 1;
+	if (q->tokens > q->burst) q->tokens = q->burst;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->mtx);
+}
+
+void lc_joinq_stats(lc_joinq_t *q, lc_join_stats_t *stats)
+{
+	pthread_mutex_lock(&q->mtx);
+	memcpy(stats, &q->stats, sizeof(lc_join_stats_t));
+	pthread_mutex_unlock(&q->mtx);
+}
+
+size_t lc_joinq_len(lc_joinq_t *q)
+{
+	size_t len;
+
+	pthread_mutex_lock(&q->mtx);
+	len = q->len;
+	pthread_mutex_unlock(&q->mtx);
+	return len;
+}
+
+static void lc_joinq_stop(lc_joinq_t *q)
+{
+	pthread_mutex_lock(&q->mtx);
+	q->stop = 1;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->mtx);
+	if (q->thread) pthread_join(q->thread, NULL);
+	q->thread = 0;
+}
+
+void lc_joinq_drain(lc_joinq_t *q)
+{
+	lc_joinq_stop(q);
+	pthread_mutex_lock(&q->mtx);
+	while (q->len) lc_joinq_apply(q);
+	pthread_mutex_unlock(&q->mtx);
+}
+
+void lc_joinq_free(lc_joinq_t *q)
+{
+	if (!q) return;
+	lc_joinq_stop(q);
+	pthread_cond_destroy(&q->cond);
+	pthread_mutex_destroy(&q->mtx);
+	free(q->heap);
+	free(q);
+}
+
+lc_joinq_t *lc_joinq_new(unsigned int rate, unsigned int burst, lc_joinq_fn_t *fn, void *arg,
+		const lc_thread_attr_t *attr, lc_epoch_t *ep)
+{
+	pthread_condattr_t ca;
+	lc_joinq_t *q;
+	int err;
+
+	if (!rate || !fn) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!(q = calloc(1, sizeof(lc_joinq_t)))) return NULL;
+	q->fn = fn;
+	q->arg = arg;
+	q->ep = ep;
+	q->rate = rate;
+	q->burst = (burst) ? burst : 1;
+	q->tokens = q->burst;
+	q->refilled = lc_joinq_now();
+	pthread_mutex_init(&q->mtx, NULL);
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_cond_init(&q->cond, &ca);
+	pthread_condattr_destroy(&ca);
+	if ((err = lc_thread_create(&q->thread, attr, &lc_joinq_thread, q))) {
+		q->thread = 0;
+		lc_joinq_free(q);
+		errno = err;
+		return NULL;
+	}
+	return q;
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _JOINQ_H
+#define _JOINQ_H 1
+
+#include <librecast/types.h>
+#include "epoch.h"
+
+/* paced join queue.  A thread applies queued items highest priority first,
+ * in order within a priority, at up to rate per second with bursts of up to
+ * burst (token bucket) */
+typedef struct lc_joinq_s lc_joinq_t;
+
+/* apply item obj.  Return 0 if applied, or 1 if skipped, which uses no token
+ * and isn't counted in stats */
+typedef int lc_joinq_fn_t(void *obj, void *arg);
+
+/* create queue and its thread, placed as attr (NULL = default).  Items are
+ * applied inside a read section of ep (NULL = none), entered before they are
+ * popped, so obj may be retired to ep once cancelled */
+lc_joinq_t *lc_joinq_new(unsigned int rate, unsigned int burst, lc_joinq_fn_t *fn, void *arg,
+		const lc_thread_attr_t *attr, lc_epoch_t *ep);
+
+/* stop thread and free queue, discarding items still queued */
+void lc_joinq_free(lc_joinq_t *q);
+
+/* stop thread and apply items queued now, and any queued as we go */
+void lc_joinq_drain(lc_joinq_t *q);
+
+/* items queued */
+size_t lc_joinq_len(lc_joinq_t *q);
+
+/* remove the item queued for obj, if any */
+void lc_joinq_cancel(lc_joinq_t *q, void *obj);
+
+/* change rate and burst */
+void lc_joinq_rate(lc_joinq_t *q, unsigned int rate, unsigned int burst);
+
+/* queue obj.  Returns 0, or -1 if out of memory */
+int lc_joinq_push(lc_joinq_t *q, void *obj, int prio);
+
+void lc_joinq_stats(lc_joinq_t *q, lc_join_stats_t *stats);
+
+#endif /* _JOINQ_H */
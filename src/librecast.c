@@ -5,13 +5,31 @@
 #include "librecast_pvt.h"
 #include <librecast/net.h>
 #include "hash.h"
+#include "dedup.h"
+#include "senders.h"
+#include "reorder.h"
+#include "packet.h"
+#include "loop.h"
+#include "pool.h"
+#include "fanout.h"
+#include "thread.h"
+#include "intern.h"
+#include "slab.h"
+#include "bandset.h"
+#include "topic.h"
+#include "iftab.h"
+#include "joinq.h"
+#include "spill.h"
+#include "grpset.h"
 #include <arpa/inet.h>
 #include <assert.h>
 #include <fcntl.h>
 #include <ifaddrs.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,19 +42,264 @@ uint32_t sock_id = 0;
 uint32_t chan_id = 0;
 
 lc_ctx_t *ctx_list = NULL;
+static pthread_mutex_t ctx_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* objects per slab chunk */
+#define CHAN_SLAB 1024
+#define SOCK_SLAB 64
+
+/* max messages read from one socket per event loop wakeup */
+#define LOOP_BUDGET 64
+
+/* default most kernel sockets of an elastic socket */
+#define ELASTIC_MAX 256
+
+/* copies of a message sent per sendmmsg(), one per interface */
+#define SEND_BATCH 64
 
-static void lc_op_data_handler(lc_socket_call_t *sc, lc_message_t *msg);
 static void lc_op_ping_handler(lc_socket_call_t *sc, lc_message_t *msg);
-static void lc_op_pong_handler(lc_socket_call_t *sc, lc_message_t *msg);
 
 int (*lc_msg_logger)(lc_channel_t *, lc_message_t *, void *logdb) = NULL;
 
+/* opcode handlers run before the message is passed to its callback */
 void (*lc_op_handler[LC_OP_MAX])(lc_socket_call_t *, lc_message_t *) = {
-	lc_op_data_handler,
-	lc_op_ping_handler,
-	lc_op_pong_handler,
+	[LC_OP_PING] = lc_op_ping_handler,
 };
 
+/* chan_list traversal, for readers inside an epoch read section */
+static inline lc_channel_t *lc_chan_first(lc_ctx_t *ctx)
+{
+	return __atomic_load_n(&ctx->chan_list, __ATOMIC_ACQUIRE);
+}
+
+static inline lc_channel_t *lc_chan_next(lc_channel_t *chan)
+{
+	return __atomic_load_n(&chan->next, __ATOMIC_ACQUIRE);
+}
+
+/* channels may be bound and unbound while listeners look them up */
+static inline lc_socket_t *lc_chan_sock(lc_channel_t *chan)
+{
+	return __atomic_load_n(&chan->sock, __ATOMIC_ACQUIRE);
+}
+
+static inline lc_channel_ext_t *lc_chan_ext(lc_channel_t *chan)
+{
+	return __atomic_load_n(&chan->ext, __ATOMIC_ACQUIRE);
+}
+
+static inline lc_reorder_t *lc_chan_reorder(lc_channel_t *chan)
+{
+	lc_channel_ext_t *ext = lc_chan_ext(chan);
+	return (ext) ? __atomic_load_n(&ext->reorder, __ATOMIC_ACQUIRE) : NULL;
+}
+
+/* any ordered channels bound to sock? */
+static inline int lc_socket_ordered(lc_socket_t *sock)
+{
+	lc_chanvec_t *vec = __atomic_load_n(&sock->ordered, __ATOMIC_ACQUIRE);
+	return vec && __atomic_load_n(&vec->n, __ATOMIC_RELAXED);
+}
+
+static void lc_chanvec_free(lc_chanvec_t *vec)
+{
+	for (lc_chanvec_t *prev; vec; vec = prev) {
+		prev = vec->prev;
+		free(vec);
+	}
+}
+
+/* add chan to the ordered channels of sock, if not there already.  Call with
+ * ctx->if_mtx held.  Returns -1 if out of memory */
+static int lc_socket_ordered_add(lc_socket_t *sock, lc_channel_t *chan)
+{
+	lc_chanvec_t *vec = sock->ordered, *grown;
+	size_t n = (vec) ? vec->n : 0, max;
+
+	for (size_t i = 0; i < n; i++) if (vec->chan[i] == chan) return 0;
+	if (!vec || n == vec->max) {
+		max = (vec) ? vec->max * 2 : 4;
+		grown = malloc(sizeof(lc_chanvec_t) + max * sizeof(lc_channel_t *));
+		if (!grown) return -1;
+		grown->prev = vec;
+		grown->n = n;
+		grown->max = max;
+		if (n) memcpy(grown->chan, vec->chan, n * sizeof(lc_channel_t *));
+		__atomic_store_n(&sock->ordered, grown, __ATOMIC_RELEASE);
+		vec = grown;
+	}
+	__atomic_store_n(&vec->chan[n], chan, __ATOMIC_RELEASE);
+	__atomic_store_n(&vec->n, n + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* remove chan from the ordered channels of sock, with ctx->if_mtx held.  The
+ * last takes its place, so a reader may see that one twice, or chan once more
+ * - which stays until the readers leave the epoch */
+static void lc_socket_ordered_del(lc_socket_t *sock, lc_channel_t *chan)
+{
+	lc_chanvec_t *vec = sock->ordered;
+	size_t n = (vec) ? vec->n : 0;
+
+	for (size_t i = 0; i < n; i++) {
+		if (vec->chan[i] != chan) continue;
+		__atomic_store_n(&vec->chan[i], vec->chan[n - 1], __ATOMIC_RELEASE);
+		__atomic_store_n(&vec->n, n - 1, __ATOMIC_RELEASE);
+		return;
+	}
+}
+
+/* sources, under ctx->if_mtx */
+static inline lc_srclist_t *lc_chan_src(lc_channel_t *chan)
+{
+	lc_channel_ext_t *ext = lc_chan_ext(chan);
+	return (ext) ? ext->src : NULL;
+}
+
+/* cold part of chan, allocated if it has none yet.  NULL if out of memory */
+static lc_channel_ext_t *lc_channel_ext(lc_channel_t *chan)
+{
+	lc_channel_ext_t *ext, *none = NULL;
+
+	if ((ext = lc_chan_ext(chan))) return ext;
+	if (!(ext = calloc(1, sizeof(lc_channel_ext_t)))) return NULL;
+	/* set once - another thread may beat us to it */
+	if (!__atomic_compare_exchange_n(&chan->ext, &none, ext, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		free(ext);
+		ext = none;
+	}
+	return ext;
+}
+
+#define CHANHASH_MIN 64 /* buckets, power of 2 */
+
+static lc_chanhash_t *lc_chanhash_new(size_t buckets)
+{
+	lc_chanhash_t *h;
+
+	if (!(h = calloc(1, sizeof(lc_chanhash_t) + buckets * sizeof(lc_channel_t *)))) return NULL;
+	h->mask = buckets - 1;
+	return h;
+}
+
+static void lc_chanhash_destroy(lc_epoch_node_t *node)
+{
+	free((char *)node - offsetof(lc_chanhash_t, retired));
+}
+
+/* push chan on the head of its bucket.  Call with ctx->epoch.lock held */
+static void lc_chanhash_push(lc_chanhash_t *h, lc_channel_t *chan)
+{
+	lc_channel_t **head = &h->bucket[lc_grpset_hash(&chan->sa.sin6_addr) & h->mask];
+
+	/* chan may be in use already, if rehashing */
+	__atomic_store_n(&chan->hnext, *head, __ATOMIC_RELEASE);
+	if (chan->hnext) chan->hnext->hpprev = &chan->hnext;
+	chan->hpprev = head;
+	__atomic_store_n(head, chan, __ATOMIC_RELEASE);
+}
+
+/* move every channel to a table of buckets buckets.  Readers can be led
+ * from one chain to another as channels move, so they look again if
+ * ctx->chanhash_seq is odd, or has moved on.  Links are stored with release,
+ * so a reader that sees any of them sees the odd seq too.  Call with
+ * ctx->epoch.lock held */
+static void lc_chanhash_resize(lc_ctx_t *ctx, size_t buckets)
+{
+	lc_chanhash_t *old = ctx->chanhash, *h;
+	lc_channel_t *chan;
+
+	if (!(h = lc_chanhash_new(buckets))) return; /* stays as it is, a little slower */
+	__atomic_store_n(&ctx->chanhash_seq, ctx->chanhash_seq + 1, __ATOMIC_RELAXED);
+	for (size_t i = 0; i <= old->mask; i++) {
+		while ((chan = old->bucket[i])) {
+			__atomic_store_n(&old->bucket[i], chan->hnext, __ATOMIC_RELEASE);
+			lc_chanhash_push(h, chan);
+		}
+	}
+	__atomic_store_n(&ctx->chanhash, h, __ATOMIC_RELEASE);
+	__atomic_store_n(&ctx->chanhash_seq, ctx->chanhash_seq + 1, __ATOMIC_RELEASE);
+	lc_epoch_retire(&ctx->epoch, &old->retired, &lc_chanhash_destroy);
+}
+
+/* index chan by its group address, growing the table to keep one channel per
+ * bucket or fewer.  Call with ctx->epoch.lock held */
+static void lc_chanhash_add(lc_ctx_t *ctx, lc_channel_t *chan)
+{
+	if (ctx->chans > ctx->chanhash->mask) lc_chanhash_resize(ctx, (ctx->chanhash->mask + 1) * 2);
+	lc_chanhash_push(ctx->chanhash, chan);
+	ctx->chans++;
+}
+
+/* chan->hnext stays intact for readers still on chan.  Call with
+ * ctx->epoch.lock held */
+static void lc_chanhash_del(lc_ctx_t *ctx, lc_channel_t *chan)
+{
+	size_t buckets = ctx->chanhash->mask + 1;
+
+	__atomic_store_n(chan->hpprev, chan->hnext, __ATOMIC_RELEASE);
+	if (chan->hnext) chan->hnext->hpprev = chan->hpprev;
+	/* give memory back under 1/8 full */
+	if (--ctx->chans * 8 < buckets && buckets > CHANHASH_MIN) lc_chanhash_resize(ctx, buckets / 2);
+}
+
+/* channel in ctx with group addr, preferring one bound to sock (if not NULL) -
+ * a sender's copy of the channel may be in the same ctx.  Call inside an
+ * epoch read section */
+static lc_channel_t *lc_chanhash_find(lc_ctx_t *ctx, const struct in6_addr *addr, lc_socket_t *sock)
+{
+	const uint64_t hash = lc_grpset_hash(addr);
+	lc_chanhash_t *h;
+	lc_channel_t *chan;
+	unsigned int seq;
+
+	do {
+		while ((seq = __atomic_load_n(&ctx->chanhash_seq, __ATOMIC_ACQUIRE)) & 1) sched_yield();
+		chan = NULL;
+		h = __atomic_load_n(&ctx->chanhash, __ATOMIC_ACQUIRE);
+		for (lc_channel_t *p = __atomic_load_n(&h->bucket[hash & h->mask], __ATOMIC_ACQUIRE);
+				p; p = __atomic_load_n(&p->hnext, __ATOMIC_ACQUIRE)) {
+			if (memcmp(addr, &p->sa.sin6_addr, sizeof(struct in6_addr))) continue;
+			if (!chan) chan = p;
+			if (!sock || lc_chan_sock(p) == sock) {
+				chan = p;
+				break;
+			}
+		}
+	} while (__atomic_load_n(&ctx->chanhash_seq, __ATOMIC_RELAXED) != seq);
+	return chan;
+}
+
+/* drop chan's sources.  Call with ctx->if_mtx held */
+static void lc_channel_src_clear(lc_channel_t *chan)
+{
+	lc_channel_ext_t *ext = lc_chan_ext(chan);
+
+	if (!ext) return;
+	free(ext->src);
+	ext->src = NULL;
+}
+
+/* band is the lower 64 bits of the group, as lc_channel_sideband() */
+static inline uint64_t lc_addr_band(const struct in6_addr *addr)
+{
+	uint64_t band;
+	memcpy(&band, &addr->s6_addr[8], sizeof band);
+	return band;
+}
+
+static inline void lc_addr_setband(struct in6_addr *addr, uint64_t band)
+{
+	memcpy(&addr->s6_addr[8], &band, sizeof band);
+}
+
+/* socket has a listener thread, or is registered with the context event loop */
+static inline int lc_socket_listening(lc_socket_t *sock)
+{
+	return sock->thread || sock->watch;
+}
+
 int lc_getrandom(void *buf, size_t buflen)
 {
 	int err, fd;
@@ -170,6 +433,7 @@ int lc_socket_loop(lc_socket_t *sock, int val)
 
 int lc_socket_ttl(lc_socket_t *sock, int val)
 {
+	if (sock->pkt) lc_packet_hops(sock->pkt, val);
 	return setsockopt(sock->sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &val, sizeof val);
 }
 
@@ -213,57 +477,201 @@ int lc_msg_init_size(lc_message_t *msg, size_t len)
 	return 0;
 }
 
+int lc_channel_ordered(lc_channel_t *chan, unsigned int depth, unsigned int hold)
+{
+	lc_channel_ext_t *ext;
+	lc_socket_t *sock;
+	lc_reorder_t *ro = NULL;
+
+	if (!chan) return LC_ERROR_CHANNEL_REQUIRED;
+	if (chan->sock && lc_socket_listening(chan->sock)) return LC_ERROR_SOCKET_LISTENING;
+	if (!depth && !lc_chan_ext(chan)) return 0; /* not ordered */
+	if (!(ext = lc_channel_ext(chan))) return LC_ERROR_MALLOC;
+	if (depth && !(ro = lc_reorder_new(depth, hold))) return LC_ERROR_MALLOC;
+	pthread_mutex_lock(&chan->ctx->if_mtx);
+	if ((sock = lc_chan_sock(chan))) {
+		if (!ro) lc_socket_ordered_del(sock, chan);
+		else if (lc_socket_ordered_add(sock, chan)) {
+			pthread_mutex_unlock(&chan->ctx->if_mtx);
+			lc_reorder_free(ro);
+			return LC_ERROR_MALLOC;
+		}
+	}
+	lc_reorder_free(ext->reorder);
+	__atomic_store_n(&ext->reorder, ro, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&chan->ctx->if_mtx);
+	return 0;
+}
+
+static void lc_channel_ext_free(lc_channel_t *chan)
+{
+	if (!chan->ext) return;
+	lc_reorder_free(chan->ext->reorder);
+	free(chan->ext->src);
+	free(chan->ext);
+}
+
+static void lc_channel_destroy(lc_epoch_node_t *node)
+{
+	lc_channel_t *chan = (lc_channel_t *)((char *)node - offsetof(lc_channel_t, retired));
+	lc_channel_ext_free(chan);
+	lc_slab_release(chan->ctx->chan_slab, chan);
+}
+
 void lc_channel_free(lc_channel_t * chan)
 {
+	lc_socket_t *sock;
+	lc_epoch_t *ep;
+
 	if (!chan) return;
-	for (lc_channel_t *p = chan->ctx->chan_list, *prev = NULL; p; p = p->next) {
-		if (p->id == chan->id) {
-			if (prev) prev->next = p->next;
-			else chan->ctx->chan_list = p->next;
+	/* cancel paced join */
+	pthread_mutex_lock(&chan->ctx->if_mtx);
+	if (chan->joined == LC_JOIN_QUEUED) {
+		chan->joined = 0;
+		if (chan->ctx->joinq) lc_joinq_cancel(chan->ctx->joinq, chan);
+	}
+	if ((sock = lc_chan_sock(chan)) && lc_chan_reorder(chan)) lc_socket_ordered_del(sock, chan);
+	pthread_mutex_unlock(&chan->ctx->if_mtx);
+	ep = &chan->ctx->epoch;
+	pthread_mutex_lock(&ep->lock);
+	if (chan->pprev) {
+		/* chan->next stays intact for readers still on chan */
+		__atomic_store_n(chan->pprev, chan->next, __ATOMIC_RELEASE);
+		if (chan->next) chan->next->pprev = chan->pprev;
+		lc_chanhash_del(chan->ctx, chan);
+		/* overwrites the back links */
+		lc_epoch_retire(ep, &chan->retired, &lc_channel_destroy);
+	}
+	lc_epoch_unlock(ep);
+}
+
+/* send a copy of msg out of each interface in tab, each with its own
+ * IPV6_PKTINFO, SEND_BATCH to a system call.  Returns the bytes in a copy if
+ * any was sent, otherwise -1 with errno set from the first to fail */
+static ssize_t lc_sendtab_sendmsg(int s, const lc_sendtab_t *tab, const struct msghdr *msg,
+		int flags)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+		size_t align; /* as struct cmsghdr */
+	} ctl[SEND_BATCH];
+	struct mmsghdr mm[SEND_BATCH];
+	struct in6_pktinfo pi = {0};
+	struct cmsghdr *cmsg;
+	ssize_t bytes = -1;
+	size_t i, j, n;
+	int rc, err = 0;
+
+	for (i = 0; i < tab->n; i += n) {
+		n = (tab->n - i < SEND_BATCH) ? tab->n - i : SEND_BATCH;
+		for (j = 0; j < n; j++) {
+			mm[j].msg_hdr = *msg;
+			mm[j].msg_hdr.msg_control = ctl[j].buf;
+			mm[j].msg_hdr.msg_controllen = sizeof ctl[j].buf;
+			cmsg = CMSG_FIRSTHDR(&mm[j].msg_hdr);
+			cmsg->cmsg_level = IPPROTO_IPV6;
+			cmsg->cmsg_type = IPV6_PKTINFO;
+			cmsg->cmsg_len = CMSG_LEN(sizeof pi);
+			pi.ipi6_ifindex = tab->ifx[i + j];
+			memcpy(CMSG_DATA(cmsg), &pi, sizeof pi);
+		}
+		for (j = 0; j < n; ) {
+			if ((rc = sendmmsg(s, &mm[j], n - j, flags)) == -1) {
+				if (errno == EINTR) continue;
+				if (!err) err = errno;
+				j++; /* skip the interface that failed, send the rest */
+				continue;
+			}
+			bytes = mm[j].msg_len;
+			j += rc;
 		}
-		prev = p;
 	}
-	free(chan);
+	if (bytes == -1) errno = err;
+	return bytes;
+}
+
+/* send msg from sock, out of the interfaces set by lc_socket_send_policy() */
+static ssize_t lc_socket_sendmsg_policy(lc_socket_t *sock, const struct msghdr *msg, int flags)
+{
+	const lc_sendtab_t *tab;
+	ssize_t bytes;
+	int e;
+
+	e = lc_epoch_enter(&sock->ctx->epoch);
+	tab = __atomic_load_n(&sock->sendtab, __ATOMIC_ACQUIRE);
+	/* none left (eg. every interface gone) - the kernel chooses */
+	if (tab && tab->n) bytes = lc_sendtab_sendmsg(sock->sock, tab, msg, flags);
+	else bytes = sendmsg(sock->sock, msg, flags);
+	lc_epoch_exit(&sock->ctx->epoch, e);
+	return bytes;
 }
 
 ssize_t lc_channel_sendmsg(lc_channel_t *chan, struct msghdr *msg, int flags)
 {
 	msg->msg_name = (struct sockaddr *)&chan->sa;
 	msg->msg_namelen = sizeof(struct sockaddr_in6);
+	if (chan->sock->pkt) return lc_packet_sendmsg(chan->sock->pkt, &chan->sa, msg, flags);
+	/* caller's own ancillary data goes as it is */
+	if (!msg->msg_controllen && __atomic_load_n(&chan->sock->sendtab, __ATOMIC_RELAXED))
+		return lc_socket_sendmsg_policy(chan->sock, msg, flags);
 	return sendmsg(chan->sock->sock, msg, flags);
 }
 
+static ssize_t lc_socket_sendto(lc_socket_t *sock, struct sockaddr_in6 *sa, const void *buf,
+		size_t len, int flags)
+{
+	struct iovec iov = { .iov_base = (void *)buf, .iov_len = len };
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+	if (sock->pkt) return lc_packet_sendmsg(sock->pkt, sa, &msg, flags);
+	if (__atomic_load_n(&sock->sendtab, __ATOMIC_RELAXED)) {
+		msg.msg_name = sa;
+		msg.msg_namelen = sizeof(struct sockaddr_in6);
+		return lc_socket_sendmsg_policy(sock, &msg, flags);
+	}
+	return sendto(sock->sock, buf, len, flags, (struct sockaddr *)sa, sizeof(struct sockaddr_in6));
+}
+
 ssize_t lc_channel_send(lc_channel_t *chan, const void *buf, size_t len, int flags)
 {
-	return sendto(chan->sock->sock, buf, len, flags,
-		(struct sockaddr *)&chan->sa, sizeof(struct sockaddr_in6));
+	return lc_socket_sendto(chan->sock, &chan->sa, buf, len, flags);
 }
 
 ssize_t lc_socket_sendmsg(lc_socket_t *sock, struct msghdr *msg, int flags)
 {
 	ssize_t bytes = 0, rc;
-	for (lc_channel_t *chan = sock->ctx->chan_list; chan; chan = chan->next) {
-		if (chan->sock == sock) {
+	int e = lc_epoch_enter(&sock->ctx->epoch);
+	for (lc_channel_t *chan = lc_chan_first(sock->ctx); chan; chan = lc_chan_next(chan)) {
+		if (lc_chan_sock(chan) == sock) {
 			if ((rc = lc_channel_sendmsg(chan, msg, flags)) > 0) {
 				bytes += rc;
 			}
-			else return -1;
+			else {
+				bytes = -1;
+				break;
+			}
 		}
 	}
+	lc_epoch_exit(&sock->ctx->epoch, e);
 	return bytes;
 }
 
 ssize_t lc_socket_send(lc_socket_t *sock, const void *buf, size_t len, int flags)
 {
 	ssize_t bytes = 0, rc;
-	for (lc_channel_t *chan = sock->ctx->chan_list; chan; chan = chan->next) {
-		if (chan->sock == sock) {
+	int e = lc_epoch_enter(&sock->ctx->epoch);
+	for (lc_channel_t *chan = lc_chan_first(sock->ctx); chan; chan = lc_chan_next(chan)) {
+		if (lc_chan_sock(chan) == sock) {
 			if ((rc = lc_channel_send(chan, buf, len, flags)) > 0) {
 				bytes += rc;
 			}
-			else return -1;
+			else {
+				bytes = -1;
+				break;
+			}
 		}
 	}
+	lc_epoch_exit(&sock->ctx->epoch, e);
 	return bytes;
 }
 
@@ -272,9 +680,11 @@ ssize_t lc_msg_sendto(int sock, const void *buf, size_t len, struct sockaddr_in6
 	return sendto(sock, buf, len, flags, (struct sockaddr *)sa, sizeof(struct sockaddr_in6));
 }
 
-ssize_t lc_msg_send(lc_channel_t *chan, lc_message_t *msg)
+/* frame msg with a header and send to sa, taking the next sequence number
+ * from seqp.  prelen bytes of pre go between header and data */
+static ssize_t lc_msg_sendto_seq(lc_socket_t *sock, struct sockaddr_in6 *sa, lc_seq_t *seqp,
+		lc_message_t *msg, const void *pre, size_t prelen)
 {
-	struct sockaddr_in6 *sa = &chan->sa;
 	lc_message_head_t *head = NULL;
 	char *buf = NULL;
 	size_t len = 0;
@@ -283,7 +693,7 @@ ssize_t lc_msg_send(lc_channel_t *chan, lc_message_t *msg)
 	int state = 0;
 	int err = 0;
 
-	if (!chan->sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
 	if (msg->len > 0 && !msg->data) return LC_ERROR_MESSAGE_EMPTY;
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
@@ -296,21 +706,22 @@ ssize_t lc_msg_send(lc_channel_t *chan, lc_message_t *msg)
 	else if (!clock_gettime(CLOCK_REALTIME, &t))
 		head->timestamp = htobe64(t.tv_sec * 1000000000 + t.tv_nsec);
 
-	head->seq = htobe64(++chan->seq);
+	head->seq = htobe64(__atomic_add_fetch(seqp, 1, __ATOMIC_RELAXED));
 	lc_getrandom(&head->rnd, sizeof(lc_rnd_t));
-	head->len = htobe64(msg->len);
+	head->len = htobe64(msg->len + prelen);
 	head->op = msg->op;
-	len = msg->len;
+	len = prelen + msg->len;
 	buf = calloc(1, sizeof(lc_message_head_t) + len);
 	if (!buf) {
 		free(head);
 		return LC_ERROR_MALLOC;
 	}
 	memcpy(buf, head, sizeof(lc_message_head_t));
-	memcpy(buf + sizeof(lc_message_head_t), msg->data, len);
+	if (prelen) memcpy(buf + sizeof(lc_message_head_t), pre, prelen);
+	memcpy(buf + sizeof(lc_message_head_t) + prelen, msg->data, msg->len);
 	len += sizeof(lc_message_head_t);
 
-	bytes = lc_msg_sendto(chan->sock->sock, buf, len, sa, 0);
+	bytes = lc_socket_sendto(sock, sa, buf, len, 0);
 	if (bytes == -1) err = errno;
 
 	free(head);
@@ -321,17 +732,146 @@ ssize_t lc_msg_send(lc_channel_t *chan, lc_message_t *msg)
 	return bytes;
 }
 
+ssize_t lc_msg_send(lc_channel_t *chan, lc_message_t *msg)
+{
+	return lc_msg_sendto_seq(chan->sock, &chan->sa, &chan->seq, msg, NULL, 0);
+}
+
 #ifndef IPV6_MULTICAST_ALL
 static int lc_socket_group_joined(lc_socket_t *sock, struct in6_addr *grp)
 {
-	for (lc_grplist_t *g = sock->grps; g; g = g->next) {
-		if (!memcmp(&g->grp, grp, sizeof(struct in6_addr))) return 1;
+	uint32_t refs;
+
+	pthread_rwlock_rdlock(&sock->grplock);
+	refs = lc_grpset_get(sock->grps, grp, NULL);
+	pthread_rwlock_unlock(&sock->grplock);
+	return refs != 0;
+}
+#endif
+
+static int lc_fd_rcvbuf_set(int fd, int size)
+{
+#ifdef SO_RCVBUFFORCE
+	/* exceed rmem_max if we have CAP_NET_ADMIN */
+	if (!setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof size))
+		return 0;
+#endif
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size) == -1)
+		return LC_ERROR_SETSOCKOPT;
+	return 0;
+}
+
+static int lc_socket_rcvbuf_set(lc_socket_t *sock, int size)
+{
+	unsigned int n;
+
+	if (!sock->spill) return lc_fd_rcvbuf_set(sock->sock, size);
+	n = __atomic_load_n(&sock->spill->n, __ATOMIC_ACQUIRE);
+	for (unsigned int i = 0; i < n; i++) {
+		if (lc_fd_rcvbuf_set(sock->spill->sock[i].fd, size)) return LC_ERROR_SETSOCKOPT;
 	}
 	return 0;
 }
+
+int lc_socket_rcvbuf(lc_socket_t *sock, int size, int max)
+{
+	int rc;
+
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (size <= 0 || (max && max < size)) return LC_ERROR_INVALID_PARAMS;
+	if ((rc = lc_socket_rcvbuf_set(sock, size))) return rc;
+	sock->rcvbuf = size;
+	sock->rcvbuf_max = max;
+	return 0;
+}
+
+int lc_socket_busy_poll(lc_socket_t *sock, int busy_us, int spin_us)
+{
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (busy_us < 0 || spin_us < 0) return LC_ERROR_INVALID_PARAMS;
+	if (lc_socket_listening(sock)) return LC_ERROR_SOCKET_LISTENING;
+#ifdef SO_BUSY_POLL
+	int fd = (sock->pkt) ? lc_packet_fd(sock->pkt) : sock->sock;
+	unsigned int n = 1;
+	if (sock->spill) n = __atomic_load_n(&sock->spill->n, __ATOMIC_ACQUIRE);
+	for (unsigned int i = 0; i < n; i++) {
+		if (sock->spill) fd = sock->spill->sock[i].fd;
+		if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busy_us, sizeof busy_us) == -1)
+			return LC_ERROR_SETSOCKOPT;
+#ifdef SO_PREFER_BUSY_POLL
+		/* hint only - not available before Linux 5.11 */
+		int prefer = (busy_us > 0);
+		setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof prefer);
 #endif
+	}
+#else
+	if (busy_us) return LC_ERROR_NOT_SUPPORTED;
+#endif
+	sock->spin = spin_us;
+	return 0;
+}
 
-ssize_t lc_msg_recv(lc_socket_t *sock, lc_message_t *msg)
+uint64_t lc_socket_drops(lc_socket_t *sock)
+{
+	return (sock) ? sock->drops : 0;
+}
+
+/* drops is the kernel's running count of packets dropped on this socket.
+ * Each kernel socket of an elastic socket has its own - last is the count seen
+ * before on that one */
+static void lc_socket_drops_update(lc_socket_t *sock, uint32_t drops, uint32_t *last)
+{
+	uint32_t delta = drops - ((last) ? *last : (uint32_t)sock->drops);
+	int size;
+
+	if (!delta) return;
+	if (last) *last = drops;
+	sock->drops += delta;
+	sock->dropped += delta;
+
+	/* grow receive buffer, up to limit */
+	if (sock->rcvbuf && sock->rcvbuf < sock->rcvbuf_max) {
+		size = (sock->rcvbuf > sock->rcvbuf_max / 2) ? sock->rcvbuf_max : sock->rcvbuf * 2;
+		if (!lc_socket_rcvbuf_set(sock, size)) sock->rcvbuf = size;
+	}
+}
+
+/* kernel socket to read next.  An elastic socket picks one with data waiting,
+ * waiting for one unless flags has MSG_DONTWAIT, and sets *last to its drop
+ * count.  Returns -1 (errno EAGAIN) if there's none */
+static int lc_socket_rfd(lc_socket_t *sock, int flags, uint32_t **last)
+{
+	int i;
+
+	if (!sock->spill) return sock->sock;
+	pthread_testcancel();
+	if ((i = lc_spill_wait(sock->spill, (flags & MSG_DONTWAIT) ? 0 : -1)) == -1) return -1;
+	if (last) *last = &sock->spill->sock[i].drops;
+	return sock->spill->sock[i].fd;
+}
+
+/* receive from packet ring, copying message out of the ring. Waits up to
+ * timeout ms (-1 = forever) */
+static ssize_t lc_msg_recv_packet(lc_socket_t *sock, lc_message_t *msg, int timeout)
+{
+	ssize_t zi;
+	void *data;
+
+	pthread_testcancel();
+	zi = lc_packet_next(sock->pkt, msg, timeout);
+	if (!zi && timeout >= 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+	if (zi <= 0 || !msg->data) return zi;
+	if (!(data = malloc(msg->len))) return LC_ERROR_MALLOC;
+	memcpy(data, msg->data, msg->len);
+	msg->data = data;
+	msg->free = &_free;
+	return zi;
+}
+
+static ssize_t lc_msg_recv_flags(lc_socket_t *sock, lc_message_t *msg, int flags)
 {
 	ssize_t zi = 0, err = 0;
 	struct iovec iov[2];
@@ -342,11 +882,15 @@ ssize_t lc_msg_recv(lc_socket_t *sock, lc_message_t *msg)
 	socklen_t fromlen = sizeof(from);
 	struct cmsghdr *cmsg;
 	lc_message_head_t head;
+	uint32_t *last = NULL;
+	int fd;
 
+	if (sock->pkt) return lc_msg_recv_packet(sock, msg, (flags & MSG_DONTWAIT) ? 0 : -1);
 #ifndef IPV6_MULTICAST_ALL
 recv_again:
 #endif
-	zi = recv(sock->sock, NULL, 0, MSG_PEEK | MSG_TRUNC);
+	if ((fd = lc_socket_rfd(sock, flags, &last)) == -1) return -1;
+	zi = recv(fd, NULL, 0, MSG_PEEK | MSG_TRUNC | flags);
 	if (zi == -1) return -1;
 
 	if ((size_t)zi > sizeof(lc_message_head_t)) {
@@ -367,7 +911,7 @@ recv_again:
 	msgh.msg_flags = 0;
 
 	pthread_testcancel();
-	if ((zi = recvmsg(sock->sock, &msgh, 0)) <= 0) return zi;
+	if ((zi = recvmsg(fd, &msgh, flags)) <= 0) return zi;
 	memcpy(&head, buf, sizeof(lc_message_head_t));
 	msg->seq = be64toh(head.seq);
 	msg->rnd = be64toh(head.rnd);
@@ -375,35 +919,171 @@ recv_again:
 	msg->timestamp = be64toh(head.timestamp);
 	msg->op = head.op;
 	for (cmsg = CMSG_FIRSTHDR(&msgh); cmsg; cmsg = CMSG_NXTHDR(&msgh, cmsg)) {
+#ifdef SO_RXQ_OVFL
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+			uint32_t drops;
+			memcpy(&drops, CMSG_DATA(cmsg), sizeof drops);
+			lc_socket_drops_update(sock, drops, last);
+			continue;
+		}
+#endif
 		if (cmsg->cmsg_type == IPV6_PKTINFO) {
 			/* may not be aligned, copy */
 			memcpy(&msg->dst, CMSG_DATA(cmsg), sizeof(struct in6_addr));
 			msg->src = (&from)->sin6_addr;
+			msg->srcport = (&from)->sin6_port;
 #ifndef IPV6_MULTICAST_ALL
 			/* destination is group we haven't joined - drop it */
 			if (!lc_socket_group_joined(sock, &msg->dst)) goto recv_again;
 #endif
-			break;
 		}
 	}
 	return zi;
 }
 
+ssize_t lc_msg_recv(lc_socket_t *sock, lc_message_t *msg)
+{
+	return lc_msg_recv_flags(sock, msg, 0);
+}
+
+ssize_t lc_msg_tryrecv(lc_socket_t *sock, lc_message_t *msg)
+{
+	return lc_msg_recv_flags(sock, msg, MSG_DONTWAIT);
+}
+
+ssize_t lc_msg_recv_timeout(lc_socket_t *sock, lc_message_t *msg, int timeout)
+{
+	struct pollfd fds = { .fd = lc_socket_fd(sock), .events = POLLIN };
+	struct timespec t0, t1;
+	ssize_t zi;
+	int wait = timeout;
+
+	if (timeout < 0) return lc_msg_recv(sock, msg);
+	if (sock->pkt) return lc_msg_recv_packet(sock, msg, timeout);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (;;) {
+		zi = lc_msg_recv_flags(sock, msg, MSG_DONTWAIT);
+		if (zi != -1 || (errno != EAGAIN && errno != EWOULDBLOCK) || wait <= 0) return zi;
+		/* readable doesn't guarantee a message for us, so recheck the time */
+		if (poll(&fds, 1, wait) == -1) return -1;
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		wait = timeout - ((t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000);
+	}
+}
+
+int lc_socket_fd(lc_socket_t *sock)
+{
+	if (!sock) return -1;
+	if (sock->spill) return sock->spill->efd;
+	return (sock->pkt) ? lc_packet_fd(sock->pkt) : sock->sock;
+}
+
+int lc_socket_elastic(lc_socket_t *sock, unsigned int max)
+{
+	lc_spill_t *sp;
+
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (lc_socket_listening(sock)) return LC_ERROR_SOCKET_LISTENING;
+	/* packet rings and socket group filters are on sock's own socket only */
+	if (sock->pkt || sock->fanout) return LC_ERROR_INVALID_PARAMS;
+	if (sock->spill) return 0;
+	if (!(sp = lc_spill_new(sock->sock, (max) ? max : ELASTIC_MAX))) return LC_ERROR_FAILURE;
+	pthread_mutex_lock(&sock->ctx->if_mtx);
+	sock->spill = sp;
+	pthread_mutex_unlock(&sock->ctx->if_mtx);
+	return 0;
+}
+
+int lc_socket_elastic_count(lc_socket_t *sock)
+{
+	if (!sock) return 0;
+	if (!sock->spill) return 1;
+	return __atomic_load_n(&sock->spill->n, __ATOMIC_ACQUIRE);
+}
+
 int lc_socket_listen_cancel(lc_socket_t *sock)
 {
+	lc_pool_t *pool;
+	int err;
+
+	if (sock->watch) {
+		lc_loop_del(sock->ctx->loop, sock->watch);
+		sock->watch = NULL;
+		free(sock->call);
+		sock->call = NULL;
+	}
 	if (sock->thread) {
-		if (pthread_cancel(sock->thread))
+		/* ESRCH - cancelled from its own callback, and gone since */
+		if ((err = pthread_cancel(sock->thread)) && err != ESRCH)
 			return LC_ERROR_THREAD_CANCEL;
+		/* called back from the listener - it stops once we return, and is
+		 * joined by the next cancel (or lc_socket_close()) from elsewhere */
+		if (pthread_equal(sock->thread, pthread_self())) return 0;
 		if (pthread_join(sock->thread, NULL))
 			return LC_ERROR_THREAD_JOIN;
 		sock->thread = 0;
 	}
+	/* wait for worker pool to finish with our messages - unless called back
+	 * by a worker, delivering one of them */
+	pool = sock->ctx->pool;
+	if (!pool || !lc_pool_self(pool)) lc_pool_wait(&sock->pending);
 	return 0;
 }
 
-static void lc_op_pong_handler(lc_socket_call_t *sc, lc_message_t *msg)
+int lc_socket_dedup(lc_socket_t *sock, size_t entries, unsigned int window)
 {
-	if (sc->callback_msg) sc->callback_msg(msg);
+	lc_dedup_t *dd = NULL;
+
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (lc_socket_listening(sock)) return LC_ERROR_SOCKET_LISTENING;
+	if (entries) {
+		if (!window) return LC_ERROR_INVALID_PARAMS;
+		if (!(dd = lc_dedup_new(entries, window))) return LC_ERROR_MALLOC;
+	}
+	lc_dedup_free(sock->dedup);
+	sock->dedup = dd;
+	return 0;
+}
+
+int lc_socket_dedup_stats(lc_socket_t *sock, lc_dedup_stats_t *stats)
+{
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (!stats) return LC_ERROR_INVALID_PARAMS;
+	if (sock->dedup) lc_dedup_stats(sock->dedup, stats);
+	else memset(stats, 0, sizeof(lc_dedup_stats_t));
+	return 0;
+}
+
+int lc_socket_senders(lc_socket_t *sock, size_t max)
+{
+	lc_senders_t *st = NULL;
+
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (lc_socket_listening(sock)) return LC_ERROR_SOCKET_LISTENING;
+	if (max && !(st = lc_senders_new(max))) return LC_ERROR_MALLOC;
+	lc_senders_free(sock->senders);
+	sock->senders = st;
+	return 0;
+}
+
+int lc_socket_sender_stats(lc_socket_t *sock, lc_channel_t *chan, struct sockaddr_in6 *src,
+		lc_sender_stats_t *stats)
+{
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (!chan) return LC_ERROR_CHANNEL_REQUIRED;
+	if (!src || !stats) return LC_ERROR_INVALID_PARAMS;
+	if (!sock->senders) return LC_ERROR_FAILURE;
+	if (lc_senders_get(sock->senders, &chan->sa.sin6_addr, &src->sin6_addr,
+				src->sin6_port, stats))
+		return LC_ERROR_FAILURE;
+	return 0;
+}
+
+ssize_t lc_socket_senders_list(lc_socket_t *sock, lc_sender_stats_t *stats, size_t n)
+{
+	if (!sock || !stats) return -1;
+	if (!sock->senders) return 0;
+	return lc_senders_list(sock->senders, stats, n);
 }
 
 static void lc_op_ping_handler(lc_socket_call_t *sc, lc_message_t *msg)
@@ -416,17 +1096,34 @@ static void lc_op_ping_handler(lc_socket_call_t *sc, lc_message_t *msg)
 	lc_msg_send(msg->chan, msg);
 }
 
-static void lc_op_data_handler(lc_socket_call_t *sc, lc_message_t *msg)
+lc_channel_t *lc_channel_by_address(lc_ctx_t *lctx, struct in6_addr *addr)
+{
+	lc_channel_t *chan;
+	int e = lc_epoch_enter(&lctx->epoch);
+	chan = lc_chanhash_find(lctx, addr, NULL);
+	lc_epoch_exit(&lctx->epoch, e);
+	return chan;
+}
+
+/* channel with addr, preferring one bound to sock */
+static lc_channel_t *lc_channel_by_sock_address(lc_socket_t *sock, struct in6_addr *addr)
 {
-	/* callback to message handler */
-	if (sc->callback_msg) sc->callback_msg(msg);
+	lc_ctx_t *lctx = sock->ctx;
+	lc_channel_t *chan;
+	int e = lc_epoch_enter(&lctx->epoch);
+	chan = lc_chanhash_find(lctx, addr, sock);
+	lc_epoch_exit(&lctx->epoch, e);
+	return chan;
 }
 
-lc_channel_t *lc_channel_by_address(lc_ctx_t *lctx, struct in6_addr *addr)
+/* range bound to sock covering addr, if any. Call inside an epoch read section */
+static lc_range_t *lc_range_by_address(lc_socket_t *sock, struct in6_addr *addr)
 {
-	for (lc_channel_t *p = lctx->chan_list; p; p = p->next) {
-		if (!memcmp(addr,& p->sa.sin6_addr, sizeof(struct in6_addr)))
-			return p;
+	lc_range_t *r = __atomic_load_n(&sock->ctx->range_list, __ATOMIC_ACQUIRE);
+	for (; r; r = __atomic_load_n(&r->next, __ATOMIC_ACQUIRE)) {
+		if (__atomic_load_n(&r->sock, __ATOMIC_ACQUIRE) == sock
+		&& !memcmp(addr, &r->sa.sin6_addr, 8))
+			return r;
 	}
 	return NULL;
 }
@@ -437,7 +1134,7 @@ static ssize_t lc_socket_recvmsg_if(lc_socket_t *sock, struct msghdr *msg, int f
 	char ctl[CMSG_SPACE(sizeof pi)];
 	struct cmsghdr *cmsg;
 	ssize_t bytes;
-	int opt = 1;
+	int opt = 1, fd;
 
 	/* We're only interested in packets arriving on the socket->ifx
 	 * interface. If we bind to an interface-specific address, we will get no
@@ -454,7 +1151,8 @@ static ssize_t lc_socket_recvmsg_if(lc_socket_t *sock, struct msghdr *msg, int f
 	}
 
 	for (;;) {
-		bytes = recvmsg(sock->sock, msg, flags);
+		if ((fd = lc_socket_rfd(sock, flags, NULL)) == -1) return -1;
+		bytes = recvmsg(fd, msg, flags);
 		for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
 			if (cmsg->cmsg_type == IPV6_PKTINFO) {
 				memcpy(&pi, CMSG_DATA(cmsg), sizeof pi);
@@ -474,39 +1172,283 @@ static ssize_t lc_socket_recv_if(lc_socket_t *sock, void *buf, size_t len, int f
 
 ssize_t lc_socket_recvmsg(lc_socket_t *sock, struct msghdr *msg, int flags)
 {
+	int fd;
+
 	if (sock->ifx) return lc_socket_recvmsg_if(sock, msg, flags);
-	return recvmsg(sock->sock, msg, flags);
+	if ((fd = lc_socket_rfd(sock, flags, NULL)) == -1) return -1;
+	return recvmsg(fd, msg, flags);
 }
 
 ssize_t lc_socket_recv(lc_socket_t *sock, void *buf, size_t len, int flags)
 {
+	int fd;
+
 	if (sock->ifx) return lc_socket_recv_if(sock, buf, len, flags);
-	return recv(sock->sock, buf, len, flags);
+	if ((fd = lc_socket_rfd(sock, flags, NULL)) == -1) return -1;
+	return recv(fd, buf, len, flags);
 }
 
-static void process_msg(lc_socket_call_t *sc, lc_message_t *msg)
+static void dispatch_msg(void *arg, lc_message_t *msg)
 {
-	lc_channel_t *chan;
+	lc_socket_call_t *sc = arg;
+	lc_channel_ext_t *ext;
+	lc_range_t *range;
+
+	/* opcode handler */
+	if (msg->op < LC_OP_MAX && lc_op_handler[msg->op])
+		lc_op_handler[msg->op](sc, msg);
+
+	/* channel found by process_msg() has its own callback */
+	if (msg->chan && (ext = lc_chan_ext(msg->chan)) && ext->fn) {
+		ext->fn(msg, ext->arg);
+		return;
+	}
+
+	/* side band of a range - demux by band */
+	if (!msg->chan && (range = lc_range_by_address(sc->sock, &msg->dst)) && range->fn) {
+		uint64_t band = lc_addr_band(&msg->dst);
+		range->fn(msg, band, (band < range->n) ? range->table[band] : range->arg);
+		return;
+	}
+
+	/* callback to message handler */
+	if (sc->callback_msg) sc->callback_msg(msg);
+}
+
+/* hand message to worker pool, if there is one, otherwise dispatch now */
+static void deliver_msg(void *arg, lc_message_t *msg)
+{
+	lc_socket_call_t *sc = arg;
+	lc_pool_t *pool = sc->sock->ctx->pool;
+
+	if (pool && !lc_pool_push(pool, sc, msg, &sc->sock->pending)) return;
+	dispatch_msg(sc, msg);
+}
+
+/* topic message on a socket with topics bound: strip the tag if subscribed,
+ * otherwise drop it (the kernel filter may be missing, or lagging) */
+static int lc_topics_accept(lc_topics_t *t, lc_message_t *msg)
+{
+	lc_topic_set_t *set = __atomic_load_n(&t->set, __ATOMIC_ACQUIRE);
+	uint32_t tag;
+
+	if (msg->len < sizeof tag) goto wasted;
+	memcpy(&tag, msg->data, sizeof tag);
+	tag = ntohl(tag);
+	if (!lc_topic_set_has(set, tag)) goto wasted;
+	msg->topic = tag;
+	msg->len -= sizeof tag;
+	memmove(msg->data, (char *)msg->data + sizeof tag, msg->len);
+	__atomic_add_fetch(&t->msgs, 1, __ATOMIC_RELAXED);
+	return 1;
+wasted:
+	__atomic_add_fetch(&t->wasted, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static void process_msg(lc_socket_call_t *sc, lc_message_t *msg)
+{
+	lc_channel_t *chan;
+	lc_topics_t *topics;
+
+	if (sc->sock->senders) lc_senders_update(sc->sock->senders, msg);
+
+	/* drop duplicates before dispatch */
+	if (sc->sock->dedup && lc_dedup_check(sc->sock->dedup, msg)) return;
+
+	msg->topic = 0;
+	topics = __atomic_load_n(&sc->sock->topics, __ATOMIC_ACQUIRE);
+	if (topics && msg->op == LC_OP_TOPIC && !lc_topics_accept(topics, msg)) return;
 
 	inet_ntop(AF_INET6, &msg->dst, msg->dstaddr, INET6_ADDRSTRLEN);
 	inet_ntop(AF_INET6, &msg->src, msg->srcaddr, INET6_ADDRSTRLEN);
 	msg->sockid = sc->sock->id;
 
 	/* update channel stats */
-	chan = lc_channel_by_address(sc->sock->ctx, &msg->dst);
+	chan = lc_channel_by_sock_address(sc->sock, &msg->dst);
+	/* msg may be reused - don't leave a channel from last time, since freed */
+	msg->chan = chan;
 	if (chan) {
-		msg->chan = chan;
-		chan->seq = (msg->seq > chan->seq) ? msg->seq + 1 : chan->seq + 1;
-		chan->rnd = msg->rnd;
+		lc_reorder_t *ro = lc_chan_reorder(chan);
 		if (lc_msg_logger) lc_msg_logger(chan, msg, NULL);
+
+		/* ordered delivery - dispatched when in sequence */
+		if (ro) {
+			unsigned int held = lc_reorder_held(ro);
+			lc_reorder_push(ro, msg, &deliver_msg, sc);
+			/* now holding messages, so expire looks at it */
+			if (!held && lc_reorder_held(ro))
+				__atomic_add_fetch(&sc->sock->held, 1, __ATOMIC_RELAXED);
+			return;
+		}
 	}
+	deliver_msg(sc, msg);
+}
+
+/* deliver any held messages that have expired, and return ms until the next
+ * one is due, or -1 if none are held */
+static int lc_socket_reorder_expire_chans(lc_socket_call_t *sc)
+{
+	lc_socket_t *sock = sc->sock;
+	lc_chanvec_t *vec = __atomic_load_n(&sock->ordered, __ATOMIC_ACQUIRE);
+	size_t n = (vec) ? __atomic_load_n(&vec->n, __ATOMIC_ACQUIRE) : 0;
+	int wait = -1, held = 0, rc;
+
+	for (size_t i = 0; i < n; i++) {
+		lc_channel_t *chan = __atomic_load_n(&vec->chan[i], __ATOMIC_ACQUIRE);
+		lc_reorder_t *ro = lc_chan_reorder(chan);
+		if (lc_chan_sock(chan) != sock || !ro || !lc_reorder_held(ro)) continue;
+		rc = lc_reorder_expire(ro, &deliver_msg, sc);
+		if (rc < 0) continue;
+		held++;
+		if (wait < 0 || rc < wait) wait = rc;
+	}
+	__atomic_store_n(&sock->held, held, __ATOMIC_RELAXED);
+	return wait;
+}
 
-	/* opcode handler */
-	if (msg->op < LC_OP_MAX && lc_op_handler[msg->op])
-		lc_op_handler[msg->op](sc, msg);
+static int lc_socket_reorder_expire(lc_socket_call_t *sc)
+{
+	lc_epoch_cleanup_t rs = { .ep = &sc->sock->ctx->epoch };
+	int wait;
 
-	/* callback to message handler */
-	if (sc->callback_msg) sc->callback_msg(msg);
+	/* nothing held since the last look */
+	if (!__atomic_load_n(&sc->sock->held, __ATOMIC_RELAXED)) return -1;
+	rs.e = lc_epoch_enter(rs.ep);
+	/* listener may be cancelled in a callback */
+	pthread_cleanup_push(lc_epoch_cleanup, &rs);
+	wait = lc_socket_reorder_expire_chans(sc);
+	pthread_cleanup_pop(1);
+	return wait;
+}
+
+/* dispatch message received, or report error. Frees msg */
+static void lc_socket_call_msg(lc_socket_call_t *sc, lc_message_t *msg, ssize_t len)
+{
+	if (sc->sock->dropped) {
+		sc->sock->dropped = 0;
+		if (sc->callback_err) sc->callback_err(LC_ERROR_NET_DROP);
+	}
+	if (len > 0) {
+		lc_epoch_cleanup_t rs = { .ep = &sc->sock->ctx->epoch };
+		rs.e = lc_epoch_enter(rs.ep);
+		/* listener may be cancelled in a callback */
+		pthread_cleanup_push(lc_epoch_cleanup, &rs);
+		msg->bytes = len;
+		process_msg(sc, msg);
+		pthread_cleanup_pop(1);
+	}
+	if (len < 0) {
+		lc_msg_free(msg);
+		if (sc->callback_err) sc->callback_err(len);
+	}
+	lc_msg_free(msg);
+}
+
+/* read and dispatch up to max messages without blocking. Returns number of
+ * messages read, or -1 if the first read failed for any reason other than
+ * there being nothing to read */
+static ssize_t lc_socket_read(lc_socket_call_t *sc, int max)
+{
+	lc_socket_t *sock = sc->sock;
+	lc_message_t msg = {0};
+	ssize_t len;
+	int i;
+
+	for (i = 0; i < max; i++) {
+		if (sock->pkt) {
+			/* zero-copy - msg.data points into the ring */
+			if (!(len = lc_packet_next(sock->pkt, &msg, 0))) break;
+		}
+		else {
+			len = lc_msg_recv_flags(sock, &msg, MSG_DONTWAIT);
+			if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				lc_msg_free(&msg);
+				break;
+			}
+		}
+		lc_socket_call_msg(sc, &msg, len);
+		if (len < 0) return (i) ? i : -1;
+	}
+	return i;
+}
+
+/* event loop callback - read up to LOOP_BUDGET messages without blocking */
+static void lc_socket_loop_read(void *arg)
+{
+	lc_socket_call_t *sc = arg;
+
+	lc_socket_read(sc, LOOP_BUDGET);
+	/* wake up in time to release held messages on ordered channels */
+	if (lc_socket_ordered(sc->sock)) lc_loop_timer(sc->sock->watch, lc_socket_reorder_expire(sc));
+}
+
+ssize_t lc_socket_drain(lc_socket_t *sock, void (*callback_msg)(lc_message_t*),
+		void (*callback_err)(int), int max)
+{
+	lc_socket_call_t sc = {
+		.sock = sock,
+		.callback_msg = callback_msg,
+		.callback_err = callback_err
+	};
+	ssize_t rc;
+
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (max <= 0) return LC_ERROR_INVALID_PARAMS;
+	if (lc_socket_listening(sock)) return LC_ERROR_SOCKET_LISTENING;
+	rc = lc_socket_read(&sc, max);
+	/* release held messages on ordered channels that are due */
+	if (lc_socket_ordered(sock)) lc_socket_reorder_expire(&sc);
+	return rc;
+}
+
+int lc_socket_timeout(lc_socket_t *sock)
+{
+	lc_chanvec_t *vec;
+	size_t n;
+	int wait = -1, rc, e;
+
+	if (!sock || !__atomic_load_n(&sock->held, __ATOMIC_RELAXED)) return -1;
+	e = lc_epoch_enter(&sock->ctx->epoch);
+	vec = __atomic_load_n(&sock->ordered, __ATOMIC_ACQUIRE);
+	n = (vec) ? __atomic_load_n(&vec->n, __ATOMIC_ACQUIRE) : 0;
+	for (size_t i = 0; i < n; i++) {
+		lc_channel_t *chan = __atomic_load_n(&vec->chan[i], __ATOMIC_ACQUIRE);
+		lc_reorder_t *ro = lc_chan_reorder(chan);
+		if (lc_chan_sock(chan) != sock || !ro) continue;
+		rc = lc_reorder_timeout(ro);
+		if (rc >= 0 && (wait < 0 || rc < wait)) wait = rc;
+	}
+	lc_epoch_exit(&sock->ctx->epoch, e);
+	return wait;
+}
+
+/* non-blocking reads for up to sock->spin us (or wait ms, if sooner), so a
+ * busy socket never sleeps. Returns as lc_msg_recv(), or -1 with errno EAGAIN
+ * if nothing arrived */
+static ssize_t lc_socket_spin(lc_socket_t *sock, lc_message_t *msg, int wait)
+{
+	struct timespec t0, t;
+	int64_t limit = (int64_t)sock->spin * 1000, ns;
+	ssize_t len;
+
+	if (wait >= 0 && (int64_t)wait * 1000000 < limit) limit = (int64_t)wait * 1000000;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do {
+		if (sock->pkt) {
+			/* zero-copy - msg.data points into the ring */
+			if ((len = lc_packet_next(sock->pkt, msg, 0))) return len;
+		}
+		else {
+			len = lc_msg_recv_flags(sock, msg, MSG_DONTWAIT);
+			if (len != -1 || (errno != EAGAIN && errno != EWOULDBLOCK)) return len;
+		}
+		pthread_testcancel();
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		ns = (t.tv_sec - t0.tv_sec) * 1000000000LL + t.tv_nsec - t0.tv_nsec;
+	} while (ns < limit);
+	errno = EAGAIN;
+	return -1;
 }
 
 void *lc_socket_listen_thread(void *arg)
@@ -514,20 +1456,32 @@ void *lc_socket_listen_thread(void *arg)
 	ssize_t len;
 	lc_message_t msg = {0};
 	lc_socket_call_t *sc = arg;
+	struct pollfd fds = { .fd = lc_socket_fd(sc->sock), .events = POLLIN };
+	int wait;
 
 	pthread_cleanup_push(free, arg);
 	pthread_cleanup_push(lc_msg_free, &msg);
 	while(1) {
-		len = lc_msg_recv(sc->sock, &msg);
-		if (len > 0) {
-			msg.bytes = len;
-			process_msg(sc, &msg);
+		/* wake up in time to release held messages on ordered channels */
+		wait = (lc_socket_ordered(sc->sock)) ? lc_socket_reorder_expire(sc) : -1;
+		if (sc->sock->spin) {
+			len = lc_socket_spin(sc->sock, &msg, wait);
+			if (len != -1 || errno != EAGAIN) {
+				lc_socket_call_msg(sc, &msg, len);
+				continue;
+			}
+			/* idle - block until the next message */
+			if (lc_socket_ordered(sc->sock)) wait = lc_socket_reorder_expire(sc);
+		}
+		if (sc->sock->pkt) {
+			/* zero-copy - msg.data points into the ring */
+			if (!(len = lc_packet_next(sc->sock->pkt, &msg, wait))) continue;
 		}
-		if (len < 0) {
-			lc_msg_free(&msg);
-			if (sc->callback_err) sc->callback_err(len);
+		else {
+			if (wait >= 0 && poll(&fds, 1, wait) == 0) continue;
+			len = lc_msg_recv(sc->sock, &msg);
 		}
-		lc_msg_free(&msg);
+		lc_socket_call_msg(sc, &msg, len);
 	}
 	/* not reached */
 	pthread_cleanup_pop(0);
@@ -539,11 +1493,11 @@ void *lc_socket_listen_thread(void *arg)
 int lc_socket_listen(lc_socket_t *sock, void (*callback_msg)(lc_message_t*),
 					void (*callback_err)(int))
 {
-	pthread_attr_t attr = {0};
 	lc_socket_call_t *sc;
+	int err;
 
 	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
-	if (sock->thread) return LC_ERROR_SOCKET_LISTENING;
+	if (lc_socket_listening(sock)) return LC_ERROR_SOCKET_LISTENING;
 
 	sc = calloc(1, sizeof(lc_socket_call_t));
 	if (!sc) return LC_ERROR_MALLOC;
@@ -551,315 +1505,1790 @@ int lc_socket_listen(lc_socket_t *sock, void (*callback_msg)(lc_message_t*),
 	sc->callback_msg = callback_msg;
 	sc->callback_err = callback_err;
 
-	pthread_attr_init(&attr);
-	pthread_create(&sock->thread, &attr, &lc_socket_listen_thread, sc);
-	pthread_attr_destroy(&attr);
+	/* context event loop running - register with that instead */
+	if (sock->ctx->loop) {
+		sock->call = sc;
+		sock->watch = lc_loop_add(sock->ctx->loop, lc_socket_fd(sock), &lc_socket_loop_read, sc);
+		if (!sock->watch) {
+			sock->call = NULL;
+			free(sc);
+			return LC_ERROR_EVENT_LOOP;
+		}
+		return 0;
+	}
+
+	err = lc_thread_create(&sock->thread, (sock->attr) ? sock->attr : sock->ctx->attr,
+			&lc_socket_listen_thread, sc);
+	if (err) {
+		sock->thread = 0;
+		free(sc);
+		errno = err;
+		return LC_ERROR_THREAD_CREATE;
+	}
 
 	return 0;
 }
 
-static int lc_channel_membership_all(int sock, int opt, struct ipv6_mreq *req)
+static int lc_channel_membership_all(int sock, int opt, struct ipv6_mreq *req,
+		const lc_iftab_t *tab)
 {
-	struct ifaddrs *ifaddr, *ifa;
 	int rc = (opt == IPV6_JOIN_GROUP) ? LC_ERROR_MCAST_JOIN : LC_ERROR_MCAST_PART;
 
-	if (getifaddrs(&ifaddr) == -1) return -1;
-	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
-		if ((ifa->ifa_flags & IFF_MULTICAST) != IFF_MULTICAST
-		  || ifa->ifa_addr == NULL
-		  || ifa->ifa_addr->sa_family != AF_INET6) continue;
-
-		req->ipv6mr_interface = if_nametoindex(ifa->ifa_name);
+	if (!tab) return -1;
+	for (size_t i = 0; i < tab->n; i++) {
+		req->ipv6mr_interface = tab->ifx[i];
 
 		if (!setsockopt(sock, IPPROTO_IPV6, opt, req, sizeof(struct ipv6_mreq))) {
 			rc = 0; /* report success if we joined anything */
 		}
 	}
-	freeifaddrs(ifaddr);
 
 	return rc;
 }
 
-#ifndef IPV6_MULTICAST_ALL
-static void lc_socket_group_add(lc_socket_t *sock, struct in6_addr *grp)
+/* value of a group in sock->grps: the kernel socket it is joined on (index in
+ * sock->spill), and whether a channel has filtered its sources */
+#define LC_GRP_INDEX    0x7fffffffU
+#define LC_GRP_FILTERED 0x80000000U
+
+/* sock->grps changes with ctx->if_mtx held.  Where the kernel delivers groups
+ * a socket hasn't joined, it is read for each message received, so changes
+ * take grplock too */
+static inline void lc_socket_grps_lock(lc_socket_t *sock)
 {
-	lc_grplist_t *g, *newgrp;
-	for (g = sock->grps; g; g = g->next) {
-		if (!memcmp(&g->grp, grp, sizeof(struct in6_addr))) return;
-		if (!g->next) break;
-	}
-	newgrp = calloc(1, sizeof(struct lc_grplist_s));
-	memcpy(&newgrp->grp, grp, sizeof(struct in6_addr));
-	if (!sock->grps) sock->grps = newgrp;
-	else g->next = newgrp;
+#ifndef IPV6_MULTICAST_ALL
+	pthread_rwlock_wrlock(&sock->grplock);
+#else
+	(void)sock;
+#endif
 }
 
-static void lc_socket_group_del(lc_socket_t *sock, struct in6_addr *grp)
+static inline void lc_socket_grps_unlock(lc_socket_t *sock)
 {
-	lc_grplist_t *prev = NULL;
-	for (lc_grplist_t *g = sock->grps; g; g = g->next) {
-		if (memcmp(g, grp, sizeof(struct in6_addr)) == 0) {
-			if (prev) {
-				prev->next = (g->next) ? g->next : NULL;
-			}
-			if (g == sock->grps) sock->grps = NULL;
-			free(g);
-		}
-		prev = g;
-	}
-}
+#ifndef IPV6_MULTICAST_ALL
+	pthread_rwlock_unlock(&sock->grplock);
+#else
+	(void)sock;
 #endif
+}
 
-static int lc_channel_membership(lc_channel_t *chan, int opt, struct ipv6_mreq *req)
+/* open another kernel socket for elastic sock, receiving as its own does.
+ * Call with ctx->if_mtx held.  Returns its index, or -1 */
+static int lc_socket_spill_open(lc_socket_t *sock)
 {
-	int s = chan->sock->sock;
-#ifndef IPV6_MULTICAST_ALL
-	if (opt == IPV6_JOIN_GROUP) {
-		lc_socket_group_add(chan->sock, &chan->sa.sin6_addr);
+	struct sockaddr_in6 sa;
+	socklen_t len = sizeof sa;
+	int s, i, opt = 1;
+
+	if (sock->spill->n == sock->spill->max) {
+		errno = EMFILE;
+		return -1;
 	}
-	else {
-		lc_socket_group_del(chan->sock, &chan->sa.sin6_addr);
+	if ((s = socket(AF_INET6, SOCK_DGRAM, 0)) == -1) return -1;
+#ifdef IPV6_MULTICAST_ALL
+	i = 0;
+	setsockopt(s, IPPROTO_IPV6, IPV6_MULTICAST_ALL, &i, sizeof i);
+#endif
+	setsockopt(s, IPPROTO_IPV6, IPV6_RECVPKTINFO, &opt, sizeof opt);
+#ifdef SO_RXQ_OVFL
+	setsockopt(s, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof opt);
+#endif
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof opt);
+#ifdef SO_REUSEPORT
+	setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof opt);
+#endif
+	/* same port, and receive options set on sock since it was created */
+	if (!getsockname(sock->sock, (struct sockaddr *)&sa, &len) && sa.sin6_port) {
+		sa.sin6_addr = in6addr_any;
+		if (bind(s, (struct sockaddr *)&sa, sizeof sa) == -1) goto err_0;
+	}
+	if (sock->rcvbuf) lc_fd_rcvbuf_set(s, sock->rcvbuf);
+#ifdef SO_BUSY_POLL
+	len = sizeof opt;
+	if (!getsockopt(sock->sock, SOL_SOCKET, SO_BUSY_POLL, &opt, &len) && opt) {
+		setsockopt(s, SOL_SOCKET, SO_BUSY_POLL, &opt, sizeof opt);
+#ifdef SO_PREFER_BUSY_POLL
+		setsockopt(s, SOL_SOCKET, SO_PREFER_BUSY_POLL, &opt, sizeof opt);
+#endif
 	}
 #endif
-	if (chan->sock->ifx) {
-		req->ipv6mr_interface = chan->sock->ifx;
-		return setsockopt(s, IPPROTO_IPV6, opt, req, sizeof(struct ipv6_mreq));
+	if ((i = lc_spill_add(sock->spill, s)) == -1) goto err_0;
+	return i;
+err_0:
+	close(s);
+	return -1;
+}
+
+/* join or part req on elastic sock, on interfaces in tab if sock has none set.
+ * A group is parted on kernel socket *idx, and joined on all its interfaces on
+ * one kernel socket, as packets are delivered to each socket joined to their
+ * group on any interface.  *idx is set to that one.  Groups joined for some
+ * sources only, or before sock was elastic, are on sock's own (index 0) */
+static int lc_socket_spill_membership(lc_socket_t *sock, int opt, struct ipv6_mreq *req,
+		const lc_iftab_t *tab, uint32_t *idx)
+{
+	lc_spill_t *sp = sock->spill;
+	size_t nif = (sock->ifx) ? 1 : (tab) ? tab->n : 0, k = 0;
+	uint32_t i;
+	int joined = 0, full;
+
+	if (opt == IPV6_LEAVE_GROUP) {
+		i = (*idx < sp->n) ? *idx : 0;
+		sp->sock[i].full = 0;
+		if (sock->ifx) {
+			req->ipv6mr_interface = sock->ifx;
+			return setsockopt(sp->sock[i].fd, IPPROTO_IPV6, opt, req, sizeof(struct ipv6_mreq));
+		}
+		return lc_channel_membership_all(sp->sock[i].fd, opt, req, tab);
+	}
+	for (i = 0;; i++) {
+		if (i == sp->n && lc_socket_spill_open(sock) == -1) return LC_ERROR_MCAST_JOIN;
+		if (sp->sock[i].full) continue;
+		for (full = 0, joined = 0, k = 0; k < nif; k++) {
+			req->ipv6mr_interface = (sock->ifx) ? sock->ifx : tab->ifx[k];
+			if (!setsockopt(sp->sock[i].fd, IPPROTO_IPV6, opt, req, sizeof(struct ipv6_mreq)))
+				joined++;
+			else if (errno == ENOMEM || errno == ENOBUFS) {
+				full = 1;
+				break;
+			}
+		}
+		if (!full) break;
+		/* no room for more - move the whole group to the next socket */
+		while (k--) {
+			req->ipv6mr_interface = (sock->ifx) ? sock->ifx : tab->ifx[k];
+			setsockopt(sp->sock[i].fd, IPPROTO_IPV6, IPV6_LEAVE_GROUP, req, sizeof(struct ipv6_mreq));
+		}
+		sp->sock[i].full = 1;
 	}
-	return lc_channel_membership_all(s, opt, req);
+	if (!joined) return LC_ERROR_MCAST_JOIN;
+	*idx = i;
+	return 0;
 }
 
-static int lc_channel_action(lc_channel_t *chan, int opt)
+/* kernel socket grp is joined on, or would be for a source filter.  Call
+ * with ctx->if_mtx held */
+static int lc_socket_group_fd(lc_socket_t *sock, const struct in6_addr *grp)
 {
-	struct ipv6_mreq req = {0};
-
-	if(!chan->sock) return LC_ERROR_SOCKET_REQUIRED;
+	uint32_t val;
 
-	memcpy(&req.ipv6mr_multiaddr, &chan->sa.sin6_addr, sizeof(struct in6_addr));
-
-	return lc_channel_membership(chan, opt, &req);
+	if (sock->spill && lc_grpset_get(sock->grps, grp, &val))
+		return sock->spill->sock[val & LC_GRP_INDEX].fd;
+	return sock->sock;
 }
 
-int lc_channel_part(lc_channel_t *chan)
+/* join or part group sa on sock in the kernel, on interfaces in tab if sock
+ * has none set.  *idx as for lc_socket_spill_membership() */
+static int lc_group_membership_kernel(lc_socket_t *sock, struct sockaddr_in6 *sa, int opt,
+		const lc_iftab_t *tab, uint32_t *idx)
 {
-	return lc_channel_action(chan, IPV6_LEAVE_GROUP);
+	struct ipv6_mreq req = {0};
+	int s = sock->sock;
+
+	if (sock->pkt && lc_packet_filter(sock->pkt, sa, opt == IPV6_JOIN_GROUP))
+		return (opt == IPV6_JOIN_GROUP) ? LC_ERROR_MCAST_JOIN : LC_ERROR_MCAST_PART;
+	memcpy(&req.ipv6mr_multiaddr, &sa->sin6_addr, sizeof(struct in6_addr));
+	if (sock->spill) return lc_socket_spill_membership(sock, opt, &req, tab, idx);
+	if (sock->ifx) {
+		req.ipv6mr_interface = sock->ifx;
+		return setsockopt(s, IPPROTO_IPV6, opt, &req, sizeof(struct ipv6_mreq));
+	}
+	return lc_channel_membership_all(s, opt, &req, tab);
+}
+
+/* join or part group sa on sock, on interfaces in tab if sock has none set.
+ * Joins are counted, so channels and ranges on one socket can share a group:
+ * the kernel joins it on the first join and leaves it on the last part.  Call
+ * with ctx->if_mtx held */
+static int lc_group_membership_tab(lc_socket_t *sock, struct sockaddr_in6 *sa, int opt,
+		const lc_iftab_t *tab)
+{
+	uint32_t val = 0, refs;
+	int rc;
+
+	refs = lc_grpset_get(sock->grps, &sa->sin6_addr, &val);
+	if (refs && (opt == IPV6_JOIN_GROUP || refs > 1)) {
+		/* a channel's source filter applies to the whole socket */
+		if (opt == IPV6_JOIN_GROUP && (val & LC_GRP_FILTERED)) return LC_ERROR_SOURCE_FILTER;
+		lc_socket_grps_lock(sock);
+		if (opt == IPV6_JOIN_GROUP) lc_grpset_ref(sock->grps, &sa->sin6_addr, val);
+		else lc_grpset_unref(sock->grps, &sa->sin6_addr);
+		lc_socket_grps_unlock(sock);
+		return 0;
+	}
+	val &= LC_GRP_INDEX;
+	rc = lc_group_membership_kernel(sock, sa, opt, tab, &val);
+	if (opt == IPV6_JOIN_GROUP && !rc) {
+		lc_socket_grps_lock(sock);
+		rc = lc_grpset_ref(sock->grps, &sa->sin6_addr, val);
+		lc_socket_grps_unlock(sock);
+		if (rc == -1) {
+			lc_group_membership_kernel(sock, sa, IPV6_LEAVE_GROUP, tab, &val);
+			return LC_ERROR_MALLOC;
+		}
+		return 0;
+	}
+	/* last reference gone, even if the kernel had left already */
+	if (opt == IPV6_LEAVE_GROUP && refs) {
+		lc_socket_grps_lock(sock);
+		lc_grpset_unref(sock->grps, &sa->sin6_addr);
+		lc_socket_grps_unlock(sock);
+	}
+	return rc;
 }
 
-int lc_channel_join(lc_channel_t *chan)
+/* interfaces to join on: the ctx cache if there is one, otherwise listed now.
+ * Call with ctx->if_mtx held, and lc_ctx_iftab_put() the table when done */
+static lc_iftab_t *lc_ctx_iftab_get(lc_ctx_t *ctx)
 {
-	return lc_channel_action(chan, IPV6_JOIN_GROUP);
+	return (ctx->iftab) ? ctx->iftab : lc_iftab_new();
 }
 
-int lc_channel_unbind(lc_channel_t *chan)
+static void lc_ctx_iftab_put(lc_ctx_t *ctx, lc_iftab_t *tab)
 {
-	chan->sock->bound--;
-	chan->sock = NULL;
-	return 0;
+	if (tab != ctx->iftab) free(tab);
 }
 
-static int lc_socket_bind_addr(lc_socket_t *sock, short port)
+/* join or part group sa on sock */
+static int lc_group_membership(lc_socket_t *sock, struct sockaddr_in6 *sa, int opt)
 {
-	int opt = 1;
-	struct sockaddr_in6 any = {
-		.sin6_family = AF_INET6,
-		.sin6_addr = IN6ADDR_ANY_INIT,
-		.sin6_port = port
-	};
+	lc_ctx_t *ctx = sock->ctx;
+	lc_iftab_t *tab = NULL;
+	int rc;
 
-	if ((setsockopt(sock->sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) == -1)
-		return LC_ERROR_SETSOCKOPT;
+	pthread_mutex_lock(&ctx->if_mtx);
+	if (!sock->ifx) tab = lc_ctx_iftab_get(ctx);
+	rc = lc_group_membership_tab(sock, sa, opt, tab);
+	lc_ctx_iftab_put(ctx, tab);
+	pthread_mutex_unlock(&ctx->if_mtx);
 
-#ifdef SO_REUSEPORT
-	if ((setsockopt(sock->sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) == -1)
-		return LC_ERROR_SETSOCKOPT;
-#endif
+	return rc;
+}
 
-	if (bind(sock->sock, (struct sockaddr *)&any, sizeof(struct sockaddr_in6)) == -1) {
-		/* ignore EINVAL "socket already bound" error */
-		if (errno != EINVAL) return LC_ERROR_SOCKET_BIND;
+/* join or part chan on sock, recording the result on chan if sock is its own,
+ * so the interface monitor can join interfaces as they appear.  Call with
+ * ctx->if_mtx held.  *tab is listed if needed, for lc_ctx_iftab_put() */
+static int lc_channel_membership(lc_channel_t *chan, lc_socket_t *sock, int opt, lc_iftab_t **tab)
+{
+	lc_srclist_t *src;
+	int rc;
+
+	if (sock == chan->sock && opt == IPV6_LEAVE_GROUP && chan->joined == LC_JOIN_QUEUED) {
+		/* not joined yet - skipped when its turn comes */
+		chan->joined = 0;
+		if (sock->ctx->joinq) lc_joinq_cancel(sock->ctx->joinq, chan);
+		return 0;
+	}
+	/* joined for some sources only - lc_channel_filter() switches */
+	if (sock == chan->sock && opt == IPV6_JOIN_GROUP && (src = lc_chan_src(chan))
+	&& src->mode == LC_FILTER_INCLUDE)
+		return LC_ERROR_SOURCE_FILTER;
+	/* the socket's membership may be shared - only count what chan holds */
+	if (sock == chan->sock && opt == IPV6_JOIN_GROUP && chan->joined == 1)
+		return LC_ERROR_MCAST_JOIN;
+	if (sock == chan->sock && opt == IPV6_LEAVE_GROUP && !chan->joined && !lc_chan_src(chan))
+		return LC_ERROR_MCAST_PART;
+	if (!sock->ifx && !*tab) *tab = lc_ctx_iftab_get(sock->ctx);
+	rc = lc_group_membership_tab(sock, &chan->sa, opt, *tab);
+	/* other sockets of a socket group aren't recorded */
+	if (!rc && sock == chan->sock) {
+		chan->joined = (opt == IPV6_JOIN_GROUP);
+		/* leaving the group drops its source filter too */
+		if (opt == IPV6_LEAVE_GROUP) lc_channel_src_clear(chan);
 	}
 
-	return 0;
+	return rc;
 }
 
-int lc_channel_bind(lc_socket_t *sock, lc_channel_t *chan)
+/* queue chan to join, if joins in ctx are paced.  Call with ctx->if_mtx held.
+ * Returns 1 if the join is to be done now */
+static int lc_channel_queue(lc_ctx_t *ctx, lc_channel_t *chan, int prio)
 {
-	/* Librecast sockets can have multiple channels bound to them, but we
-	 * only need to call lc_socket_bind_addr() the first time */
+	if (!ctx->joinq || chan->joined == 1) return 1;
+	if (chan->joined == LC_JOIN_QUEUED) return 0;
+	if (lc_joinq_push(ctx->joinq, chan, prio)) return LC_ERROR_MALLOC;
+	chan->joined = LC_JOIN_QUEUED;
+	return 0;
+}
 
-	int rc = (sock->bound) ? 0 : lc_socket_bind_addr(sock, chan->sa.sin6_port);
+static int lc_channel_sock_action(lc_socket_t *sock, lc_channel_t *chan, int opt)
+{
+	lc_iftab_t *tab = NULL;
+	int rc;
 
-	if (!rc) {
-		chan->sock = sock;
-		sock->bound++;
-	}
+	if(!sock) return LC_ERROR_SOCKET_REQUIRED;
+	pthread_mutex_lock(&sock->ctx->if_mtx);
+	rc = lc_channel_membership(chan, sock, opt, &tab);
+	lc_ctx_iftab_put(sock->ctx, tab);
+	pthread_mutex_unlock(&sock->ctx->if_mtx);
 
 	return rc;
 }
 
-static int lc_hashgroup(char *baseaddr, unsigned char *group, size_t len,
-		struct in6_addr *addr, unsigned int flags)
+int lc_channel_part(lc_channel_t *chan)
 {
-	unsigned char hashgrp[HASHSIZE];
-	hash_state state;
+	if (!chan) return LC_ERROR_CHANNEL_REQUIRED;
+	return lc_channel_sock_action(chan->sock, chan, IPV6_LEAVE_GROUP);
+}
 
-	hash_init(&state, NULL, 0, HASHSIZE);
-	hash_update(&state, (unsigned char *)group, len);
-	hash_update(&state, (unsigned char *)&flags, sizeof(flags));
-	hash_final(&state, hashgrp, HASHSIZE);
+int lc_channel_join_prio(lc_channel_t *chan, int prio)
+{
+	lc_socket_t *sock;
+	lc_iftab_t *tab = NULL;
+	int rc;
 
-	/* we have 112 bits (14 bytes) available for the group address
-	 * XOR the hashed group with the base multicast address */
-	if (inet_pton(AF_INET6, baseaddr, &addr->s6_addr) != 1)
-		return LC_ERROR_INVALID_BASEADDR;
-	for (int i = 2; i < 16; i++) {
-		addr->s6_addr[i] ^= hashgrp[i];
+	if (!chan) return LC_ERROR_CHANNEL_REQUIRED;
+	if (!(sock = chan->sock)) return LC_ERROR_SOCKET_REQUIRED;
+	pthread_mutex_lock(&sock->ctx->if_mtx);
+	if ((rc = lc_channel_queue(sock->ctx, chan, prio)) == 1)
+		rc = lc_channel_membership(chan, sock, IPV6_JOIN_GROUP, &tab);
+	lc_ctx_iftab_put(sock->ctx, tab);
+	pthread_mutex_unlock(&sock->ctx->if_mtx);
+
+	return rc;
+}
+
+int lc_channel_join(lc_channel_t *chan)
+{
+	return lc_channel_join_prio(chan, 0);
+}
+
+/* join or part n channels, finding interfaces once for all of them */
+static int lc_channel_action_many(lc_channel_t *chan[], size_t n, int rc[], int opt)
+{
+	lc_ctx_t *ctx = NULL;
+	lc_iftab_t *tab = NULL;
+	int err, ret = 0;
+
+	if (!chan && n) return LC_ERROR_INVALID_PARAMS;
+	for (size_t i = 0; i < n; i++) {
+		lc_socket_t *sock = (chan[i]) ? chan[i]->sock : NULL;
+		if (!chan[i]) err = LC_ERROR_CHANNEL_REQUIRED;
+		else if (!sock) err = LC_ERROR_SOCKET_REQUIRED;
+		else {
+			/* channels may be in different contexts - usually they aren't */
+			if (sock->ctx != ctx) {
+				if (ctx) {
+					lc_ctx_iftab_put(ctx, tab);
+					pthread_mutex_unlock(&ctx->if_mtx);
+				}
+				ctx = sock->ctx;
+				tab = NULL;
+				pthread_mutex_lock(&ctx->if_mtx);
+			}
+			if (opt != IPV6_JOIN_GROUP || (err = lc_channel_queue(ctx, chan[i], 0)) == 1)
+				err = lc_channel_membership(chan[i], sock, opt, &tab);
+		}
+		if (rc) rc[i] = err;
+		if (err && !ret) ret = err;
+	}
+	if (ctx) {
+		lc_ctx_iftab_put(ctx, tab);
+		pthread_mutex_unlock(&ctx->if_mtx);
 	}
 
-	return 0;
+	return ret;
 }
 
-static lc_channel_t * lc_channel_ins(lc_ctx_t *ctx, lc_channel_t *chan)
+int lc_channel_join_many(lc_channel_t *chan[], size_t n, int rc[])
 {
-	chan->next = ctx->chan_list;
-	ctx->chan_list = chan;
-	return chan;
+	return lc_channel_action_many(chan, n, rc, IPV6_JOIN_GROUP);
 }
 
-static inline void lc_channel_setid(lc_channel_t *chan)
+int lc_channel_part_many(lc_channel_t *chan[], size_t n, int rc[])
 {
-	chan->id = ++chan_id;
+	return lc_channel_action_many(chan, n, rc, IPV6_LEAVE_GROUP);
 }
 
-lc_channel_t * lc_channel_sidehash(lc_channel_t *base, unsigned char *key, size_t keylen)
+/* position of src in list, or where it would go.  Returns 1 if found */
+static int lc_srclist_find(const lc_srclist_t *list, const struct in6_addr *src, size_t *pos)
 {
-	struct in6_addr *in;
-	unsigned char *ptr;
-	lc_ctx_t *ctx = base->ctx;
-	lc_channel_t *side = lc_channel_copy(ctx, base);
-	if (!side) return NULL;
-	in = &side->sa.sin6_addr;
-	ptr = (unsigned char *)&in->s6_addr[2];
-	hash_generic_key(ptr, 14, (unsigned char *)in, sizeof(struct in6_addr), key, keylen);
-	return side;
+	size_t lo = 0, hi = (list) ? list->n : 0, mid;
+	int c;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		c = memcmp(&list->addr[mid], src, sizeof(struct in6_addr));
+		if (!c) {
+			*pos = mid;
+			return 1;
+		}
+		if (c < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	*pos = lo;
+	return 0;
 }
 
-lc_channel_t * lc_channel_sideband(lc_channel_t *base, uint64_t band)
+static int lc_srclist_add(lc_srclist_t **list, lc_filter_mode_t mode, const struct in6_addr *src)
 {
-	struct in6_addr *in;
-	uint64_t *ptr;
-	lc_ctx_t *ctx = base->ctx;
-	lc_channel_t *side = lc_channel_copy(ctx, base);
-	if (!side) return NULL;
-	in = &side->sa.sin6_addr;
-	ptr = (uint64_t *)&in->s6_addr[8];
-	*ptr = band;
-	return side;
+	lc_srclist_t *l = *list;
+	size_t pos, max;
+
+	if (lc_srclist_find(l, src, &pos)) return 0;
+	if (!l || l->n == l->max) {
+		max = (l) ? l->max * 2 : 4;
+		if (!(l = realloc(l, sizeof(lc_srclist_t) + max * sizeof(struct in6_addr)))) return -1;
+		if (!*list) l->n = 0;
+		l->max = max;
+		*list = l;
+	}
+	l->mode = mode;
+	memmove(&l->addr[pos + 1], &l->addr[pos], (l->n - pos) * sizeof(struct in6_addr));
+	l->addr[pos] = *src;
+	l->n++;
+	return 0;
 }
 
-lc_channel_t * lc_channel_copy(lc_ctx_t *ctx, lc_channel_t *chan)
+static void lc_srclist_del(lc_srclist_t **list, size_t pos)
 {
-	lc_channel_t *copy = calloc(1, sizeof(lc_channel_t));
-	if (!copy) return NULL;
-	copy->ctx = ctx;
-	lc_channel_setid(copy);
-	memcpy(&copy->sa, &chan->sa, sizeof(struct sockaddr_in6));
-	return lc_channel_ins(ctx, copy);
+	lc_srclist_t *l = *list;
+
+	l->n--;
+	memmove(&l->addr[pos], &l->addr[pos + 1], (l->n - pos) * sizeof(struct in6_addr));
+	if (!l->n) {
+		free(l);
+		*list = NULL;
+	}
 }
 
-lc_channel_t *lc_channel_init(lc_ctx_t *ctx, struct sockaddr_in6 *sa)
+static int lc_srclist_cmp(const void *a, const void *b)
 {
-	lc_channel_t *chan;
-	chan = calloc(1, sizeof(lc_channel_t));
-	if (!chan) return NULL;
-	chan->ctx = ctx;
-	lc_channel_setid(chan);
-	memcpy(&chan->sa, sa, sizeof(struct sockaddr_in6));
-	return lc_channel_ins(ctx, chan);
+	return memcmp(a, b, sizeof(struct in6_addr));
 }
 
-lc_channel_t * lc_channel_nnew(lc_ctx_t *ctx, unsigned char *s, size_t len)
+/* source option opt (MCAST_JOIN_SOURCE_GROUP etc.) for src and group sa on
+ * sock, on interfaces in tab if sock has none set.  Returns 0 if applied on
+ * any interface */
+static int lc_source_membership(lc_socket_t *sock, struct sockaddr_in6 *sa, int opt,
+		const struct in6_addr *src, const lc_iftab_t *tab)
 {
-	struct sockaddr_in6 sa = {
-		.sin6_family = AF_INET6,
-		.sin6_port = htons(LC_DEFAULT_PORT)
-	};
+	struct group_source_req req = {0};
+	struct sockaddr_in6 *grp = (struct sockaddr_in6 *)&req.gsr_group;
+	struct sockaddr_in6 *from = (struct sockaddr_in6 *)&req.gsr_source;
+	size_t n = (sock->ifx) ? 1 : (tab) ? tab->n : 0;
+	int s = lc_socket_group_fd(sock, &sa->sin6_addr);
+	int rc = -1;
 
-	if (lc_hashgroup(DEFAULT_ADDR, s, len, &sa.sin6_addr, 0))
-		return NULL;
+	grp->sin6_family = AF_INET6;
+	grp->sin6_addr = sa->sin6_addr;
+	from->sin6_family = AF_INET6;
+	from->sin6_addr = *src;
+	for (size_t i = 0; i < n; i++) {
+		req.gsr_interface = (sock->ifx) ? sock->ifx : tab->ifx[i];
+		if (!setsockopt(s, IPPROTO_IPV6, opt, &req, sizeof req)) rc = 0;
+	}
+	return rc;
+}
 
-	return lc_channel_init(ctx, &sa);
+/* set source filter list for grp on interface ifx of s, joining it first if
+ * not joined.  Replaces any filter set before */
+static int lc_source_filter_ifx(int s, unsigned int ifx, const struct in6_addr *grp,
+		const lc_srclist_t *list)
+{
+#ifdef MCAST_MSFILTER
+	struct group_source_req gsr = { .gsr_interface = ifx };
+	struct ipv6_mreq req = { .ipv6mr_multiaddr = *grp, .ipv6mr_interface = ifx };
+	struct group_filter *gf;
+	struct sockaddr_in6 *sa;
+	int rc;
+
+	if (!(gf = calloc(1, GROUP_FILTER_SIZE(list->n)))) return -1;
+	gf->gf_interface = ifx;
+	gf->gf_fmode = (list->mode == LC_FILTER_INCLUDE) ? MCAST_INCLUDE : MCAST_EXCLUDE;
+	gf->gf_numsrc = list->n;
+	sa = (struct sockaddr_in6 *)&gf->gf_group;
+	sa->sin6_family = AF_INET6;
+	sa->sin6_addr = *grp;
+	for (size_t i = 0; i < list->n; i++) {
+		sa = (struct sockaddr_in6 *)&gf->gf_slist[i];
+		sa->sin6_family = AF_INET6;
+		sa->sin6_addr = list->addr[i];
+	}
+	rc = setsockopt(s, IPPROTO_IPV6, MCAST_MSFILTER, gf, GROUP_FILTER_SIZE(list->n));
+	if (rc == -1 && errno == EINVAL) {
+		/* not joined - join in the mode we want, so there's no report for
+		 * all sources first, then try again */
+		if (list->mode == LC_FILTER_INCLUDE) {
+			sa = (struct sockaddr_in6 *)&gsr.gsr_group;
+			sa->sin6_family = AF_INET6;
+			sa->sin6_addr = *grp;
+			sa = (struct sockaddr_in6 *)&gsr.gsr_source;
+			sa->sin6_family = AF_INET6;
+			sa->sin6_addr = list->addr[0];
+			rc = setsockopt(s, IPPROTO_IPV6, MCAST_JOIN_SOURCE_GROUP, &gsr, sizeof gsr);
+		}
+		else rc = setsockopt(s, IPPROTO_IPV6, IPV6_JOIN_GROUP, &req, sizeof req);
+		if (!rc && (rc = setsockopt(s, IPPROTO_IPV6, MCAST_MSFILTER, gf,
+						GROUP_FILTER_SIZE(list->n))))
+			setsockopt(s, IPPROTO_IPV6, IPV6_LEAVE_GROUP, &req, sizeof req);
+	}
+	free(gf);
+	return rc;
+#else
+	(void)s; (void)ifx; (void)grp; (void)list;
+	errno = ENOSYS;
+	return -1;
+#endif
 }
 
-lc_channel_t * lc_channel_new(lc_ctx_t *ctx, char *s)
+/* does chan hold a reference to its group on its socket? */
+static inline int lc_channel_holds(lc_channel_t *chan)
 {
-	lc_channel_t *chan;
-	chan = lc_channel_nnew(ctx, (unsigned char *)s, strlen(s));
-	chan->uri = s;
-	return chan;
+	return chan->joined == 1 || lc_chan_src(chan);
 }
 
-lc_channel_t *lc_channel_random(lc_ctx_t *ctx)
+/* a source filter applies to the socket's membership of a group, so chan may
+ * only filter a group no other channel or range on its socket has joined */
+static int lc_channel_filter_shared(lc_socket_t *sock, lc_channel_t *chan)
 {
-	unsigned char buf[14];
-	if (lc_getrandom(buf, sizeof buf) != sizeof buf) return NULL;
-	return lc_channel_nnew(ctx, buf, sizeof buf);
+	return lc_grpset_get(sock->grps, &chan->sa.sin6_addr, NULL) > (uint32_t)lc_channel_holds(chan);
 }
 
-#ifndef IPV6_MULTICAST_ALL
-static int lc_socket_groups_free(lc_socket_t *sock)
+/* bring chan's reference on its socket's membership in step with its sources,
+ * after they change.  held is whether it had one before */
+static void lc_channel_filter_ref(lc_socket_t *sock, lc_channel_t *chan, int held)
 {
-	lc_grplist_t *tmp;
-	for (lc_grplist_t *g = sock->grps; g; ) {
-		tmp = g;
-		g = g->next;
-		free(tmp);
+	struct in6_addr *grp = &chan->sa.sin6_addr;
+	uint32_t val = 0;
+
+	lc_grpset_get(sock->grps, grp, &val);
+	val = (lc_chan_src(chan)) ? val | LC_GRP_FILTERED : val & ~LC_GRP_FILTERED;
+	lc_socket_grps_lock(sock);
+	if (!lc_channel_holds(chan)) {
+		if (held) lc_grpset_unref(sock->grps, grp);
 	}
-	return 0;
+	else if (!held) lc_grpset_ref(sock->grps, grp, val);
+	else lc_grpset_put(sock->grps, grp, val);
+	lc_socket_grps_unlock(sock);
 }
-#endif
 
-void lc_socket_close(lc_socket_t *sock)
+/* add or remove src with source option opt, keeping chan's source list to
+ * match */
+static int lc_channel_source(lc_channel_t *chan, const struct in6_addr *src, int opt)
 {
-	if (!sock) return;
-
-	lc_socket_listen_cancel(sock);
-#ifndef IPV6_MULTICAST_ALL
-	lc_socket_groups_free(sock);
-#endif
-
-	if (sock->sock) close(sock->sock);
-	lc_socket_t *prev = NULL;
-	for (lc_socket_t *p = sock->ctx->sock_list; p; p = p->next) {
-		if (p->id == sock->id) {
+	lc_socket_t *sock;
+	lc_channel_ext_t *ext;
+	lc_iftab_t *tab = NULL;
+	lc_filter_mode_t mode;
+	size_t pos;
+	int add, held, rc;
+
+	if (!chan) return LC_ERROR_CHANNEL_REQUIRED;
+	if (!src) return LC_ERROR_INVALID_PARAMS;
+	if (!(sock = chan->sock)) return LC_ERROR_SOCKET_REQUIRED;
+	if (sock->pkt) return LC_ERROR_INVALID_PARAMS;
+	add = (opt == MCAST_JOIN_SOURCE_GROUP || opt == MCAST_BLOCK_SOURCE);
+	mode = (opt == MCAST_JOIN_SOURCE_GROUP || opt == MCAST_LEAVE_SOURCE_GROUP)
+		? LC_FILTER_INCLUDE : LC_FILTER_EXCLUDE;
+
+	pthread_mutex_lock(&sock->ctx->if_mtx);
+	/* sources are joined without, and blocked with, an any source join */
+	if ((mode == LC_FILTER_INCLUDE) ? chan->joined != 0 : chan->joined != 1) {
+		rc = LC_ERROR_SOURCE_FILTER;
+		goto unlock;
+	}
+	if (lc_srclist_find(lc_chan_src(chan), src, &pos) == add) {
+		rc = (add) ? 0 : LC_ERROR_INVALID_PARAMS;
+		goto unlock;
+	}
+	if (lc_channel_filter_shared(sock, chan)) {
+		rc = LC_ERROR_SOURCE_FILTER;
+		goto unlock;
+	}
+	held = lc_channel_holds(chan);
+	/* removing, src was found, so chan has its cold part already */
+	if (!(ext = lc_channel_ext(chan)) || (add && lc_srclist_add(&ext->src, mode, src))) {
+		rc = LC_ERROR_MALLOC;
+		goto unlock;
+	}
+	if (!sock->ifx) tab = lc_ctx_iftab_get(sock->ctx);
+	rc = lc_source_membership(sock, &chan->sa, opt, src, tab);
+	lc_ctx_iftab_put(sock->ctx, tab);
+	if (add && rc) {
+		lc_srclist_find(ext->src, src, &pos);
+		lc_srclist_del(&ext->src, pos);
+	}
+	else if (!add) lc_srclist_del(&ext->src, pos);
+	lc_channel_filter_ref(sock, chan, held);
+	if (rc) rc = (add) ? LC_ERROR_MCAST_JOIN : LC_ERROR_MCAST_PART;
+unlock:
+	pthread_mutex_unlock(&sock->ctx->if_mtx);
+	return rc;
+}
+
+int lc_channel_join_source(lc_channel_t *chan, const struct in6_addr *src)
+{
+	return lc_channel_source(chan, src, MCAST_JOIN_SOURCE_GROUP);
+}
+
+int lc_channel_part_source(lc_channel_t *chan, const struct in6_addr *src)
+{
+	return lc_channel_source(chan, src, MCAST_LEAVE_SOURCE_GROUP);
+}
+
+int lc_channel_block_source(lc_channel_t *chan, const struct in6_addr *src)
+{
+	return lc_channel_source(chan, src, MCAST_BLOCK_SOURCE);
+}
+
+int lc_channel_unblock_source(lc_channel_t *chan, const struct in6_addr *src)
+{
+	return lc_channel_source(chan, src, MCAST_UNBLOCK_SOURCE);
+}
+
+int lc_channel_filter(lc_channel_t *chan, lc_filter_mode_t mode, const struct in6_addr src[],
+		size_t n)
+{
+	lc_socket_t *sock;
+	lc_channel_ext_t *ext;
+	lc_iftab_t *tab = NULL;
+	lc_srclist_t *list;
+	size_t nif;
+	int rc = LC_ERROR_MCAST_JOIN, held, s;
+
+	if (!chan) return LC_ERROR_CHANNEL_REQUIRED;
+	if ((n && !src) || (mode != LC_FILTER_INCLUDE && mode != LC_FILTER_EXCLUDE))
+		return LC_ERROR_INVALID_PARAMS;
+	if (!(sock = chan->sock)) return LC_ERROR_SOCKET_REQUIRED;
+	if (sock->pkt) return LC_ERROR_INVALID_PARAMS;
+	if (mode == LC_FILTER_INCLUDE && !n) return lc_channel_part(chan);
+	if (!(ext = lc_channel_ext(chan))) return LC_ERROR_MALLOC;
+
+	/* sorted, without duplicates */
+	if (!(list = malloc(sizeof(lc_srclist_t) + n * sizeof(struct in6_addr)))) return LC_ERROR_MALLOC;
+	list->mode = mode;
+	list->max = n;
+	list->n = 0;
+	if (n) {
+		memcpy(list->addr, src, n * sizeof(struct in6_addr));
+		qsort(list->addr, n, sizeof(struct in6_addr), &lc_srclist_cmp);
+		list->n = 1;
+		for (size_t i = 1; i < n; i++) {
+			if (memcmp(&list->addr[i], &list->addr[list->n - 1], sizeof(struct in6_addr)))
+				list->addr[list->n++] = list->addr[i];
+		}
+	}
+
+	pthread_mutex_lock(&sock->ctx->if_mtx);
+	if (lc_channel_filter_shared(sock, chan)) {
+		rc = LC_ERROR_SOURCE_FILTER;
+		goto unlock;
+	}
+	/* applied now - a paced join still queued is skipped */
+	if (chan->joined == LC_JOIN_QUEUED) {
+		chan->joined = 0;
+		if (sock->ctx->joinq) lc_joinq_cancel(sock->ctx->joinq, chan);
+	}
+	held = lc_channel_holds(chan);
+	if (!sock->ifx) tab = lc_ctx_iftab_get(sock->ctx);
+	nif = (sock->ifx) ? 1 : (tab) ? tab->n : 0;
+	s = lc_socket_group_fd(sock, &chan->sa.sin6_addr);
+	for (size_t i = 0; i < nif; i++) {
+		if (!lc_source_filter_ifx(s, (sock->ifx) ? sock->ifx : tab->ifx[i],
+					&chan->sa.sin6_addr, list))
+			rc = 0; /* report success if we joined anything */
+	}
+	lc_ctx_iftab_put(sock->ctx, tab);
+	if (!rc) {
+		chan->joined = (mode == LC_FILTER_EXCLUDE);
+		free(ext->src);
+		ext->src = (list->n) ? list : NULL;
+		lc_channel_filter_ref(sock, chan, held);
+	}
+unlock:
+	pthread_mutex_unlock(&sock->ctx->if_mtx);
+	if (rc || !list->n) free(list);
+
+	return rc;
+}
+
+/* chan moves off sock, which it is bound to, with ctx->if_mtx held.  Its
+ * membership goes, a queued join is cancelled and its source filter dropped,
+ * as when sock is closed, so it starts afresh on the next socket */
+static void lc_channel_leave(lc_channel_t *chan, lc_socket_t *sock)
+{
+	lc_iftab_t *tab = NULL;
+
+	if (chan->joined || lc_chan_src(chan)) {
+		lc_channel_membership(chan, sock, IPV6_LEAVE_GROUP, &tab);
+		lc_ctx_iftab_put(sock->ctx, tab);
+	}
+	chan->joined = 0;
+	lc_channel_src_clear(chan);
+	if (lc_chan_reorder(chan)) lc_socket_ordered_del(sock, chan);
+}
+
+int lc_channel_unbind(lc_channel_t *chan)
+{
+	lc_socket_t *sock;
+
+	/* locked, so chan leaves the socket it was bound to, not one it moves to */
+	pthread_mutex_lock(&chan->ctx->if_mtx);
+	if ((sock = lc_chan_sock(chan))) {
+		lc_channel_leave(chan, sock);
+		__atomic_store_n(&chan->sock, NULL, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&sock->bound, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&chan->ctx->if_mtx);
+	return 0;
+}
+
+static int lc_socket_bind_addr(lc_socket_t *sock, short port)
+{
+	int opt = 1;
+	struct sockaddr_in6 any = {
+		.sin6_family = AF_INET6,
+		.sin6_addr = IN6ADDR_ANY_INIT,
+		.sin6_port = port
+	};
+
+	if ((setsockopt(sock->sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) == -1)
+		return LC_ERROR_SETSOCKOPT;
+
+#ifdef SO_REUSEPORT
+	if ((setsockopt(sock->sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) == -1)
+		return LC_ERROR_SETSOCKOPT;
+#endif
+
+	if (bind(sock->sock, (struct sockaddr *)&any, sizeof(struct sockaddr_in6)) == -1) {
+		/* ignore EINVAL "socket already bound" error */
+		if (errno != EINVAL) return LC_ERROR_SOCKET_BIND;
+	}
+
+	return 0;
+}
+
+int lc_channel_listen(lc_channel_t *chan, lc_channel_fn_t *fn, void *arg)
+{
+	lc_channel_ext_t *ext;
+
+	if (!chan) return LC_ERROR_CHANNEL_REQUIRED;
+	if (chan->sock && lc_socket_listening(chan->sock)) return LC_ERROR_SOCKET_LISTENING;
+	if (!fn && !lc_chan_ext(chan)) return 0; /* no callback */
+	if (!(ext = lc_channel_ext(chan))) return LC_ERROR_MALLOC;
+	ext->arg = arg;
+	ext->fn = fn;
+	return 0;
+}
+
+int lc_channel_bind(lc_socket_t *sock, lc_channel_t *chan)
+{
+	/* Librecast sockets can have multiple channels bound to them, but we
+	 * only need to call lc_socket_bind_addr() the first time */
+
+	int rc = (__atomic_load_n(&sock->bound, __ATOMIC_RELAXED)) ? 0
+		: lc_socket_bind_addr(sock, chan->sa.sin6_port);
+	lc_socket_t *old;
+
+	if (rc) return rc;
+	/* locked, so a channel moved from another socket leaves it first */
+	pthread_mutex_lock(&chan->ctx->if_mtx);
+	if ((old = lc_chan_sock(chan)) && old != sock) lc_channel_leave(chan, old);
+	if (lc_chan_reorder(chan) && lc_socket_ordered_add(sock, chan)) rc = LC_ERROR_MALLOC;
+	if (!rc) {
+		__atomic_store_n(&chan->sock, sock, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&sock->bound, 1, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&chan->ctx->if_mtx);
+
+	return rc;
+}
+
+static void lc_hashgroup(const struct in6_addr *base, unsigned char *group, size_t len,
+		struct in6_addr *addr, unsigned int flags)
+{
+	unsigned char hashgrp[HASHSIZE];
+	hash_state state;
+
+	hash_init(&state, NULL, 0, HASHSIZE);
+	hash_update(&state, (unsigned char *)group, len);
+	hash_update(&state, (unsigned char *)&flags, sizeof(flags));
+	hash_final(&state, hashgrp, HASHSIZE);
+
+	/* we have 112 bits (14 bytes) available for the group address
+	 * XOR the hashed group with the base multicast address */
+	memcpy(addr, base, sizeof(struct in6_addr));
+	for (int i = 2; i < 16; i++) {
+		addr->s6_addr[i] ^= hashgrp[i];
+	}
+}
+
+static struct in6_addr default_base;
+static pthread_once_t default_base_once = PTHREAD_ONCE_INIT;
+
+static void lc_default_base_init(void)
+{
+	inet_pton(AF_INET6, DEFAULT_ADDR, &default_base);
+}
+
+/* DEFAULT_ADDR, parsed once */
+static const struct in6_addr *lc_default_base(void)
+{
+	pthread_once(&default_base_once, &lc_default_base_init);
+	return &default_base;
+}
+
+/* group address for channel name s, from the ctx intern table if there */
+static void lc_channel_addr(lc_ctx_t *ctx, unsigned char *s, size_t len, struct in6_addr *addr)
+{
+	if (ctx->intern && !lc_intern_get(ctx->intern, s, len, addr)) return;
+	lc_hashgroup(lc_default_base(), s, len, addr, 0);
+	if (ctx->intern) lc_intern_put(ctx->intern, s, len, addr);
+}
+
+/* link chain of channels first..last at the head of chan_list */
+static void lc_channel_link(lc_ctx_t *ctx, lc_channel_t *first, lc_channel_t *last)
+{
+	pthread_mutex_lock(&ctx->epoch.lock);
+	last->next = ctx->chan_list;
+	if (last->next) last->next->pprev = &last->next;
+	first->pprev = &ctx->chan_list;
+	/* publish - readers see the chain fully initialised, or not at all */
+	__atomic_store_n(&ctx->chan_list, first, __ATOMIC_RELEASE);
+	for (lc_channel_t *chan = first;; chan = chan->next) {
+		lc_chanhash_add(ctx, chan);
+		if (chan == last) break;
+	}
+	lc_epoch_unlock(&ctx->epoch);
+}
+
+static lc_channel_t * lc_channel_ins(lc_ctx_t *ctx, lc_channel_t *chan)
+{
+	lc_channel_link(ctx, chan, chan);
+	return chan;
+}
+
+static inline lc_channel_t *lc_channel_alloc(lc_ctx_t *ctx)
+{
+	lc_channel_t *chan = lc_slab_alloc(ctx->chan_slab);
+	if (chan) chan->ctx = ctx;
+	return chan;
+}
+
+static inline void lc_channel_setid(lc_channel_t *chan)
+{
+	chan->id = __atomic_add_fetch(&chan_id, 1, __ATOMIC_RELAXED);
+}
+
+/* copy of chan, not yet linked, so its address can still change */
+static lc_channel_t *lc_channel_dup(lc_ctx_t *ctx, lc_channel_t *chan)
+{
+	lc_channel_t *copy = lc_channel_alloc(ctx);
+	if (!copy) return NULL;
+	lc_channel_setid(copy);
+	memcpy(&copy->sa, &chan->sa, sizeof(struct sockaddr_in6));
+	return copy;
+}
+
+lc_channel_t * lc_channel_sidehash(lc_channel_t *base, unsigned char *key, size_t keylen)
+{
+	struct in6_addr *in;
+	unsigned char *ptr;
+	lc_ctx_t *ctx = base->ctx;
+	lc_channel_t *side = lc_channel_dup(ctx, base);
+	if (!side) return NULL;
+	in = &side->sa.sin6_addr;
+	ptr = (unsigned char *)&in->s6_addr[2];
+	hash_generic_key(ptr, 14, (unsigned char *)in, sizeof(struct in6_addr), key, keylen);
+	return lc_channel_ins(ctx, side);
+}
+
+lc_channel_t * lc_channel_sideband(lc_channel_t *base, uint64_t band)
+{
+	struct in6_addr *in;
+	uint64_t *ptr;
+	lc_ctx_t *ctx = base->ctx;
+	lc_channel_t *side = lc_channel_dup(ctx, base);
+	if (!side) return NULL;
+	in = &side->sa.sin6_addr;
+	ptr = (uint64_t *)&in->s6_addr[8];
+	*ptr = band;
+	return lc_channel_ins(ctx, side);
+}
+
+lc_channel_t * lc_channel_copy(lc_ctx_t *ctx, lc_channel_t *chan)
+{
+	lc_channel_t *copy = lc_channel_dup(ctx, chan);
+	if (!copy) return NULL;
+	return lc_channel_ins(ctx, copy);
+}
+
+static void lc_range_destroy(lc_epoch_node_t *node)
+{
+	lc_range_t *range = (lc_range_t *)((char *)node - offsetof(lc_range_t, retired));
+	lc_bandset_free(range->joined);
+	pthread_mutex_destroy(&range->mtx);
+	free(range);
+}
+
+static void lc_range_part_band(uint64_t band, void *arg)
+{
+	lc_range_t *range = arg;
+	struct sockaddr_in6 sa = range->sa;
+	lc_addr_setband(&sa.sin6_addr, band);
+	lc_group_membership(range->sock, &sa, IPV6_LEAVE_GROUP);
+}
+
+void lc_range_free(lc_range_t *range)
+{
+	lc_socket_t *sock;
+	lc_epoch_t *ep;
+
+	if (!range) return;
+	pthread_mutex_lock(&range->mtx);
+	if (range->sock) lc_bandset_each(range->joined, &lc_range_part_band, range);
+	if ((sock = __atomic_exchange_n(&range->sock, NULL, __ATOMIC_ACQ_REL)))
+		__atomic_sub_fetch(&sock->bound, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&range->mtx);
+	ep = &range->ctx->epoch;
+	pthread_mutex_lock(&ep->lock);
+	if (range->pprev) {
+		__atomic_store_n(range->pprev, range->next, __ATOMIC_RELEASE);
+		if (range->next) range->next->pprev = range->pprev;
+		range->pprev = NULL;
+		lc_epoch_retire(ep, &range->retired, &lc_range_destroy);
+	}
+	lc_epoch_unlock(ep);
+}
+
+lc_range_t *lc_range_new(lc_channel_t *base)
+{
+	lc_range_t *range;
+	lc_ctx_t *ctx;
+
+	if (!base) return NULL;
+	ctx = base->ctx;
+	if (!(range = calloc(1, sizeof(lc_range_t)))) return NULL;
+	if (!(range->joined = lc_bandset_new())) {
+		free(range);
+		return NULL;
+	}
+	pthread_mutex_init(&range->mtx, NULL);
+	range->ctx = ctx;
+	range->sa = base->sa;
+	lc_addr_setband(&range->sa.sin6_addr, 0);
+	pthread_mutex_lock(&ctx->epoch.lock);
+	range->next = ctx->range_list;
+	if (range->next) range->next->pprev = &range->next;
+	range->pprev = &ctx->range_list;
+	__atomic_store_n(&ctx->range_list, range, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&ctx->epoch.lock);
+	return range;
+}
+
+int lc_range_bind(lc_socket_t *sock, lc_range_t *range)
+{
+	lc_socket_t *old;
+	int rc;
+
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (!range) return LC_ERROR_INVALID_PARAMS;
+	rc = (__atomic_load_n(&sock->bound, __ATOMIC_RELAXED)) ? 0
+		: lc_socket_bind_addr(sock, range->sa.sin6_port);
+	if (rc) return rc;
+	/* rebinding moves the range, counted once on the socket it's on */
+	old = __atomic_exchange_n(&range->sock, sock, __ATOMIC_ACQ_REL);
+	if (old == sock) return 0;
+	if (old) __atomic_sub_fetch(&old->bound, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&sock->bound, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int lc_range_join(lc_range_t *range, uint64_t band)
+{
+	struct sockaddr_in6 sa;
+	int rc;
+
+	if (!range) return LC_ERROR_INVALID_PARAMS;
+	sa = range->sa;
+	lc_addr_setband(&sa.sin6_addr, band);
+	pthread_mutex_lock(&range->mtx);
+	/* under the lock - lc_socket_close() detaches the range */
+	if (!range->sock) rc = LC_ERROR_SOCKET_REQUIRED;
+	else if ((rc = lc_bandset_add(range->joined, band)) == -1) rc = LC_ERROR_MALLOC;
+	else if (rc == 1) rc = 0; /* already joined */
+	else if ((rc = lc_group_membership(range->sock, &sa, IPV6_JOIN_GROUP))) {
+		lc_bandset_del(range->joined, band);
+	}
+	pthread_mutex_unlock(&range->mtx);
+	return rc;
+}
+
+int lc_range_part(lc_range_t *range, uint64_t band)
+{
+	struct sockaddr_in6 sa;
+	int rc = LC_ERROR_MCAST_PART;
+
+	if (!range) return LC_ERROR_INVALID_PARAMS;
+	sa = range->sa;
+	lc_addr_setband(&sa.sin6_addr, band);
+	pthread_mutex_lock(&range->mtx);
+	if (!range->sock) rc = LC_ERROR_SOCKET_REQUIRED;
+	else if (!lc_bandset_del(range->joined, band)) {
+		rc = lc_group_membership(range->sock, &sa, IPV6_LEAVE_GROUP);
+	}
+	pthread_mutex_unlock(&range->mtx);
+	return rc;
+}
+
+size_t lc_range_joined(lc_range_t *range)
+{
+	size_t n;
+
+	pthread_mutex_lock(&range->mtx);
+	n = lc_bandset_count(range->joined);
+	pthread_mutex_unlock(&range->mtx);
+	return n;
+}
+
+size_t lc_range_bytes(lc_range_t *range)
+{
+	size_t n;
+
+	pthread_mutex_lock(&range->mtx);
+	n = sizeof(lc_range_t) + lc_bandset_bytes(range->joined);
+	pthread_mutex_unlock(&range->mtx);
+	return n;
+}
+
+/* the listener reads fn, arg and table without locks, so they change only
+ * while it isn't running */
+static inline int lc_range_listening(lc_range_t *range)
+{
+	lc_socket_t *sock = __atomic_load_n(&range->sock, __ATOMIC_ACQUIRE);
+	return sock && lc_socket_listening(sock);
+}
+
+int lc_range_listen(lc_range_t *range, lc_range_fn_t *fn, void *arg)
+{
+	if (!range) return LC_ERROR_INVALID_PARAMS;
+	if (lc_range_listening(range)) return LC_ERROR_SOCKET_LISTENING;
+	range->arg = arg;
+	range->fn = fn;
+	return 0;
+}
+
+int lc_range_table(lc_range_t *range, void *table[], size_t n)
+{
+	if (!range || (n && !table)) return LC_ERROR_INVALID_PARAMS;
+	if (lc_range_listening(range)) return LC_ERROR_SOCKET_LISTENING;
+	range->table = table;
+	range->n = n;
+	return 0;
+}
+
+void lc_range_addr(lc_range_t *range, uint64_t band, struct in6_addr *addr)
+{
+	memcpy(addr, &range->sa.sin6_addr, sizeof(struct in6_addr));
+	lc_addr_setband(addr, band);
+}
+
+ssize_t lc_range_send(lc_range_t *range, uint64_t band, const void *buf, size_t len, int flags)
+{
+	struct sockaddr_in6 sa = range->sa;
+	lc_addr_setband(&sa.sin6_addr, band);
+	return lc_socket_sendto(range->sock, &sa, buf, len, flags);
+}
+
+ssize_t lc_range_msg_send(lc_range_t *range, uint64_t band, lc_message_t *msg)
+{
+	struct sockaddr_in6 sa = range->sa;
+	lc_addr_setband(&sa.sin6_addr, band);
+	return lc_msg_sendto_seq(range->sock, &sa, &range->seq, msg, NULL, 0);
+}
+
+uint32_t lc_topic_tag(const char *topic)
+{
+	return lc_topic_hash((const unsigned char *)topic, strlen(topic));
+}
+
+/* multiply-shift: tags spread evenly over any number of shards */
+static inline unsigned int lc_topics_shard_tag(lc_topics_t *t, uint32_t tag)
+{
+	return (unsigned int)(((uint64_t)tag * t->shards) >> 32);
+}
+
+unsigned int lc_topics_shard(lc_topics_t *t, const char *topic)
+{
+	return lc_topics_shard_tag(t, lc_topic_tag(topic));
+}
+
+static void lc_topic_set_destroy(lc_epoch_node_t *node)
+{
+	free((char *)node - offsetof(lc_topic_set_t, retired));
+}
+
+/* keep the kernel filter in step with the subscriptions. Sockets with a
+ * fanout filter already, and packet sockets, filter in userspace only */
+static void lc_topics_filter_set(lc_topics_t *t)
+{
+	lc_socket_t *sock = t->sock;
+
+	if (!sock || sock->pkt || sock->fanout) return;
+	if (t->filter && !lc_topic_filter(sock->sock, t->set->tag, t->set->n)) {
+		t->filtered = 1;
+	}
+	else if (t->filtered) {
+		lc_topic_filter_detach(sock->sock);
+		t->filtered = 0;
+	}
+}
+
+/* publish subscriptions to listeners and the kernel. Call with t->mtx held */
+static int lc_topics_update(lc_topics_t *t)
+{
+	lc_epoch_t *ep = &t->ctx->epoch;
+	lc_topic_set_t *set, *old;
+
+	if (!(set = lc_topic_set_new(t->subs))) return LC_ERROR_MALLOC;
+	pthread_mutex_lock(&ep->lock);
+	old = t->set;
+	__atomic_store_n(&t->set, set, __ATOMIC_RELEASE);
+	lc_epoch_retire(ep, &old->retired, &lc_topic_set_destroy);
+	lc_epoch_unlock(ep);
+	lc_topics_filter_set(t);
+	return 0;
+}
+
+int lc_topics_subscribe(lc_topics_t *t, const char *topic)
+{
+	uint32_t tag;
+	unsigned int shard;
+	int rc;
+
+	if (!t || !topic) return LC_ERROR_INVALID_PARAMS;
+	if (!t->sock) return LC_ERROR_SOCKET_REQUIRED;
+	tag = lc_topic_tag(topic);
+	shard = lc_topics_shard_tag(t, tag);
+	pthread_mutex_lock(&t->mtx);
+	rc = lc_topic_subs_add(t->subs, tag);
+	if (rc == -1) {
+		rc = LC_ERROR_MALLOC;
+		goto out;
+	}
+	if (rc == 0) goto out; /* subscribed already */
+	if ((rc = lc_topics_update(t))) goto err_0;
+	if (!t->shard_refs[shard]++) {
+		/* first topic on this shard */
+		if ((rc = lc_range_join(t->range, shard))) {
+			t->shard_refs[shard]--;
+			goto err_0;
+		}
+		t->joined++;
+	}
+out:
+	pthread_mutex_unlock(&t->mtx);
+	return rc;
+err_0:
+	lc_topic_subs_del(t->subs, tag);
+	lc_topics_update(t);
+	pthread_mutex_unlock(&t->mtx);
+	return rc;
+}
+
+int lc_topics_unsubscribe(lc_topics_t *t, const char *topic)
+{
+	uint32_t tag;
+	unsigned int shard;
+	int rc;
+
+	if (!t || !topic) return LC_ERROR_INVALID_PARAMS;
+	tag = lc_topic_tag(topic);
+	shard = lc_topics_shard_tag(t, tag);
+	pthread_mutex_lock(&t->mtx);
+	rc = lc_topic_subs_del(t->subs, tag);
+	if (rc == -1) rc = LC_ERROR_INVALID_PARAMS;
+	else if (rc == 1) {
+		rc = lc_topics_update(t);
+		if (!--t->shard_refs[shard]) {
+			/* last topic on this shard */
+			lc_range_part(t->range, shard);
+			t->joined--;
+		}
+	}
+	pthread_mutex_unlock(&t->mtx);
+	return rc;
+}
+
+int lc_topics_filter(lc_topics_t *t, int enable)
+{
+	if (!t) return LC_ERROR_INVALID_PARAMS;
+	pthread_mutex_lock(&t->mtx);
+	t->filter = !!enable;
+	lc_topics_filter_set(t);
+	pthread_mutex_unlock(&t->mtx);
+	return 0;
+}
+
+int lc_topics_stats(lc_topics_t *t, lc_topic_stats_t *stats)
+{
+	if (!t || !stats) return LC_ERROR_INVALID_PARAMS;
+	pthread_mutex_lock(&t->mtx);
+	stats->shards = t->shards;
+	stats->joined = t->joined;
+	stats->topics = lc_topic_subs_count(t->subs);
+	stats->filter = t->filtered;
+	pthread_mutex_unlock(&t->mtx);
+	stats->msgs = __atomic_load_n(&t->msgs, __ATOMIC_RELAXED);
+	stats->wasted = __atomic_load_n(&t->wasted, __ATOMIC_RELAXED);
+	return 0;
+}
+
+double lc_topics_waste(unsigned int shards, size_t topics, size_t subscribed)
+{
+	double miss = 1.0, p, joined;
+
+	if (!shards || !topics || !subscribed) return 0.0;
+	if (subscribed > topics) subscribed = topics;
+	/* chance a shard has none of our topics: (1 - 1/shards)^subscribed */
+	p = 1.0 - 1.0 / shards;
+	for (size_t k = subscribed; k; k >>= 1, p *= p) {
+		if (k & 1) miss *= p;
+	}
+	joined = shards * (1.0 - miss);
+	/* topics arriving on the shards joined, of which we want subscribed */
+	return 1.0 - subscribed / (topics * joined / shards);
+}
+
+ssize_t lc_topics_send(lc_topics_t *t, const char *topic, const void *buf, size_t len)
+{
+	lc_message_t msg = { .op = LC_OP_TOPIC, .data = (void *)buf, .len = len };
+	struct sockaddr_in6 sa;
+	uint32_t tag;
+
+	if (!t || !topic) return LC_ERROR_INVALID_PARAMS;
+	tag = lc_topic_tag(topic);
+	sa = t->range->sa;
+	lc_addr_setband(&sa.sin6_addr, lc_topics_shard_tag(t, tag));
+	tag = htonl(tag);
+	return lc_msg_sendto_seq(t->range->sock, &sa, &t->range->seq, &msg, &tag, sizeof tag);
+}
+
+int lc_topics_bind(lc_socket_t *sock, lc_topics_t *t)
+{
+	lc_topics_t *none = NULL;
+	int rc;
+
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (!t || t->sock) return LC_ERROR_INVALID_PARAMS;
+	/* one topic space per socket - it has the socket's kernel filter */
+	if (!__atomic_compare_exchange_n(&sock->topics, &none, t, 0,
+				__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		return LC_ERROR_INVALID_PARAMS;
+	if ((rc = lc_range_bind(sock, t->range))) {
+		__atomic_store_n(&sock->topics, NULL, __ATOMIC_RELEASE);
+		return rc;
+	}
+	pthread_mutex_lock(&t->mtx);
+	t->sock = sock;
+	lc_topics_filter_set(t);
+	pthread_mutex_unlock(&t->mtx);
+	return 0;
+}
+
+static void lc_topics_destroy(lc_epoch_node_t *node)
+{
+	lc_topics_t *t = (lc_topics_t *)((char *)node - offsetof(lc_topics_t, retired));
+	free(t->set);
+	lc_topic_subs_free(t->subs);
+	free(t->shard_refs);
+	pthread_mutex_destroy(&t->mtx);
+	free(t);
+}
+
+void lc_topics_free(lc_topics_t *t)
+{
+	lc_epoch_t *ep;
+	lc_topics_t *self = t;
+
+	if (!t) return;
+	if (t->sock) {
+		__atomic_compare_exchange_n(&t->sock->topics, &self, NULL, 0,
+				__ATOMIC_RELEASE, __ATOMIC_RELAXED);
+		if (t->filtered) lc_topic_filter_detach(t->sock->sock);
+	}
+	lc_range_free(t->range); /* parts the shards joined */
+	ep = &t->ctx->epoch;
+	pthread_mutex_lock(&ep->lock);
+	if (t->pprev) {
+		__atomic_store_n(t->pprev, t->next, __ATOMIC_RELEASE);
+		if (t->next) t->next->pprev = t->pprev;
+		t->pprev = NULL;
+		lc_epoch_retire(ep, &t->retired, &lc_topics_destroy);
+	}
+	lc_epoch_unlock(ep);
+}
+
+lc_topics_t *lc_topics_new(lc_channel_t *base, unsigned int shards)
+{
+	lc_topics_t *t;
+	lc_ctx_t *ctx;
+
+	if (!base || !shards) return NULL;
+	ctx = base->ctx;
+	if (!(t = calloc(1, sizeof(lc_topics_t)))) return NULL;
+	t->ctx = ctx;
+	t->shards = shards;
+	t->filter = 1;
+	t->shard_refs = calloc(shards, sizeof(unsigned int));
+	t->subs = lc_topic_subs_new();
+	if (!t->shard_refs || !t->subs || !(t->set = lc_topic_set_new(t->subs))) goto err_0;
+	if (!(t->range = lc_range_new(base))) goto err_0;
+	pthread_mutex_init(&t->mtx, NULL);
+	pthread_mutex_lock(&ctx->epoch.lock);
+	t->next = ctx->topics_list;
+	if (t->next) t->next->pprev = &t->next;
+	t->pprev = &ctx->topics_list;
+	__atomic_store_n(&ctx->topics_list, t, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&ctx->epoch.lock);
+	return t;
+err_0:
+	free(t->set);
+	lc_topic_subs_free(t->subs);
+	free(t->shard_refs);
+	free(t);
+	return NULL;
+}
+
+lc_channel_t *lc_channel_init(lc_ctx_t *ctx, struct sockaddr_in6 *sa)
+{
+	lc_channel_t *chan;
+	chan = lc_channel_alloc(ctx);
+	if (!chan) return NULL;
+	lc_channel_setid(chan);
+	memcpy(&chan->sa, sa, sizeof(struct sockaddr_in6));
+	return lc_channel_ins(ctx, chan);
+}
+
+static lc_channel_t *lc_channel_named(lc_ctx_t *ctx, unsigned char *s, size_t len, char *uri)
+{
+	lc_channel_t *chan;
+
+	chan = lc_channel_alloc(ctx);
+	if (!chan) return NULL;
+	chan->uri = uri; /* before the channel is published */
+	lc_channel_setid(chan);
+	chan->sa.sin6_family = AF_INET6;
+	chan->sa.sin6_port = htons(LC_DEFAULT_PORT);
+	lc_channel_addr(ctx, s, len, &chan->sa.sin6_addr);
+	return lc_channel_ins(ctx, chan);
+}
+
+lc_channel_t * lc_channel_nnew(lc_ctx_t *ctx, unsigned char *s, size_t len)
+{
+	return lc_channel_named(ctx, s, len, NULL);
+}
+
+lc_channel_t * lc_channel_new(lc_ctx_t *ctx, char *s)
+{
+	return lc_channel_named(ctx, (unsigned char *)s, strlen(s), s);
+}
+
+int lc_channel_new_many(lc_ctx_t *ctx, char *names[], size_t n, lc_channel_t *out[])
+{
+	lc_channel_t *chan;
+	uint32_t id;
+
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	if (!n) return 0;
+	if (!names || !out || n > UINT32_MAX) return LC_ERROR_INVALID_PARAMS;
+	for (size_t i = 0; i < n; i++) if (!names[i]) return LC_ERROR_INVALID_PARAMS;
+	if (!(chan = lc_slab_alloc_many(ctx->chan_slab, n))) return LC_ERROR_MALLOC;
+	id = __atomic_add_fetch(&chan_id, (uint32_t)n, __ATOMIC_RELAXED) - (uint32_t)n;
+	for (size_t i = 0; i < n; i++) {
+		chan[i].ctx = ctx;
+		chan[i].uri = names[i];
+		chan[i].id = ++id;
+		chan[i].sa.sin6_family = AF_INET6;
+		chan[i].sa.sin6_port = htons(LC_DEFAULT_PORT);
+		lc_channel_addr(ctx, (unsigned char *)names[i], strlen(names[i]), &chan[i].sa.sin6_addr);
+		if (i) {
+			chan[i - 1].next = &chan[i];
+			chan[i].pprev = &chan[i - 1].next;
+		}
+		out[i] = &chan[i];
+	}
+	/* link the lot in one go */
+	lc_channel_link(ctx, &chan[0], &chan[n - 1]);
+	return 0;
+}
+
+lc_channel_t *lc_channel_random(lc_ctx_t *ctx)
+{
+	struct sockaddr_in6 sa = {
+		.sin6_family = AF_INET6,
+		.sin6_port = htons(LC_DEFAULT_PORT)
+	};
+	unsigned char buf[14];
+
+	/* not interned - never asked for by name again */
+	if (lc_getrandom(buf, sizeof buf) != sizeof buf) return NULL;
+	lc_hashgroup(lc_default_base(), buf, sizeof buf, &sa.sin6_addr, 0);
+	return lc_channel_init(ctx, &sa);
+}
+
+static void lc_socket_destroy(lc_epoch_node_t *node)
+{
+	lc_socket_t *sock = (lc_socket_t *)((char *)node - offsetof(lc_socket_t, retired));
+#ifndef IPV6_MULTICAST_ALL
+	pthread_rwlock_destroy(&sock->grplock);
+#endif
+	lc_pool_pending_destroy(&sock->pending);
+	lc_grpset_free(sock->grps);
+	free(sock->sendtab);
+	lc_chanvec_free(sock->ordered);
+	lc_slab_release(sock->ctx->sock_slab, sock);
+}
+
+/* mark sock closing, so the interface monitor passes it by, and detach the
+ * topic space, ranges and channels bound to it, before anything they would
+ * reach is freed.  Memberships go with the socket */
+static void lc_socket_detach(lc_socket_t *sock)
+{
+	lc_ctx_t *ctx = sock->ctx;
+	lc_topics_t *t;
+	lc_bandset_t *none;
+	lc_socket_t *self;
+	int e;
+
+	e = lc_epoch_enter(&ctx->epoch);
+	if ((t = __atomic_exchange_n(&sock->topics, NULL, __ATOMIC_ACQ_REL))) {
+		pthread_mutex_lock(&t->mtx);
+		t->sock = NULL;
+		t->filtered = 0;
+		pthread_mutex_unlock(&t->mtx);
+	}
+	for (lc_range_t *r = __atomic_load_n(&ctx->range_list, __ATOMIC_ACQUIRE); r;
+			r = __atomic_load_n(&r->next, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&r->mtx);
+		if (r->sock == sock) {
+			__atomic_store_n(&r->sock, NULL, __ATOMIC_RELEASE);
+			if ((none = lc_bandset_new())) {
+				lc_bandset_free(r->joined);
+				r->joined = none;
+			}
+		}
+		pthread_mutex_unlock(&r->mtx);
+	}
+	pthread_mutex_lock(&ctx->if_mtx);
+	sock->closing = 1;
+	for (lc_channel_t *chan = lc_chan_first(ctx); chan; chan = lc_chan_next(chan)) {
+		/* only touch our own channels - others may be in use elsewhere */
+		if (lc_chan_sock(chan) != sock) continue;
+		self = sock;
+		/* lc_channel_unbind() may race us - one of us detaches */
+		if (!__atomic_compare_exchange_n(&chan->sock, &self, NULL, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			continue;
+		if (chan->joined == LC_JOIN_QUEUED && ctx->joinq) lc_joinq_cancel(ctx->joinq, chan);
+		chan->joined = 0;
+		lc_channel_src_clear(chan);
+	}
+	pthread_mutex_unlock(&ctx->if_mtx);
+	lc_epoch_exit(&ctx->epoch, e);
+}
+
+void lc_socket_close(lc_socket_t *sock)
+{
+	lc_epoch_t *ep;
+
+	if (!sock) return;
+
+	lc_socket_listen_cancel(sock);
+	lc_socket_detach(sock);
+	lc_dedup_free(sock->dedup);
+	lc_senders_free(sock->senders);
+	lc_packet_free(sock->pkt);
+	free(sock->attr);
+	lc_spill_free(sock->spill);
+
+	if (sock->sock) close(sock->sock);
+	ep = &sock->ctx->epoch;
+	pthread_mutex_lock(&ep->lock);
+	if (sock->pprev) {
+		__atomic_store_n(sock->pprev, sock->next, __ATOMIC_RELEASE);
+		if (sock->next) sock->next->pprev = sock->pprev;
+		sock->pprev = NULL;
+		lc_epoch_retire(ep, &sock->retired, &lc_socket_destroy);
+	}
+	lc_epoch_unlock(ep);
+}
+
+/* return the i-th CPU (modulo CPUs available) we are allowed to run on */
+static int lc_socket_group_cpu(int i)
+{
+#ifdef __linux__
+	cpu_set_t cpus;
+	int n;
+
+	if (sched_getaffinity(0, sizeof cpus, &cpus) || !(n = CPU_COUNT(&cpus))) return -1;
+	i %= n;
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &cpus) && !i--) return cpu;
+	}
+#endif
+	(void)i;
+	return -1;
+}
+
+lc_socket_group_t *lc_socket_group_new(lc_ctx_t *ctx, int n, lc_fanout_t mode)
+{
+	lc_socket_group_t *grp;
+	int err, cpu;
+
+	if (!ctx || n <= 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!(grp = calloc(1, sizeof(lc_socket_group_t)))) return NULL;
+	if (!(grp->sock = calloc(n, sizeof(lc_socket_t *)))) goto err_0;
+	grp->ctx = ctx;
+	grp->mode = mode;
+	for (int i = 0; i < n; i++) {
+		if (!(grp->sock[i] = lc_socket_new(ctx))) goto err_1;
+		grp->n++;
+		if (lc_fanout_filter(grp->sock[i]->sock, mode, n, i)) goto err_1;
+		grp->sock[i]->fanout = 1;
+		if ((cpu = lc_socket_group_cpu(i)) >= 0) {
+			lc_thread_attr_t attr;
+			if (ctx->attr) memcpy(&attr, ctx->attr, sizeof attr);
+			else lc_thread_attr_init(&attr);
+			memset(attr.cpus, 0, sizeof attr.cpus);
+			lc_thread_attr_setcpu(&attr, cpu);
+			if (lc_socket_thread_attr(grp->sock[i], &attr)) goto err_1;
+		}
+	}
+	grp->next = ctx->group_list;
+	ctx->group_list = grp;
+	return grp;
+err_1:
+	err = errno;
+	for (int i = 0; i < grp->n; i++) lc_socket_close(grp->sock[i]);
+	free(grp->sock);
+	errno = err;
+err_0:
+	err = errno;
+	free(grp);
+	errno = err;
+	return NULL;
+}
+
+void lc_socket_group_free(lc_socket_group_t *grp)
+{
+	lc_socket_group_t *prev = NULL;
+
+	if (!grp) return;
+	for (lc_socket_group_t *p = grp->ctx->group_list; p; p = p->next) {
+		if (p == grp) {
 			if (prev) prev->next = p->next;
-			else sock->ctx->sock_list = p->next;
+			else grp->ctx->group_list = p->next;
+			break;
 		}
 		prev = p;
 	}
-	free(sock);
+	for (int i = 0; i < grp->n; i++) lc_socket_close(grp->sock[i]);
+	free(grp->sock);
+	free(grp);
+}
+
+lc_socket_t *lc_socket_group_socket(lc_socket_group_t *grp, int i)
+{
+	if (!grp || i < 0 || i >= grp->n) return NULL;
+	return grp->sock[i];
+}
+
+int lc_socket_group_bind(lc_socket_group_t *grp, lc_channel_t *chan)
+{
+	int rc;
+
+	if (!grp) return LC_ERROR_SOCKET_REQUIRED;
+	if (!chan) return LC_ERROR_CHANNEL_REQUIRED;
+	/* the reorder buffer belongs to the channel, not the socket */
+	if (lc_chan_reorder(chan)) return LC_ERROR_INVALID_PARAMS;
+	for (int i = 1; i < grp->n; i++) {
+		lc_socket_t *sock = grp->sock[i];
+		if (!__atomic_load_n(&sock->bound, __ATOMIC_RELAXED)
+		&& (rc = lc_socket_bind_addr(sock, chan->sa.sin6_port)))
+			return rc;
+		__atomic_add_fetch(&sock->bound, 1, __ATOMIC_RELAXED);
+	}
+	return lc_channel_bind(grp->sock[0], chan);
+}
+
+static int lc_socket_group_action(lc_socket_group_t *grp, lc_channel_t *chan, int opt)
+{
+	int rc = 0, err;
+
+	if (!grp) return LC_ERROR_SOCKET_REQUIRED;
+	if (!chan) return LC_ERROR_CHANNEL_REQUIRED;
+	for (int i = 0; i < grp->n; i++) {
+		if ((err = lc_channel_sock_action(grp->sock[i], chan, opt))) rc = err;
+	}
+	return rc;
+}
+
+int lc_socket_group_join(lc_socket_group_t *grp, lc_channel_t *chan)
+{
+	return lc_socket_group_action(grp, chan, IPV6_JOIN_GROUP);
+}
+
+int lc_socket_group_part(lc_socket_group_t *grp, lc_channel_t *chan)
+{
+	return lc_socket_group_action(grp, chan, IPV6_LEAVE_GROUP);
+}
+
+int lc_socket_group_listen(lc_socket_group_t *grp, void (*callback_msg)(lc_message_t*),
+		void (*callback_err)(int))
+{
+	int rc;
+
+	if (!grp) return LC_ERROR_SOCKET_REQUIRED;
+	for (int i = 0; i < grp->n; i++) {
+		if ((rc = lc_socket_listen(grp->sock[i], callback_msg, callback_err))) {
+			while (i--) lc_socket_listen_cancel(grp->sock[i]);
+			return rc;
+		}
+	}
+	return 0;
+}
+
+int lc_socket_group_listen_cancel(lc_socket_group_t *grp)
+{
+	if (!grp) return LC_ERROR_SOCKET_REQUIRED;
+	for (int i = 0; i < grp->n; i++) lc_socket_listen_cancel(grp->sock[i]);
+	return 0;
 }
 
 void lc_ctx_free(lc_ctx_t *ctx)
 {
 	if (ctx) {
 		void *p, *h;
+		lc_joinq_t *q;
+		lc_ctx_ifmonitor(ctx, 0);
+		/* off ctx before it's freed, so closing sockets don't cancel
+		 * their queued joins on it */
+		pthread_mutex_lock(&ctx->if_mtx);
+		q = ctx->joinq;
+		ctx->joinq = NULL;
+		pthread_mutex_unlock(&ctx->if_mtx);
+		lc_joinq_free(q);
+		if (ctx->loop) lc_loop_stop(ctx->loop);
+		while (ctx->group_list) lc_socket_group_free(ctx->group_list);
 		p = ctx->sock_list;
 		while (p) {
 			h = p;
 			p = ((lc_socket_t *)p)->next;
 			lc_socket_close(h);
 		}
-		p = ctx->chan_list;
-		while (p) {
-			h = p;
-			p = ((lc_channel_t *)p)->next;
-			lc_channel_free(h);
-		}
 		if (ctx->sock >= 0) close(ctx->sock);
+		lc_loop_free(ctx->loop);
+		lc_pool_free(ctx->pool);
+		/* no listeners or workers left - free everything retired, then
+		 * channels still in use go with their slab, all at once */
+		lc_epoch_destroy(&ctx->epoch);
+		for (lc_channel_t *chan = ctx->chan_list; chan; chan = chan->next) {
+			lc_channel_ext_free(chan);
+		}
+		free(ctx->chanhash);
+		/* sockets are closed, so topics and ranges have nothing to part */
+		while ((p = ctx->topics_list)) {
+			ctx->topics_list = ((lc_topics_t *)p)->next;
+			lc_topics_destroy(&((lc_topics_t *)p)->retired);
+		}
+		while ((p = ctx->range_list)) {
+			ctx->range_list = ((lc_range_t *)p)->next;
+			lc_range_destroy(&((lc_range_t *)p)->retired);
+		}
+		lc_slab_free(ctx->chan_slab);
+		lc_slab_free(ctx->sock_slab);
+		pthread_mutex_lock(&ctx_list_lock);
+		for (lc_ctx_t **p = &ctx_list; *p; p = &(*p)->next) {
+			if (*p == ctx) {
+				*p = ctx->next;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&ctx_list_lock);
+		lc_intern_free(ctx->intern);
+		pthread_mutex_destroy(&ctx->if_mtx);
+		free(ctx->attr);
 		free(ctx);
 	}
 }
 
+static void lc_sendtab_destroy(lc_epoch_node_t *node)
+{
+	free((char *)node - offsetof(lc_sendtab_t, retired));
+}
+
+static lc_sendtab_t *lc_sendtab_new(const unsigned int ifx[], size_t n)
+{
+	lc_sendtab_t *tab;
+
+	if (!(tab = malloc(sizeof(lc_sendtab_t) + n * sizeof(unsigned int)))) return NULL;
+	tab->n = n;
+	if (n) memcpy(tab->ifx, ifx, n * sizeof(unsigned int));
+	return tab;
+}
+
+/* switch sock to tab, returning the table replaced for lc_sendtab_retire().
+ * Call with ctx->if_mtx held */
+static lc_sendtab_t *lc_socket_sendtab_set(lc_socket_t *sock, lc_send_policy_t policy,
+		lc_sendtab_t *tab)
+{
+	sock->send_policy = policy;
+	return __atomic_exchange_n(&sock->sendtab, tab, __ATOMIC_ACQ_REL);
+}
+
+/* reclaiming waits for readers, who may want ctx->if_mtx - so call without it,
+ * or from inside a read section, where reclaiming is left for later */
+static void lc_sendtab_retire(lc_ctx_t *ctx, lc_sendtab_t *old)
+{
+	lc_epoch_t *ep = &ctx->epoch;
+
+	if (!old) return;
+	pthread_mutex_lock(&ep->lock);
+	lc_epoch_retire(ep, &old->retired, &lc_sendtab_destroy);
+	lc_epoch_unlock(ep);
+}
+
+int lc_socket_send_policy(lc_socket_t *sock, lc_send_policy_t policy, const unsigned int ifx[],
+		size_t n)
+{
+	lc_ctx_t *ctx;
+	lc_iftab_t *iftab;
+	lc_sendtab_t *tab = NULL, *old;
+
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (sock->pkt) return LC_ERROR_INVALID_PARAMS; /* rings send out of their own interface */
+	if (policy == LC_SEND_LIST) {
+		if (!ifx || !n) return LC_ERROR_INVALID_PARAMS;
+		for (size_t i = 0; i < n; i++) if (!ifx[i]) return LC_ERROR_INVALID_PARAMS;
+	}
+	else if (policy != LC_SEND_DEFAULT && policy != LC_SEND_ALL) return LC_ERROR_INVALID_PARAMS;
+	ctx = sock->ctx;
+	pthread_mutex_lock(&ctx->if_mtx);
+	if (policy == LC_SEND_ALL) {
+		/* the cache follows interfaces as they change - a list made now doesn't */
+		if (!(iftab = lc_ctx_iftab_get(ctx))) {
+			pthread_mutex_unlock(&ctx->if_mtx);
+			return LC_ERROR_FAILURE;
+		}
+		tab = lc_sendtab_new(iftab->ifx, iftab->n);
+		lc_ctx_iftab_put(ctx, iftab);
+	}
+	else if (policy == LC_SEND_LIST) tab = lc_sendtab_new(ifx, n);
+	if (policy != LC_SEND_DEFAULT && !tab) {
+		pthread_mutex_unlock(&ctx->if_mtx);
+		return LC_ERROR_MALLOC;
+	}
+	old = lc_socket_sendtab_set(sock, policy, tab);
+	pthread_mutex_unlock(&ctx->if_mtx);
+	lc_sendtab_retire(ctx, old);
+	return 0;
+}
+
 int lc_socket_bind(lc_socket_t *sock, unsigned int ifx)
 {
 	if (setsockopt(sock->sock, IPPROTO_IPV6, IPV6_MULTICAST_IF, &ifx, sizeof ifx) == -1) {
@@ -874,12 +3303,15 @@ lc_socket_t * lc_socket_new(lc_ctx_t *ctx)
 	lc_socket_t *sock;
 	int s, i, err = 0;
 
-	sock = calloc(1, sizeof(lc_socket_t));
-	if (!sock) return NULL;
+	if (!ctx) return NULL; /* errno set by lc_ctx_new() */
+	sock = lc_slab_alloc(ctx->sock_slab);
+	if (!sock) return NULL; /* errno set by malloc */
 	sock->ctx = ctx;
-	sock->id = ++sock_id;
-	sock->next = ctx->sock_list;
-	ctx->sock_list = sock;
+	sock->id = __atomic_add_fetch(&sock_id, 1, __ATOMIC_RELAXED);
+	if (!(sock->grps = lc_grpset_new())) {
+		err = errno;
+		goto err_0;
+	}
 	s = socket(AF_INET6, SOCK_DGRAM, 0);
 	if (s == -1) {
 		err = errno;
@@ -897,6 +3329,10 @@ lc_socket_t * lc_socket_new(lc_ctx_t *ctx)
 	if (setsockopt(s, IPPROTO_IPV6, IPV6_RECVPKTINFO, &i, sizeof i) == -1) {
 		goto err_1;
 	}
+#ifdef SO_RXQ_OVFL
+	/* report kernel drop count with each packet, where supported */
+	setsockopt(s, SOL_SOCKET, SO_RXQ_OVFL, &i, sizeof i);
+#endif
 	i = DEFAULT_MULTICAST_LOOP;
 	if (setsockopt(s, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &i, sizeof i) == -1) {
 		goto err_1;
@@ -905,25 +3341,438 @@ lc_socket_t * lc_socket_new(lc_ctx_t *ctx)
 	if (setsockopt(s, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &i, sizeof i) == -1) {
 		goto err_1;
 	}
+#ifndef IPV6_MULTICAST_ALL
+	pthread_rwlock_init(&sock->grplock, NULL);
+#endif
+	lc_pool_pending_init(&sock->pending);
+	pthread_mutex_lock(&ctx->epoch.lock);
+	sock->next = ctx->sock_list;
+	if (sock->next) sock->next->pprev = &sock->next;
+	sock->pprev = &ctx->sock_list;
+	__atomic_store_n(&ctx->sock_list, sock, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&ctx->epoch.lock);
 	return sock;
 err_1:
 	err = errno;
 	close(s);
 err_0:
-	free(sock);
+	lc_grpset_free(sock->grps);
+	lc_slab_release(ctx->sock_slab, sock);
+	errno = err;
+	return NULL;
+}
+
+lc_socket_t * lc_socket_packet_new(lc_ctx_t *ctx, unsigned int ifx)
+{
+	lc_socket_t *sock;
+	lc_packet_t *pkt;
+	int err;
+
+	if (!(pkt = lc_packet_new(ifx))) return NULL;
+	if (!(sock = lc_socket_new(ctx))) goto err_0;
+
+	/* the UDP socket is kept for multicast group membership (MLD) only -
+	 * everything it would receive arrives on the ring instead */
+	if (lc_socket_bind(sock, ifx) || lc_packet_mute(sock->sock)) {
+		err = errno;
+		lc_socket_close(sock);
+		errno = err;
+		goto err_0;
+	}
+	sock->pkt = pkt;
+	return sock;
+err_0:
+	err = errno;
+	lc_packet_free(pkt);
 	errno = err;
 	return NULL;
 }
 
+void lc_thread_attr_init(lc_thread_attr_t *attr)
+{
+	memset(attr, 0, sizeof(lc_thread_attr_t));
+	attr->node = -1;
+}
+
+int lc_thread_attr_setcpu(lc_thread_attr_t *attr, int cpu)
+{
+	if (!attr || cpu < 0 || cpu >= LC_CPUS_MAX) return LC_ERROR_INVALID_PARAMS;
+	attr->cpus[cpu / 64] |= 1ULL << (cpu % 64);
+	return 0;
+}
+
+/* replace *dst with a copy of attr, or NULL */
+static int lc_thread_attr_copy(lc_thread_attr_t **dst, const lc_thread_attr_t *attr)
+{
+	lc_thread_attr_t *copy = NULL;
+
+	if (attr) {
+		if (attr->priority < 0 || attr->priority > 99) return LC_ERROR_INVALID_PARAMS;
+		if (!(copy = malloc(sizeof(lc_thread_attr_t)))) return LC_ERROR_MALLOC;
+		memcpy(copy, attr, sizeof(lc_thread_attr_t));
+	}
+	free(*dst);
+	*dst = copy;
+	return 0;
+}
+
+int lc_socket_thread_attr(lc_socket_t *sock, const lc_thread_attr_t *attr)
+{
+	if (!sock) return LC_ERROR_SOCKET_REQUIRED;
+	if (lc_socket_listening(sock)) return LC_ERROR_SOCKET_LISTENING;
+	return lc_thread_attr_copy(&sock->attr, attr);
+}
+
+int lc_ctx_thread_attr(lc_ctx_t *ctx, const lc_thread_attr_t *attr)
+{
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	return lc_thread_attr_copy(&ctx->attr, attr);
+}
+
+int lc_ctx_intern(lc_ctx_t *ctx, size_t entries)
+{
+	lc_intern_t *in = NULL;
+
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	if (entries && !(in = lc_intern_new(entries))) return LC_ERROR_MALLOC;
+	lc_intern_free(ctx->intern);
+	ctx->intern = in;
+	return 0;
+}
+
+int lc_ctx_mem_stats(lc_ctx_t *ctx, lc_mem_stats_t *stats)
+{
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	if (!stats) return LC_ERROR_INVALID_PARAMS;
+	stats->chan_size = lc_slab_size(ctx->chan_slab);
+	stats->chan_used = lc_slab_used(ctx->chan_slab);
+	stats->chan_bytes = lc_slab_bytes(ctx->chan_slab);
+	stats->sock_size = lc_slab_size(ctx->sock_slab);
+	stats->sock_used = lc_slab_used(ctx->sock_slab);
+	stats->sock_bytes = lc_slab_bytes(ctx->sock_slab);
+	return 0;
+}
+
+/* join or part group on s, on interfaces in d->tab but not d->old, with source
+ * filter src if not NULL, and part interfaces in d->old but not in d->tab */
+typedef struct lc_ifdiff_s {
+	const lc_iftab_t *old;
+	const lc_iftab_t *tab;
+	lc_range_t *range;
+} lc_ifdiff_t;
+
+static void lc_ifdiff_apply(lc_ifdiff_t *d, int s, struct in6_addr *grp, const lc_srclist_t *src)
+{
+	struct ipv6_mreq req = {0};
+
+	memcpy(&req.ipv6mr_multiaddr, grp, sizeof(struct in6_addr));
+	for (size_t i = 0; i < d->tab->n; i++) {
+		if (lc_iftab_has(d->old, d->tab->ifx[i])) continue;
+		req.ipv6mr_interface = d->tab->ifx[i];
+		if (src) lc_source_filter_ifx(s, d->tab->ifx[i], grp, src);
+		else setsockopt(s, IPPROTO_IPV6, IPV6_JOIN_GROUP, &req, sizeof req);
+	}
+	for (size_t i = 0; d->old && i < d->old->n; i++) {
+		if (lc_iftab_has(d->tab, d->old->ifx[i])) continue;
+		req.ipv6mr_interface = d->old->ifx[i];
+		setsockopt(s, IPPROTO_IPV6, IPV6_LEAVE_GROUP, &req, sizeof req);
+	}
+}
+
+static void lc_ifdiff_band(uint64_t band, void *arg)
+{
+	lc_ifdiff_t *d = arg;
+	struct in6_addr grp = d->range->sa.sin6_addr;
+
+	lc_addr_setband(&grp, band);
+	lc_ifdiff_apply(d, lc_socket_group_fd(d->range->sock, &grp), &grp, NULL);
+}
+
+/* interfaces changed - list them again, and move memberships of sockets
+ * joined on all interfaces to match */
+static void lc_ctx_ifupdate(lc_ctx_t *ctx)
+{
+	lc_ifdiff_t d = {0};
+	lc_iftab_t *tab;
+	lc_socket_t *sock;
+	int e;
+
+	if (!(tab = lc_iftab_new())) return;
+	e = lc_epoch_enter(&ctx->epoch);
+	pthread_mutex_lock(&ctx->if_mtx);
+	d.old = ctx->iftab;
+	d.tab = ctx->iftab = tab;
+	/* sockets sending out of every interface follow them */
+	for (sock = __atomic_load_n(&ctx->sock_list, __ATOMIC_ACQUIRE); sock;
+			sock = __atomic_load_n(&sock->next, __ATOMIC_ACQUIRE)) {
+		lc_sendtab_t *st;
+		if (sock->closing) continue;
+		if (sock->send_policy == LC_SEND_ALL && (st = lc_sendtab_new(tab->ifx, tab->n)))
+			lc_sendtab_retire(ctx, lc_socket_sendtab_set(sock, LC_SEND_ALL, st));
+	}
+	for (lc_channel_t *chan = lc_chan_first(ctx); chan; chan = lc_chan_next(chan)) {
+		if (!lc_channel_holds(chan) || !(sock = lc_chan_sock(chan)) || sock->ifx)
+			continue;
+		lc_ifdiff_apply(&d, lc_socket_group_fd(sock, &chan->sa.sin6_addr), &chan->sa.sin6_addr,
+				lc_chan_src(chan));
+	}
+	pthread_mutex_unlock(&ctx->if_mtx);
+	/* range bands (and topic shards) are joined under the range lock */
+	for (lc_range_t *r = __atomic_load_n(&ctx->range_list, __ATOMIC_ACQUIRE); r;
+			r = __atomic_load_n(&r->next, __ATOMIC_ACQUIRE)) {
+		lc_socket_t *rs;
+		pthread_mutex_lock(&r->mtx);
+		/* bound without the lock, detached under it */
+		if ((rs = __atomic_load_n(&r->sock, __ATOMIC_ACQUIRE)) && !rs->ifx) {
+			d.range = r;
+			pthread_mutex_lock(&ctx->if_mtx);
+			lc_bandset_each(r->joined, &lc_ifdiff_band, &d);
+			pthread_mutex_unlock(&ctx->if_mtx);
+		}
+		pthread_mutex_unlock(&r->mtx);
+	}
+	lc_epoch_exit(&ctx->epoch, e);
+	free((void *)d.old);
+}
+
+static void *lc_ctx_ifmonitor_thread(void *arg)
+{
+	lc_ctx_t *ctx = arg;
+	int state;
+
+	while (lc_iftab_wait(ctx->ifsock) != -1) {
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+		lc_ctx_ifupdate(ctx);
+		pthread_setcancelstate(state, NULL);
+	}
+	return NULL;
+}
+
+int lc_ctx_ifmonitor(lc_ctx_t *ctx, int on)
+{
+	lc_iftab_t *tab;
+	int err;
+
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	if (!on) {
+		if (!ctx->ifmon) return 0;
+		pthread_cancel(ctx->ifmon);
+		pthread_join(ctx->ifmon, NULL);
+		ctx->ifmon = 0;
+		close(ctx->ifsock);
+		pthread_mutex_lock(&ctx->if_mtx);
+		tab = ctx->iftab;
+		ctx->iftab = NULL;
+		pthread_mutex_unlock(&ctx->if_mtx);
+		free(tab);
+		return 0;
+	}
+	if (ctx->ifmon) return 0;
+	/* watch first, so no change is missed while we list */
+	if ((ctx->ifsock = lc_iftab_watch()) == -1) return LC_ERROR_FAILURE;
+	if (!(tab = lc_iftab_new())) {
+		close(ctx->ifsock);
+		return LC_ERROR_FAILURE;
+	}
+	pthread_mutex_lock(&ctx->if_mtx);
+	ctx->iftab = tab;
+	pthread_mutex_unlock(&ctx->if_mtx);
+	err = lc_thread_create(&ctx->ifmon, ctx->attr, &lc_ctx_ifmonitor_thread, ctx);
+	if (err) {
+		ctx->ifmon = 0;
+		close(ctx->ifsock);
+		pthread_mutex_lock(&ctx->if_mtx);
+		ctx->iftab = NULL;
+		pthread_mutex_unlock(&ctx->if_mtx);
+		free(tab);
+		errno = err;
+		return LC_ERROR_THREAD_CREATE;
+	}
+	return 0;
+}
+
+ssize_t lc_ctx_iflist(lc_ctx_t *ctx, unsigned int ifx[], size_t n)
+{
+	ssize_t rc = -1;
+
+	if (!ctx) return -1;
+	pthread_mutex_lock(&ctx->if_mtx);
+	if (ctx->iftab) {
+		rc = ctx->iftab->n;
+		if (ifx) memcpy(ifx, ctx->iftab->ifx, ((size_t)rc < n ? (size_t)rc : n) * sizeof(unsigned int));
+	}
+	pthread_mutex_unlock(&ctx->if_mtx);
+	return rc;
+}
+
+/* apply a paced join, unless the channel was parted, unbound or freed since */
+static int lc_channel_join_queued(void *obj, void *arg)
+{
+	lc_ctx_t *ctx = arg;
+	lc_channel_t *chan = obj;
+	lc_iftab_t *tab = NULL;
+	lc_join_fn_t *fn;
+	void *fn_arg;
+	int rc, e;
+
+	e = lc_epoch_enter(&ctx->epoch);
+	pthread_mutex_lock(&ctx->if_mtx);
+	/* cancelled once popped - lc_channel_free() retires chan after the
+	 * queue's read section, so it's still ours to look at */
+	if (chan->joined != LC_JOIN_QUEUED) {
+		pthread_mutex_unlock(&ctx->if_mtx);
+		lc_epoch_exit(&ctx->epoch, e);
+		return 1;
+	}
+	chan->joined = 0;
+	rc = (chan->sock) ? lc_channel_membership(chan, chan->sock, IPV6_JOIN_GROUP, &tab)
+		: LC_ERROR_SOCKET_REQUIRED;
+	lc_ctx_iftab_put(ctx, tab);
+	fn = ctx->join_fn;
+	fn_arg = ctx->join_arg;
+	pthread_mutex_unlock(&ctx->if_mtx);
+	if (fn) fn(chan, rc, fn_arg);
+	lc_epoch_exit(&ctx->epoch, e);
+	return 0;
+}
+
+int lc_ctx_join_pace(lc_ctx_t *ctx, unsigned int rate, unsigned int burst, lc_join_fn_t *fn,
+		void *arg)
+{
+	lc_joinq_t *q;
+
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	pthread_mutex_lock(&ctx->if_mtx);
+	q = ctx->joinq;
+	if (rate) {
+		if (q) lc_joinq_rate(q, rate, burst);
+		else if (!(q = lc_joinq_new(rate, burst, &lc_channel_join_queued, ctx, ctx->attr,
+						&ctx->epoch))) {
+			pthread_mutex_unlock(&ctx->if_mtx);
+			return (errno == ENOMEM) ? LC_ERROR_MALLOC : LC_ERROR_THREAD_CREATE;
+		}
+		ctx->join_fn = fn;
+		ctx->join_arg = arg;
+		ctx->joinq = q;
+		pthread_mutex_unlock(&ctx->if_mtx);
+		return 0;
+	}
+	if (!q || ctx->join_draining) {
+		pthread_mutex_unlock(&ctx->if_mtx);
+		return 0;
+	}
+	ctx->join_draining = 1;
+	pthread_mutex_unlock(&ctx->if_mtx);
+	/* join what's left unpaced.  The queue stays on ctx until it's empty, so
+	 * channels freed meanwhile cancel their joins */
+	for (;;) {
+		lc_joinq_drain(q);
+		pthread_mutex_lock(&ctx->if_mtx);
+		if (!lc_joinq_len(q)) break;
+		pthread_mutex_unlock(&ctx->if_mtx);
+	}
+	ctx->joinq = NULL;
+	ctx->join_draining = 0;
+	pthread_mutex_unlock(&ctx->if_mtx);
+	lc_joinq_free(q);
+	return 0;
+}
+
+int lc_ctx_join_stats(lc_ctx_t *ctx, lc_join_stats_t *stats)
+{
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	if (!stats) return LC_ERROR_INVALID_PARAMS;
+	memset(stats, 0, sizeof(lc_join_stats_t));
+	pthread_mutex_lock(&ctx->if_mtx);
+	if (ctx->joinq) lc_joinq_stats(ctx->joinq, stats);
+	pthread_mutex_unlock(&ctx->if_mtx);
+	return 0;
+}
+
+int lc_ctx_workers(lc_ctx_t *ctx, int nworkers, lc_workers_key_t key)
+{
+	lc_pool_t *pool = NULL;
+	int e, listening = 0;
+
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	if (nworkers < 0) return LC_ERROR_INVALID_PARAMS;
+	e = lc_epoch_enter(&ctx->epoch);
+	for (lc_socket_t *sock = __atomic_load_n(&ctx->sock_list, __ATOMIC_ACQUIRE); sock;
+			sock = __atomic_load_n(&sock->next, __ATOMIC_ACQUIRE)) {
+		if (lc_socket_listening(sock)) listening = 1;
+	}
+	lc_epoch_exit(&ctx->epoch, e);
+	if (listening) return LC_ERROR_SOCKET_LISTENING;
+	if (nworkers && !(pool = lc_pool_new(nworkers, key, &dispatch_msg, ctx->attr, &ctx->epoch)))
+		return (errno == ENOMEM) ? LC_ERROR_MALLOC : LC_ERROR_FAILURE;
+	lc_pool_free(ctx->pool);
+	ctx->pool = pool;
+	return 0;
+}
+
+int lc_ctx_workers_stats(lc_ctx_t *ctx, lc_worker_stats_t *stats, int n)
+{
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	if (!ctx->pool) return 0;
+	return lc_pool_stats(ctx->pool, stats, n);
+}
+
+static int lc_ctx_loop_init(lc_ctx_t *ctx)
+{
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	if (!ctx->loop && !(ctx->loop = lc_loop_new())) return LC_ERROR_EVENT_LOOP;
+	return 0;
+}
+
+int lc_ctx_loop_start(lc_ctx_t *ctx, int nthreads)
+{
+	int rc;
+
+	if ((rc = lc_ctx_loop_init(ctx))) return rc;
+	if (lc_loop_start(ctx->loop, nthreads, ctx->attr)) return LC_ERROR_EVENT_LOOP;
+	return 0;
+}
+
+int lc_ctx_run(lc_ctx_t *ctx)
+{
+	int rc;
+
+	if ((rc = lc_ctx_loop_init(ctx))) return rc;
+	if (lc_loop_run(ctx->loop)) return LC_ERROR_EVENT_LOOP;
+	return 0;
+}
+
+int lc_ctx_loop_stop(lc_ctx_t *ctx)
+{
+	if (!ctx) return LC_ERROR_CTX_REQUIRED;
+	if (ctx->loop) lc_loop_stop(ctx->loop);
+	return 0;
+}
+
 lc_ctx_t * lc_ctx_new(void)
 {
 	lc_ctx_t *ctx;
 
 	if (!(ctx = calloc(1, sizeof(lc_ctx_t)))) return NULL; /* errno set by calloc */
-	ctx->id = ++ctx_id;
+	ctx->chan_slab = lc_slab_new(sizeof(lc_channel_t), CHAN_SLAB);
+	ctx->sock_slab = lc_slab_new(sizeof(lc_socket_t), SOCK_SLAB);
+	ctx->chanhash = lc_chanhash_new(CHANHASH_MIN);
+	if (!ctx->chan_slab || !ctx->sock_slab || !ctx->chanhash) {
+		lc_slab_free(ctx->chan_slab);
+		lc_slab_free(ctx->sock_slab);
+		free(ctx->chanhash);
+		free(ctx);
+		errno = ENOMEM;
+		return NULL;
+	}
+	ctx->id = __atomic_add_fetch(&ctx_id, 1, __ATOMIC_RELAXED);
+	ctx->sock = -1;
+	lc_epoch_init(&ctx->epoch);
+	pthread_mutex_init(&ctx->if_mtx, NULL);
+	pthread_mutex_lock(&ctx_list_lock);
 	ctx->next = ctx_list;
 	ctx_list = ctx;
-	ctx->sock = -1;
+	pthread_mutex_unlock(&ctx_list_lock);
 
 	return ctx;
 }
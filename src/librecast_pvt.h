@@ -5,48 +5,207 @@
 #define _LIBRECAST_PVT_H 1
 
 #include "../include/librecast/types.h"
+#include "epoch.h"
+#include "pool.h"
 #include <stddef.h>
 
+typedef struct lc_loop_s lc_loop_t;
+typedef struct lc_socket_group_s lc_socket_group_t;
+typedef struct lc_intern_s lc_intern_t;
+typedef struct lc_slab_s lc_slab_t;
+typedef struct lc_bandset_s lc_bandset_t;
+typedef struct lc_topic_subs_s lc_topic_subs_t;
+typedef struct lc_topic_set_s lc_topic_set_t;
+typedef struct lc_iftab_s lc_iftab_t;
+typedef struct lc_joinq_s lc_joinq_t;
+typedef struct lc_spill_s lc_spill_t;
+typedef struct lc_grpset_s lc_grpset_t;
+typedef struct lc_chanhash_s lc_chanhash_t;
+typedef struct lc_chanvec_s lc_chanvec_t;
+
+/* interfaces a socket sends a copy out of */
+typedef struct lc_sendtab_s {
+	lc_epoch_node_t retired;
+	size_t n;
+	unsigned int ifx[];
+} lc_sendtab_t;
+
 typedef struct lc_ctx_t {
 	lc_ctx_t *next;
 	uint32_t id;
 	lc_socket_t *sock_list;
 	lc_channel_t *chan_list;
+	lc_range_t *range_list;
+	lc_topics_t *topics_list;
 	int sock; /* AF_LOCAL socket for ioctls */
+	lc_loop_t *loop; /* event loop, NULL = thread per socket */
+	lc_pool_t *pool; /* callback workers, NULL = call from listener */
+	lc_socket_group_t *group_list;
+	lc_thread_attr_t *attr; /* thread placement default, NULL = none */
+	lc_epoch_t epoch; /* sock_list, chan_list, range_list: lock-free readers, locked writers */
+	lc_chanhash_t *chanhash; /* chan_list by group address, as chan_list */
+	unsigned int chanhash_seq; /* odd while rehashing */
+	size_t chans; /* channels in chanhash */
+	lc_intern_t *intern; /* channel name -> address memo, NULL = disabled */
+	lc_slab_t *chan_slab;
+	lc_slab_t *sock_slab;
+	pthread_mutex_t if_mtx; /* iftab, channel joined flags */
+	lc_iftab_t *iftab; /* interface cache, NULL = list interfaces on each join */
+	pthread_t ifmon; /* interface monitor thread, 0 = not running */
+	int ifsock; /* interface change notifications */
+	lc_joinq_t *joinq; /* paced joins, NULL = join now */
+	int join_draining; /* joinq being emptied by lc_ctx_join_pace() */
+	lc_join_fn_t *join_fn; /* called as paced joins are applied */
+	void *join_arg;
 } lc_ctx_t;
 
-#ifndef IPV6_MULTICAST_ALL
-typedef struct lc_grplist_s lc_grplist_t;
-struct lc_grplist_s {
-	lc_grplist_t *next;
-	struct in6_addr grp;
-};
-#endif
+typedef struct lc_dedup_s lc_dedup_t;
+typedef struct lc_senders_s lc_senders_t;
+typedef struct lc_reorder_s lc_reorder_t;
+typedef struct lc_packet_s lc_packet_t;
+typedef struct lc_loop_watch_s lc_loop_watch_t;
 
 typedef struct lc_socket_t {
 	lc_socket_t *next;
+	lc_socket_t **pprev; /* link pointing to us, NULL once unlinked */
 	lc_ctx_t *ctx;
 	pthread_t thread;
+	lc_loop_watch_t *watch; /* listening on ctx event loop */
+	lc_socket_call_t *call;
 	uint32_t id;
 	unsigned int ifx; /* interface index, 0 = all (default) */
+	lc_send_policy_t send_policy; /* interfaces sent on (ctx->if_mtx) */
+	lc_sendtab_t *sendtab; /* sent on, NULL = default.  Read in epoch */
+	lc_grpset_t *grps; /* groups joined, with references (ctx->if_mtx) */
 #ifndef IPV6_MULTICAST_ALL
-	lc_grplist_t *grps;
+	pthread_rwlock_t grplock; /* grps, read for each message received */
 #endif
+	lc_dedup_t *dedup; /* duplicate filter, NULL = disabled */
+	lc_senders_t *senders; /* per-sender stats, NULL = disabled */
+	lc_packet_t *pkt; /* AF_PACKET rings, NULL = use sock */
+	lc_topics_t *topics; /* topic space bound, NULL = none */
+	int fanout; /* socket group kernel filter attached */
+	lc_pool_pending_t pending; /* messages waiting in worker pool */
+	lc_thread_attr_t *attr; /* listener thread placement, NULL = ctx default */
 	int bound; /* how many channels are bound to this socket */
+	lc_chanvec_t *ordered; /* ordered channels bound (ctx->if_mtx), NULL = none */
+	int held; /* ordered channels holding messages, as of the last push or expire */
+	int spin; /* listener spins this many us before blocking, 0 = don't spin */
+	int rcvbuf; /* receive buffer size requested, 0 = system default */
+	int rcvbuf_max; /* grow rcvbuf up to this size on drops */
+	uint64_t drops; /* packets dropped by kernel (SO_RXQ_OVFL) */
+	uint64_t dropped; /* drops not yet reported to listener */
+	lc_spill_t *spill; /* elastic - more kernel sockets, NULL = sock only */
+	int closing; /* closed, channels detached - skip it (ctx->if_mtx) */
+	lc_epoch_node_t retired;
 	int sock;
 } lc_socket_t;
 
+/* ordered to pack without holes - there may be millions of these */
+/* source filter of a channel, addresses sorted */
+typedef struct lc_srclist_s {
+	lc_filter_mode_t mode;
+	size_t n;
+	size_t max;
+	struct in6_addr addr[];
+} lc_srclist_t;
+
+/* parts of a channel few channels use, allocated on first use (set once, so
+ * readers can hold on to it) and freed with the channel */
+typedef struct lc_channel_ext_s {
+	lc_reorder_t *reorder; /* ordered delivery buffer, NULL = disabled */
+	lc_channel_fn_t *fn; /* message callback, NULL = socket callback */
+	void *arg;
+	lc_srclist_t *src; /* sources joined (joined = 0) or blocked (joined = 1),
+			      NULL = none, under ctx->if_mtx */
+} lc_channel_ext_t;
+
+/* 112 bytes, so a slab slot holds it without padding */
 typedef struct lc_channel_t {
 	lc_channel_t *next;
+	lc_channel_t *hnext; /* next in its ctx->chanhash bucket */
+	union {
+		struct {
+			lc_channel_t **pprev; /* link pointing to us */
+			lc_channel_t **hpprev; /* bucket link pointing to us */
+		};
+		/* readers never look at the back links, so once unlinked the
+		 * channel is retired in their place */
+		lc_epoch_node_t retired;
+	};
 	lc_ctx_t *ctx;
 	struct lc_socket_t *sock;
-	struct sockaddr_in6 sa;
 	char *uri;
+	lc_channel_ext_t *ext; /* NULL = none of it used */
+	lc_seq_t seq; /* messages sent - only senders move it, so each sender's
+			 seq rises by one per message */
+	struct sockaddr_in6 sa; /* not changed once linked - it is the hash key */
 	uint32_t id;
-	lc_seq_t seq; /* sequence number (Lamport clock) */
-	lc_rnd_t rnd; /* random nonce */
+	int joined; /* joined on sock (1), or LC_JOIN_QUEUED, under ctx->if_mtx */
 } lc_channel_t;
 
+/* channels of a ctx by group address, chained through hnext */
+struct lc_chanhash_s {
+	lc_epoch_node_t retired;
+	size_t mask; /* buckets - 1 */
+	lc_channel_t *bucket[];
+};
+
+/* channels of a socket.  Readers take n, then chan[0..n), without locks: an
+ * entry is only overwritten by another of the list, and a full list is copied
+ * to a larger one, kept until the socket is freed */
+struct lc_chanvec_s {
+	lc_chanvec_t *prev; /* outgrown */
+	size_t n;
+	size_t max;
+	lc_channel_t *chan[];
+};
+
+/* side band channels of base, for any band, without a channel each */
+struct lc_range_s {
+	lc_range_t *next;
+	lc_range_t **pprev; /* link pointing to us, NULL once unlinked */
+	lc_ctx_t *ctx;
+	lc_socket_t *sock;
+	lc_range_fn_t *fn; /* demux callback, NULL = socket callback */
+	void *arg;
+	void **table; /* fn arg for bands < n, direct indexed */
+	size_t n;
+	pthread_mutex_t mtx; /* joined */
+	lc_bandset_t *joined;
+	lc_seq_t seq; /* sequence number, shared by all bands */
+	lc_epoch_node_t retired;
+	struct sockaddr_in6 sa; /* base address, band bits zero */
+};
+
+/* topic space hashed onto shards, which are bands of a range */
+struct lc_topics_s {
+	lc_topics_t *next;
+	lc_topics_t **pprev; /* link pointing to us, NULL once unlinked */
+	lc_ctx_t *ctx;
+	lc_range_t *range; /* shard n is band n */
+	lc_socket_t *sock;
+	unsigned int shards;
+	unsigned int joined; /* shards joined */
+	int filter; /* use kernel filter where possible (default) */
+	int filtered; /* kernel filter attached */
+	pthread_mutex_t mtx; /* subs, shard_refs, set */
+	lc_topic_subs_t *subs;
+	unsigned int *shard_refs; /* topics subscribed per shard */
+	lc_topic_set_t *set; /* subscribed tags, for listeners */
+	uint64_t msgs;
+	uint64_t wasted;
+	lc_epoch_node_t retired;
+};
+
+struct lc_socket_group_s {
+	lc_socket_group_t *next;
+	lc_ctx_t *ctx;
+	lc_fanout_t mode;
+	int n;
+	lc_socket_t **sock; /* sock[i] takes share i of n */
+};
+
 typedef struct lc_message_head_t {
 	uint64_t timestamp; /* nanosecond timestamp */
 	lc_seq_t seq; /* sequence number */
@@ -64,6 +223,7 @@ extern lc_socket_t *sock_list;
 extern lc_channel_t *chan_list;
 
 #define BUFSIZE 1500
+#define LC_JOIN_QUEUED 2
 #define DEFAULT_ADDR "ff1e::"
 
 #endif /* _LIBRECAST_PVT_H */
@@ -0,0 +1,338 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "loop.h"
+#include "thread.h"
+#include <errno.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+struct lc_loop_watch_s {
+	lc_loop_watch_t *next;
+	lc_loop_t *loop;
+	pthread_mutex_t lock; /* held while callback runs */
+	lc_loop_fn_t *fn;
+	void *arg;
+	int fd;
+	int timerfd; /* created on first call to lc_loop_timer() */
+	int dead;
+};
+
+struct lc_loop_s {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int epfd;
+	int evfd;
+	int running; /* threads in lc_loop_run() */
+	int stop; /* lc_loop_stop() - every thread returns */
+	pthread_t *thread;
+	int nthreads;
+	pthread_t *unwind; /* lc_loop_start() failed - threads from here to
+			      thread + nthreads return, NULL = none */
+	lc_loop_watch_t *watches;
+};
+
+static int lc_loop_arm(lc_loop_t *loop, lc_loop_watch_t *w, int op, int fd)
+{
+	struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = w };
+	return epoll_ctl(loop->epfd, op, fd, &ev);
+}
+
+static void lc_loop_dispatch(lc_loop_t *loop, lc_loop_watch_t *w)
+{
+	uint64_t u;
+
+	pthread_mutex_lock(&w->lock);
+	if (!w->dead) {
+		/* clear timer expiry, if any */
+		if (w->timerfd != -1 && read(w->timerfd, &u, sizeof u) == -1) u = 0;
+		w->fn(w->arg);
+		lc_loop_arm(loop, w, EPOLL_CTL_MOD, w->fd);
+		if (w->timerfd != -1) lc_loop_arm(loop, w, EPOLL_CTL_MOD, w->timerfd);
+	}
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* woken by the eventfd - should we return? */
+static int lc_loop_stopping(lc_loop_t *loop)
+{
+	pthread_t self = pthread_self();
+	int stop;
+
+	pthread_mutex_lock(&loop->lock);
+	stop = loop->stop;
+	if (loop->unwind) {
+		for (pthread_t *t = loop->unwind; !stop && t < loop->thread + loop->nthreads; t++)
+			stop = pthread_equal(*t, self);
+	}
+	pthread_mutex_unlock(&loop->lock);
+	return stop;
+}
+
+int lc_loop_run(lc_loop_t *loop)
+{
+	struct epoll_event ev;
+	int rc = 0;
+
+	pthread_mutex_lock(&loop->lock);
+	loop->running++;
+	pthread_mutex_unlock(&loop->lock);
+	for (;;) {
+		/* one event per wait, so idle threads pick up the next socket */
+		if (epoll_wait(loop->epfd, &ev, 1, -1) == -1) {
+			if (errno == EINTR) continue;
+			rc = -1;
+			break;
+		}
+		if (!ev.data.ptr) { /* eventfd - stop */
+			if (lc_loop_stopping(loop)) break;
+			sched_yield(); /* others are stopping - readable until they have */
+			continue;
+		}
+		lc_loop_dispatch(loop, ev.data.ptr);
+	}
+	pthread_mutex_lock(&loop->lock);
+	loop->running--;
+	pthread_cond_broadcast(&loop->cond);
+	pthread_mutex_unlock(&loop->lock);
+	return rc;
+}
+
+static void *lc_loop_thread(void *arg)
+{
+	lc_loop_run(arg);
+	return NULL;
+}
+
+/* free watches that have been deleted - only when no threads are running */
+static void lc_loop_reap(lc_loop_t *loop, int all)
+{
+	lc_loop_watch_t *w, **p = &loop->watches;
+	while ((w = *p)) {
+		if (w->dead || all) {
+			*p = w->next;
+			if (w->timerfd != -1) close(w->timerfd);
+			pthread_mutex_destroy(&w->lock);
+			free(w);
+		}
+		else p = &w->next;
+	}
+}
+
+void lc_loop_stop(lc_loop_t *loop)
+{
+	uint64_t u = 1;
+
+	pthread_mutex_lock(&loop->lock);
+	loop->stop = 1;
+	pthread_mutex_unlock(&loop->lock);
+	if (write(loop->evfd, &u, sizeof u) == -1) return;
+	for (int i = 0; i < loop->nthreads; i++) {
+		pthread_join(loop->thread[i], NULL);
+	}
+	pthread_mutex_lock(&loop->lock);
+	while (loop->running) pthread_cond_wait(&loop->cond, &loop->lock);
+	free(loop->thread);
+	loop->thread = NULL;
+	loop->nthreads = 0;
+	lc_loop_reap(loop, 0);
+	if (read(loop->evfd, &u, sizeof u) == -1) u = 0;
+	loop->stop = 0;
+	pthread_mutex_unlock(&loop->lock);
+}
+
+int lc_loop_start(lc_loop_t *loop, int nthreads, const lc_thread_attr_t *attr)
+{
+	pthread_t *t;
+	uint64_t u = 1;
+	int err, first, stopped = 0;
+
+	if (nthreads <= 0) return 0;
+	pthread_mutex_lock(&loop->lock);
+	t = realloc(loop->thread, sizeof(pthread_t) * (loop->nthreads + nthreads));
+	if (!t) {
+		pthread_mutex_unlock(&loop->lock);
+		return -1;
+	}
+	loop->thread = t;
+	first = loop->nthreads;
+	for (int i = 0; i < nthreads; i++) {
+		if ((err = lc_thread_create(&t[loop->nthreads], attr, &lc_loop_thread, loop)))
+			goto err_0;
+		loop->nthreads++;
+	}
+	pthread_mutex_unlock(&loop->lock);
+	return 0;
+err_0:
+	loop->unwind = &t[first];
+	pthread_mutex_unlock(&loop->lock);
+	/* stop the threads we started - threads already running carry on.  If
+	 * they can't be woken, they're left for lc_loop_stop() */
+	if (loop->nthreads > first && write(loop->evfd, &u, sizeof u) != -1) {
+		for (int i = first; i < loop->nthreads; i++) pthread_join(t[i], NULL);
+		if (read(loop->evfd, &u, sizeof u) == -1) u = 0;
+		stopped = 1;
+	}
+	pthread_mutex_lock(&loop->lock);
+	if (stopped) loop->nthreads = first;
+	loop->unwind = NULL;
+	pthread_mutex_unlock(&loop->lock);
+	errno = err;
+	return -1;
+}
+
+lc_loop_watch_t *lc_loop_add(lc_loop_t *loop, int fd, lc_loop_fn_t *fn, void *arg)
+{
+	lc_loop_watch_t *w;
+
+	if (!(w = calloc(1, sizeof(lc_loop_watch_t)))) return NULL;
+	pthread_mutex_init(&w->lock, NULL);
+	w->loop = loop;
+	w->fn = fn;
+	w->arg = arg;
+	w->fd = fd;
+	w->timerfd = -1;
+	pthread_mutex_lock(&loop->lock);
+	w->next = loop->watches;
+	loop->watches = w;
+	pthread_mutex_unlock(&loop->lock);
+	if (lc_loop_arm(loop, w, EPOLL_CTL_ADD, fd) == -1) {
+		w->dead = 1;
+		return NULL;
+	}
+	return w;
+}
+
+void lc_loop_del(lc_loop_t *loop, lc_loop_watch_t *w)
+{
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+	if (w->timerfd != -1) epoll_ctl(loop->epfd, EPOLL_CTL_DEL, w->timerfd, NULL);
+	/* wait for callback to return, if running */
+	pthread_mutex_lock(&w->lock);
+	w->dead = 1;
+	pthread_mutex_unlock(&w->lock);
+}
+
+int lc_loop_timer(lc_loop_watch_t *w, int ms)
+{
+	struct itimerspec its = {0};
+
+	if (w->timerfd == -1) {
+		if (ms < 0) return 0;
+		w->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (w->timerfd == -1) return -1;
+		if (lc_loop_arm(w->loop, w, EPOLL_CTL_ADD, w->timerfd) == -1) {
+			close(w->timerfd);
+			w->timerfd = -1;
+			return -1;
+		}
+	}
+	if (ms >= 0) {
+		its.it_value.tv_sec = ms / 1000;
+		its.it_value.tv_nsec = (ms % 1000) * 1000000;
+		if (!ms) its.it_value.tv_nsec = 1; /* zero would disarm */
+	}
+	return timerfd_settime(w->timerfd, 0, &its, NULL);
+}
+
+void lc_loop_free(lc_loop_t *loop)
+{
+	if (!loop) return;
+	lc_loop_stop(loop);
+	lc_loop_reap(loop, 1);
+	close(loop->epfd);
+	close(loop->evfd);
+	pthread_cond_destroy(&loop->cond);
+	pthread_mutex_destroy(&loop->lock);
+	free(loop);
+}
+
+lc_loop_t *lc_loop_new(void)
+{
+	lc_loop_t *loop;
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	int err;
+
+	if (!(loop = calloc(1, sizeof(lc_loop_t)))) return NULL;
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd == -1) goto err_0;
+	loop->evfd = eventfd(0, EFD_CLOEXEC);
+	if (loop->evfd == -1) goto err_1;
+	/* level triggered, so every thread sees it */
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->evfd, &ev) == -1) goto err_2;
+	pthread_mutex_init(&loop->lock, NULL);
+	pthread_cond_init(&loop->cond, NULL);
+	return loop;
+err_2:
+	err = errno;
+	close(loop->evfd);
+	errno = err;
+err_1:
+	err = errno;
+	close(loop->epfd);
+	errno = err;
+err_0:
+	free(loop);
+	return NULL;
+}
+
+#else /* !__linux__ */
+
+lc_loop_t *lc_loop_new(void)
+{
+	errno = ENOTSUP;
+	return NULL;
+}
+
+void lc_loop_free(lc_loop_t *loop)
+{
+	(void)loop;
+}
+
+int lc_loop_start(lc_loop_t *loop, int nthreads, const lc_thread_attr_t *attr)
+{
+	(void)loop; (void)nthreads; (void)attr;
+	errno = ENOTSUP;
+	return -1;
+}
+
+int lc_loop_run(lc_loop_t *loop)
+{
+	(void)loop;
+	errno = ENOTSUP;
+	return -1;
+}
+
+void lc_loop_stop(lc_loop_t *loop)
+{
+	(void)loop;
+}
+
+lc_loop_watch_t *lc_loop_add(lc_loop_t *loop, int fd, lc_loop_fn_t *fn, void *arg)
+{
+	(void)loop; (void)fd; (void)fn; (void)arg;
+	errno = ENOTSUP;
+	return NULL;
+}
+
+void lc_loop_del(lc_loop_t *loop, lc_loop_watch_t *w)
+{
+	(void)loop; (void)w;
+}
+
+int lc_loop_timer(lc_loop_watch_t *w, int ms)
+{
+	(void)w; (void)ms;
+	errno = ENOTSUP;
+	return -1;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _LOOP_H
+#define _LOOP_H 1
+
+#include <librecast/types.h>
+
+/* epoll event loop, run by any number of threads.  Each watched file
+ * descriptor is armed one-shot, so its callback runs on one thread at a time,
+ * and is re-armed when the callback returns. Threads are stopped by writing to
+ * an eventfd, which wakes them all. */
+typedef struct lc_loop_s lc_loop_t;
+typedef struct lc_loop_watch_s lc_loop_watch_t;
+typedef void lc_loop_fn_t(void *arg);
+
+/* create loop. Returns NULL and sets errno on failure (ENOTSUP if epoll is
+ * unavailable) */
+lc_loop_t *lc_loop_new(void);
+
+/* stop loop and free it, and all watches */
+void lc_loop_free(lc_loop_t *loop);
+
+/* start nthreads threads running the loop, placed as attr (NULL = default) */
+int lc_loop_start(lc_loop_t *loop, int nthreads, const lc_thread_attr_t *attr);
+
+/* run loop in calling thread until lc_loop_stop() is called */
+int lc_loop_run(lc_loop_t *loop);
+
+/* stop all threads running the loop and wait for them to return. Must not be
+ * called from a watch callback */
+void lc_loop_stop(lc_loop_t *loop);
+
+/* call fn(arg) whenever fd is readable */
+lc_loop_watch_t *lc_loop_add(lc_loop_t *loop, int fd, lc_loop_fn_t *fn, void *arg);
+
+/* stop watching. Once this returns the callback is not running, and will not
+ * be called again. Memory is reclaimed when the loop is next stopped */
+void lc_loop_del(lc_loop_t *loop, lc_loop_watch_t *w);
+
+/* call the watch callback after ms milliseconds, whether or not the fd is
+ * readable. ms < 0 cancels. Call from the watch callback only */
+int lc_loop_timer(lc_loop_watch_t *w, int ms);
+
+#endif /* _LOOP_H */
@@ -0,0 +1,507 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#define _GNU_SOURCE
+#include "packet.h"
+#include "librecast_pvt.h"
+#include <librecast/net.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define RX_BLOCK_SIZE (1 << 18)
+#define RX_BLOCK_NR 16
+#define RX_FRAME_SIZE 2048
+#define RX_BLOCK_TOV 1 /* ms before a partly filled block is retired */
+#define TX_FRAME_SIZE 2048
+#define TX_FRAME_NR 256
+#define TX_BLOCK_SIZE (1 << 16)
+#define TX_DATA_OFF TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+/* offsets into Ethernet frame of IPv6 / UDP fields */
+#define ETH_HLEN_ 14
+#define OFF_ETHERTYPE 12
+#define OFF_NEXTHDR (ETH_HLEN_ + 6)
+#define OFF_SRC (ETH_HLEN_ + 8)
+#define OFF_DST (ETH_HLEN_ + 24)
+#define OFF_UDP (ETH_HLEN_ + 40)
+#define OFF_DPORT (OFF_UDP + 2)
+#define OFF_PAYLOAD (OFF_UDP + 8)
+
+/* instructions: 6 prologue, 11 per group, 1 epilogue */
+#define FILTER_GROUP_INSNS 11
+#define FILTER_MAX_GROUPS ((BPF_MAXINSNS - 7) / FILTER_GROUP_INSNS)
+
+struct lc_packet_s {
+	int fd;
+	unsigned int ifx;
+	uint8_t *map;
+	size_t maplen;
+	uint8_t *rx;
+	uint8_t *tx;
+	unsigned int rxblock;   /* current rx block */
+	int rxopen;             /* current rx block held by us */
+	uint32_t rxleft;        /* packets left to read in block */
+	uint8_t *rxpkt;         /* next packet in block */
+	unsigned int txframe;   /* next tx frame */
+	int hops;
+	unsigned char mac[ETH_ALEN];
+	struct in6_addr src;
+	pthread_mutex_t txlock;
+	pthread_mutex_t grplock;
+	struct sockaddr_in6 *grp; /* groups joined */
+	size_t ngrp;
+};
+
+static struct tpacket_block_desc *lc_packet_block(lc_packet_t *pkt, unsigned int i)
+{
+	return (struct tpacket_block_desc *)(pkt->rx + (size_t)i * RX_BLOCK_SIZE);
+}
+
+static int lc_packet_filter_attach(lc_packet_t *pkt)
+{
+	struct sock_filter *f, *p;
+	struct sock_fprog prog;
+	size_t n = pkt->ngrp;
+	int rc;
+
+	if (n > FILTER_MAX_GROUPS) n = 0; /* too many - accept all, filter in userspace */
+	f = p = calloc(7 + n * FILTER_GROUP_INSNS, sizeof(struct sock_filter));
+	if (!f) return -1;
+	if (!pkt->ngrp) {
+		*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+		goto attach;
+	}
+	*p++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H | BPF_ABS, OFF_ETHERTYPE);
+	*p++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IPV6, 1, 0);
+	*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+	*p++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, OFF_NEXTHDR);
+	*p++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 1, 0);
+	*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+	for (size_t i = 0; i < n; i++) {
+		uint32_t w[4];
+		memcpy(w, &pkt->grp[i].sin6_addr, sizeof w);
+		/* match each word of the group address, then the port; on
+		 * mismatch, jump to the next group */
+		for (int j = 0; j < 4; j++) {
+			*p++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, OFF_DST + j * 4);
+			*p++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(w[j]),
+					0, FILTER_GROUP_INSNS - 2 - j * 2);
+		}
+		*p++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H | BPF_ABS, OFF_DPORT);
+		*p++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+				ntohs(pkt->grp[i].sin6_port), 0, 1);
+		*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	}
+	*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (n) ? 0 : 0xffffffff);
+attach:
+	prog.len = p - f;
+	prog.filter = f;
+	rc = setsockopt(pkt->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof prog);
+	free(f);
+	return rc;
+}
+
+/* the kernel filter matches groups exactly, unless there are too many to fit,
+ * in which case we check here */
+static int lc_packet_joined(lc_packet_t *pkt, struct in6_addr *dst, in_port_t port)
+{
+	int rc = 0;
+
+	if (__atomic_load_n(&pkt->ngrp, __ATOMIC_RELAXED) <= FILTER_MAX_GROUPS) return 1;
+	pthread_mutex_lock(&pkt->grplock);
+	for (size_t i = 0; i < pkt->ngrp; i++) {
+		if (pkt->grp[i].sin6_port == port
+		&& !memcmp(&pkt->grp[i].sin6_addr, dst, sizeof(struct in6_addr))) {
+			rc = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pkt->grplock);
+	return rc;
+}
+
+int lc_packet_mute(int fd)
+{
+	struct sock_filter f = BPF_STMT(BPF_RET | BPF_K, 0);
+	struct sock_fprog prog = { .len = 1, .filter = &f };
+	return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof prog);
+}
+
+int lc_packet_filter(lc_packet_t *pkt, struct sockaddr_in6 *sa, int join)
+{
+	size_t i;
+	int rc = 0;
+
+	pthread_mutex_lock(&pkt->grplock);
+	for (i = 0; i < pkt->ngrp; i++) {
+		if (pkt->grp[i].sin6_port == sa->sin6_port
+		&& !memcmp(&pkt->grp[i].sin6_addr, &sa->sin6_addr, sizeof(struct in6_addr)))
+			break;
+	}
+	if (join) {
+		struct sockaddr_in6 *grp;
+		if (i < pkt->ngrp) goto unlock;
+		grp = realloc(pkt->grp, (pkt->ngrp + 1) * sizeof(struct sockaddr_in6));
+		if (!grp) {
+			rc = -1;
+			goto unlock;
+		}
+		pkt->grp = grp;
+		memcpy(&pkt->grp[pkt->ngrp], sa, sizeof(struct sockaddr_in6));
+		__atomic_store_n(&pkt->ngrp, pkt->ngrp + 1, __ATOMIC_RELAXED);
+	}
+	else {
+		if (i == pkt->ngrp) goto unlock;
+		pkt->grp[i] = pkt->grp[pkt->ngrp - 1];
+		__atomic_store_n(&pkt->ngrp, pkt->ngrp - 1, __ATOMIC_RELAXED);
+	}
+	rc = lc_packet_filter_attach(pkt);
+unlock:
+	pthread_mutex_unlock(&pkt->grplock);
+	return rc;
+}
+
+/* parse Ethernet / IPv6 / UDP / librecast headers in place */
+static ssize_t lc_packet_parse(lc_packet_t *pkt, struct tpacket3_hdr *ppd, lc_message_t *msg)
+{
+	uint8_t *frame = (uint8_t *)ppd + ppd->tp_mac;
+	lc_message_head_t head;
+	uint16_t ethertype, sport, dport, udplen;
+	size_t len = ppd->tp_snaplen;
+	size_t bytes;
+
+	if (len < OFF_PAYLOAD + sizeof(lc_message_head_t)) return -1;
+	memcpy(&ethertype, frame + OFF_ETHERTYPE, sizeof ethertype);
+	if (ntohs(ethertype) != ETH_P_IPV6 || frame[OFF_NEXTHDR] != IPPROTO_UDP) return -1;
+	memcpy(&dport, frame + OFF_DPORT, sizeof dport);
+	if (!lc_packet_joined(pkt, (struct in6_addr *)(frame + OFF_DST), dport)) return -1;
+	memcpy(&sport, frame + OFF_UDP, sizeof sport);
+	memcpy(&udplen, frame + OFF_UDP + 4, sizeof udplen);
+	bytes = ntohs(udplen) - 8;
+	if (ntohs(udplen) < 8 || bytes > len - OFF_PAYLOAD) return -1;
+
+	lc_msg_init(msg);
+	memcpy(&msg->dst, frame + OFF_DST, sizeof(struct in6_addr));
+	memcpy(&msg->src, frame + OFF_SRC, sizeof(struct in6_addr));
+	msg->srcport = sport;
+	memcpy(&head, frame + OFF_PAYLOAD, sizeof head);
+	msg->timestamp = be64toh(head.timestamp);
+	msg->seq = be64toh(head.seq);
+	msg->rnd = be64toh(head.rnd);
+	msg->op = head.op;
+	msg->len = be64toh(head.len);
+	if (msg->len > bytes - sizeof head) msg->len = bytes - sizeof head;
+	if (msg->len) msg->data = frame + OFF_PAYLOAD + sizeof head;
+	msg->bytes = bytes;
+	return bytes;
+}
+
+static void lc_packet_release(lc_packet_t *pkt)
+{
+	struct tpacket_block_desc *pbd = lc_packet_block(pkt, pkt->rxblock);
+	__atomic_store_n(&pbd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+	pkt->rxblock = (pkt->rxblock + 1) % RX_BLOCK_NR;
+	pkt->rxopen = 0;
+}
+
+ssize_t lc_packet_next(lc_packet_t *pkt, lc_message_t *msg, int timeout)
+{
+	struct pollfd fds = { .fd = pkt->fd, .events = POLLIN | POLLERR };
+	struct tpacket_block_desc *pbd;
+	struct tpacket3_hdr *ppd;
+	ssize_t rc;
+
+	for (;;) {
+		if (pkt->rxopen && !pkt->rxleft) lc_packet_release(pkt);
+		if (!pkt->rxopen) {
+			pbd = lc_packet_block(pkt, pkt->rxblock);
+			if (!(__atomic_load_n(&pbd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+				rc = poll(&fds, 1, timeout);
+				if (rc <= 0) return rc;
+				continue;
+			}
+			pkt->rxopen = 1;
+			pkt->rxleft = pbd->hdr.bh1.num_pkts;
+			pkt->rxpkt = (uint8_t *)pbd + pbd->hdr.bh1.offset_to_first_pkt;
+			continue;
+		}
+		ppd = (struct tpacket3_hdr *)pkt->rxpkt;
+		pkt->rxpkt += ppd->tp_next_offset;
+		pkt->rxleft--;
+		if ((rc = lc_packet_parse(pkt, ppd, msg)) >= 0) return rc;
+	}
+}
+
+static uint32_t lc_packet_csum_add(uint32_t sum, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	for (; len > 1; len -= 2, p += 2) sum += (p[0] << 8) | p[1];
+	if (len) sum += p[0] << 8;
+	return sum;
+}
+
+ssize_t lc_packet_sendmsg(lc_packet_t *pkt, struct sockaddr_in6 *dst, struct msghdr *msg, int flags)
+{
+	struct tpacket3_hdr *ppd;
+	uint8_t *frame, *ip6, *udp, *p;
+	ssize_t len = 0;
+	uint32_t sum;
+	uint16_t u16;
+	uint32_t u32;
+	int state;
+
+	for (size_t i = 0; i < msg->msg_iovlen; i++) len += msg->msg_iov[i].iov_len;
+	if (OFF_PAYLOAD + (size_t)len > TX_FRAME_SIZE - TX_DATA_OFF) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+	pthread_mutex_lock(&pkt->txlock);
+
+	/* wait for a free frame */
+	ppd = (struct tpacket3_hdr *)(pkt->tx + (size_t)pkt->txframe * TX_FRAME_SIZE);
+	while (__atomic_load_n(&ppd->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+		struct pollfd fds = { .fd = pkt->fd, .events = POLLOUT };
+		if (__atomic_load_n(&ppd->tp_status, __ATOMIC_ACQUIRE) == TP_STATUS_WRONG_FORMAT) {
+			ppd->tp_status = TP_STATUS_AVAILABLE;
+			break;
+		}
+		if (send(pkt->fd, NULL, 0, MSG_DONTWAIT) == -1 && errno != EAGAIN && errno != ENOBUFS) {
+			len = -1;
+			goto unlock;
+		}
+		poll(&fds, 1, 1);
+	}
+	frame = (uint8_t *)ppd + TX_DATA_OFF;
+
+	/* Ethernet - IPv6 multicast MAC is 33:33 + low 32 bits of group */
+	frame[0] = 0x33; frame[1] = 0x33;
+	memcpy(frame + 2, &dst->sin6_addr.s6_addr[12], 4);
+	memcpy(frame + ETH_ALEN, pkt->mac, ETH_ALEN);
+	u16 = htons(ETH_P_IPV6);
+	memcpy(frame + OFF_ETHERTYPE, &u16, 2);
+
+	/* IPv6 */
+	ip6 = frame + ETH_HLEN_;
+	u32 = htonl(6 << 28);
+	memcpy(ip6, &u32, 4);
+	u16 = htons(8 + len);
+	memcpy(ip6 + 4, &u16, 2);
+	ip6[6] = IPPROTO_UDP;
+	ip6[7] = pkt->hops;
+	memcpy(ip6 + 8, &pkt->src, 16);
+	memcpy(ip6 + 24, &dst->sin6_addr, 16);
+
+	/* UDP */
+	udp = frame + OFF_UDP;
+	memcpy(udp, &dst->sin6_port, 2); /* we're bound to the channel port */
+	memcpy(udp + 2, &dst->sin6_port, 2);
+	memcpy(udp + 4, &u16, 2);
+	memset(udp + 6, 0, 2);
+	p = udp + 8;
+	for (size_t i = 0; i < msg->msg_iovlen; i++) {
+		memcpy(p, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+		p += msg->msg_iov[i].iov_len;
+	}
+
+	/* checksum is mandatory for UDP over IPv6 */
+	sum = lc_packet_csum_add(0, ip6 + 8, 32);
+	sum += 8 + len + IPPROTO_UDP;
+	sum = lc_packet_csum_add(sum, udp, 8 + len);
+	while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+	u16 = htons(~sum & 0xffff);
+	if (!u16) u16 = 0xffff;
+	memcpy(udp + 6, &u16, 2);
+
+	ppd->tp_len = OFF_PAYLOAD + len;
+	__atomic_store_n(&ppd->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+	pkt->txframe = (pkt->txframe + 1) % TX_FRAME_NR;
+
+	if (!(flags & MSG_MORE)) {
+		if (send(pkt->fd, NULL, 0, MSG_DONTWAIT) == -1 && errno != EAGAIN && errno != ENOBUFS)
+			len = -1;
+	}
+unlock:
+	pthread_mutex_unlock(&pkt->txlock);
+	pthread_setcancelstate(state, NULL);
+	return len;
+}
+
+void lc_packet_hops(lc_packet_t *pkt, int hops)
+{
+	pkt->hops = hops;
+}
+
+int lc_packet_fd(lc_packet_t *pkt)
+{
+	return pkt->fd;
+}
+
+/* find source address for interface - prefer global scope */
+static void lc_packet_srcaddr(lc_packet_t *pkt, const char *ifname)
+{
+	struct ifaddrs *ifaddr, *ifa;
+	struct in6_addr *addr;
+
+	if (getifaddrs(&ifaddr) == -1) return;
+	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+		if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET6) continue;
+		if (strcmp(ifa->ifa_name, ifname)) continue;
+		addr = &((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr;
+		if (IN6_IS_ADDR_UNSPECIFIED(&pkt->src) || !IN6_IS_ADDR_LINKLOCAL(addr))
+			memcpy(&pkt->src, addr, sizeof(struct in6_addr));
+	}
+	freeifaddrs(ifaddr);
+}
+
+void lc_packet_free(lc_packet_t *pkt)
+{
+	if (!pkt) return;
+	if (pkt->map) munmap(pkt->map, pkt->maplen);
+	if (pkt->fd != -1) close(pkt->fd);
+	pthread_mutex_destroy(&pkt->txlock);
+	pthread_mutex_destroy(&pkt->grplock);
+	free(pkt->grp);
+	free(pkt);
+}
+
+lc_packet_t *lc_packet_new(unsigned int ifx)
+{
+	lc_packet_t *pkt;
+	struct tpacket_req3 rxreq = {
+		.tp_block_size = RX_BLOCK_SIZE,
+		.tp_block_nr = RX_BLOCK_NR,
+		.tp_frame_size = RX_FRAME_SIZE,
+		.tp_frame_nr = RX_BLOCK_SIZE / RX_FRAME_SIZE * RX_BLOCK_NR,
+		.tp_retire_blk_tov = RX_BLOCK_TOV,
+	};
+	struct tpacket_req3 txreq = {
+		.tp_block_size = TX_BLOCK_SIZE,
+		.tp_block_nr = TX_FRAME_NR * TX_FRAME_SIZE / TX_BLOCK_SIZE,
+		.tp_frame_size = TX_FRAME_SIZE,
+		.tp_frame_nr = TX_FRAME_NR,
+	};
+	struct sockaddr_ll sll = {
+		.sll_family = AF_PACKET,
+		.sll_protocol = htons(ETH_P_IPV6),
+		.sll_ifindex = ifx,
+	};
+	struct ifreq ifr = {0};
+	int opt, err;
+
+	if (!ifx || !if_indextoname(ifx, ifr.ifr_name)) {
+		errno = ENODEV;
+		return NULL;
+	}
+	if (!(pkt = calloc(1, sizeof(lc_packet_t)))) return NULL;
+	pthread_mutex_init(&pkt->txlock, NULL);
+	pthread_mutex_init(&pkt->grplock, NULL);
+	pkt->ifx = ifx;
+	pkt->hops = DEFAULT_MULTICAST_HOPS;
+	pkt->fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (pkt->fd == -1) goto err_0;
+
+	/* drop everything until groups are joined */
+	if (lc_packet_filter_attach(pkt)) goto err_0;
+	opt = TPACKET_V3;
+	if (setsockopt(pkt->fd, SOL_PACKET, PACKET_VERSION, &opt, sizeof opt)) goto err_0;
+#ifdef PACKET_IGNORE_OUTGOING
+	opt = 1;
+	setsockopt(pkt->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &opt, sizeof opt);
+#endif
+	if (setsockopt(pkt->fd, SOL_PACKET, PACKET_RX_RING, &rxreq, sizeof rxreq)) goto err_0;
+	if (setsockopt(pkt->fd, SOL_PACKET, PACKET_TX_RING, &txreq, sizeof txreq)) goto err_0;
+	pkt->maplen = (size_t)RX_BLOCK_SIZE * RX_BLOCK_NR + (size_t)TX_FRAME_SIZE * TX_FRAME_NR;
+	pkt->map = mmap(NULL, pkt->maplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE,
+			pkt->fd, 0);
+	if (pkt->map == MAP_FAILED) {
+		/* retry without locking, in case RLIMIT_MEMLOCK is low */
+		pkt->map = mmap(NULL, pkt->maplen, PROT_READ | PROT_WRITE, MAP_SHARED, pkt->fd, 0);
+	}
+	if (pkt->map == MAP_FAILED) {
+		pkt->map = NULL;
+		goto err_0;
+	}
+	pkt->rx = pkt->map;
+	pkt->tx = pkt->map + (size_t)RX_BLOCK_SIZE * RX_BLOCK_NR;
+	if (bind(pkt->fd, (struct sockaddr *)&sll, sizeof sll)) goto err_0;
+	if (!ioctl(pkt->fd, SIOCGIFHWADDR, &ifr))
+		memcpy(pkt->mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	lc_packet_srcaddr(pkt, ifr.ifr_name);
+	return pkt;
+err_0:
+	err = errno;
+	lc_packet_free(pkt);
+	errno = err;
+	return NULL;
+}
+
+#else /* !__linux__ */
+
+int lc_packet_mute(int fd)
+{
+	(void)fd;
+	errno = ENOTSUP;
+	return -1;
+}
+
+lc_packet_t *lc_packet_new(unsigned int ifx)
+{
+	(void)ifx;
+	errno = ENOTSUP;
+	return NULL;
+}
+
+void lc_packet_free(lc_packet_t *pkt)
+{
+	(void)pkt;
+}
+
+int lc_packet_fd(lc_packet_t *pkt)
+{
+	(void)pkt;
+	return -1;
+}
+
+int lc_packet_filter(lc_packet_t *pkt, struct sockaddr_in6 *sa, int join)
+{
+	(void)pkt; (void)sa; (void)join;
+	return -1;
+}
+
+void lc_packet_hops(lc_packet_t *pkt, int hops)
+{
+	(void)pkt; (void)hops;
+}
+
+ssize_t lc_packet_next(lc_packet_t *pkt, lc_message_t *msg, int timeout)
+{
+	(void)pkt; (void)msg; (void)timeout;
+	errno = ENOTSUP;
+	return -1;
+}
+
+ssize_t lc_packet_sendmsg(lc_packet_t *pkt, struct sockaddr_in6 *dst, struct msghdr *msg, int flags)
+{
+	(void)pkt; (void)dst; (void)msg; (void)flags;
+	errno = ENOTSUP;
+	return -1;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _PACKET_H
+#define _PACKET_H 1
+
+#include <librecast/types.h>
+
+/* AF_PACKET (TPACKET_V3) memory-mapped ring backend for lc_socket_t.
+ * Frames are filtered in the kernel to the groups joined, and received
+ * messages are parsed in place - msg->data points into the ring and is valid
+ * until the next call to lc_packet_next(). */
+typedef struct lc_packet_s lc_packet_t;
+
+/* open packet socket and map rings on interface ifx (requires CAP_NET_RAW) */
+lc_packet_t *lc_packet_new(unsigned int ifx);
+
+void lc_packet_free(lc_packet_t *pkt);
+
+/* return file descriptor of packet socket (for polling) */
+int lc_packet_fd(lc_packet_t *pkt);
+
+/* add (join != 0) or remove group sa from kernel filter */
+int lc_packet_filter(lc_packet_t *pkt, struct sockaddr_in6 *sa, int join);
+
+/* attach a kernel filter to socket fd which drops everything */
+int lc_packet_mute(int fd);
+
+/* set hop limit for sent packets */
+void lc_packet_hops(lc_packet_t *pkt, int hops);
+
+/* fetch next message, waiting up to timeout ms (-1 = forever). Returns bytes
+ * of UDP payload, 0 on timeout, -1 on error. msg->data is a view into the
+ * ring, and msg->free is NULL */
+ssize_t lc_packet_next(lc_packet_t *pkt, lc_message_t *msg, int timeout);
+
+/* queue UDP datagram to dst in tx ring. Ring is flushed to the network unless
+ * flags includes MSG_MORE. Safe to call from multiple threads */
+ssize_t lc_packet_sendmsg(lc_packet_t *pkt, struct sockaddr_in6 *dst, struct msghdr *msg, int flags);
+
+#endif /* _PACKET_H */
@@ -0,0 +1,373 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "pool.h"
+#include "thread.h"
+#include <librecast/net.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SHARDS_PER_WORKER 8
+#define SHARD_BUDGET 64 /* messages per shard visit, before moving on */
+
+typedef struct lc_pool_node_s lc_pool_node_t;
+struct lc_pool_node_s {
+	lc_pool_node_t *next;
+	lc_socket_call_t sc; /* copy - the listener may go away first */
+	lc_pool_pending_t *pending;
+	int epoch; /* reference held on pool->ep */
+	lc_message_t msg;
+};
+
+/* intrusive MPSC queue (Vyukov) - push is wait-free, pop is single consumer,
+ * which is whichever worker holds the shard */
+typedef struct lc_pool_shard_s {
+	lc_pool_node_t *head;   /* producers */
+	char pad0[64 - sizeof(void *)];
+	lc_pool_node_t *tail;   /* consumer */
+	lc_pool_node_t stub;
+	size_t depth;
+	int busy;               /* held by a worker */
+	char pad1[64];
+} lc_pool_shard_t;
+
+typedef struct lc_pool_worker_s {
+	lc_pool_t *pool;
+	pthread_t thread;
+	sem_t sem;
+	int id;
+	int sleeping;
+	lc_worker_stats_t stats;
+	uint64_t start;
+	char pad[64];
+} lc_pool_worker_t;
+
+struct lc_pool_s {
+	lc_pool_fn_t *fn;
+	lc_workers_key_t key;
+	lc_epoch_t *ep;
+	int nworkers;
+	int nshards;
+	int stop;
+	lc_pool_shard_t *shard;
+	lc_pool_worker_t *worker;
+};
+
+static uint64_t lc_pool_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void *lc_pool_data_free(void *data, void *hint)
+{
+	free(data);
+	return hint;
+}
+
+static void lc_pool_enqueue(lc_pool_shard_t *s, lc_pool_node_t *n)
+{
+	lc_pool_node_t *prev;
+	__atomic_store_n(&n->next, NULL, __ATOMIC_RELAXED);
+	prev = __atomic_exchange_n(&s->head, n, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+/* returns NULL if empty, or if a producer is part way through a push */
+static lc_pool_node_t *lc_pool_dequeue(lc_pool_shard_t *s)
+{
+	lc_pool_node_t *tail = s->tail, *next, *head;
+
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (tail == &s->stub) {
+		if (!next) return NULL;
+		s->tail = tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		s->tail = next;
+		return tail;
+	}
+	head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+	if (tail != head) return NULL;
+	lc_pool_enqueue(s, &s->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		s->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+static uint32_t lc_pool_hash(const void *data, size_t len, uint32_t h)
+{
+	const unsigned char *p = data;
+	for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * 16777619; /* FNV-1a */
+	return h;
+}
+
+static int lc_pool_shard(lc_pool_t *pool, lc_message_t *msg)
+{
+	uint32_t h = lc_pool_hash(&msg->dst, sizeof msg->dst, 2166136261);
+	if (pool->key == LC_WORKERS_SOURCE) {
+		h = lc_pool_hash(&msg->src, sizeof msg->src, h);
+		h = lc_pool_hash(&msg->srcport, sizeof msg->srcport, h);
+	}
+	return h % pool->nshards;
+}
+
+void lc_pool_pending_init(lc_pool_pending_t *pending)
+{
+	pending->n = 0;
+	pending->waiting = 0;
+	pthread_mutex_init(&pending->mtx, NULL);
+	pthread_cond_init(&pending->cond, NULL);
+}
+
+void lc_pool_pending_destroy(lc_pool_pending_t *pending)
+{
+	pthread_cond_destroy(&pending->cond);
+	pthread_mutex_destroy(&pending->mtx);
+}
+
+/* a message counted by pending is done with.  The lock is only taken for the
+ * last one, with someone waiting.  Either they see n drop to zero, or we see
+ * them waiting: both are seq_cst */
+static void lc_pool_done(lc_pool_pending_t *pending)
+{
+	if (__atomic_sub_fetch(&pending->n, 1, __ATOMIC_SEQ_CST)) return;
+	if (!__atomic_load_n(&pending->waiting, __ATOMIC_SEQ_CST)) return;
+	pthread_mutex_lock(&pending->mtx);
+	pthread_cond_broadcast(&pending->cond);
+	pthread_mutex_unlock(&pending->mtx);
+}
+
+void lc_pool_wait(lc_pool_pending_t *pending)
+{
+	pthread_mutex_lock(&pending->mtx);
+	__atomic_add_fetch(&pending->waiting, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&pending->n, __ATOMIC_SEQ_CST))
+		pthread_cond_wait(&pending->cond, &pending->mtx);
+	__atomic_sub_fetch(&pending->waiting, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&pending->mtx);
+}
+
+int lc_pool_self(lc_pool_t *pool)
+{
+	pthread_t self = pthread_self();
+
+	for (int i = 0; i < pool->nworkers; i++) {
+		if (pool->worker[i].thread && pthread_equal(pool->worker[i].thread, self)) return 1;
+	}
+	return 0;
+}
+
+/* deliver up to SHARD_BUDGET messages from shard, if no other worker holds it.
+ * Returns number delivered */
+static int lc_pool_drain(lc_pool_worker_t *w, lc_pool_shard_t *s)
+{
+	lc_epoch_t *ep = w->pool->ep;
+	lc_pool_node_t *n;
+	uint64_t t0;
+	int msgs = 0, e = 0;
+
+	if (!__atomic_load_n(&s->depth, __ATOMIC_ACQUIRE)) return 0;
+	if (__atomic_exchange_n(&s->busy, 1, __ATOMIC_ACQUIRE)) return 0;
+	t0 = lc_pool_now();
+	/* callbacks run in a read section, as they would from the listener */
+	if (ep) e = lc_epoch_enter(ep);
+	while (msgs < SHARD_BUDGET && (n = lc_pool_dequeue(s))) {
+		__atomic_sub_fetch(&s->depth, 1, __ATOMIC_RELEASE);
+		w->pool->fn(&n->sc, &n->msg);
+		lc_msg_free(&n->msg);
+		/* pending lives in the socket, which our read section keeps */
+		lc_pool_done(n->pending);
+		if (ep) lc_epoch_release(ep, n->epoch);
+		free(n);
+		msgs++;
+	}
+	if (ep) lc_epoch_exit(ep, e);
+	__atomic_store_n(&s->busy, 0, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&w->stats.busy, lc_pool_now() - t0, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&w->stats.msgs, msgs, __ATOMIC_RELAXED);
+	return msgs;
+}
+
+/* any shard with work waiting, that no worker holds */
+static int lc_pool_pending(lc_pool_t *pool)
+{
+	for (int i = 0; i < pool->nshards; i++) {
+		lc_pool_shard_t *s = &pool->shard[i];
+		if (__atomic_load_n(&s->depth, __ATOMIC_SEQ_CST) && !__atomic_load_n(&s->busy, __ATOMIC_SEQ_CST))
+			return 1;
+	}
+	return 0;
+}
+
+static void *lc_pool_worker(void *arg)
+{
+	lc_pool_worker_t *w = arg;
+	lc_pool_t *pool = w->pool;
+	int found, msgs;
+
+	while (!__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) {
+		found = 0;
+		/* home shards first */
+		for (int i = w->id; i < pool->nshards; i += pool->nworkers) {
+			found += lc_pool_drain(w, &pool->shard[i]);
+		}
+		/* then steal any shard with work waiting */
+		if (!found) for (int i = 0; i < pool->nshards; i++) {
+			if (i % pool->nworkers == w->id) continue;
+			if ((msgs = lc_pool_drain(w, &pool->shard[i]))) {
+				__atomic_add_fetch(&w->stats.stolen, 1, __ATOMIC_RELAXED);
+				found += msgs;
+			}
+		}
+		if (found) continue;
+		/* nothing to do - sleep, unless something arrived meanwhile */
+		__atomic_store_n(&w->sleeping, 1, __ATOMIC_SEQ_CST);
+		if (!lc_pool_pending(pool) && !__atomic_load_n(&pool->stop, __ATOMIC_SEQ_CST))
+			sem_wait(&w->sem);
+		__atomic_store_n(&w->sleeping, 0, __ATOMIC_SEQ_CST);
+	}
+	return NULL;
+}
+
+static void lc_pool_wake(lc_pool_t *pool, int home)
+{
+	lc_pool_worker_t *w = &pool->worker[home];
+
+	/* wake home worker, or if it's busy, someone who can steal */
+	if (!__atomic_load_n(&w->sleeping, __ATOMIC_SEQ_CST)) {
+		for (int i = 0; i < pool->nworkers; i++) {
+			if (__atomic_load_n(&pool->worker[i].sleeping, __ATOMIC_SEQ_CST)) {
+				w = &pool->worker[i];
+				break;
+			}
+		}
+	}
+	if (__atomic_exchange_n(&w->sleeping, 0, __ATOMIC_SEQ_CST)) sem_post(&w->sem);
+}
+
+int lc_pool_push(lc_pool_t *pool, lc_socket_call_t *sc, lc_message_t *msg,
+		lc_pool_pending_t *pending)
+{
+	lc_pool_node_t *n;
+	int shard;
+
+	if (!(n = malloc(sizeof(lc_pool_node_t)))) return -1;
+	memcpy(&n->sc, sc, sizeof(lc_socket_call_t));
+	memcpy(&n->msg, msg, sizeof(lc_message_t));
+	if (msg->data && !msg->free) {
+		/* not ours to keep (eg. a view into a packet ring) - copy it */
+		if (!(n->msg.data = malloc(msg->len))) {
+			free(n);
+			return -1;
+		}
+		memcpy(n->msg.data, msg->data, msg->len);
+		n->msg.free = &lc_pool_data_free;
+	}
+	msg->data = NULL;
+	n->pending = pending;
+	if (pool->ep) n->epoch = lc_epoch_hold(pool->ep);
+	__atomic_add_fetch(&pending->n, 1, __ATOMIC_SEQ_CST);
+	shard = lc_pool_shard(pool, msg);
+	lc_pool_enqueue(&pool->shard[shard], n);
+	__atomic_add_fetch(&pool->shard[shard].depth, 1, __ATOMIC_SEQ_CST);
+	lc_pool_wake(pool, shard % pool->nworkers);
+	return 0;
+}
+
+int lc_pool_stats(lc_pool_t *pool, lc_worker_stats_t *stats, int n)
+{
+	uint64_t now = lc_pool_now();
+
+	for (int i = 0; i < n && i < pool->nworkers; i++) {
+		lc_pool_worker_t *w = &pool->worker[i];
+		stats[i].msgs = __atomic_load_n(&w->stats.msgs, __ATOMIC_RELAXED);
+		stats[i].stolen = __atomic_load_n(&w->stats.stolen, __ATOMIC_RELAXED);
+		stats[i].busy = __atomic_load_n(&w->stats.busy, __ATOMIC_RELAXED);
+		stats[i].elapsed = now - w->start;
+		stats[i].depth = 0;
+		for (int j = i; j < pool->nshards; j += pool->nworkers) {
+			stats[i].depth += __atomic_load_n(&pool->shard[j].depth, __ATOMIC_RELAXED);
+		}
+	}
+	return pool->nworkers;
+}
+
+void lc_pool_free(lc_pool_t *pool)
+{
+	lc_pool_node_t *n;
+
+	if (!pool) return;
+	__atomic_store_n(&pool->stop, 1, __ATOMIC_SEQ_CST);
+	for (int i = 0; pool->worker && i < pool->nworkers; i++) {
+		if (!pool->worker[i].thread) continue;
+		sem_post(&pool->worker[i].sem);
+		pthread_join(pool->worker[i].thread, NULL);
+	}
+	for (int i = 0; pool->worker && i < pool->nworkers; i++) sem_destroy(&pool->worker[i].sem);
+	for (int i = 0; pool->shard && i < pool->nshards; i++) {
+		while ((n = lc_pool_dequeue(&pool->shard[i]))) {
+			lc_msg_free(&n->msg);
+			lc_pool_done(n->pending);
+			if (pool->ep) lc_epoch_release(pool->ep, n->epoch);
+			free(n);
+		}
+	}
+	free(pool->shard);
+	free(pool->worker);
+	free(pool);
+}
+
+lc_pool_t *lc_pool_new(int nworkers, lc_workers_key_t key, lc_pool_fn_t *fn,
+		const lc_thread_attr_t *attr, lc_epoch_t *ep)
+{
+	lc_pool_t *pool;
+	int err;
+
+	if (nworkers <= 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!(pool = calloc(1, sizeof(lc_pool_t)))) return NULL;
+	pool->fn = fn;
+	pool->key = key;
+	pool->ep = ep;
+	pool->nworkers = nworkers;
+	pool->nshards = nworkers * SHARDS_PER_WORKER;
+	pool->shard = calloc(pool->nshards, sizeof(lc_pool_shard_t));
+	pool->worker = calloc(nworkers, sizeof(lc_pool_worker_t));
+	if (!pool->shard || !pool->worker) goto err_0;
+	for (int i = 0; i < pool->nshards; i++) {
+		pool->shard[i].head = pool->shard[i].tail = &pool->shard[i].stub;
+	}
+	for (int i = 0; i < nworkers; i++) {
+		lc_pool_worker_t *w = &pool->worker[i];
+		w->pool = pool;
+		w->id = i;
+		w->start = lc_pool_now();
+		sem_init(&w->sem, 0, 0);
+	}
+	for (int i = 0; i < nworkers; i++) {
+		lc_pool_worker_t *w = &pool->worker[i];
+		if ((err = lc_thread_create(&w->thread, attr, &lc_pool_worker, w))) {
+			w->thread = 0;
+			errno = err;
+			goto err_0;
+		}
+	}
+	return pool;
+err_0:
+	err = errno;
+	lc_pool_free(pool);
+	errno = err;
+	return NULL;
+}
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _POOL_H
+#define _POOL_H 1
+
+#include <librecast/types.h>
+#include "epoch.h"
+#include <pthread.h>
+
+/* worker pool for message callbacks.  Messages are sharded by channel (or
+ * channel and source) onto lock-free multi-producer queues. Each shard has a
+ * home worker, and is drained by one worker at a time, so messages within a
+ * shard are delivered in order.  Idle workers steal whole shards from busy
+ * ones. */
+typedef struct lc_pool_s lc_pool_t;
+
+/* messages pushed and not yet delivered, for lc_pool_wait() */
+typedef struct lc_pool_pending_s {
+	int n;
+	int waiting; /* threads in lc_pool_wait() */
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+} lc_pool_pending_t;
+
+/* deliver message - called from worker threads with a copy of the
+ * lc_socket_call_t the message was pushed with */
+typedef void lc_pool_fn_t(void *sc, lc_message_t *msg);
+
+/* create pool of nworkers threads, placed as attr (NULL = default).  If ep is
+ * set, queued messages hold a reference on it until delivered, so whatever
+ * they point to outlives the read section they were pushed from */
+lc_pool_t *lc_pool_new(int nworkers, lc_workers_key_t key, lc_pool_fn_t *fn,
+		const lc_thread_attr_t *attr, lc_epoch_t *ep);
+
+/* stop workers and free pool. Messages still queued are discarded */
+void lc_pool_free(lc_pool_t *pool);
+
+/* queue msg for delivery with callbacks from sc.  Takes ownership of
+ * msg->data, copying it if msg has no free function (not ours to keep).
+ * pending counts msg until it is delivered */
+int lc_pool_push(lc_pool_t *pool, lc_socket_call_t *sc, lc_message_t *msg,
+		lc_pool_pending_t *pending);
+
+void lc_pool_pending_init(lc_pool_pending_t *pending);
+void lc_pool_pending_destroy(lc_pool_pending_t *pending);
+
+/* sleep until every message counted by pending is delivered.  Must not be
+ * called from a worker, which may be delivering one of them */
+void lc_pool_wait(lc_pool_pending_t *pending);
+
+/* is the calling thread one of pool's workers? */
+int lc_pool_self(lc_pool_t *pool);
+
+/* copy stats for up to n workers into stats, returning number of workers */
+int lc_pool_stats(lc_pool_t *pool, lc_worker_stats_t *stats, int n);
+
+#endif /* _POOL_H */
@@ -0,0 +1,272 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "reorder.h"
+#include <librecast/net.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REORDER_SENDERS 16
+#define NIL UINT32_MAX
+
+typedef struct lc_reorder_sender_s {
+	struct in6_addr src;
+	in_port_t port;
+	int active;
+	lc_seq_t next;      /* next sequence number to deliver */
+	lc_seq_t gap;       /* messages skipped since last delivery */
+	unsigned int held;  /* messages held in ring */
+	uint64_t since;     /* time (ms) current gap started waiting */
+	uint64_t used;      /* time (ms) last message received */
+	uint32_t *ring;     /* slot index for each seq % depth, or NIL */
+} lc_reorder_sender_t;
+
+struct lc_reorder_s {
+	lc_message_t *slot; /* preallocated message slots */
+	uint32_t *free;     /* stack of free slot indices */
+	uint32_t nfree;
+	uint32_t depth;
+	uint64_t hold;
+	uint32_t *rings;
+	lc_reorder_sender_t sender[REORDER_SENDERS];
+};
+
+static uint64_t lc_reorder_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void *lc_reorder_data_free(void *data, void *hint)
+{
+	free(data);
+	return hint;
+}
+
+static void lc_reorder_deliver(lc_reorder_sender_t *s, lc_message_t *msg,
+		lc_reorder_fn_t *deliver, void *arg)
+{
+	msg->gap = s->gap;
+	s->gap = 0;
+	deliver(arg, msg);
+}
+
+static void lc_reorder_release(lc_reorder_t *ro, lc_reorder_sender_t *s, lc_seq_t seq,
+		lc_reorder_fn_t *deliver, void *arg)
+{
+	uint32_t *r = &s->ring[seq % ro->depth];
+	lc_message_t *msg = &ro->slot[*r];
+
+	lc_reorder_deliver(s, msg, deliver, arg);
+	lc_msg_free(msg);
+	ro->free[ro->nfree++] = *r;
+	*r = NIL;
+	s->held--;
+}
+
+/* deliver contiguous messages from s->next onwards */
+static void lc_reorder_contiguous(lc_reorder_t *ro, lc_reorder_sender_t *s,
+		lc_reorder_fn_t *deliver, void *arg)
+{
+	int released = 0;
+	while (s->held && s->ring[s->next % ro->depth] != NIL) {
+		lc_reorder_release(ro, s, s->next++, deliver, arg);
+		released++;
+	}
+	if (released && s->held) s->since = lc_reorder_now();
+}
+
+/* give up waiting for anything before seq upto */
+static void lc_reorder_skip(lc_reorder_t *ro, lc_reorder_sender_t *s, lc_seq_t upto,
+		lc_reorder_fn_t *deliver, void *arg)
+{
+	lc_seq_t end = (upto - s->next > ro->depth) ? s->next + ro->depth : upto;
+
+	for (lc_seq_t seq = s->next; seq < end; seq++) {
+		if (s->ring[seq % ro->depth] != NIL)
+			lc_reorder_release(ro, s, seq, deliver, arg);
+		else
+			s->gap++;
+	}
+	s->gap += upto - end;
+	s->next = upto;
+}
+
+/* skip the oldest gap, delivering what follows it */
+static void lc_reorder_skip_gap(lc_reorder_t *ro, lc_reorder_sender_t *s,
+		lc_reorder_fn_t *deliver, void *arg)
+{
+	lc_seq_t seq = s->next;
+	while (s->ring[seq % ro->depth] == NIL) seq++;
+	lc_reorder_skip(ro, s, seq, deliver, arg);
+	lc_reorder_contiguous(ro, s, deliver, arg);
+	s->since = lc_reorder_now();
+}
+
+static lc_reorder_sender_t *lc_reorder_sender(lc_reorder_t *ro, lc_message_t *msg,
+		lc_reorder_fn_t *deliver, void *arg)
+{
+	lc_reorder_sender_t *s, *unused = NULL, *lru = NULL, *busy = NULL;
+
+	for (int i = 0; i < REORDER_SENDERS; i++) {
+		s = &ro->sender[i];
+		if (!s->active) {
+			if (!unused) unused = s;
+		}
+		else if (s->port == msg->srcport && !memcmp(&s->src, &msg->src, sizeof(struct in6_addr)))
+			return s;
+		else if (!s->held) {
+			if (!lru || s->used < lru->used) lru = s;
+		}
+		else if (!busy || s->since < busy->since) busy = s;
+	}
+	/* table full - recycle the idle sender heard from least recently, or
+	 * flush the sender that has been waiting longest */
+	s = (unused) ? unused : (lru) ? lru : busy;
+	while (s->held) lc_reorder_skip_gap(ro, s, deliver, arg);
+	memset(s, 0, offsetof(lc_reorder_sender_t, ring));
+	memcpy(&s->src, &msg->src, sizeof(struct in6_addr));
+	s->port = msg->srcport;
+	s->next = msg->seq;
+	s->active = 1;
+	return s;
+}
+
+void lc_reorder_push(lc_reorder_t *ro, lc_message_t *msg, lc_reorder_fn_t *deliver, void *arg)
+{
+	lc_reorder_sender_t *s;
+	uint64_t now = lc_reorder_now();
+	uint32_t i;
+
+	s = lc_reorder_sender(ro, msg, deliver, arg);
+	s->used = now;
+	if (s->held && now - s->since >= ro->hold)
+		lc_reorder_skip_gap(ro, s, deliver, arg);
+	if (msg->seq >= s->next + ro->depth) {
+		lc_reorder_skip(ro, s, msg->seq - ro->depth + 1, deliver, arg);
+		lc_reorder_contiguous(ro, s, deliver, arg);
+	}
+
+	/* no free slots - skip gaps, longest waiting first */
+	while (msg->seq > s->next && !ro->nfree) {
+		lc_reorder_sender_t *oldest = NULL;
+		for (int j = 0; j < REORDER_SENDERS; j++) {
+			lc_reorder_sender_t *p = &ro->sender[j];
+			if (p->held && (!oldest || p->since < oldest->since)) oldest = p;
+		}
+		if (oldest == s) {
+			/* skip up to this message, which can then be delivered */
+			lc_reorder_skip(ro, s, msg->seq, deliver, arg);
+			s->since = now;
+		}
+		else lc_reorder_skip_gap(ro, oldest, deliver, arg);
+	}
+
+	if (msg->seq < s->next) return; /* too late, already skipped */
+	if (msg->seq == s->next) {
+		lc_reorder_deliver(s, msg, deliver, arg);
+		s->next++;
+		lc_reorder_contiguous(ro, s, deliver, arg);
+		return;
+	}
+	if (s->ring[msg->seq % ro->depth] != NIL) return; /* duplicate */
+
+	/* hold message, taking ownership of its data */
+	i = ro->free[--ro->nfree];
+	memcpy(&ro->slot[i], msg, sizeof(lc_message_t));
+	if (msg->data && !msg->free) {
+		/* not ours to keep (eg. a view into a packet ring) - copy it */
+		if (!(ro->slot[i].data = malloc(msg->len))) {
+			ro->free[ro->nfree++] = i;
+			return;
+		}
+		memcpy(ro->slot[i].data, msg->data, msg->len);
+		ro->slot[i].free = &lc_reorder_data_free;
+	}
+	msg->data = NULL;
+	s->ring[msg->seq % ro->depth] = i;
+	if (!s->held++) s->since = now;
+}
+
+int lc_reorder_expire(lc_reorder_t *ro, lc_reorder_fn_t *deliver, void *arg)
+{
+	uint64_t now = lc_reorder_now();
+	int wait = -1;
+
+	for (int i = 0; i < REORDER_SENDERS; i++) {
+		lc_reorder_sender_t *s = &ro->sender[i];
+		if (!s->held) continue;
+		if (now - s->since >= ro->hold)
+			lc_reorder_skip_gap(ro, s, deliver, arg);
+		if (s->held) {
+			uint64_t left = ro->hold - (now - s->since);
+			if (wait == -1 || left < (uint64_t)wait) wait = (int)left;
+		}
+	}
+	return wait;
+}
+
+unsigned int lc_reorder_held(lc_reorder_t *ro)
+{
+	return ro->depth - ro->nfree;
+}
+
+int lc_reorder_timeout(lc_reorder_t *ro)
+{
+	uint64_t now = lc_reorder_now(), age;
+	int wait = -1;
+
+	for (int i = 0; i < REORDER_SENDERS; i++) {
+		lc_reorder_sender_t *s = &ro->sender[i];
+		if (!s->held) continue;
+		age = now - s->since;
+		if (age >= ro->hold) return 0;
+		if (wait == -1 || ro->hold - age < (uint64_t)wait) wait = (int)(ro->hold - age);
+	}
+	return wait;
+}
+
+void lc_reorder_free(lc_reorder_t *ro)
+{
+	if (!ro) return;
+	for (int i = 0; i < REORDER_SENDERS; i++) {
+		lc_reorder_sender_t *s = &ro->sender[i];
+		for (uint32_t j = 0; s->held && j < ro->depth; j++) {
+			if (s->ring[j] == NIL) continue;
+			lc_msg_free(&ro->slot[s->ring[j]]);
+			s->held--;
+		}
+	}
+	free(ro->rings);
+	free(ro->free);
+	free(ro->slot);
+	free(ro);
+}
+
+lc_reorder_t *lc_reorder_new(unsigned int depth, unsigned int hold)
+{
+	lc_reorder_t *ro;
+
+	if (!depth) return NULL;
+	ro = calloc(1, sizeof(lc_reorder_t));
+	if (!ro) return NULL;
+	ro->slot = calloc(depth, sizeof(lc_message_t));
+	ro->free = calloc(depth, sizeof(uint32_t));
+	ro->rings = malloc(sizeof(uint32_t) * depth * REORDER_SENDERS);
+	if (!ro->slot || !ro->free || !ro->rings) {
+		lc_reorder_free(ro);
+		return NULL;
+	}
+	memset(ro->rings, 0xff, sizeof(uint32_t) * depth * REORDER_SENDERS);
+	for (int i = 0; i < REORDER_SENDERS; i++) {
+		ro->sender[i].ring = ro->rings + i * depth;
+	}
+	for (uint32_t i = 0; i < depth; i++) ro->free[i] = depth - 1 - i;
+	ro->nfree = depth;
+	ro->depth = depth;
+	ro->hold = hold;
+	return ro;
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _REORDER_H
+#define _REORDER_H 1
+
+#include <librecast/types.h>
+
+/* per-channel reorder buffer.  Out of order messages are held per sender
+ * (source address + port) in a preallocated ring of depth slots until the
+ * gap before them is filled, depth is exceeded, or they have been held for
+ * hold ms.  Skipped gaps are reported in msg->gap of the next message
+ * delivered from that sender. */
+typedef struct lc_reorder_s lc_reorder_t;
+
+typedef void lc_reorder_fn_t(void *arg, lc_message_t *msg);
+
+lc_reorder_t *lc_reorder_new(unsigned int depth, unsigned int hold);
+
+/* free buffer and any messages still held */
+void lc_reorder_free(lc_reorder_t *ro);
+
+/* add msg, calling deliver() for each message now ready, in order.
+ * Takes ownership of msg->data if msg is held: msg->data is set to NULL */
+void lc_reorder_push(lc_reorder_t *ro, lc_message_t *msg, lc_reorder_fn_t *deliver, void *arg);
+
+/* deliver messages held for longer than hold ms, skipping gaps.
+ * Returns ms until next message expires, or -1 if nothing is held */
+int lc_reorder_expire(lc_reorder_t *ro, lc_reorder_fn_t *deliver, void *arg);
+
+/* ms until next message expires (0 = now), or -1 if nothing is held */
+int lc_reorder_timeout(lc_reorder_t *ro);
+
+/* number of messages held */
+unsigned int lc_reorder_held(lc_reorder_t *ro);
+
+#endif /* _REORDER_H */
@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "senders.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NIL UINT32_MAX
+
+typedef struct lc_sender_s {
+	lc_sender_stats_t s;
+	uint64_t seen;  /* bitmap: bit i set => seq (s.seq - 1 - i) received */
+	uint32_t hash;
+	uint32_t hnext; /* hash bucket chain */
+	uint32_t prev;  /* LRU list, most recent at head */
+	uint32_t next;
+} lc_sender_t;
+
+struct lc_senders_s {
+	pthread_mutex_t mtx;
+	lc_sender_t *tab;
+	uint32_t *bucket;
+	uint32_t mask;  /* buckets - 1 */
+	uint32_t max;
+	uint32_t used;
+	uint32_t head;
+	uint32_t tail;
+};
+
+static inline uint64_t lc_senders_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint32_t lc_senders_hash(struct in6_addr *grp, struct in6_addr *src, in_port_t port)
+{
+	uint64_t w[4], h = port;
+	memcpy(w, grp, sizeof(struct in6_addr));
+	memcpy(w + 2, src, sizeof(struct in6_addr));
+	for (int i = 0; i < 4; i++) h = lc_senders_mix(h ^ w[i]);
+	return (uint32_t)h;
+}
+
+static void lc_senders_unlink(lc_senders_t *st, uint32_t i)
+{
+	lc_sender_t *e = &st->tab[i];
+	if (e->prev != NIL) st->tab[e->prev].next = e->next;
+	else st->head = e->next;
+	if (e->next != NIL) st->tab[e->next].prev = e->prev;
+	else st->tail = e->prev;
+}
+
+static void lc_senders_push(lc_senders_t *st, uint32_t i)
+{
+	lc_sender_t *e = &st->tab[i];
+	e->prev = NIL;
+	e->next = st->head;
+	if (st->head != NIL) st->tab[st->head].prev = i;
+	st->head = i;
+	if (st->tail == NIL) st->tail = i;
+}
+
+static uint32_t lc_senders_find(lc_senders_t *st, uint32_t hash,
+		struct in6_addr *grp, struct in6_addr *src, in_port_t port)
+{
+	for (uint32_t i = st->bucket[hash & st->mask]; i != NIL; i = st->tab[i].hnext) {
+		lc_sender_t *e = &st->tab[i];
+		if (e->hash == hash && e->s.port == port
+		 && !memcmp(&e->s.src, src, sizeof(struct in6_addr))
+		 && !memcmp(&e->s.grp, grp, sizeof(struct in6_addr)))
+			return i;
+	}
+	return NIL;
+}
+
+/* evict least recently used sender and return its slot */
+static uint32_t lc_senders_evict(lc_senders_t *st)
+{
+	uint32_t i = st->tail;
+	uint32_t *p = &st->bucket[st->tab[i].hash & st->mask];
+	while (*p != i) p = &st->tab[*p].hnext;
+	*p = st->tab[i].hnext;
+	lc_senders_unlink(st, i);
+	return i;
+}
+
+static void lc_senders_seq(lc_sender_t *e, lc_seq_t seq)
+{
+	lc_sender_stats_t *s = &e->s;
+	uint64_t d;
+
+	if (seq > s->seq) {
+		d = seq - s->seq;
+		s->lost += d - 1;
+		if (d < 64) e->seen = (e->seen << d) | (1ULL << (d - 1));
+		else e->seen = (d == 64) ? 1ULL << 63 : 0;
+		s->seq = seq;
+		s->received++;
+		return;
+	}
+	d = s->seq - seq;
+	if (d == 0 || (d <= 64 && e->seen & (1ULL << (d - 1)))) {
+		s->dups++;
+		return;
+	}
+	/* late arrival, previously counted as lost */
+	if (d <= 64) e->seen |= 1ULL << (d - 1);
+	if (s->lost) s->lost--;
+	s->reordered++;
+	s->received++;
+}
+
+void lc_senders_update(lc_senders_t *st, lc_message_t *msg)
+{
+	struct timespec ts;
+	lc_sender_t *e;
+	uint32_t i, hash;
+
+	hash = lc_senders_hash(&msg->dst, &msg->src, msg->srcport);
+	clock_gettime(CLOCK_REALTIME, &ts);
+	pthread_mutex_lock(&st->mtx);
+	i = lc_senders_find(st, hash, &msg->dst, &msg->src, msg->srcport);
+	if (i == NIL) {
+		i = (st->used < st->max) ? st->used++ : lc_senders_evict(st);
+		e = &st->tab[i];
+		memset(e, 0, sizeof(lc_sender_t));
+		memcpy(&e->s.grp, &msg->dst, sizeof(struct in6_addr));
+		memcpy(&e->s.src, &msg->src, sizeof(struct in6_addr));
+		e->s.port = msg->srcport;
+		e->s.seq = msg->seq;
+		e->s.received = 1;
+		e->hash = hash;
+		e->hnext = st->bucket[hash & st->mask];
+		st->bucket[hash & st->mask] = i;
+	}
+	else {
+		e = &st->tab[i];
+		lc_senders_unlink(st, i);
+		lc_senders_seq(e, msg->seq);
+	}
+	e->s.lastseen = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	lc_senders_push(st, i);
+	pthread_mutex_unlock(&st->mtx);
+}
+
+int lc_senders_get(lc_senders_t *st, struct in6_addr *grp, struct in6_addr *src,
+		in_port_t port, lc_sender_stats_t *stats)
+{
+	uint32_t i, hash = lc_senders_hash(grp, src, port);
+
+	pthread_mutex_lock(&st->mtx);
+	i = lc_senders_find(st, hash, grp, src, port);
+	if (i != NIL) memcpy(stats, &st->tab[i].s, sizeof(lc_sender_stats_t));
+	pthread_mutex_unlock(&st->mtx);
+
+	return (i == NIL) ? -1 : 0;
+}
+
+size_t lc_senders_list(lc_senders_t *st, lc_sender_stats_t *stats, size_t n)
+{
+	size_t c = 0;
+
+	pthread_mutex_lock(&st->mtx);
+	for (uint32_t i = st->head; i != NIL && c < n; i = st->tab[i].next) {
+		memcpy(&stats[c++], &st->tab[i].s, sizeof(lc_sender_stats_t));
+	}
+	pthread_mutex_unlock(&st->mtx);
+
+	return c;
+}
+
+void lc_senders_free(lc_senders_t *st)
+{
+	if (!st) return;
+	pthread_mutex_destroy(&st->mtx);
+	free(st->bucket);
+	free(st->tab);
+	free(st);
+}
+
+lc_senders_t *lc_senders_new(size_t max)
+{
+	lc_senders_t *st;
+	uint32_t buckets = 1;
+
+	if (!max || max >= NIL) return NULL;
+	while (buckets < max) buckets <<= 1;
+	st = calloc(1, sizeof(lc_senders_t));
+	if (!st) return NULL;
+	st->tab = calloc(max, sizeof(lc_sender_t));
+	st->bucket = malloc(buckets * sizeof(uint32_t));
+	if (!st->tab || !st->bucket) {
+		free(st->tab);
+		free(st->bucket);
+		free(st);
+		return NULL;
+	}
+	memset(st->bucket, 0xff, buckets * sizeof(uint32_t));
+	pthread_mutex_init(&st->mtx, NULL);
+	st->mask = buckets - 1;
+	st->max = max;
+	st->head = NIL;
+	st->tail = NIL;
+	return st;
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _SENDERS_H
+#define _SENDERS_H 1
+
+#include <librecast/types.h>
+
+/* bounded table of per-sender receive statistics, keyed on
+ * (channel, source address, source port).  When full, the sender least
+ * recently heard from is evicted. */
+typedef struct lc_senders_s lc_senders_t;
+
+lc_senders_t *lc_senders_new(size_t max);
+
+void lc_senders_free(lc_senders_t *st);
+
+/* account for received message msg */
+void lc_senders_update(lc_senders_t *st, lc_message_t *msg);
+
+/* copy stats for sender matching grp/src/port. Return 0 if found, -1 if not */
+int lc_senders_get(lc_senders_t *st, struct in6_addr *grp, struct in6_addr *src,
+		in_port_t port, lc_sender_stats_t *stats);
+
+/* copy up to n entries, most recently heard from first. Return number copied */
+size_t lc_senders_list(lc_senders_t *st, lc_sender_stats_t *stats, size_t n);
+
+#endif /* _SENDERS_H */
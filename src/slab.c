@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "slab.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct lc_slab_chunk_s lc_slab_chunk_t;
+struct lc_slab_chunk_s {
+	lc_slab_chunk_t *next;
+	size_t n;     /* objects */
+	size_t used;  /* objects carved so far */
+	max_align_t data[];
+};
+
+typedef struct lc_slab_free_s lc_slab_free_t;
+struct lc_slab_free_s {
+	lc_slab_free_t *next;
+};
+
+struct lc_slab_s {
+	pthread_mutex_t mtx;
+	size_t size;
+	size_t per;
+	size_t used;
+	size_t bytes;
+	lc_slab_chunk_t *chunk; /* carving from head */
+	lc_slab_free_t *free;   /* released objects */
+};
+
+/* new chunk of n objects, at the head if we're to carve from it */
+static lc_slab_chunk_t *lc_slab_chunk(lc_slab_t *slab, size_t n, int head)
+{
+	lc_slab_chunk_t *c;
+	size_t bytes;
+
+	if (n > (SIZE_MAX - sizeof(lc_slab_chunk_t)) / slab->size) return NULL;
+	bytes = sizeof(lc_slab_chunk_t) + n * slab->size;
+	if (!(c = malloc(bytes))) return NULL;
+	c->n = n;
+	c->used = 0;
+	if (head || !slab->chunk) {
+		c->next = slab->chunk;
+		slab->chunk = c;
+	}
+	else {
+		c->next = slab->chunk->next;
+		slab->chunk->next = c;
+	}
+	slab->bytes += bytes;
+	return c;
+}
+
+/* carve n objects from chunk c */
+static void *lc_slab_carve(lc_slab_t *slab, lc_slab_chunk_t *c, size_t n)
+{
+	void *obj = (char *)c->data + c->used * slab->size;
+	c->used += n;
+	slab->used += n;
+	return obj;
+}
+
+void *lc_slab_alloc(lc_slab_t *slab)
+{
+	lc_slab_chunk_t *c;
+	void *obj = NULL;
+
+	pthread_mutex_lock(&slab->mtx);
+	if (slab->free) {
+		obj = slab->free;
+		slab->free = slab->free->next;
+		slab->used++;
+	}
+	else if ((c = slab->chunk) && c->used < c->n) {
+		obj = lc_slab_carve(slab, c, 1);
+	}
+	else if ((c = lc_slab_chunk(slab, slab->per, 1))) {
+		obj = lc_slab_carve(slab, c, 1);
+	}
+	pthread_mutex_unlock(&slab->mtx);
+	if (obj) memset(obj, 0, slab->size);
+	return obj;
+}
+
+void *lc_slab_alloc_many(lc_slab_t *slab, size_t n)
+{
+	lc_slab_chunk_t *c;
+	void *obj = NULL;
+
+	if (!n) return NULL;
+	pthread_mutex_lock(&slab->mtx);
+	if ((c = slab->chunk) && c->n - c->used >= n) {
+		obj = lc_slab_carve(slab, c, n);
+	}
+	else if ((c = lc_slab_chunk(slab, (n > slab->per) ? n : slab->per, n < slab->per))) {
+		/* big runs get a chunk to themselves, behind the one we carve from */
+		obj = lc_slab_carve(slab, c, n);
+	}
+	pthread_mutex_unlock(&slab->mtx);
+	if (obj) memset(obj, 0, n * slab->size);
+	return obj;
+}
+
+void lc_slab_release(lc_slab_t *slab, void *obj)
+{
+	lc_slab_free_t *f = obj;
+
+	if (!obj) return;
+	pthread_mutex_lock(&slab->mtx);
+	f->next = slab->free;
+	slab->free = f;
+	slab->used--;
+	pthread_mutex_unlock(&slab->mtx);
+}
+
+size_t lc_slab_size(lc_slab_t *slab)
+{
+	return slab->size;
+}
+
+size_t lc_slab_used(lc_slab_t *slab)
+{
+	size_t used;
+	pthread_mutex_lock(&slab->mtx);
+	used = slab->used;
+	pthread_mutex_unlock(&slab->mtx);
+	return used;
+}
+
+size_t lc_slab_bytes(lc_slab_t *slab)
+{
+	size_t bytes;
+	pthread_mutex_lock(&slab->mtx);
+	bytes = slab->bytes;
+	pthread_mutex_unlock(&slab->mtx);
+	return bytes;
+}
+
+void lc_slab_free(lc_slab_t *slab)
+{
+	lc_slab_chunk_t *c;
+
+	if (!slab) return;
+	while ((c = slab->chunk)) {
+		slab->chunk = c->next;
+		free(c);
+	}
+	pthread_mutex_destroy(&slab->mtx);
+	free(slab);
+}
+
+lc_slab_t *lc_slab_new(size_t size, size_t per)
+{
+	lc_slab_t *slab;
+
+	if (!size || !per) return NULL;
+	if (!(slab = calloc(1, sizeof(lc_slab_t)))) return NULL;
+	/* room for the free list link, and aligned as malloc() would */
+	if (size < sizeof(lc_slab_free_t)) size = sizeof(lc_slab_free_t);
+	slab->size = (size + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+	slab->per = per;
+	pthread_mutex_init(&slab->mtx, NULL);
+	return slab;
+}
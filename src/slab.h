@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _SLAB_H
+#define _SLAB_H 1
+
+#include <stddef.h>
+
+/* fixed size object allocator.  Objects are carved from chunks, and freed
+ * objects are kept for reuse, so alloc and release are O(1).  Chunks are only
+ * returned to the system all together, by lc_slab_free().  Safe to use from
+ * several threads. */
+typedef struct lc_slab_s lc_slab_t;
+
+/* slab of objects of size bytes, allocated per at a time */
+lc_slab_t *lc_slab_new(size_t size, size_t per);
+
+/* free slab and every object in it, released or not */
+void lc_slab_free(lc_slab_t *slab);
+
+/* zeroed object, or NULL if out of memory */
+void *lc_slab_alloc(lc_slab_t *slab);
+
+/* n zeroed objects, contiguous, or NULL if out of memory.  Each may be
+ * released on its own */
+void *lc_slab_alloc_many(lc_slab_t *slab, size_t n);
+
+/* return obj to slab for reuse */
+void lc_slab_release(lc_slab_t *slab, void *obj);
+
+/* bytes per object, after alignment */
+size_t lc_slab_size(lc_slab_t *slab);
+
+/* objects allocated and not released */
+size_t lc_slab_used(lc_slab_t *slab);
+
+/* bytes held by slab, including released objects */
+size_t lc_slab_bytes(lc_slab_t *slab);
+
+#endif /* _SLAB_H */
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "spill.h"
+#include <errno.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+int lc_spill_add(lc_spill_t *sp, int fd)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	unsigned int i = sp->n;
+
+	if (i == sp->max) {
+		errno = EMFILE;
+		return -1;
+	}
+	sp->sock[i] = (lc_spill_sock_t){ .fd = fd };
+	ev.data.u32 = i;
+	if (epoll_ctl(sp->efd, EPOLL_CTL_ADD, fd, &ev) == -1) return -1;
+	__atomic_store_n(&sp->n, i + 1, __ATOMIC_RELEASE);
+	return i;
+}
+
+int lc_spill_wait(lc_spill_t *sp, int wait)
+{
+	struct epoll_event ev;
+	int rc;
+
+	/* level triggered - a socket left with data is queued again behind the
+	 * others, so busy sockets don't starve the rest */
+	while ((rc = epoll_wait(sp->efd, &ev, 1, wait)) == -1 && errno == EINTR);
+	if (rc == 1) return ev.data.u32;
+	if (!rc) errno = EAGAIN;
+	return -1;
+}
+
+void lc_spill_free(lc_spill_t *sp)
+{
+	if (!sp) return;
+	for (unsigned int i = 1; i < sp->n; i++) close(sp->sock[i].fd);
+	close(sp->efd);
+	free(sp);
+}
+
+lc_spill_t *lc_spill_new(int fd, unsigned int max)
+{
+	lc_spill_t *sp;
+
+	if (!max) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!(sp = calloc(1, sizeof(lc_spill_t) + max * sizeof(lc_spill_sock_t)))) return NULL;
+	sp->max = max;
+	if ((sp->efd = epoll_create1(EPOLL_CLOEXEC)) == -1) goto err_0;
+	if (lc_spill_add(sp, fd) == -1) goto err_1;
+	return sp;
+err_1:
+	close(sp->efd);
+err_0:
+	free(sp);
+	return NULL;
+}
+
+#else
+
+int lc_spill_add(lc_spill_t *sp, int fd)
+{
+	(void)sp; (void)fd;
+	errno = ENOTSUP;
+	return -1;
+}
+
+int lc_spill_wait(lc_spill_t *sp, int wait)
+{
+	(void)sp; (void)wait;
+	errno = ENOTSUP;
+	return -1;
+}
+
+void lc_spill_free(lc_spill_t *sp)
+{
+	(void)sp;
+}
+
+lc_spill_t *lc_spill_new(int fd, unsigned int max)
+{
+	(void)fd; (void)max;
+	errno = ENOTSUP;
+	return NULL;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _SPILL_H
+#define _SPILL_H 1
+
+#include <stdint.h>
+
+/* kernel sockets of an elastic socket, read through one epoll set.  The
+ * kernel limits memberships per socket (Linux charges them to
+ * net.core.optmem_max), so groups spill onto another socket when those open
+ * are full.  The caller locks, except for lc_spill_wait() and the fd and drops
+ * of a socket it returns */
+typedef struct lc_spill_sock_s {
+	int fd;
+	int full;       /* kernel refused a join - try the others first */
+	uint32_t drops; /* kernel drop count last seen (SO_RXQ_OVFL) */
+} lc_spill_sock_t;
+
+typedef struct lc_spill_s {
+	int efd;            /* epoll set of sock[].fd, readable when any is */
+	unsigned int n;     /* sockets, sock[0] is the lc_socket_t's own */
+	unsigned int max;   /* most sockets */
+	lc_spill_sock_t sock[];
+} lc_spill_t;
+
+/* create set of up to max sockets, the first being fd.  Returns NULL and sets
+ * errno on failure (ENOTSUP if epoll is unavailable) */
+lc_spill_t *lc_spill_new(int fd, unsigned int max);
+
+/* free set, closing all sockets but the first */
+void lc_spill_free(lc_spill_t *sp);
+
+/* add socket fd. Returns its index, or -1 if there are max already */
+int lc_spill_add(lc_spill_t *sp, int fd);
+
+/* index of a socket with data waiting, waiting up to wait ms (-1 = forever).
+ * Returns -1 with errno EAGAIN if there's none */
+int lc_spill_wait(lc_spill_t *sp, int wait);
+
+#endif /* _SPILL_H */
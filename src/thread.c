@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#define _GNU_SOURCE
+#include "thread.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+typedef struct lc_thread_start_s {
+	void *(*fn)(void *);
+	void *arg;
+	int node;
+} lc_thread_start_t;
+
+#ifdef __linux__
+
+#define NODEMASK_BITS 1024
+
+/* read CPUs of NUMA node into set. Returns 0 on success, -1 on error */
+static int lc_thread_node_cpus(int node, cpu_set_t *set)
+{
+	char path[64], *p, *end;
+	char buf[4096];
+	FILE *f;
+	long lo, hi;
+
+	snprintf(path, sizeof path, "/sys/devices/system/node/node%i/cpulist", node);
+	if (!(f = fopen(path, "r"))) return -1;
+	p = fgets(buf, sizeof buf, f);
+	fclose(f);
+	if (!p) return -1;
+	CPU_ZERO(set);
+	/* eg. "0-3,8-11" */
+	while (*p && *p != '\n') {
+		lo = hi = strtol(p, &end, 10);
+		if (end == p) return -1;
+		if (*end == '-') hi = strtol(end + 1, &end, 10);
+		for (long cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, set);
+		p = (*end == ',') ? end + 1 : end;
+	}
+	return 0;
+}
+
+static int lc_thread_affinity(pthread_attr_t *pattr, const lc_thread_attr_t *attr)
+{
+	cpu_set_t set, node;
+	int any = 0;
+
+	CPU_ZERO(&set);
+	for (int cpu = 0; cpu < LC_CPUS_MAX && cpu < CPU_SETSIZE; cpu++) {
+		if (attr->cpus[cpu / 64] & (1ULL << (cpu % 64))) {
+			CPU_SET(cpu, &set);
+			any = 1;
+		}
+	}
+	if (attr->node >= 0) {
+		if (lc_thread_node_cpus(attr->node, &node)) return EINVAL;
+		if (any) CPU_AND(&set, &set, &node);
+		else memcpy(&set, &node, sizeof set);
+		any = 1;
+	}
+	if (!any) return 0;
+	if (!CPU_COUNT(&set)) return EINVAL;
+	return pthread_attr_setaffinity_np(pattr, sizeof set, &set);
+}
+
+/* prefer memory from node for everything this thread touches first */
+static void lc_thread_mempolicy(int node)
+{
+	unsigned long mask[NODEMASK_BITS / (8 * sizeof(unsigned long))] = {0};
+	const int bits = 8 * sizeof(unsigned long);
+
+	if (node < 0 || node >= NODEMASK_BITS) return;
+	mask[node / bits] = 1UL << (node % bits);
+	/* best effort - the thread runs without it (eg. kernel without NUMA) */
+	syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, NODEMASK_BITS);
+}
+
+#else /* !__linux__ */
+
+static int lc_thread_affinity(pthread_attr_t *pattr, const lc_thread_attr_t *attr)
+{
+	(void)pattr;
+	if (attr->node >= 0) return ENOTSUP;
+	for (size_t i = 0; i < sizeof attr->cpus / sizeof attr->cpus[0]; i++) {
+		if (attr->cpus[i]) return ENOTSUP;
+	}
+	return 0;
+}
+
+static void lc_thread_mempolicy(int node)
+{
+	(void)node;
+}
+
+#endif /* __linux__ */
+
+static void *lc_thread_start(void *arg)
+{
+	lc_thread_start_t start = *(lc_thread_start_t *)arg;
+
+	free(arg);
+	lc_thread_mempolicy(start.node);
+	return start.fn(start.arg);
+}
+
+int lc_thread_create(pthread_t *thread, const lc_thread_attr_t *attr,
+		void *(*fn)(void *), void *arg)
+{
+	pthread_attr_t pattr;
+	struct sched_param param = {0};
+	lc_thread_start_t *start;
+	int err;
+
+	if (!attr) return pthread_create(thread, NULL, fn, arg);
+	if (!(start = malloc(sizeof(lc_thread_start_t)))) return ENOMEM;
+	start->fn = fn;
+	start->arg = arg;
+	start->node = attr->node;
+	if ((err = pthread_attr_init(&pattr))) goto err_0;
+	if ((err = lc_thread_affinity(&pattr, attr))) goto err_1;
+	if (attr->stacksize && (err = pthread_attr_setstacksize(&pattr, attr->stacksize))) goto err_1;
+	if (attr->priority) {
+		param.sched_priority = attr->priority;
+		if ((err = pthread_attr_setinheritsched(&pattr, PTHREAD_EXPLICIT_SCHED))) goto err_1;
+		if ((err = pthread_attr_setschedpolicy(&pattr, SCHED_FIFO))) goto err_1;
+		if ((err = pthread_attr_setschedparam(&pattr, &param))) goto err_1;
+	}
+	err = pthread_create(thread, &pattr, &lc_thread_start, start);
+	pthread_attr_destroy(&pattr);
+	if (err) free(start);
+	return err;
+err_1:
+	pthread_attr_destroy(&pattr);
+err_0:
+	free(start);
+	return err;
+}
@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _THREAD_H
+#define _THREAD_H 1
+
+#include <librecast/types.h>
+#include <pthread.h>
+
+/* create thread running fn(arg), placed according to attr (NULL = default).
+ * The thread runs on attr->cpus, restricted to the CPUs of attr->node, and
+ * its memory is allocated from attr->node where possible.  Returns 0 on
+ * success, or an error number, as pthread_create() */
+int lc_thread_create(pthread_t *thread, const lc_thread_attr_t *attr,
+		void *(*fn)(void *), void *arg);
+
+#endif /* _THREAD_H */
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#include "topic.h"
+#include <librecast/types.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct lc_topic_sub_s {
+	uint32_t tag;
+	uint32_t refs;
+} lc_topic_sub_t;
+
+/* sorted by tag */
+struct lc_topic_subs_s {
+	lc_topic_sub_t *sub;
+	size_t n;
+	size_t size;
+};
+
+uint32_t lc_topic_hash(const unsigned char *name, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++) h = (h ^ name[i]) * 1099511628211ULL; /* FNV-1a */
+	/* mix, so the high bits choosing the shard depend on every byte */
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (uint32_t)h;
+}
+
+/* index of tag, or where it would go */
+static size_t lc_topic_subs_find(lc_topic_subs_t *subs, uint32_t tag)
+{
+	size_t lo = 0, hi = subs->n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (subs->sub[mid].tag < tag) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+int lc_topic_subs_add(lc_topic_subs_t *subs, uint32_t tag)
+{
+	size_t i = lc_topic_subs_find(subs, tag);
+
+	if (i < subs->n && subs->sub[i].tag == tag) {
+		subs->sub[i].refs++;
+		return 0;
+	}
+	if (subs->n == subs->size) {
+		size_t size = (subs->size) ? subs->size * 2 : 16;
+		lc_topic_sub_t *sub = realloc(subs->sub, size * sizeof(lc_topic_sub_t));
+		if (!sub) return -1;
+		subs->sub = sub;
+		subs->size = size;
+	}
+	memmove(&subs->sub[i + 1], &subs->sub[i], (subs->n - i) * sizeof(lc_topic_sub_t));
+	subs->sub[i].tag = tag;
+	subs->sub[i].refs = 1;
+	subs->n++;
+	return 1;
+}
+
+int lc_topic_subs_del(lc_topic_subs_t *subs, uint32_t tag)
+{
+	size_t i = lc_topic_subs_find(subs, tag);
+
+	if (i == subs->n || subs->sub[i].tag != tag) return -1;
+	if (--subs->sub[i].refs) return 0;
+	subs->n--;
+	memmove(&subs->sub[i], &subs->sub[i + 1], (subs->n - i) * sizeof(lc_topic_sub_t));
+	return 1;
+}
+
+size_t lc_topic_subs_count(lc_topic_subs_t *subs)
+{
+	return subs->n;
+}
+
+void lc_topic_subs_free(lc_topic_subs_t *subs)
+{
+	if (!subs) return;
+	free(subs->sub);
+	free(subs);
+}
+
+lc_topic_subs_t *lc_topic_subs_new(void)
+{
+	return calloc(1, sizeof(lc_topic_subs_t));
+}
+
+lc_topic_set_t *lc_topic_set_new(lc_topic_subs_t *subs)
+{
+	lc_topic_set_t *set = malloc(sizeof(lc_topic_set_t) + subs->n * sizeof(uint32_t));
+	if (!set) return NULL;
+	set->n = subs->n;
+	for (size_t i = 0; i < subs->n; i++) set->tag[i] = subs->sub[i].tag;
+	return set;
+}
+
+int lc_topic_set_has(const lc_topic_set_t *set, uint32_t tag)
+{
+	size_t lo = 0, hi = set->n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (set->tag[mid] < tag) lo = mid + 1;
+		else if (set->tag[mid] > tag) hi = mid;
+		else return 1;
+	}
+	return 0;
+}
+
+#ifdef __linux__
+
+#include <linux/filter.h>
+#include <sys/socket.h>
+
+/* tags compared per accept instruction - jump offsets are 8 bits */
+#define FILTER_RUN 255
+
+int lc_topic_filter(int fd, const uint32_t *tag, size_t n)
+{
+	struct sock_filter *f, *p;
+	struct sock_fprog prog;
+	size_t runs = (n + FILTER_RUN - 1) / FILTER_RUN;
+	size_t len = 8 + n + 2 * runs;
+	int rc, err;
+
+	if (len > BPF_MAXINSNS) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	if (!(f = p = calloc(len, sizeof(struct sock_filter)))) return -1;
+	/* anything too short to carry a tag, or not a topic message, passes */
+	*p++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0);
+	*p++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, LC_TOPIC_OFF + 4, 1, 0);
+	*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	*p++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, LC_TOPIC_OFF_OP);
+	*p++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, LC_OP_TOPIC, 1, 0);
+	*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	/* tag is sent in network byte order, which is how BPF loads it */
+	*p++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, LC_TOPIC_OFF);
+	for (size_t i = 0; i < n; i += FILTER_RUN) {
+		size_t m = (n - i < FILTER_RUN) ? n - i : FILTER_RUN;
+		/* m compares, skip accept, accept */
+		for (size_t j = 0; j < m; j++) {
+			*p++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, tag[i + j], m - j, 0);
+		}
+		*p++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JA, 1, 0, 0);
+		*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	}
+	*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+	prog.len = p - f;
+	prog.filter = f;
+	rc = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof prog);
+	err = errno;
+	free(f);
+	errno = err;
+	return rc;
+}
+
+int lc_topic_filter_detach(int fd)
+{
+	int dummy = 0;
+	return setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof dummy);
+}
+
+#else /* !__linux__ */
+
+int lc_topic_filter(int fd, const uint32_t *tag, size_t n)
+{
+	(void)fd; (void)tag; (void)n;
+	errno = ENOTSUP;
+	return -1;
+}
+
+int lc_topic_filter_detach(int fd)
+{
+	(void)fd;
+	errno = ENOTSUP;
+	return -1;
+}
+
+#endif /* __linux__ */
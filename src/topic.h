@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0-only OR GPL-3.0-only */
+/* Copyright (c) 2022 Brett Sheffield <bacs@librecast.net> */
+
+#ifndef _TOPIC_H
+#define _TOPIC_H 1
+
+#include "epoch.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* offset of the topic tag in a topic message, relative to the UDP header:
+ * UDP header (8) + lc_message_head_t (33) */
+#define LC_TOPIC_OFF 41
+/* offset of the opcode, likewise */
+#define LC_TOPIC_OFF_OP 32
+
+/* tag for topic name */
+uint32_t lc_topic_hash(const unsigned char *name, size_t len);
+
+/* subscribed topic tags, counting subscriptions to each.  Not thread safe -
+ * callers lock */
+typedef struct lc_topic_subs_s lc_topic_subs_t;
+
+lc_topic_subs_t *lc_topic_subs_new(void);
+
+void lc_topic_subs_free(lc_topic_subs_t *subs);
+
+/* subscribe to tag. Return 1 if new, 0 if already subscribed, -1 if out of memory */
+int lc_topic_subs_add(lc_topic_subs_t *subs, uint32_t tag);
+
+/* unsubscribe from tag. Return 1 if no longer subscribed, 0 if still
+ * subscribed, -1 if not subscribed */
+int lc_topic_subs_del(lc_topic_subs_t *subs, uint32_t tag);
+
+/* number of tags subscribed */
+size_t lc_topic_subs_count(lc_topic_subs_t *subs);
+
+/* sorted copy of subscribed tags, for listeners to search while the
+ * subscriptions change */
+typedef struct lc_topic_set_s {
+	lc_epoch_node_t retired;
+	size_t n;
+	uint32_t tag[];
+} lc_topic_set_t;
+
+/* snapshot of subs, or NULL if out of memory.  Free with free() */
+lc_topic_set_t *lc_topic_set_new(lc_topic_subs_t *subs);
+
+/* return 1 if tag is in set, 0 if not */
+int lc_topic_set_has(const lc_topic_set_t *set, uint32_t tag);
+
+/* Attach kernel filter to UDP socket fd, dropping topic messages whose tag is
+ * not one of the n sorted tags.  Other packets pass.  Returns 0 on success,
+ * -1 on error (errno set; EMSGSIZE if too many tags for one filter) */
+int lc_topic_filter(int fd, const uint32_t *tag, size_t n);
+
+/* detach filter from fd */
+int lc_topic_filter_detach(int fd);
+
+#endif /* _TOPIC_H */
@@ -0,0 +1,62 @@
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/librecast_pvt.h"
+#include <time.h>
+
+static int msgs[3];
+
+void msg_received(lc_message_t *msg)
+{
+	if (msg->seq < 3) msgs[msg->seq]++;
+}
+
+int main()
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock, *sout;
+	lc_channel_t *chan, *cout;
+	lc_dedup_stats_t stats;
+	lc_message_head_t head = { .seq = htobe64(1), .rnd = 42 };
+	struct timespec t = { .tv_nsec = 99999999 };
+
+	test_name("lc_socket_dedup() / lc_socket_dedup_stats()");
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, "0000-0035");
+	cout = lc_channel_copy(lctx, chan);
+
+	test_assert(!lc_socket_dedup_stats(sock, &stats), "lc_socket_dedup_stats() - disabled");
+	test_assert(stats.mem == 0, "no memory used when disabled");
+	test_assert(lc_socket_dedup(sock, 1024, 0) == LC_ERROR_INVALID_PARAMS,
+			"window required");
+	test_assert(!lc_socket_dedup(sock, 1024, 1000), "lc_socket_dedup()");
+	test_assert(!lc_socket_dedup_stats(sock, &stats), "lc_socket_dedup_stats()");
+	test_assert(stats.mem > 1024 * 2, "memory reported: %zu", stats.mem);
+
+	lc_socket_loop(sout, 1);
+	test_assert(!lc_channel_bind(sock, chan), "lc_channel_bind()");
+	test_assert(!lc_channel_bind(sout, cout), "lc_channel_bind()");
+	test_assert(!lc_channel_join(chan), "lc_channel_join()");
+	test_assert(!lc_socket_listen(sock, &msg_received, NULL), "lc_socket_listen()");
+	test_assert(lc_socket_dedup(sock, 0, 0) == LC_ERROR_SOCKET_LISTENING,
+			"can't change filter while listening");
+
+	/* same message three times, then a new one */
+	for (int i = 0; i < 3; i++) {
+		lc_channel_send(cout, &head, sizeof head, 0);
+	}
+	head.seq = htobe64(2);
+	lc_channel_send(cout, &head, sizeof head, 0);
+	nanosleep(&t, &t);
+
+	test_assert(msgs[1] > 0, "first message delivered");
+	test_assert(msgs[1] == msgs[2], "duplicates not delivered (%i, %i)", msgs[1], msgs[2]);
+	lc_socket_dedup_stats(sock, &stats);
+	test_assert(stats.msgs == 4, "%zu messages checked", stats.msgs);
+	test_assert(stats.dups == 2, "%zu duplicates dropped", stats.dups);
+
+	lc_ctx_free(lctx);
+	return fails;
+}
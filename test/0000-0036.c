@@ -0,0 +1,171 @@
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/librecast_pvt.h"
+#include "../src/senders.h"
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SENDERS 256
+#define BENCH_MSGS 1000000
+
+static void sender_msg(lc_message_t *msg, int sender, lc_seq_t seq)
+{
+	lc_msg_init(msg);
+	msg->dst.s6_addr[0] = 0xff;
+	msg->src.s6_addr[15] = sender;
+	msg->srcport = htons(4242);
+	msg->seq = seq;
+}
+
+static void test_accounting(void)
+{
+	lc_senders_t *st;
+	lc_sender_stats_t stats;
+	lc_message_t msg;
+	lc_seq_t seqs[] = { 1, 2, 4, 3, 3, 10 };
+
+	st = lc_senders_new(2);
+	test_assert(st != NULL, "lc_senders_new()");
+	for (size_t i = 0; i < sizeof seqs / sizeof seqs[0]; i++) {
+		sender_msg(&msg, 1, seqs[i]);
+		lc_senders_update(st, &msg);
+	}
+	test_assert(!lc_senders_get(st, &msg.dst, &msg.src, msg.srcport, &stats), "lc_senders_get()");
+	test_assert(stats.seq == 10, "seq = %zu", stats.seq);
+	test_assert(stats.received == 5, "received = %zu", stats.received);
+	test_assert(stats.lost == 5, "lost = %zu", stats.lost);
+	test_assert(stats.dups == 1, "dups = %zu", stats.dups);
+	test_assert(stats.reordered == 1, "reordered = %zu", stats.reordered);
+	test_assert(stats.lastseen > 0, "lastseen set");
+
+	/* table holds two senders - adding a third evicts sender 1 */
+	sender_msg(&msg, 2, 1);
+	lc_senders_update(st, &msg);
+	sender_msg(&msg, 3, 1);
+	lc_senders_update(st, &msg);
+	sender_msg(&msg, 1, 1);
+	test_assert(lc_senders_get(st, &msg.dst, &msg.src, msg.srcport, &stats) == -1,
+			"least recently used sender evicted");
+	test_assert(lc_senders_list(st, &stats, 1) == 1, "lc_senders_list()");
+	test_assert(stats.src.s6_addr[15] == 3, "most recent sender listed first");
+	lc_senders_free(st);
+}
+
+static void test_benchmark(void)
+{
+	lc_senders_t *st;
+	lc_message_t msg[BENCH_SENDERS];
+	struct timespec t0, t1;
+	double ns;
+
+	st = lc_senders_new(1024);
+	for (int i = 0; i < BENCH_SENDERS; i++) sender_msg(&msg[i], i, 0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < BENCH_MSGS; i++) {
+		lc_message_t *m = &msg[i % BENCH_SENDERS];
+		m->seq++;
+		lc_senders_update(st, m);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = (t1.tv_sec - t0.tv_sec) * 1000000000.0 + (t1.tv_nsec - t0.tv_nsec);
+	test_log("lc_senders_update(): %.1f ns/msg (%i senders)", ns / BENCH_MSGS, BENCH_SENDERS);
+	lc_senders_free(st);
+}
+
+static void test_socket(void)
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock, *sout;
+	lc_channel_t *chan, *cout;
+	lc_sender_stats_t stats;
+	lc_message_head_t head = {0};
+	struct timespec t = { .tv_nsec = 99999999 };
+	lc_seq_t seqs[] = { 1, 3 };
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, "0000-0036");
+	cout = lc_channel_copy(lctx, chan);
+	lc_socket_loop(sout, 1);
+	lc_channel_bind(sock, chan);
+	lc_channel_bind(sout, cout);
+	lc_channel_join(chan);
+	test_assert(lc_socket_senders_list(sock, &stats, 1) == 0, "disabled by default");
+	test_assert(!lc_socket_senders(sock, 16), "lc_socket_senders()");
+	test_assert(!lc_socket_listen(sock, NULL, NULL), "lc_socket_listen()");
+	for (size_t i = 0; i < sizeof seqs / sizeof seqs[0]; i++) {
+		head.seq = htobe64(seqs[i]);
+		lc_channel_send(cout, &head, sizeof head, 0);
+	}
+	nanosleep(&t, &t);
+	test_assert(lc_socket_senders_list(sock, &stats, 1) == 1, "lc_socket_senders_list()");
+	test_assert(stats.received == 2, "received = %zu", stats.received);
+	test_assert(stats.lost == 1, "lost = %zu", stats.lost);
+	lc_ctx_free(lctx);
+}
+
+/* messages received on a channel don't move its sequence, so a channel that
+ * sends and receives is seen without gaps */
+static void test_send_recv(void)
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock, *sboth;
+	lc_channel_t *chan, *cboth;
+	lc_sender_stats_t stats[4];
+	lc_message_head_t head = {0};
+	lc_message_t msg;
+	struct sockaddr_in6 sa;
+	socklen_t salen = sizeof sa;
+	struct timespec t = { .tv_nsec = 99999999 };
+	ssize_t n;
+	int found = 0, fd;
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sboth = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, "0000-0036/both");
+	cboth = lc_channel_copy(lctx, chan);
+	lc_socket_loop(sboth, 1);
+	lc_channel_bind(sock, chan);
+	lc_channel_bind(sboth, cboth);
+	lc_channel_join(chan);
+	lc_channel_join(cboth);
+	lc_socket_senders(sock, 16);
+	test_assert(!lc_socket_listen(sock, NULL, NULL), "lc_socket_listen()");
+	test_assert(!lc_socket_listen(sboth, NULL, NULL), "lc_socket_listen() - sends too");
+
+	/* another sender, from its own port, well ahead in sequence */
+	fd = socket(AF_INET6, SOCK_DGRAM, 0);
+	lc_msg_init_data(&msg, "one", 3, NULL, NULL);
+	lc_msg_send(cboth, &msg);
+	head.seq = htobe64(1000);
+	sendto(fd, &head, sizeof head, 0, (struct sockaddr *)&chan->sa, sizeof chan->sa);
+	nanosleep(&t, NULL);
+	lc_msg_init_data(&msg, "two", 3, NULL, NULL);
+	lc_msg_send(cboth, &msg);
+	nanosleep(&t, NULL);
+	close(fd);
+
+	getsockname(lc_socket_raw(sboth), (struct sockaddr *)&sa, &salen);
+	n = lc_socket_senders_list(sock, stats, 4);
+	test_assert(n == 2, "two senders: %zi", n);
+	for (ssize_t i = 0; i < n; i++) {
+		if (stats[i].port != sa.sin6_port) continue;
+		found = 1;
+		test_assert(stats[i].received == 2, "received = %zu", stats[i].received);
+		test_assert(stats[i].lost == 0, "nothing lost: %zu", stats[i].lost);
+	}
+	test_assert(found, "sender found");
+	lc_ctx_free(lctx);
+}
+
+int main()
+{
+	test_name("lc_socket_senders() - per-sender loss accounting");
+	test_accounting();
+	test_benchmark();
+	test_socket();
+	test_send_recv();
+	return fails;
+}
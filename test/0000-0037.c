@@ -0,0 +1,216 @@
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/librecast_pvt.h"
+#include "../src/reorder.h"
+#include <time.h>
+#include <unistd.h>
+
+#define HOLD 50
+#define MAXMSGS 32
+
+static lc_seq_t got[MAXMSGS];
+static lc_seq_t gap[MAXMSGS];
+static int msgs;
+
+void deliver(void *arg, lc_message_t *msg)
+{
+	(void)arg;
+	/* ignore repeat callbacks for the same message */
+	if (msgs && got[msgs - 1] == msg->seq) return;
+	if (msgs == MAXMSGS) return;
+	gap[msgs] = msg->gap;
+	got[msgs++] = msg->seq;
+}
+
+void msg_received(lc_message_t *msg)
+{
+	deliver(NULL, msg);
+}
+
+static void push(lc_reorder_t *ro, lc_seq_t seq)
+{
+	lc_message_t msg;
+	lc_msg_init_size(&msg, 8);
+	msg.src.s6_addr[15] = 1;
+	msg.seq = seq;
+	lc_reorder_push(ro, &msg, &deliver, NULL);
+	lc_msg_free(&msg);
+}
+
+static void expect(lc_seq_t *seqs, lc_seq_t *gaps, int n)
+{
+	test_assert(msgs == n, "%i messages delivered, expected %i", msgs, n);
+	for (int i = 0; i < n && i < msgs; i++) {
+		test_assert(got[i] == seqs[i], "[%i] seq %zu, expected %zu", i, got[i], seqs[i]);
+		test_assert(gap[i] == gaps[i], "[%i] gap %zu, expected %zu", i, gap[i], gaps[i]);
+	}
+	msgs = 0;
+}
+
+static void test_reorder(void)
+{
+	lc_reorder_t *ro;
+	struct timespec t = { .tv_nsec = HOLD * 1000000 };
+
+	ro = lc_reorder_new(4, HOLD);
+	test_assert(ro != NULL, "lc_reorder_new()");
+
+	/* reordered messages released in sequence */
+	push(ro, 1); push(ro, 3); push(ro, 4); push(ro, 2);
+	expect((lc_seq_t []){ 1, 2, 3, 4 }, (lc_seq_t []){ 0, 0, 0, 0 }, 4);
+
+	/* duplicates and late arrivals dropped */
+	push(ro, 3); push(ro, 6); push(ro, 6);
+	expect(NULL, NULL, 0);
+
+	/* gap skipped after hold time expires */
+	test_assert(lc_reorder_expire(ro, &deliver, NULL) > 0, "waiting for 5");
+	nanosleep(&t, NULL);
+	test_assert(lc_reorder_expire(ro, &deliver, NULL) == -1, "nothing held");
+	expect((lc_seq_t []){ 6 }, (lc_seq_t []){ 1 }, 1);
+
+	/* gap skipped when depth exceeded */
+	push(ro, 9); push(ro, 12);
+	expect((lc_seq_t []){ 9 }, (lc_seq_t []){ 2 }, 1);
+	push(ro, 11);
+	expect(NULL, NULL, 0);
+	lc_reorder_free(ro); /* frees held messages */
+}
+
+static void test_socket(void)
+{
+	lc_ctx_t *lctx, *octx;
+	lc_socket_t *sock, *sout;
+	lc_channel_t *chan, *cout;
+	lc_message_head_t head = {0};
+	struct timespec t = { .tv_nsec = HOLD * 4000000 };
+	lc_seq_t seqs[] = { 1, 3, 2, 5 };
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	octx = lc_ctx_new();
+	sout = lc_socket_new(octx);
+	chan = lc_channel_new(lctx, "0000-0037");
+	cout = lc_channel_new(octx, "0000-0037");
+	lc_socket_loop(sout, 1);
+	test_assert(!lc_channel_ordered(chan, 16, HOLD), "lc_channel_ordered()");
+	lc_channel_bind(sock, chan);
+	lc_channel_bind(sout, cout);
+	lc_channel_join(chan);
+	test_assert(!lc_socket_listen(sock, &msg_received, NULL), "lc_socket_listen()");
+	for (size_t i = 0; i < sizeof seqs / sizeof seqs[0]; i++) {
+		head.seq = htobe64(seqs[i]);
+		lc_channel_send(cout, &head, sizeof head, 0);
+	}
+	nanosleep(&t, NULL);
+	expect((lc_seq_t []){ 1, 2, 3, 5 }, (lc_seq_t []){ 0, 0, 0, 1 }, 4);
+	lc_ctx_free(octx);
+	lc_ctx_free(lctx);
+}
+
+/* a sender that also receives on the channel stays in sequence, so isn't held */
+static void test_send_recv(void)
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock, *sboth;
+	lc_channel_t *chan, *cboth;
+	lc_message_head_t head = {0};
+	lc_message_t msg;
+	struct timespec t = { .tv_nsec = HOLD * 200000 };
+	int fd;
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sboth = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, "0000-0037/both");
+	cboth = lc_channel_copy(lctx, chan);
+	lc_socket_loop(sboth, 1);
+	lc_channel_ordered(chan, 16, HOLD);
+	lc_channel_bind(sock, chan);
+	lc_channel_bind(sboth, cboth);
+	lc_channel_join(chan);
+	lc_channel_join(cboth);
+	test_assert(!lc_socket_listen(sock, &msg_received, NULL), "lc_socket_listen()");
+	test_assert(!lc_socket_listen(sboth, NULL, NULL), "lc_socket_listen() - sends too");
+
+	/* another sender, from its own port, ahead in sequence */
+	fd = socket(AF_INET6, SOCK_DGRAM, 0);
+	lc_msg_init_data(&msg, "one", 3, NULL, NULL);
+	lc_msg_send(cboth, &msg);
+	head.seq = htobe64(5);
+	sendto(fd, &head, sizeof head, 0, (struct sockaddr *)&chan->sa, sizeof chan->sa);
+	nanosleep(&t, NULL);
+	lc_msg_init_data(&msg, "two", 3, NULL, NULL);
+	lc_msg_send(cboth, &msg);
+	nanosleep(&t, NULL); /* well inside HOLD */
+	close(fd);
+	expect((lc_seq_t []){ 1, 5, 2 }, (lc_seq_t []){ 0, 0, 0 }, 3);
+	lc_ctx_free(lctx);
+}
+
+/* a socket expires only the ordered channels bound to it, and only while they
+ * hold messages - the list empties as the last one goes */
+static void test_list(void)
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock;
+	lc_channel_t *chan, *other, *plain;
+	lc_message_head_t head = {0};
+	struct timespec t = { .tv_nsec = HOLD * 200000 };
+	struct timespec hold = { .tv_nsec = HOLD * 2000000 };
+	int fd;
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, "0000-0037/list");
+	other = lc_channel_new(lctx, "0000-0037/other");
+	plain = lc_channel_new(lctx, "0000-0037/plain");
+	lc_channel_ordered(chan, 16, HOLD);
+	lc_channel_ordered(other, 16, HOLD);
+	lc_channel_bind(sock, chan);
+	lc_channel_bind(sock, other);
+	lc_channel_bind(sock, plain);
+	test_assert(sock->ordered && sock->ordered->n == 2, "ordered channels listed");
+	test_assert(lc_socket_timeout(sock) == -1, "nothing held");
+
+	/* 2 is missing, so 3 is held until it expires */
+	lc_channel_join(chan);
+	fd = socket(AF_INET6, SOCK_DGRAM, 0);
+	for (lc_seq_t seq = 1; seq <= 3; seq += 2) {
+		head.seq = htobe64(seq);
+		sendto(fd, &head, sizeof head, 0, (struct sockaddr *)&chan->sa, sizeof chan->sa);
+	}
+	close(fd);
+	nanosleep(&t, NULL);
+	test_assert(lc_socket_drain(sock, &msg_received, NULL, 8) == 2, "lc_socket_drain()");
+	expect((lc_seq_t []){ 1 }, (lc_seq_t []){ 0 }, 1);
+	test_assert(sock->held == 1, "one channel holding messages");
+	test_assert(lc_socket_timeout(sock) > 0, "held message expires later");
+	nanosleep(&hold, NULL);
+	test_assert(lc_socket_drain(sock, &msg_received, NULL, 8) == 0, "lc_socket_drain() - expire");
+	expect((lc_seq_t []){ 3 }, (lc_seq_t []){ 1 }, 1);
+	test_assert(sock->held == 0, "no channel holding messages");
+	test_assert(lc_socket_timeout(sock) == -1, "nothing held - expired");
+
+	/* disabled, unbound and freed channels leave the list */
+	test_assert(!lc_channel_ordered(chan, 0, 0), "lc_channel_ordered() - disable");
+	test_assert(sock->ordered->n == 1, "disabled channel unlisted");
+	lc_channel_unbind(other);
+	test_assert(sock->ordered->n == 0, "unbound channel unlisted - none left");
+	lc_channel_bind(sock, other);
+	lc_channel_bind(sock, other);
+	test_assert(sock->ordered->n == 1, "listed once when bound again");
+	lc_channel_free(other);
+	test_assert(sock->ordered->n == 0, "freed channel unlisted");
+	lc_ctx_free(lctx);
+}
+
+int main()
+{
+	test_name("lc_channel_ordered() - in-order delivery");
+	test_reorder();
+	test_socket();
+	test_send_recv();
+	test_list();
+	return fails;
+}
@@ -0,0 +1,66 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <time.h>
+
+#define MSGS 500
+#define RCVBUF 4096
+
+static int errs;
+
+void msg_err(int err)
+{
+	if (err == LC_ERROR_NET_DROP) errs++;
+}
+
+int main()
+{
+	lc_ctx_t *lctx, *octx;
+	lc_socket_t *sock, *sout;
+	lc_channel_t *chan, *cout;
+	char buf[1000] = {0};
+	struct timespec t = { .tv_nsec = 99999999 };
+	int before, after;
+	socklen_t len = sizeof(int);
+
+	test_name("lc_socket_rcvbuf() / lc_socket_drops()");
+
+	lctx = lc_ctx_new();
+	octx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(octx);
+	chan = lc_channel_new(lctx, "0000-0038");
+	cout = lc_channel_new(octx, "0000-0038");
+
+	test_assert(lc_socket_rcvbuf(sock, RCVBUF, RCVBUF - 1) == LC_ERROR_INVALID_PARAMS,
+			"max must not be less than size");
+	test_assert(!lc_socket_rcvbuf(sock, RCVBUF, RCVBUF * 64), "lc_socket_rcvbuf()");
+	getsockopt(lc_socket_raw(sock), SOL_SOCKET, SO_RCVBUF, &before, &len);
+
+	lc_socket_loop(sout, 1);
+	lc_channel_bind(sock, chan);
+	lc_channel_bind(sout, cout);
+	lc_channel_join(chan);
+	test_assert(lc_socket_drops(sock) == 0, "no drops yet");
+
+	/* overflow receive buffer before anyone is listening */
+	for (int i = 0; i < MSGS; i++) {
+		lc_channel_send(cout, buf, sizeof buf, 0);
+	}
+	test_assert(!lc_socket_listen(sock, NULL, &msg_err), "lc_socket_listen()");
+	nanosleep(&t, NULL);
+
+	/* drop count is reported with the next packet queued */
+	lc_channel_send(cout, buf, sizeof buf, 0);
+	nanosleep(&t, NULL);
+
+	test_log("%zu packets dropped", lc_socket_drops(sock));
+	test_assert(lc_socket_drops(sock) > 0, "kernel drops reported");
+	test_assert(errs > 0, "callback_err called with LC_ERROR_NET_DROP");
+	getsockopt(lc_socket_raw(sock), SOL_SOCKET, SO_RCVBUF, &after, &len);
+	test_log("SO_RCVBUF %i => %i", before, after);
+	test_assert(after > before, "receive buffer grown");
+
+	lc_ctx_free(octx);
+	lc_ctx_free(lctx);
+	return fails;
+}
@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/librecast_pvt.h"
+#include <librecast/if.h>
+#include <linux/rtnetlink.h>
+#include <linux/veth.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MSGS 10000
+#define PAYLOAD 64
+#define WAITMS 2000
+#define RCVBUF (1 << 25) /* skb truesize is much larger than the ring frame */
+#define IFOUT "0000-0039o"
+#define IFIN "0000-0039i"
+
+static volatile int count;
+static lc_seq_t last;
+
+void msg_received(lc_message_t *msg)
+{
+	/* ignore repeat callbacks for the same message */
+	if (msg->seq == last) return;
+	last = msg->seq;
+	if (msg->len == PAYLOAD && ((unsigned char *)msg->data)[PAYLOAD - 1] == 0x39)
+		count++;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct rtattr *rta_add(struct nlmsghdr *nlh, int type, const void *data, size_t len)
+{
+	struct rtattr *rta = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	if (data) memcpy(RTA_DATA(rta), data, len);
+	nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+	return rta;
+}
+
+static void rta_end(struct nlmsghdr *nlh, struct rtattr *rta)
+{
+	rta->rta_len = (char *)nlh + nlh->nlmsg_len - (char *)rta;
+}
+
+/* create veth pair in a new network namespace - frames sent on one end are
+ * received on the other. Multicast doesn't route over loopback */
+static int netns_veth(lc_ctx_t *ctx)
+{
+	char buf[512] = {0};
+	struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+	struct rtattr *linkinfo, *data, *peer;
+	struct {
+		struct nlmsghdr nlh;
+		struct nlmsgerr err;
+	} ack;
+	FILE *f;
+	int s, rc = -1;
+
+	if (unshare(CLONE_NEWNET)) return -1;
+
+	/* skip duplicate address detection, so link-local addresses are usable */
+	if ((f = fopen("/proc/sys/net/ipv6/conf/default/accept_dad", "w"))) {
+		fputs("0", f);
+		fclose(f);
+	}
+
+	nlh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+	nlh->nlmsg_type = RTM_NEWLINK;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK;
+	rta_add(nlh, IFLA_IFNAME, IFOUT, sizeof IFOUT);
+	linkinfo = rta_add(nlh, IFLA_LINKINFO, NULL, 0);
+	rta_add(nlh, IFLA_INFO_KIND, "veth", 4);
+	data = rta_add(nlh, IFLA_INFO_DATA, NULL, 0);
+	peer = rta_add(nlh, VETH_INFO_PEER, NULL, sizeof(struct ifinfomsg));
+	rta_add(nlh, IFLA_IFNAME, IFIN, sizeof IFIN);
+	rta_end(nlh, peer);
+	rta_end(nlh, data);
+	rta_end(nlh, linkinfo);
+
+	s = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (s == -1) return -1;
+	if (send(s, buf, nlh->nlmsg_len, 0) == (ssize_t)nlh->nlmsg_len
+	&& recv(s, &ack, sizeof ack, 0) > 0 && ack.nlh.nlmsg_type == NLMSG_ERROR)
+		rc = ack.err.error;
+	close(s);
+	if (rc) return rc;
+	if (lc_link_set(ctx, IFOUT, LC_IF_UP)) return -1;
+	return lc_link_set(ctx, IFIN, LC_IF_UP);
+}
+
+/* send MSGS from sout to sin, returning messages received per second */
+static double xfer(lc_ctx_t *ictx, lc_socket_t *sin, lc_ctx_t *octx, lc_socket_t *sout,
+		char *name)
+{
+	lc_channel_t *cin, *cout;
+	lc_message_head_t *head;
+	unsigned char buf[sizeof(lc_message_head_t) + PAYLOAD] = {0};
+	struct timespec t = { .tv_nsec = 1000000 };
+	double start, end;
+
+	head = (lc_message_head_t *)buf;
+	head->len = htobe64(PAYLOAD);
+	buf[sizeof buf - 1] = 0x39;
+	cin = lc_channel_new(ictx, name);
+	cout = lc_channel_new(octx, name);
+	lc_channel_bind(sin, cin);
+	lc_channel_bind(sout, cout);
+	test_assert(!lc_channel_join(cin), "%s: lc_channel_join()", name);
+	count = 0;
+	last = 0;
+	start = now();
+	for (int i = 0; i < MSGS; i++) {
+		head->seq = htobe64(i + 1);
+		if (lc_channel_send(cout, buf, sizeof buf, 0) == -1) {
+			test_assert(0, "%s: lc_channel_send(): %s", name, strerror(errno));
+			break;
+		}
+	}
+	while (count < MSGS && now() - start < WAITMS / 1000.0) nanosleep(&t, NULL);
+	end = now();
+	test_assert(count == MSGS, "%s: %i/%i received", name, count, MSGS);
+	lc_channel_part(cin);
+	lc_channel_free(cout);
+	lc_channel_free(cin);
+	return count / (end - start);
+}
+
+int main()
+{
+	lc_ctx_t *ictx, *octx;
+	lc_socket_t *sin, *sout, *udp;
+	lc_channel_t *other, *oout;
+	lc_message_t msg;
+	struct timespec t = { .tv_nsec = 100000000 };
+	double ring, std;
+	unsigned int ifin, ifout;
+
+	test_require_linux();
+	test_cap_require(CAP_NET_RAW);
+	test_name("lc_socket_packet_new() - AF_PACKET rings");
+
+	ictx = lc_ctx_new();
+	octx = lc_ctx_new();
+	test_assert(!netns_veth(octx), "veth pair in new network namespace");
+	ifin = if_nametoindex(IFIN);
+	ifout = if_nametoindex(IFOUT);
+	if (!ifin || !ifout) goto cleanup;
+	test_assert(lc_socket_packet_new(ictx, 0) == NULL && errno == ENODEV, "invalid interface");
+	sin = lc_socket_packet_new(ictx, ifin);
+	test_assert(sin != NULL, "lc_socket_packet_new() - receiver");
+	sout = lc_socket_packet_new(octx, ifout);
+	test_assert(sout != NULL, "lc_socket_packet_new() - sender");
+	if (!sin || !sout) goto cleanup;
+	test_assert(!lc_socket_listen(sin, &msg_received, NULL), "lc_socket_listen()");
+
+	/* channel not joined is filtered out */
+	other = lc_channel_new(ictx, "0000-0039 not joined");
+	oout = lc_channel_new(octx, "0000-0039 not joined");
+	lc_channel_bind(sin, other);
+	lc_channel_bind(sout, oout);
+	lc_msg_init_size(&msg, PAYLOAD);
+	memset(msg.data, 0x39, PAYLOAD);
+	test_assert(lc_msg_send(oout, &msg) > 0, "lc_msg_send()");
+	lc_msg_free(&msg);
+	nanosleep(&t, NULL);
+	test_assert(count == 0, "message on channel not joined filtered");
+
+	ring = xfer(ictx, sin, octx, sout, "0000-0039 ring");
+	test_log("packet ring: %.0f msgs/s", ring);
+
+	/* frames built for the ring must be valid to the UDP stack */
+	udp = lc_socket_new(ictx);
+	lc_socket_bind(udp, ifin);
+	lc_socket_rcvbuf(udp, RCVBUF, 0);
+	test_assert(!lc_socket_listen(udp, &msg_received, NULL), "lc_socket_listen() - udp");
+	xfer(ictx, udp, octx, sout, "0000-0039 ring => udp");
+	lc_socket_close(udp);
+
+	/* compare with UDP sockets */
+	sin = lc_socket_new(ictx);
+	sout = lc_socket_new(octx);
+	lc_socket_bind(sin, ifin);
+	lc_socket_rcvbuf(sin, RCVBUF, 0);
+	lc_socket_bind(sout, ifout);
+	lc_socket_listen(sin, &msg_received, NULL);
+	std = xfer(ictx, sin, octx, sout, "0000-0039 udp");
+	test_log("udp socket: %.0f msgs/s", std);
+	test_log("ring / udp: %.2f", ring / std);
+cleanup:
+	lc_ctx_free(octx);
+	lc_ctx_free(ictx);
+	return fails;
+}
@@ -0,0 +1,236 @@
+#define _GNU_SOURCE
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/librecast_pvt.h"
+#include <dirent.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define SOCKS 1000
+#define ROUNDS 10
+#define THREADS 2
+#define WAITMS 5000
+#define HOLD 50
+
+static int msgs;
+static lc_seq_t last[SOCKS];
+static uint32_t base;
+static int create_fail = -1; /* pthread_create() fails when zero - decremented each call */
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*fn)(void *), void *arg)
+{
+	static int (*_pthread_create)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *);
+	if (!_pthread_create) *(void **)&_pthread_create = dlsym(RTLD_NEXT, "pthread_create");
+	if (create_fail > 0) create_fail--;
+	if (!create_fail) return EAGAIN;
+	return _pthread_create(thread, attr, fn, arg);
+}
+
+void msg_received(lc_message_t *msg)
+{
+	/* ignore repeat callbacks for the same message */
+	if (last[msg->sockid - base] == msg->seq) return;
+	last[msg->sockid - base] = msg->seq;
+	__atomic_add_fetch(&msgs, 1, __ATOMIC_SEQ_CST);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cputime(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+		+ (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static int wait_msgs(int n)
+{
+	struct timespec t = { .tv_nsec = 1000000 };
+	double start = now();
+	while (__atomic_load_n(&msgs, __ATOMIC_SEQ_CST) < n && now() - start < WAITMS / 1000.0)
+		nanosleep(&t, NULL);
+	return __atomic_load_n(&msgs, __ATOMIC_SEQ_CST);
+}
+
+/* send ROUNDS messages to each of n sockets, listening with a thread each
+ * (threads == 0) or on the ctx event loop */
+static void bench(int n, int threads)
+{
+	lc_ctx_t *ictx, *octx;
+	lc_socket_t *sin, *sout;
+	lc_channel_t *chan, *cout[SOCKS];
+	lc_message_head_t head = {0};
+	char name[32];
+	double cpu, wall;
+	int got;
+
+	ictx = lc_ctx_new();
+	octx = lc_ctx_new();
+	if (threads) test_assert(!lc_ctx_loop_start(ictx, threads), "lc_ctx_loop_start()");
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	for (int i = 0; i < n; i++) {
+		snprintf(name, sizeof name, "0000-0040/%i", i);
+		sin = lc_socket_new(ictx);
+		if (!sin) {
+			test_assert(0, "lc_socket_new() %i: %s", i, strerror(errno));
+			n = i;
+			break;
+		}
+		if (!i) base = sin->id;
+		chan = lc_channel_new(ictx, name);
+		lc_channel_bind(sin, chan);
+		lc_channel_join(chan);
+		test_assert(!lc_socket_listen(sin, &msg_received, NULL), "lc_socket_listen()");
+		cout[i] = lc_channel_new(octx, name);
+		lc_channel_bind(sout, cout[i]);
+	}
+	memset(last, 0, sizeof last);
+	msgs = 0;
+	cpu = cputime();
+	wall = now();
+	for (int r = 0; r < ROUNDS; r++) {
+		head.seq = htobe64(r + 1);
+		for (int i = 0; i < n; i++) {
+			lc_channel_send(cout[i], &head, sizeof head, 0);
+		}
+	}
+	got = wait_msgs(n * ROUNDS);
+	cpu = cputime() - cpu;
+	wall = now() - wall;
+	test_assert(got == n * ROUNDS, "%i/%i received", got, n * ROUNDS);
+	if (threads) test_log("event loop, %i threads: %i sockets, %i msgs, cpu %.1f ms, wall %.1f ms",
+			threads, n, got, cpu * 1000, wall * 1000);
+	else test_log("thread per socket: %i sockets, %i msgs, cpu %.1f ms, wall %.1f ms",
+			n, got, cpu * 1000, wall * 1000);
+	lc_ctx_free(octx);
+	lc_ctx_free(ictx);
+}
+
+/* threads in this process */
+static int tasks(void)
+{
+	struct dirent *d;
+	DIR *dir;
+	int n = 0;
+
+	if (!(dir = opendir("/proc/self/task"))) return -1;
+	while ((d = readdir(dir))) if (d->d_name[0] != '.') n++;
+	closedir(dir);
+	return n;
+}
+
+/* threads started by a failed lc_ctx_loop_start() are stopped, others run on */
+static void test_unwind(void)
+{
+	lc_ctx_t *ctx;
+	int n;
+
+	ctx = lc_ctx_new();
+	n = tasks();
+	test_assert(!lc_ctx_loop_start(ctx, 2), "lc_ctx_loop_start() - 2 threads");
+	create_fail = 3;
+	test_assert(lc_ctx_loop_start(ctx, 4) == LC_ERROR_EVENT_LOOP,
+			"lc_ctx_loop_start() - third thread fails");
+	create_fail = -1;
+	test_assert(tasks() == n + 2, "threads started before failure stopped: %i", tasks() - n);
+	test_assert(!lc_ctx_loop_start(ctx, 1), "lc_ctx_loop_start() - after failure");
+	test_assert(tasks() == n + 3, "loop threads: %i", tasks() - n);
+	test_assert(!lc_ctx_loop_stop(ctx), "lc_ctx_loop_stop()");
+	test_assert(tasks() == n, "all stopped");
+	lc_ctx_free(ctx);
+}
+
+static void *run(void *arg)
+{
+	static int rc;
+	rc = lc_ctx_run(arg);
+	return &rc;
+}
+
+/* lc_ctx_run() in our own thread, and ordered delivery from loop timers */
+static void test_run(void)
+{
+	lc_ctx_t *ictx, *octx;
+	lc_socket_t *sin, *sout;
+	lc_channel_t *chan, *cout;
+	lc_message_head_t head = {0};
+	pthread_t thread;
+	struct timespec t = { .tv_nsec = 10000000 };
+	void *ret;
+	int got;
+
+	ictx = lc_ctx_new();
+	octx = lc_ctx_new();
+	test_assert(!lc_ctx_loop_start(ictx, 0), "lc_ctx_loop_start() - no threads");
+	pthread_create(&thread, NULL, &run, ictx);
+	sin = lc_socket_new(ictx);
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	base = sin->id;
+	memset(last, 0, sizeof last);
+	msgs = 0;
+	chan = lc_channel_new(ictx, "0000-0040");
+	cout = lc_channel_new(octx, "0000-0040");
+	test_assert(!lc_channel_ordered(chan, 16, HOLD), "lc_channel_ordered()");
+	lc_channel_bind(sin, chan);
+	lc_channel_bind(sout, cout);
+	lc_channel_join(chan);
+	test_assert(!lc_socket_listen(sin, &msg_received, NULL), "lc_socket_listen()");
+	test_assert(lc_socket_listen(sin, &msg_received, NULL) == LC_ERROR_SOCKET_LISTENING,
+			"already listening");
+
+	/* 2 is missing - 3 is released by the loop timer after HOLD ms */
+	head.seq = htobe64(1);
+	lc_channel_send(cout, &head, sizeof head, 0);
+	head.seq = htobe64(3);
+	lc_channel_send(cout, &head, sizeof head, 0);
+	nanosleep(&t, NULL);
+	got = __atomic_load_n(&msgs, __ATOMIC_SEQ_CST);
+	test_assert(got == 1, "1 delivered, 3 held (%i)", got);
+	test_assert(wait_msgs(2) == 2, "3 released after hold time");
+
+	/* cancelled socket isn't called again */
+	test_assert(!lc_socket_listen_cancel(sin), "lc_socket_listen_cancel()");
+	head.seq = htobe64(4);
+	lc_channel_send(cout, &head, sizeof head, 0);
+	nanosleep(&t, NULL);
+	test_assert(__atomic_load_n(&msgs, __ATOMIC_SEQ_CST) == 2, "no callback after cancel");
+
+	test_assert(!lc_ctx_loop_stop(ictx), "lc_ctx_loop_stop()");
+	pthread_join(thread, &ret);
+	test_assert(*(int *)ret == 0, "lc_ctx_run() returned");
+	lc_ctx_free(octx);
+	lc_ctx_free(ictx);
+}
+
+int main()
+{
+	struct rlimit rl;
+	int n = SOCKS;
+
+	test_name("lc_ctx_loop_start() / lc_ctx_run() - shared event loop");
+
+	test_run();
+	test_unwind();
+
+	/* need a descriptor for each socket, plus a few */
+	getrlimit(RLIMIT_NOFILE, &rl);
+	if (rl.rlim_cur < SOCKS + 64) {
+		rl.rlim_cur = (rl.rlim_max < SOCKS + 64) ? rl.rlim_max : SOCKS + 64;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if (rl.rlim_cur < SOCKS + 64) n = rl.rlim_cur - 64;
+	bench(n, 0);
+	bench(n, THREADS);
+	return fails;
+}
@@ -0,0 +1,173 @@
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/librecast_pvt.h"
+#include <stdio.h>
+#include <time.h>
+
+#define CHANNELS 8
+#define MSGS 20 /* total stays within default receive buffer */
+#define WORKERS 4
+#define DELAY 200000 /* ns per callback */
+#define WAITMS 5000
+
+static lc_channel_t *chan[CHANNELS];
+static lc_seq_t last[CHANNELS];
+static int order[CHANNELS];
+static int msgs;
+static lc_socket_t *cancelled;
+static int cancel_rc = -1, cancel_calls;
+
+/* slow callback - checks messages on each channel arrive in order */
+void msg_received(lc_message_t *msg)
+{
+	struct timespec t = { .tv_nsec = DELAY };
+	int i;
+
+	for (i = 0; i < CHANNELS && chan[i] != msg->chan; i++);
+	if (i == CHANNELS) return;
+	/* ignore repeat callbacks for the same message */
+	if (msg->seq == last[i]) return;
+	if (msg->seq != last[i] + 1) order[i]++;
+	last[i] = msg->seq;
+	nanosleep(&t, NULL);
+	__atomic_add_fetch(&msgs, 1, __ATOMIC_SEQ_CST);
+}
+
+/* stop listening from the socket's own callback */
+void msg_cancel(lc_message_t *msg)
+{
+	(void)msg;
+	if (__atomic_add_fetch(&cancel_calls, 1, __ATOMIC_SEQ_CST) > 1) return;
+	__atomic_store_n(&cancel_rc, lc_socket_listen_cancel(cancelled), __ATOMIC_SEQ_CST);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(int workers)
+{
+	lc_ctx_t *lctx, *octx;
+	lc_socket_t *sock, *sout;
+	lc_channel_t *cout[CHANNELS];
+	lc_message_head_t head = {0};
+	lc_worker_stats_t stats[WORKERS];
+	struct timespec t = { .tv_nsec = 1000000 };
+	char name[32];
+	double start, elapsed;
+	uint64_t total = 0;
+	int got;
+
+	lctx = lc_ctx_new();
+	octx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	test_assert(!lc_ctx_workers(lctx, workers, LC_WORKERS_CHANNEL), "lc_ctx_workers(%i)", workers);
+	for (int i = 0; i < CHANNELS; i++) {
+		snprintf(name, sizeof name, "0000-0041/%i", i);
+		chan[i] = lc_channel_new(lctx, name);
+		cout[i] = lc_channel_new(octx, name);
+		lc_channel_bind(sock, chan[i]);
+		lc_channel_bind(sout, cout[i]);
+		lc_channel_join(chan[i]);
+	}
+	memset(last, 0, sizeof last);
+	memset(order, 0, sizeof order);
+	msgs = 0;
+	test_assert(!lc_socket_listen(sock, &msg_received, NULL), "lc_socket_listen()");
+	test_assert(lc_ctx_workers(lctx, workers, LC_WORKERS_CHANNEL) == LC_ERROR_SOCKET_LISTENING,
+			"lc_ctx_workers() - socket already listening");
+
+	/* interleave messages for all channels */
+	start = now();
+	for (int j = 0; j < MSGS; j++) {
+		head.seq = htobe64(j + 1);
+		for (int i = 0; i < CHANNELS; i++) {
+			lc_channel_send(cout[i], &head, sizeof head, 0);
+		}
+	}
+	while ((got = __atomic_load_n(&msgs, __ATOMIC_SEQ_CST)) < CHANNELS * MSGS
+			&& now() - start < WAITMS / 1000.0)
+		nanosleep(&t, NULL);
+	elapsed = now() - start;
+	test_assert(got == CHANNELS * MSGS, "%i/%i messages", got, CHANNELS * MSGS);
+	for (int i = 0; i < CHANNELS; i++) {
+		test_assert(!order[i], "channel %i in order", i);
+	}
+	if (workers) {
+		test_assert(lc_ctx_workers_stats(lctx, stats, WORKERS) == workers, "lc_ctx_workers_stats()");
+		for (int i = 0; i < workers; i++) {
+			test_log("worker %i: %zu msgs, %zu stolen, utilisation %.0f%%, depth %zu", i,
+				stats[i].msgs, stats[i].stolen, 100.0 * stats[i].busy / stats[i].elapsed,
+				stats[i].depth);
+			total += stats[i].msgs;
+		}
+		test_assert(total == CHANNELS * MSGS, "workers delivered %zu", total);
+	}
+	else test_assert(lc_ctx_workers_stats(lctx, stats, WORKERS) == 0, "no workers");
+	test_log("%i workers: %i msgs in %.1f ms", workers, got, elapsed * 1000);
+	lc_ctx_free(octx);
+	lc_ctx_free(lctx);
+	return elapsed;
+}
+
+/* cancel from a callback returns, with or without workers */
+static void cancel_self(int workers)
+{
+	lc_ctx_t *lctx, *octx;
+	lc_socket_t *sout;
+	lc_channel_t *cin, *cout;
+	lc_message_head_t head = {0};
+	struct timespec t = { .tv_nsec = 1000000 };
+	double start;
+	int calls;
+
+	lctx = lc_ctx_new();
+	octx = lc_ctx_new();
+	if (workers) lc_ctx_workers(lctx, workers, LC_WORKERS_CHANNEL);
+	cancelled = lc_socket_new(lctx);
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	cin = lc_channel_new(lctx, "0000-0041/cancel");
+	cout = lc_channel_new(octx, "0000-0041/cancel");
+	lc_channel_bind(cancelled, cin);
+	lc_channel_bind(sout, cout);
+	lc_channel_join(cin);
+	cancel_rc = -1;
+	cancel_calls = 0;
+	test_assert(!lc_socket_listen(cancelled, &msg_cancel, NULL), "lc_socket_listen()");
+	head.seq = htobe64(1);
+	lc_channel_send(cout, &head, sizeof head, 0);
+	start = now();
+	while (__atomic_load_n(&cancel_rc, __ATOMIC_SEQ_CST) == -1 && now() - start < WAITMS / 1000.0)
+		nanosleep(&t, NULL);
+	test_assert(__atomic_load_n(&cancel_rc, __ATOMIC_SEQ_CST) == 0,
+			"%i workers: lc_socket_listen_cancel() from callback", workers);
+	/* listener gone - nothing more is delivered */
+	nanosleep(&t, NULL);
+	calls = __atomic_load_n(&cancel_calls, __ATOMIC_SEQ_CST);
+	head.seq = htobe64(2);
+	lc_channel_send(cout, &head, sizeof head, 0);
+	for (int i = 0; i < 50; i++) nanosleep(&t, NULL);
+	test_assert(__atomic_load_n(&cancel_calls, __ATOMIC_SEQ_CST) == calls,
+			"%i workers: no callback after cancel", workers);
+	lc_ctx_free(octx);
+	lc_ctx_free(lctx);
+}
+
+int main()
+{
+	double inline_t, pool_t;
+
+	test_name("lc_ctx_workers() - worker pool dispatch");
+	inline_t = run(0);
+	pool_t = run(WORKERS);
+	cancel_self(0);
+	cancel_self(WORKERS);
+	test_log("speedup with %i workers: %.2fx", WORKERS, inline_t / pool_t);
+	return fails;
+}
@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/librecast_pvt.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GROUPMAX 4
+#define SENDERS 16
+#define MSGS 8 /* per sender - total stays within default receive buffer */
+#define DELAY 100000 /* ns per callback */
+#define WAITMS 5000
+
+static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
+static lc_socket_group_t *grp;
+static in_port_t port[SENDERS];
+static lc_seq_t last[SENDERS];
+static int sockidx[SENDERS];
+static int count[GROUPMAX];
+static int order, split, msgs;
+
+void msg_received(lc_message_t *msg)
+{
+	struct timespec t = { .tv_nsec = DELAY };
+	int i, s;
+
+	for (s = 0; s < GROUPMAX; s++) {
+		lc_socket_t *sock = lc_socket_group_socket(grp, s);
+		if (sock && sock->id == msg->sockid) break;
+	}
+	if (s == GROUPMAX) return;
+	pthread_mutex_lock(&mtx);
+	for (i = 0; i < SENDERS && port[i] && port[i] != msg->srcport; i++);
+	if (i == SENDERS || msg->seq == last[i]) {
+		/* ignore repeat callbacks for the same message */
+		pthread_mutex_unlock(&mtx);
+		return;
+	}
+	if (!port[i]) {
+		port[i] = msg->srcport;
+		sockidx[i] = s;
+	}
+	if (sockidx[i] != s) split++;
+	if (msg->seq != last[i] + 1) order++;
+	last[i] = msg->seq;
+	count[s]++;
+	pthread_mutex_unlock(&mtx);
+	nanosleep(&t, NULL);
+	__atomic_add_fetch(&msgs, 1, __ATOMIC_SEQ_CST);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(int n, lc_fanout_t mode, int pin)
+{
+	lc_ctx_t *lctx;
+	lc_channel_t *chan;
+	int sout[SENDERS];
+	lc_message_head_t head = {0};
+	struct timespec t = { .tv_nsec = 1000000 };
+	cpu_set_t cpus, saved;
+	double start, elapsed;
+	int used = 0, cpu = 0;
+
+	lctx = lc_ctx_new();
+	grp = lc_socket_group_new(lctx, n, mode);
+	test_assert(grp != NULL, "lc_socket_group_new(%i)", n);
+	chan = lc_channel_new(lctx, "0000-0042");
+	test_assert(!lc_socket_group_bind(grp, chan), "lc_socket_group_bind()");
+	test_assert(!lc_socket_group_join(grp, chan), "lc_socket_group_join()");
+	/* plain UDP senders, each with its own source port. Librecast senders
+	 * bind to the channel port, so would differ only by address */
+	for (int i = 0; i < SENDERS; i++) {
+		sout[i] = socket(AF_INET6, SOCK_DGRAM, 0);
+	}
+	memset(port, 0, sizeof port);
+	memset(last, 0, sizeof last);
+	memset(count, 0, sizeof count);
+	order = 0; split = 0; msgs = 0;
+	test_assert(!lc_socket_group_listen(grp, &msg_received, NULL), "lc_socket_group_listen()");
+
+	if (pin) {
+		/* send (and so receive, on loopback) from a single CPU */
+		sched_getaffinity(0, sizeof saved, &saved);
+		for (cpu = 0; !CPU_ISSET(cpu, &saved); cpu++);
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		sched_setaffinity(0, sizeof cpus, &cpus);
+	}
+	start = now();
+	for (int j = 0; j < MSGS; j++) {
+		head.seq = htobe64(j + 1);
+		for (int i = 0; i < SENDERS; i++) {
+			sendto(sout[i], &head, sizeof head, 0, (struct sockaddr *)&chan->sa, sizeof chan->sa);
+		}
+	}
+	if (pin) sched_setaffinity(0, sizeof saved, &saved);
+	while (msgs < SENDERS * MSGS && now() - start < WAITMS / 1000.0) nanosleep(&t, NULL);
+	elapsed = now() - start;
+
+	test_assert(msgs == SENDERS * MSGS, "%i/%i messages", msgs, SENDERS * MSGS);
+	test_assert(!order, "messages from each sender in order");
+	for (int s = 0; s < n; s++) {
+		test_log("n=%i socket %i: %i msgs", n, s, count[s]);
+		if (count[s]) used++;
+	}
+	if (mode == LC_FANOUT_HASH) {
+		test_assert(!split, "each sender handled by one socket");
+		if (n > 1) test_assert(used > 1, "load spread over %i/%i sockets", used, n);
+	}
+	else if (pin) {
+		test_assert(count[cpu % n] == msgs, "all messages on socket for CPU %i", cpu);
+	}
+	test_assert(!lc_socket_group_listen_cancel(grp), "lc_socket_group_listen_cancel()");
+	for (int i = 0; i < SENDERS; i++) close(sout[i]);
+	lc_ctx_free(lctx); /* frees group */
+	return elapsed;
+}
+
+int main()
+{
+	lc_ctx_t *lctx;
+	lc_channel_t *chan;
+	double t1, t;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	test_name("lc_socket_group_new() - receive fan-out across sockets");
+
+	test_assert(lc_socket_group_new(NULL, 2, LC_FANOUT_HASH) == NULL, "ctx required");
+	lctx = lc_ctx_new();
+	test_assert(lc_socket_group_new(lctx, 0, LC_FANOUT_HASH) == NULL, "n > 0 required");
+	grp = lc_socket_group_new(lctx, 2, LC_FANOUT_HASH);
+	test_assert(lc_socket_group_socket(grp, 2) == NULL, "socket out of range");
+	chan = lc_channel_new(lctx, "0000-0042/ordered");
+	lc_channel_ordered(chan, 16, 10);
+	test_assert(lc_socket_group_bind(grp, chan) == LC_ERROR_INVALID_PARAMS,
+			"ordered channel refused");
+	lc_ctx_free(lctx);
+
+	/* per-core scaling - callbacks are slow, so n sockets should approach
+	 * n times the rate of one, up to the number of CPUs */
+	t1 = run(1, LC_FANOUT_HASH, 0);
+	test_log("%li CPUs, n=1: %.0f msgs/s", cpus, SENDERS * MSGS / t1);
+	for (int n = 2; n <= GROUPMAX; n *= 2) {
+		t = run(n, LC_FANOUT_HASH, 0);
+		test_log("n=%i: %.0f msgs/s, %.2fx", n, SENDERS * MSGS / t, t1 / t);
+	}
+	run(GROUPMAX, LC_FANOUT_CPU, 1);
+
+	return fails;
+}
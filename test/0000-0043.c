@@ -0,0 +1,185 @@
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/librecast_pvt.h"
+#include <errno.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SOCKETS 100
+#define TIMEOUT 50 /* ms */
+#define HOLD 50 /* ms */
+#define WAITMS 5000
+
+static lc_seq_t last[SOCKETS];
+static lc_socket_t *sock[SOCKETS];
+static int msgs;
+
+void msg_received(lc_message_t *msg)
+{
+	int i;
+	for (i = 0; i < SOCKETS && sock[i] && sock[i]->id != msg->sockid; i++);
+	if (i == SOCKETS || !sock[i]) return;
+	/* ignore repeat callbacks for the same message */
+	if (msg->seq == last[i]) return;
+	last[i] = msg->seq;
+	msgs++;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void send_seq(lc_channel_t *chan, lc_seq_t seq)
+{
+	lc_message_head_t head = { .seq = htobe64(seq) };
+	lc_channel_send(chan, &head, sizeof head, 0);
+}
+
+static void test_recv(lc_ctx_t *lctx, lc_ctx_t *octx)
+{
+	lc_socket_t *s, *sout;
+	lc_channel_t *chan, *cout;
+	lc_message_t msg = {0};
+	double t;
+	ssize_t rc;
+
+	s = lc_socket_new(lctx);
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	chan = lc_channel_new(lctx, "0000-0043");
+	cout = lc_channel_new(octx, "0000-0043");
+	lc_channel_bind(s, chan);
+	lc_channel_bind(sout, cout);
+	lc_channel_join(chan);
+	test_assert(lc_socket_fd(s) == lc_socket_raw(s), "lc_socket_fd() - UDP socket");
+
+	rc = lc_msg_tryrecv(s, &msg);
+	test_assert(rc == -1 && errno == EAGAIN, "lc_msg_tryrecv() - nothing waiting");
+	t = now();
+	rc = lc_msg_recv_timeout(s, &msg, TIMEOUT);
+	t = now() - t;
+	test_assert(rc == -1 && errno == EAGAIN, "lc_msg_recv_timeout() - timed out");
+	test_assert(t >= TIMEOUT / 1000.0 * 0.9, "lc_msg_recv_timeout() waited %.1f ms", t * 1000);
+
+	send_seq(cout, 1);
+	rc = lc_msg_recv_timeout(s, &msg, WAITMS);
+	test_assert(rc > 0 && msg.seq == 1, "lc_msg_recv_timeout() - received");
+	lc_msg_free(&msg);
+	send_seq(cout, 2);
+	t = now();
+	while ((rc = lc_msg_tryrecv(s, &msg)) == -1 && errno == EAGAIN && now() - t < WAITMS / 1000.0);
+	test_assert(rc > 0 && msg.seq == 2, "lc_msg_tryrecv() - received");
+	lc_msg_free(&msg);
+
+	test_assert(lc_socket_drain(s, NULL, NULL, 0) == LC_ERROR_INVALID_PARAMS, "lc_socket_drain() - max");
+	test_assert(lc_socket_drain(s, NULL, NULL, 1) == 0, "lc_socket_drain() - nothing waiting");
+	lc_socket_listen(s, NULL, NULL);
+	test_assert(lc_socket_drain(s, NULL, NULL, 1) == LC_ERROR_SOCKET_LISTENING,
+			"lc_socket_drain() - socket listening");
+	lc_socket_listen_cancel(s);
+}
+
+/* ordered channel - lc_socket_timeout() tells us when to drain held messages */
+static void test_ordered(lc_ctx_t *lctx, lc_ctx_t *octx)
+{
+	struct pollfd fds = { .events = POLLIN };
+	lc_socket_t *s, *sout;
+	lc_channel_t *chan, *cout;
+	double t;
+	int wait;
+
+	sock[0] = s = lc_socket_new(lctx);
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	chan = lc_channel_new(lctx, "0000-0043/ordered");
+	cout = lc_channel_new(octx, "0000-0043/ordered");
+	lc_channel_ordered(chan, 16, HOLD);
+	lc_channel_bind(s, chan);
+	lc_channel_bind(sout, cout);
+	lc_channel_join(chan);
+	fds.fd = lc_socket_fd(s);
+	test_assert(lc_socket_timeout(s) == -1, "lc_socket_timeout() - nothing held");
+
+	memset(last, 0, sizeof last);
+	msgs = 0;
+	send_seq(cout, 1);
+	send_seq(cout, 3); /* held, waiting for 2 */
+	t = now();
+	while (msgs < 2 && now() - t < WAITMS / 1000.0) {
+		wait = lc_socket_timeout(s);
+		if (msgs == 1) test_assert(wait > 0 && wait <= HOLD, "lc_socket_timeout() = %i", wait);
+		poll(&fds, 1, (wait < 0) ? WAITMS : wait);
+		lc_socket_drain(s, &msg_received, NULL, 8);
+	}
+	test_assert(msgs == 2, "ordered: %i/2 messages", msgs);
+	test_assert(now() - t >= HOLD / 1000.0 * 0.9, "held message released after %.1f ms",
+			(now() - t) * 1000);
+	test_assert(lc_socket_timeout(s) == -1, "lc_socket_timeout() - nothing held");
+}
+
+/* external reactor - one epoll set, many sockets, no threads */
+static void test_reactor(lc_ctx_t *lctx, lc_ctx_t *octx)
+{
+	struct epoll_event ev[16], e = { .events = EPOLLIN | EPOLLET };
+	lc_socket_t *sout;
+	lc_channel_t *chan, *cout;
+	char name[32];
+	double t;
+	int efd, n;
+
+	efd = epoll_create1(0);
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	for (int i = 0; i < SOCKETS; i++) {
+		snprintf(name, sizeof name, "0000-0043/%i", i);
+		sock[i] = lc_socket_new(lctx);
+		chan = lc_channel_new(lctx, name);
+		lc_channel_bind(sock[i], chan);
+		lc_channel_join(chan);
+		e.data.ptr = sock[i];
+		epoll_ctl(efd, EPOLL_CTL_ADD, lc_socket_fd(sock[i]), &e);
+	}
+	memset(last, 0, sizeof last);
+	msgs = 0;
+	for (int i = 0; i < SOCKETS; i++) {
+		snprintf(name, sizeof name, "0000-0043/%i", i);
+		cout = lc_channel_new(octx, name);
+		lc_channel_bind(sout, cout);
+		send_seq(cout, 1);
+	}
+	t = now();
+	while (msgs < SOCKETS && now() - t < WAITMS / 1000.0) {
+		n = epoll_wait(efd, ev, 16, WAITMS);
+		for (int i = 0; i < n; i++) {
+			/* edge-triggered - read until there is no more */
+			while (lc_socket_drain(ev[i].data.ptr, &msg_received, NULL, 4) == 4);
+		}
+	}
+	test_assert(msgs == SOCKETS, "reactor: %i/%i messages", msgs, SOCKETS);
+	close(efd);
+}
+
+int main()
+{
+	lc_ctx_t *lctx, *octx;
+
+	test_name("lc_msg_tryrecv() / lc_msg_recv_timeout() / lc_socket_drain() - readiness API");
+
+	lctx = lc_ctx_new();
+	octx = lc_ctx_new();
+	test_assert(lc_socket_fd(NULL) == -1, "lc_socket_fd() - socket required");
+	test_assert(lc_socket_drain(NULL, NULL, NULL, 1) == LC_ERROR_SOCKET_REQUIRED,
+			"lc_socket_drain() - socket required");
+	test_recv(lctx, octx);
+	test_ordered(lctx, octx);
+	test_reactor(lctx, octx);
+	lc_ctx_free(octx);
+	lc_ctx_free(lctx);
+
+	return fails;
+}
@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include "test.h"
+#include <librecast/net.h>
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STACKSIZE (1024 * 1024)
+#define MSGS 200
+#define WAITMS 5000
+
+static cpu_set_t cpus;
+static size_t stacksize;
+static int policy, mempolicy, memnode, called;
+static lc_seq_t last;
+static uint64_t lat[MSGS];
+static int nlat;
+
+static uint64_t realtime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* record placement of the thread we are called from */
+void msg_placement(lc_message_t *msg)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+	unsigned long mask[16] = {0};
+
+	if (msg->seq == last) return;
+	last = msg->seq;
+	pthread_getaffinity_np(pthread_self(), sizeof cpus, &cpus);
+	pthread_getattr_np(pthread_self(), &attr);
+	pthread_attr_getstacksize(&attr, &stacksize);
+	pthread_attr_destroy(&attr);
+	pthread_getschedparam(pthread_self(), &policy, &param);
+	if (!syscall(SYS_get_mempolicy, &mempolicy, mask, sizeof mask * 8, NULL, 0)) {
+		for (memnode = 0; memnode < (int)sizeof mask * 8 && !(mask[memnode / 64] & (1UL << (memnode % 64))); memnode++);
+	}
+	__atomic_store_n(&called, 1, __ATOMIC_SEQ_CST);
+}
+
+void msg_latency(lc_message_t *msg)
+{
+	if (msg->seq == last) return;
+	last = msg->seq;
+	if (nlat < MSGS) lat[nlat] = realtime() - msg->timestamp;
+	__atomic_add_fetch(&nlat, 1, __ATOMIC_SEQ_CST);
+}
+
+static int wait_for(int *flag, int n)
+{
+	struct timespec t = { .tv_nsec = 100000 };
+	for (int i = 0; i < WAITMS * 10 && __atomic_load_n(flag, __ATOMIC_SEQ_CST) < n; i++)
+		nanosleep(&t, NULL);
+	return __atomic_load_n(flag, __ATOMIC_SEQ_CST) >= n;
+}
+
+/* start listener on a fresh socket, placed by sattr (or ctx default), send one
+ * message and wait for the callback */
+static int placed(lc_ctx_t *lctx, lc_channel_t *cout, lc_thread_attr_t *sattr, char *name)
+{
+	lc_socket_t *sock;
+	lc_channel_t *chan;
+	lc_message_t msg;
+	int rc;
+
+	sock = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, name);
+	lc_channel_bind(sock, chan);
+	lc_channel_join(chan);
+	if (sattr) test_assert(!lc_socket_thread_attr(sock, sattr), "lc_socket_thread_attr()");
+	called = 0; last = 0; memnode = -1; mempolicy = -1;
+	if ((rc = lc_socket_listen(sock, &msg_placement, NULL))) goto out;
+	lc_msg_init(&msg);
+	lc_msg_send(cout, &msg);
+	test_assert(wait_for(&called, 1), "callback");
+	lc_socket_listen_cancel(sock);
+out:
+	lc_socket_close(sock);
+	lc_channel_free(chan);
+	return rc;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	uint64_t x = *(uint64_t *)a, y = *(uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* median receive latency with the listener on node (-1 = unpinned), sender
+ * pinned to cpu */
+static double latency(int node, int cpu)
+{
+	lc_ctx_t *lctx, *octx;
+	lc_socket_t *sock, *sout;
+	lc_channel_t *chan, *cout;
+	lc_thread_attr_t attr;
+	lc_message_t msg;
+	cpu_set_t saved, one;
+	struct timespec t = { .tv_nsec = 200000 };
+	double median;
+
+	lctx = lc_ctx_new();
+	octx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	chan = lc_channel_new(lctx, "0000-0044/latency");
+	cout = lc_channel_new(octx, "0000-0044/latency");
+	lc_channel_bind(sock, chan);
+	lc_channel_bind(sout, cout);
+	lc_channel_join(chan);
+	lc_thread_attr_init(&attr);
+	attr.node = node;
+	lc_socket_thread_attr(sock, &attr);
+	nlat = 0; last = 0;
+	test_assert(!lc_socket_listen(sock, &msg_latency, NULL), "listen on node %i", node);
+
+	sched_getaffinity(0, sizeof saved, &saved);
+	CPU_ZERO(&one);
+	CPU_SET(cpu, &one);
+	sched_setaffinity(0, sizeof one, &one);
+	for (int i = 0; i < MSGS; i++) {
+		lc_msg_init(&msg);
+		lc_msg_send(cout, &msg);
+		nanosleep(&t, NULL); /* one at a time - measure wakeup, not queueing */
+	}
+	sched_setaffinity(0, sizeof saved, &saved);
+	test_assert(wait_for(&nlat, MSGS), "%i/%i latency samples", nlat, MSGS);
+	qsort(lat, MSGS, sizeof lat[0], &cmp);
+	median = lat[MSGS / 2] / 1000.0;
+	lc_ctx_free(octx);
+	lc_ctx_free(lctx);
+	return median;
+}
+
+static int node_cpu(int node)
+{
+	char path[64];
+	FILE *f;
+	int cpu = -1;
+
+	snprintf(path, sizeof path, "/sys/devices/system/node/node%i/cpulist", node);
+	if (!(f = fopen(path, "r"))) return -1;
+	if (fscanf(f, "%i", &cpu) != 1) cpu = -1;
+	fclose(f);
+	return cpu;
+}
+
+int main()
+{
+	lc_ctx_t *lctx, *octx;
+	lc_socket_t *sout;
+	lc_channel_t *cout;
+	lc_thread_attr_t attr, dflt;
+	int cpu, rc, nodes, local;
+
+	test_name("lc_socket_thread_attr() / lc_ctx_thread_attr() - thread placement");
+
+	sched_getaffinity(0, sizeof cpus, &cpus);
+	for (cpu = 0; !CPU_ISSET(cpu, &cpus); cpu++);
+
+	lctx = lc_ctx_new();
+	octx = lc_ctx_new();
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	cout = lc_channel_new(octx, "0000-0044");
+	lc_channel_bind(sout, cout);
+
+	lc_thread_attr_init(&attr);
+	test_assert(attr.node == -1, "lc_thread_attr_init()");
+	test_assert(lc_thread_attr_setcpu(&attr, LC_CPUS_MAX) == LC_ERROR_INVALID_PARAMS,
+			"lc_thread_attr_setcpu() - out of range");
+	attr.priority = 100;
+	test_assert(lc_ctx_thread_attr(lctx, &attr) == LC_ERROR_INVALID_PARAMS, "priority range");
+
+	/* socket placement: CPU and stack size */
+	lc_thread_attr_init(&attr);
+	lc_thread_attr_setcpu(&attr, cpu);
+	attr.stacksize = STACKSIZE;
+	test_assert(!placed(lctx, cout, &attr, "0000-0044"), "lc_socket_listen()");
+	test_assert(CPU_COUNT(&cpus) == 1 && CPU_ISSET(cpu, &cpus), "listener pinned to CPU %i", cpu);
+	test_assert(stacksize == STACKSIZE, "stack size %zu", stacksize);
+
+	/* context default, used by sockets without their own */
+	lc_thread_attr_init(&dflt);
+	dflt.stacksize = STACKSIZE * 2;
+	dflt.node = (node_cpu(0) >= 0) ? 0 : -1;
+	test_assert(!lc_ctx_thread_attr(lctx, &dflt), "lc_ctx_thread_attr()");
+	test_assert(!placed(lctx, cout, NULL, "0000-0044"), "lc_socket_listen() - ctx default");
+	test_assert(stacksize == STACKSIZE * 2, "ctx default stack size %zu", stacksize);
+	if (dflt.node == 0) {
+		test_assert(mempolicy == MPOL_PREFERRED && memnode == 0,
+				"listener allocates from node 0 (policy %i, node %i)", mempolicy, memnode);
+	}
+	test_assert(!placed(lctx, cout, &attr, "0000-0044"), "lc_socket_listen() - socket overrides ctx");
+	test_assert(stacksize == STACKSIZE, "socket stack size %zu", stacksize);
+
+	/* realtime priority needs privilege - either placed, or refused */
+	lc_thread_attr_init(&attr);
+	attr.priority = 1;
+	rc = placed(lctx, cout, &attr, "0000-0044");
+	if (rc) test_assert(rc == LC_ERROR_THREAD_CREATE, "SCHED_FIFO refused: %s", lc_error_msg(rc));
+	else test_assert(policy == SCHED_FIFO, "SCHED_FIFO listener");
+	lc_ctx_free(octx);
+	lc_ctx_free(lctx);
+
+	/* local versus cross-node receive latency, sender on node 0 */
+	for (nodes = 0; node_cpu(nodes) >= 0; nodes++);
+	local = node_cpu(0);
+	if (local >= 0) {
+		test_log("%i NUMA node(s), sender on CPU %i", nodes, local);
+		test_log("unpinned listener: median latency %.1f us", latency(-1, local));
+		test_log("local (node 0) listener: median latency %.1f us", latency(0, local));
+		if (nodes > 1)
+			test_log("cross-node (node %i) listener: median latency %.1f us",
+					nodes - 1, latency(nodes - 1, local));
+		else
+			test_log("cross-node: single node, not measured");
+	}
+
+	return fails;
+}
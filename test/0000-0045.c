@@ -0,0 +1,125 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PINGS 2000
+#define WARMUP 100
+#define BUSY 50 /* us */
+#define SPIN 200 /* us */
+#define WAITMS 1000
+
+typedef struct {
+	char *name;
+	int busy;
+	int spin;
+} rx_mode_t;
+
+static uint64_t rtt[PINGS];
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	uint64_t x = *(uint64_t *)a, y = *(uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* send PING, wait for PONG. Returns round trip in ns, 0 on timeout */
+static uint64_t ping(lc_socket_t *sock, lc_channel_t *chan)
+{
+	lc_message_t msg;
+	uint64_t t0;
+	int op = LC_OP_PING;
+
+	lc_msg_init(&msg);
+	lc_msg_set(&msg, LC_ATTR_OPCODE, &op);
+	t0 = now();
+	lc_msg_send(chan, &msg);
+	for (;;) {
+		/* our own PING comes back too - skip it */
+		lc_msg_init(&msg);
+		if (lc_msg_recv_timeout(sock, &msg, WAITMS) == -1) return 0;
+		op = msg.op;
+		lc_msg_free(&msg);
+		if (op == LC_OP_PONG) return now() - t0;
+	}
+}
+
+/* responder listens in the mode under test, echoing PONG for each PING.  The
+ * pinger blocks the same way in every mode, so differences are the responder's */
+static int run(rx_mode_t *mode)
+{
+	lc_ctx_t *rctx, *pctx;
+	lc_socket_t *rsock, *psock;
+	lc_channel_t *rchan, *pchan;
+	int rc, lost = 0, n = 0;
+	uint64_t t;
+
+	rctx = lc_ctx_new();
+	pctx = lc_ctx_new();
+	rsock = lc_socket_new(rctx);
+	psock = lc_socket_new(pctx);
+	lc_socket_loop(rsock, 1);
+	lc_socket_loop(psock, 1);
+	rchan = lc_channel_new(rctx, "0000-0045");
+	pchan = lc_channel_new(pctx, "0000-0045");
+	lc_channel_bind(rsock, rchan);
+	lc_channel_bind(psock, pchan);
+	lc_channel_join(rchan);
+	lc_channel_join(pchan);
+	if ((rc = lc_socket_busy_poll(rsock, mode->busy, mode->spin))) {
+		test_log("%-9s: unavailable (%s: %s)", mode->name, lc_error_msg(rc), strerror(errno));
+		goto out;
+	}
+	test_assert(!lc_socket_listen(rsock, NULL, NULL), "%s: lc_socket_listen()", mode->name);
+	for (int i = 0; i < WARMUP + PINGS; i++) {
+		if (!(t = ping(psock, pchan))) lost++;
+		else if (i >= WARMUP) rtt[n++] = t;
+	}
+	test_assert(!lost, "%s: %i pings lost", mode->name, lost);
+	qsort(rtt, n, sizeof rtt[0], &cmp);
+	if (n) test_log("%-9s: p50 %6.1f us  p99 %6.1f us  p99.9 %7.1f us", mode->name,
+			rtt[n / 2] / 1000.0, rtt[n * 99 / 100] / 1000.0, rtt[n * 999 / 1000] / 1000.0);
+	test_assert(lc_socket_busy_poll(rsock, 0, 0) == LC_ERROR_SOCKET_LISTENING,
+			"%s: lc_socket_busy_poll() - socket listening", mode->name);
+out:
+	lc_ctx_free(pctx);
+	lc_ctx_free(rctx);
+	return rc;
+}
+
+int main()
+{
+	rx_mode_t mode[] = {
+		{ "blocking",  0,    0    },
+		{ "busy-poll", BUSY, 0    },
+		{ "spin",      0,    SPIN },
+		{ "hybrid",    BUSY, SPIN },
+	};
+	lc_ctx_t *lctx;
+	lc_socket_t *sock;
+
+	test_name("lc_socket_busy_poll() - PING/PONG round trip latency");
+
+	test_assert(lc_socket_busy_poll(NULL, 0, 0) == LC_ERROR_SOCKET_REQUIRED, "socket required");
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	test_assert(lc_socket_busy_poll(sock, -1, 0) == LC_ERROR_INVALID_PARAMS, "busy_us >= 0");
+	test_assert(lc_socket_busy_poll(sock, 0, -1) == LC_ERROR_INVALID_PARAMS, "spin_us >= 0");
+	test_assert(!lc_socket_busy_poll(sock, 0, SPIN), "lc_socket_busy_poll() - spin");
+	lc_ctx_free(lctx);
+
+	for (size_t i = 0; i < sizeof mode / sizeof mode[0]; i++) {
+		/* only kernel busy polling may need privileges */
+		if (run(&mode[i])) test_assert(mode[i].busy, "%s mode available", mode[i].name);
+	}
+
+	return fails;
+}
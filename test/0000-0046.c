@@ -0,0 +1,186 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define THREADS 8
+#define ROUNDS 200
+#define MSGS 4
+#define KEEP 100 /* channels looked up while the index grows and shrinks */
+#define GROW 100000
+
+typedef struct {
+	int id;
+	lc_ctx_t *lctx;
+	lc_socket_t *sock;
+	uint32_t *ids;
+} churn_t;
+
+static int msgs, matched, wrong;
+
+/* each message carries the id of the channel it was sent to */
+void msg_received(lc_message_t *msg)
+{
+	uint32_t id;
+
+	__atomic_add_fetch(&msgs, 1, __ATOMIC_RELAXED);
+	if (!msg->chan) return; /* freed before the listener looked */
+	/* the channel must still be valid, even if freed meanwhile */
+	if (msg->len == sizeof id) {
+		memcpy(&id, msg->data, sizeof id);
+		if (lc_channel_get_id(msg->chan) == id) {
+			__atomic_add_fetch(&matched, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+	__atomic_add_fetch(&wrong, 1, __ATOMIC_RELAXED);
+}
+
+/* create, bind, join, send to, part and free channels, while the listener
+ * looks them up, and sockets come and go alongside */
+static void *churn(void *arg)
+{
+	churn_t *c = arg;
+	lc_ctx_t *octx;
+	lc_socket_t *sout, *tmp;
+	lc_channel_t *chan, *out;
+	lc_message_t msg;
+	char name[ROUNDS][32];
+
+	octx = lc_ctx_new();
+	sout = lc_socket_new(octx);
+	lc_socket_loop(sout, 1);
+	for (int i = 0; i < ROUNDS; i++) {
+		snprintf(name[i], sizeof name[i], "0000-0046/%i/%i", c->id, i);
+		chan = lc_channel_new(c->lctx, name[i]);
+		c->ids[i] = lc_channel_get_id(chan);
+		lc_channel_bind(c->sock, chan);
+		lc_channel_join(chan);
+		out = lc_channel_new(octx, name[i]);
+		lc_channel_bind(sout, out);
+		for (int j = 0; j < MSGS; j++) {
+			lc_msg_init_data(&msg, &c->ids[i], sizeof c->ids[i], NULL, NULL);
+			lc_msg_send(out, &msg);
+		}
+		lc_socket_timeout(c->sock);
+		if (!(i % 16)) {
+			tmp = lc_socket_new(c->lctx);
+			lc_socket_close(tmp);
+		}
+		lc_channel_part(chan);
+		lc_channel_unbind(chan);
+		lc_channel_free(chan);
+		lc_channel_free(out);
+	}
+	lc_ctx_free(octx);
+	return NULL;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	uint32_t x = *(uint32_t *)a, y = *(uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void stress(int nworkers)
+{
+	static uint32_t ids[THREADS * ROUNDS];
+	pthread_t thread[THREADS];
+	churn_t c[THREADS];
+	lc_ctx_t *lctx;
+	lc_socket_t *sock;
+	lc_channel_t *chan;
+	struct timespec t = { .tv_nsec = 1000000 };
+	int dups = 0, before, received, nmatched, nwrong;
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	/* keep the socket bound while channels come and go */
+	chan = lc_channel_new(lctx, "0000-0046");
+	lc_channel_bind(sock, chan);
+	if (nworkers) test_assert(!lc_ctx_workers(lctx, nworkers, LC_WORKERS_CHANNEL), "lc_ctx_workers()");
+	__atomic_store_n(&msgs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&matched, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&wrong, 0, __ATOMIC_RELAXED);
+	test_assert(!lc_socket_listen(sock, &msg_received, NULL), "lc_socket_listen()");
+	for (int i = 0; i < THREADS; i++) {
+		c[i].id = i;
+		c[i].lctx = lctx;
+		c[i].sock = sock;
+		c[i].ids = &ids[i * ROUNDS];
+		pthread_create(&thread[i], NULL, &churn, &c[i]);
+	}
+	for (int i = 0; i < THREADS; i++) pthread_join(thread[i], NULL);
+
+	/* let stragglers arrive */
+	do {
+		before = __atomic_load_n(&msgs, __ATOMIC_RELAXED);
+		for (int i = 0; i < 100; i++) nanosleep(&t, NULL);
+	} while (__atomic_load_n(&msgs, __ATOMIC_RELAXED) != before);
+	received = __atomic_load_n(&msgs, __ATOMIC_RELAXED);
+	nmatched = __atomic_load_n(&matched, __ATOMIC_RELAXED);
+	nwrong = __atomic_load_n(&wrong, __ATOMIC_RELAXED);
+	test_log("%i workers: %i callbacks for %i messages sent, %i on their channel", nworkers,
+			received, THREADS * ROUNDS * MSGS, nmatched);
+	test_assert(received > 0, "%i workers: messages received", nworkers);
+	test_assert(!nwrong, "%i workers: %i messages passed the wrong channel", nworkers, nwrong);
+	test_assert(nmatched > 0, "%i workers: messages passed their channel", nworkers);
+
+	qsort(ids, THREADS * ROUNDS, sizeof ids[0], &cmp);
+	for (int i = 1; i < THREADS * ROUNDS; i++) if (ids[i] == ids[i - 1]) dups++;
+	test_assert(!dups, "%i workers: channel ids unique (%i duplicates)", nworkers, dups);
+	lc_ctx_free(lctx);
+}
+
+static lc_channel_t *keep[KEEP];
+static int looking = 1;
+
+/* look up channels that stay, as the listener does, until told to stop */
+static void *lookup(void *arg)
+{
+	lc_ctx_t *lctx = arg;
+	long misses = 0;
+
+	while (__atomic_load_n(&looking, __ATOMIC_ACQUIRE)) {
+		for (int i = 0; i < KEEP; i++) {
+			if (lc_channel_by_address(lctx, lc_channel_in6addr(keep[i])) != keep[i]) misses++;
+		}
+	}
+	return (void *)misses;
+}
+
+/* the channel index is rehashed as channels come and go, under readers */
+static void rehash(void)
+{
+	static char names[GROW][32];
+	static char *pnames[GROW];
+	static lc_channel_t *chan[GROW];
+	lc_ctx_t *lctx = lc_ctx_new();
+	pthread_t thread;
+	void *misses;
+
+	for (int i = 0; i < KEEP; i++) keep[i] = lc_channel_random(lctx);
+	for (int i = 0; i < GROW; i++) {
+		snprintf(names[i], sizeof names[i], "0000-0046/%i", i);
+		pnames[i] = names[i];
+	}
+	test_assert(!pthread_create(&thread, NULL, &lookup, lctx), "pthread_create()");
+	for (int round = 0; round < 3; round++) {
+		for (int i = 0; i < GROW; i++) chan[i] = lc_channel_new(lctx, pnames[i]);
+		for (int i = 0; i < GROW; i++) lc_channel_free(chan[i]);
+	}
+	__atomic_store_n(&looking, 0, __ATOMIC_RELEASE);
+	pthread_join(thread, &misses);
+	test_assert(!misses, "channels found while rehashed (%li misses)", (long)misses);
+	lc_ctx_free(lctx);
+}
+
+int main()
+{
+	test_name("concurrent channel and socket create/free while listening");
+	stress(0);
+	stress(4);
+	rehash();
+	return fails;
+}
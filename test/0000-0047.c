@@ -0,0 +1,113 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <time.h>
+
+#define CHANNELS 1000000
+#define CHECKS 1000 /* compared one by one with lc_channel_new() */
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* create names n at a time, returning channels/sec */
+static double create(lc_ctx_t *lctx, char **names, lc_channel_t **chan, int n)
+{
+	double t = now();
+	if (n == 1) {
+		for (int i = 0; i < CHANNELS; i++) chan[i] = lc_channel_new(lctx, names[i]);
+	}
+	else {
+		test_assert(!lc_channel_new_many(lctx, names, CHANNELS, chan), "lc_channel_new_many()");
+	}
+	return CHANNELS / (now() - t);
+}
+
+int main()
+{
+	lc_ctx_t *lctx, *octx;
+	lc_channel_t **chan, *one;
+	char **names, *buf;
+	double rate;
+	int diff = 0;
+	uint32_t id;
+
+	test_name("lc_channel_new_many() / lc_ctx_intern()");
+
+	test_assert(lc_channel_new_many(NULL, NULL, 1, NULL) == LC_ERROR_CTX_REQUIRED, "ctx required");
+	test_assert(lc_ctx_intern(NULL, 1) == LC_ERROR_CTX_REQUIRED, "lc_ctx_intern() - ctx required");
+
+	names = malloc(CHANNELS * sizeof(char *));
+	buf = malloc(CHANNELS * 24);
+	chan = malloc(CHANNELS * sizeof(lc_channel_t *));
+	test_assert(names && buf && chan, "malloc");
+	for (int i = 0; i < CHANNELS; i++) {
+		names[i] = buf + i * 24;
+		snprintf(names[i], 24, "0000-0047/topic/%i", i);
+	}
+
+	lctx = lc_ctx_new();
+	octx = lc_ctx_new();
+	test_assert(!lc_channel_new_many(lctx, names, 0, chan), "n = 0");
+	test_assert(lc_channel_new_many(lctx, NULL, 1, chan) == LC_ERROR_INVALID_PARAMS, "names required");
+	test_assert(lc_channel_new_many(lctx, names, 1, NULL) == LC_ERROR_INVALID_PARAMS, "out required");
+
+	/* same addresses and uris as one at a time, consecutive ids */
+	test_assert(!lc_channel_new_many(lctx, names, CHECKS, chan), "lc_channel_new_many()");
+	for (int i = 0; i < CHECKS; i++) {
+		one = lc_channel_new(octx, names[i]);
+		if (memcmp(lc_channel_in6addr(one), lc_channel_in6addr(chan[i]), sizeof(struct in6_addr))) diff++;
+		if (lc_channel_uri(chan[i]) != names[i]) diff++;
+		if (lc_channel_ctx(chan[i]) != lctx) diff++;
+		lc_channel_free(one);
+	}
+	test_assert(!diff, "%i channels differ from lc_channel_new()", diff);
+	id = lc_channel_get_id(chan[0]);
+	for (int i = 1; i < CHECKS; i++) if (lc_channel_get_id(chan[i]) != id + i) diff++;
+	test_assert(!diff, "ids consecutive");
+	/* free from the middle, out of order */
+	for (int i = CHECKS / 2; i < CHECKS; i++) lc_channel_free(chan[i]);
+	for (int i = 0; i < CHECKS / 2; i++) lc_channel_free(chan[i]);
+
+	/* interned addresses match hashed ones */
+	test_assert(!lc_ctx_intern(lctx, CHECKS / 2), "lc_ctx_intern()");
+	test_assert(!lc_channel_new_many(lctx, names, CHECKS, chan), "lc_channel_new_many() - intern");
+	for (int i = 0; i < CHECKS; i++) {
+		one = lc_channel_new(lctx, names[i]); /* first half interned, rest not (full) */
+		if (memcmp(lc_channel_in6addr(one), lc_channel_in6addr(chan[i]), sizeof(struct in6_addr))) diff++;
+		lc_channel_free(one);
+		lc_channel_free(chan[i]);
+	}
+	test_assert(!diff, "%i interned channels differ", diff);
+	lc_ctx_free(lctx);
+	lc_ctx_free(octx);
+
+	/* throughput */
+	lctx = lc_ctx_new();
+	rate = create(lctx, names, chan, 1);
+	test_log("lc_channel_new():              %9.0f channels/s", rate);
+	lc_ctx_free(lctx);
+	lctx = lc_ctx_new();
+	rate = create(lctx, names, chan, CHANNELS);
+	test_log("lc_channel_new_many():         %9.0f channels/s", rate);
+	lc_ctx_free(lctx);
+	lctx = lc_ctx_new();
+	lc_ctx_intern(lctx, CHANNELS);
+	rate = create(lctx, names, chan, CHANNELS);
+	test_log("lc_channel_new_many() - cold:  %9.0f channels/s (interning)", rate);
+	lc_ctx_free(lctx);
+	lctx = lc_ctx_new();
+	lc_ctx_intern(lctx, CHANNELS);
+	create(lctx, names, chan, CHANNELS);
+	for (int i = 0; i < CHANNELS; i++) lc_channel_free(chan[i]);
+	rate = create(lctx, names, chan, CHANNELS);
+	test_log("lc_channel_new_many() - warm:  %9.0f channels/s (interned)", rate);
+	lc_ctx_free(lctx);
+
+	free(chan);
+	free(buf);
+	free(names);
+	return fails;
+}
@@ -0,0 +1,123 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <time.h>
+
+#define CHANNELS 1000000
+#define RETIRE_BATCH 64 /* channels freed may wait this long for readers */
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main()
+{
+	lc_ctx_t *lctx;
+	lc_channel_t **chan;
+	lc_mem_stats_t ms;
+	struct in6_addr *addr;
+	char **names, *buf;
+	size_t bytes;
+	double t;
+	int ok;
+
+	test_name("slab allocated channels - create / free / teardown");
+
+	test_assert(lc_ctx_mem_stats(NULL, &ms) == LC_ERROR_CTX_REQUIRED, "ctx required");
+
+	names = malloc(CHANNELS * sizeof(char *));
+	buf = malloc(CHANNELS * 24);
+	chan = malloc(CHANNELS * sizeof(lc_channel_t *));
+	addr = malloc(CHANNELS * sizeof(struct in6_addr));
+	test_assert(names && buf && chan && addr, "malloc");
+	for (int i = 0; i < CHANNELS; i++) {
+		names[i] = buf + i * 24;
+		snprintf(names[i], 24, "0000-0048/topic/%i", i);
+	}
+
+	lctx = lc_ctx_new();
+	test_assert(lc_ctx_mem_stats(lctx, NULL) == LC_ERROR_INVALID_PARAMS, "stats required");
+	test_assert(!lc_ctx_mem_stats(lctx, &ms), "lc_ctx_mem_stats()");
+	test_assert(ms.chan_used == 0, "no channels yet");
+	test_log("channel: %zu bytes, socket: %zu bytes", ms.chan_size, ms.sock_size);
+	test_assert(ms.chan_size <= 112, "channel fits in 112 bytes (%zu)", ms.chan_size);
+
+	/* create */
+	t = now();
+	for (int i = 0; i < CHANNELS; i++) chan[i] = lc_channel_new(lctx, names[i]);
+	t = now() - t;
+	test_log("lc_channel_new():   %9.0f channels/s", CHANNELS / t);
+	lc_ctx_mem_stats(lctx, &ms);
+	test_assert(ms.chan_used == CHANNELS, "%zu channels used", ms.chan_used);
+	test_log("%zu bytes held for %i channels (%.1f bytes each)", ms.chan_bytes, CHANNELS,
+			(double)ms.chan_bytes / CHANNELS);
+	test_assert(ms.chan_bytes < (ms.chan_size + 8) * CHANNELS, "little overhead");
+	bytes = ms.chan_bytes;
+
+	/* looked up by address, as the listener does for each message */
+	t = now();
+	ok = 1;
+	for (int i = 0; i < CHANNELS; i++) {
+		memcpy(&addr[i], lc_channel_in6addr(chan[i]), sizeof(struct in6_addr));
+		if (lc_channel_by_address(lctx, &addr[i]) != chan[i]) ok = 0;
+	}
+	t = now() - t;
+	test_log("lc_channel_by_address(): %9.0f lookups/s", CHANNELS / t);
+	test_assert(ok, "lc_channel_by_address() finds each channel");
+
+	/* free in random order, each O(1) */
+	for (int i = CHANNELS - 1; i > 0; i--) {
+		int j = random() % (i + 1);
+		lc_channel_t *tmp = chan[i];
+		chan[i] = chan[j];
+		chan[j] = tmp;
+	}
+	t = now();
+	for (int i = 0; i < CHANNELS; i++) lc_channel_free(chan[i]);
+	t = now() - t;
+	test_log("lc_channel_free():  %9.0f channels/s (random order)", CHANNELS / t);
+	lc_ctx_mem_stats(lctx, &ms);
+	test_assert(ms.chan_used < RETIRE_BATCH, "%zu channels still used", ms.chan_used);
+	ok = 1;
+	for (int i = 0; i < CHANNELS; i++) if (lc_channel_by_address(lctx, &addr[i])) ok = 0;
+	test_assert(ok, "lc_channel_by_address() finds no freed channel");
+
+	/* freed channels are reused */
+	for (int i = 0; i < CHANNELS; i++) chan[i] = lc_channel_new(lctx, names[i]);
+	lc_ctx_mem_stats(lctx, &ms);
+	test_assert(ms.chan_bytes <= bytes + ms.chan_size * RETIRE_BATCH * 16,
+			"slots reused (%zu bytes, was %zu)", ms.chan_bytes, bytes);
+
+	/* teardown with channels still live goes a slab at a time */
+	t = now();
+	lc_ctx_free(lctx);
+	t = now() - t;
+	test_log("lc_ctx_free():      %9.3f s (%i channels)", t, CHANNELS);
+
+	/* channels from lc_channel_new_many() free one by one too */
+	lctx = lc_ctx_new();
+	test_assert(!lc_channel_new_many(lctx, names, CHANNELS, chan), "lc_channel_new_many()");
+	for (int i = 0; i < CHANNELS; i += 2) lc_channel_free(chan[i]);
+	lc_ctx_mem_stats(lctx, &ms);
+	test_assert(ms.chan_used < CHANNELS / 2 + RETIRE_BATCH, "%zu channels still used", ms.chan_used);
+	for (int i = 1; i < CHANNELS; i += 2) {
+		if (lc_channel_ctx(chan[i]) != lctx) {
+			test_assert(0, "channel %i intact", i);
+			break;
+		}
+	}
+	ok = 1;
+	for (int i = 0; i < CHANNELS; i++) {
+		if (lc_channel_by_address(lctx, &addr[i]) != ((i & 1) ? chan[i] : NULL)) ok = 0;
+	}
+	test_assert(ok, "lc_channel_by_address() - lc_channel_new_many() channels");
+	lc_ctx_free(lctx);
+
+	free(addr);
+	free(chan);
+	free(buf);
+	free(names);
+	return fails;
+}
@@ -0,0 +1,153 @@
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/bandset.h"
+#include <time.h>
+
+#define SET_BANDS 100000
+#define JOIN_BANDS 1000
+#define BIG_BAND 0x123456789abcdefULL
+
+static int got[4];
+static int got_big;
+
+static int count(int *n)
+{
+	return __atomic_load_n(n, __ATOMIC_RELAXED);
+}
+
+static void range_msg(lc_message_t *msg, uint64_t band, void *arg)
+{
+	(void)msg;
+	if (band < 4) test_assert(arg == &got[band], "table arg for band %lu", band);
+	else if (band == BIG_BAND) test_assert(arg == &got_big, "range arg for big band");
+	__atomic_add_fetch((int *)arg, 1, __ATOMIC_RELAXED);
+}
+
+static void test_bandset(void)
+{
+	lc_bandset_t *set;
+	size_t bytes;
+	int diff = 0;
+
+	set = lc_bandset_new();
+	test_assert(set != NULL, "lc_bandset_new()");
+	bytes = lc_bandset_bytes(set);
+	test_assert(lc_bandset_add(set, 0) == 0, "add band 0");
+	test_assert(lc_bandset_add(set, 0) == 1, "add band 0 again");
+	test_assert(lc_bandset_add(set, UINT64_MAX) == 0, "add band max");
+	for (uint64_t i = 1; i <= SET_BANDS; i++) {
+		if (lc_bandset_add(set, i * 0x9e3779b97f4a7c15ULL)) diff++;
+	}
+	test_assert(!diff, "add %i bands", SET_BANDS);
+	test_assert(lc_bandset_count(set) == SET_BANDS + 2, "count = %zu", lc_bandset_count(set));
+	/* remove odd, check the rest are still found */
+	for (uint64_t i = 1; i <= SET_BANDS; i += 2) {
+		if (lc_bandset_del(set, i * 0x9e3779b97f4a7c15ULL)) diff++;
+	}
+	test_assert(!diff, "del odd bands");
+	for (uint64_t i = 1; i <= SET_BANDS; i++) {
+		if (lc_bandset_has(set, i * 0x9e3779b97f4a7c15ULL) != !(i & 1)) diff++;
+	}
+	test_assert(!diff, "%i bands wrong after delete", diff);
+	test_assert(lc_bandset_has(set, 0) && lc_bandset_has(set, UINT64_MAX), "0 and max kept");
+	test_assert(lc_bandset_del(set, 1) == -1, "del absent band");
+	for (uint64_t i = 2; i <= SET_BANDS; i += 2) lc_bandset_del(set, i * 0x9e3779b97f4a7c15ULL);
+	lc_bandset_del(set, 0);
+	lc_bandset_del(set, UINT64_MAX);
+	test_assert(lc_bandset_count(set) == 0, "empty");
+	test_assert(lc_bandset_bytes(set) == bytes, "memory returned when empty");
+	lc_bandset_free(set);
+}
+
+static void test_range(void)
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock, *sout;
+	lc_channel_t *base, *side;
+	lc_range_t *range, *rout;
+	lc_message_t msg;
+	struct in6_addr addr;
+	struct timespec t = { .tv_nsec = 100000000 };
+	void *table[4] = { &got[0], &got[1], &got[2], &got[3] };
+	size_t bytes;
+	char data[] = "band";
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(lctx);
+	lc_socket_loop(sout, 1);
+	base = lc_channel_new(lctx, "0000-0049");
+
+	test_assert(lc_range_new(NULL) == NULL, "base required");
+	range = lc_range_new(base);
+	rout = lc_range_new(base);
+	test_assert(range && rout, "lc_range_new()");
+	test_assert(lc_range_join(range, 1) == LC_ERROR_SOCKET_REQUIRED, "join needs socket");
+
+	/* same addresses as lc_channel_sideband() */
+	side = lc_channel_sideband(base, BIG_BAND);
+	lc_range_addr(range, BIG_BAND, &addr);
+	test_assert(!memcmp(&addr, lc_channel_in6addr(side), sizeof addr), "lc_range_addr()");
+	lc_channel_free(side);
+
+	test_assert(!lc_range_bind(sock, range), "lc_range_bind()");
+	test_assert(!lc_range_bind(sout, rout), "lc_range_bind() - sender");
+	for (uint64_t band = 0; band < 4; band++) {
+		test_assert(!lc_range_join(range, band), "join band %lu", band);
+	}
+	test_assert(!lc_range_join(range, BIG_BAND), "join big band");
+	test_assert(!lc_range_join(range, BIG_BAND), "join big band again");
+	test_assert(lc_range_joined(range) == 5, "5 bands joined");
+	test_assert(lc_range_part(range, 42) == LC_ERROR_MCAST_PART, "part band not joined");
+
+	test_assert(!lc_range_listen(range, &range_msg, &got_big), "lc_range_listen()");
+	test_assert(!lc_range_table(range, table, 4), "lc_range_table()");
+	test_assert(!lc_socket_listen(sock, NULL, NULL), "lc_socket_listen()");
+	test_assert(lc_range_listen(range, &range_msg, NULL) == LC_ERROR_SOCKET_LISTENING,
+			"lc_range_listen() - socket listening");
+	test_assert(lc_range_table(range, table, 2) == LC_ERROR_SOCKET_LISTENING,
+			"lc_range_table() - socket listening");
+
+	lc_msg_init_data(&msg, data, sizeof data, NULL, NULL);
+	for (uint64_t band = 0; band < 8; band++) lc_range_msg_send(rout, band, &msg);
+	lc_range_send(rout, BIG_BAND, data, sizeof data, 0);
+	nanosleep(&t, NULL);
+	for (int band = 0; band < 4; band++) {
+		test_assert(count(&got[band]) == 1, "band %i: %i messages", band, count(&got[band]));
+	}
+	test_assert(count(&got_big) == 1, "big band: %i messages", count(&got_big));
+
+	/* parted band no longer delivered */
+	test_assert(!lc_range_part(range, 2), "part band 2");
+	for (uint64_t band = 0; band < 4; band++) lc_range_msg_send(rout, band, &msg);
+	nanosleep(&t, NULL);
+	test_assert(count(&got[2]) == 1, "band 2 parted: %i messages", count(&got[2]));
+	test_assert(count(&got[1]) == 2, "band 1: %i messages", count(&got[1]));
+
+	/* memory follows bands joined, not bands addressed */
+	for (uint64_t band = 0; band < 4; band++) lc_range_part(range, band);
+	lc_range_part(range, BIG_BAND);
+	test_assert(lc_range_joined(range) == 0, "all parted");
+	bytes = lc_range_bytes(range);
+	for (uint64_t band = 100; band < 100 + JOIN_BANDS; band++) lc_range_join(range, band);
+	test_assert(lc_range_joined(range) == JOIN_BANDS, "%zu bands joined", lc_range_joined(range));
+	test_log("range: %zu bytes, %zu bytes with %i bands joined", bytes, lc_range_bytes(range),
+			JOIN_BANDS);
+	test_assert(lc_range_bytes(range) < bytes + JOIN_BANDS * 32, "bytes per band joined");
+	for (uint64_t band = 100; band < 100 + JOIN_BANDS; band++) lc_range_part(range, band);
+	test_assert(lc_range_bytes(range) == bytes, "memory returned on part");
+
+	lc_socket_listen_cancel(sock);
+	lc_range_free(rout);
+	lc_range_free(range);
+	lc_range_new(base); /* freed with ctx */
+	lc_ctx_free(lctx);
+}
+
+int main()
+{
+	test_name("lc_range_new() - channel ranges");
+	test_bandset();
+	test_range();
+	return fails;
+}
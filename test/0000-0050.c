@@ -0,0 +1,168 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <time.h>
+
+#define SHARDS 16
+#define OTHERS 200
+
+static char payload[] = "payload";
+static uint32_t tag_a, tag_b;
+static int got_a, got_b, got_other, got_plain, bad;
+
+static int count(int *n)
+{
+	return __atomic_load_n(n, __ATOMIC_RELAXED);
+}
+
+static void msg_cb(lc_message_t *msg)
+{
+	if (msg->op != LC_OP_TOPIC) {
+		__atomic_add_fetch(&got_plain, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	if (msg->len != sizeof payload || memcmp(msg->data, payload, sizeof payload))
+		__atomic_add_fetch(&bad, 1, __ATOMIC_RELAXED);
+	if (msg->topic == tag_a) __atomic_add_fetch(&got_a, 1, __ATOMIC_RELAXED);
+	else if (msg->topic == tag_b) __atomic_add_fetch(&got_b, 1, __ATOMIC_RELAXED);
+	else __atomic_add_fetch(&got_other, 1, __ATOMIC_RELAXED);
+}
+
+static void test_waste(void)
+{
+	unsigned int shards[] = { 16, 256, 4096, 65536 };
+	double w;
+
+	test_assert(lc_topics_waste(1, 100, 10) > 0.899 && lc_topics_waste(1, 100, 10) < 0.901,
+			"one shard: everything but ours is waste");
+	test_assert(lc_topics_waste(1000000, 100, 10) < 0.001, "shard per topic: no waste");
+	test_assert(lc_topics_waste(16, 100, 0) == 0.0, "nothing subscribed");
+	for (size_t i = 0; i < sizeof shards / sizeof shards[0]; i++) {
+		w = lc_topics_waste(shards[i], 100000, 100);
+		test_log("%6u shards, 100000 topics, 100 subscribed: %5.1f%% wasted", shards[i], w * 100);
+	}
+}
+
+/* send both our topics, and OTHERS topics we don't want. Return how many of
+ * those land on shards we've joined */
+static int send_all(lc_topics_t *tout, lc_topics_t *t, char names[OTHERS][32], int joined[SHARDS])
+{
+	int n = 0;
+	for (int i = 0; i < OTHERS; i++) {
+		lc_topics_send(tout, names[i], payload, sizeof payload);
+		if (joined[lc_topics_shard(t, names[i])]) n++;
+	}
+	lc_topics_send(tout, "news/a", payload, sizeof payload);
+	lc_topics_send(tout, "news/b", payload, sizeof payload);
+	return n;
+}
+
+static void test_topics(void)
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock, *sout;
+	lc_channel_t *base, *plain, *pout;
+	lc_topics_t *t, *t2, *tout;
+	lc_topic_stats_t stats;
+	lc_message_t msg;
+	struct timespec ts = { .tv_nsec = 200000000 };
+	static char names[OTHERS][32];
+	int joined[SHARDS] = {0};
+	int hist[SHARDS] = {0};
+	int others;
+
+	for (int i = 0; i < OTHERS; i++) snprintf(names[i], sizeof names[i], "other/%i", i);
+	tag_a = lc_topic_tag("news/a");
+	tag_b = lc_topic_tag("news/b");
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(lctx);
+	lc_socket_loop(sout, 1);
+	base = lc_channel_new(lctx, "0000-0050");
+	test_assert(lc_topics_new(base, 0) == NULL, "shards required");
+	t = lc_topics_new(base, SHARDS);
+	tout = lc_topics_new(base, SHARDS);
+	test_assert(t && tout, "lc_topics_new()");
+
+	/* topics spread over shards */
+	for (int i = 0; i < OTHERS; i++) hist[lc_topics_shard(t, names[i])]++;
+	for (int i = 0; i < SHARDS; i++) test_assert(hist[i] > 0, "shard %i used", i);
+
+	test_assert(lc_topics_subscribe(t, "news/a") == LC_ERROR_SOCKET_REQUIRED, "bind first");
+	test_assert(!lc_topics_bind(sock, t), "lc_topics_bind()");
+	test_assert(lc_topics_bind(sock, t) == LC_ERROR_INVALID_PARAMS, "bound already");
+	t2 = lc_topics_new(base, SHARDS);
+	test_assert(lc_topics_bind(sock, t2) == LC_ERROR_INVALID_PARAMS, "socket has a topic space");
+	lc_topics_free(t2);
+	test_assert(!lc_topics_bind(sout, tout), "lc_topics_bind() - sender");
+	test_assert(!lc_topics_subscribe(t, "news/a"), "subscribe news/a");
+	test_assert(!lc_topics_subscribe(t, "news/b"), "subscribe news/b");
+	test_assert(!lc_topics_subscribe(t, "news/b"), "subscribe news/b again");
+	joined[lc_topics_shard(t, "news/a")] = 1;
+	joined[lc_topics_shard(t, "news/b")] = 1;
+	test_assert(lc_topics_unsubscribe(t, "news/c") == LC_ERROR_INVALID_PARAMS, "not subscribed");
+	lc_topics_stats(t, &stats);
+	test_assert(stats.shards == SHARDS, "shards = %u", stats.shards);
+	test_assert(stats.topics == 2, "topics = %zu", stats.topics);
+	test_assert(stats.joined == (unsigned)(joined[lc_topics_shard(t, "news/a")]
+			+ (lc_topics_shard(t, "news/a") != lc_topics_shard(t, "news/b"))), "joined = %u",
+			stats.joined);
+	test_assert(stats.filter == 1, "kernel filter attached");
+
+	/* plain channel on the same socket isn't filtered */
+	plain = lc_channel_new(lctx, "0000-0050/plain");
+	pout = lc_channel_copy(lctx, plain);
+	lc_channel_bind(sock, plain);
+	lc_channel_bind(sout, pout);
+	lc_channel_join(plain);
+
+	test_assert(!lc_socket_listen(sock, &msg_cb, NULL), "lc_socket_listen()");
+	others = send_all(tout, t, names, joined);
+	lc_msg_init_data(&msg, payload, sizeof payload, NULL, NULL);
+	lc_msg_send(pout, &msg);
+	nanosleep(&ts, NULL);
+	test_assert(count(&got_a) == 1 && count(&got_b) == 1, "subscribed topics received");
+	test_assert(count(&got_other) == 0, "other topics: %i", count(&got_other));
+	test_assert(count(&got_plain) == 1, "plain channel received once");
+	test_assert(count(&bad) == 0, "tag stripped");
+	lc_topics_stats(t, &stats);
+	test_assert(stats.msgs == 2, "msgs = %lu", stats.msgs);
+	test_assert(stats.wasted == 0, "kernel dropped other topics, wasted = %lu", stats.wasted);
+
+	/* without the kernel filter, the listener drops them */
+	test_assert(!lc_topics_filter(t, 0), "lc_topics_filter()");
+	lc_topics_stats(t, &stats);
+	test_assert(stats.filter == 0, "kernel filter detached");
+	send_all(tout, t, names, joined);
+	nanosleep(&ts, NULL);
+	lc_topics_stats(t, &stats);
+	test_assert(count(&got_other) == 0, "other topics: %i", count(&got_other));
+	test_assert(stats.msgs == 4, "msgs = %lu", stats.msgs);
+	test_assert(stats.wasted == (uint64_t)others, "wasted = %lu, expected %i", stats.wasted, others);
+	test_log("%u shards, %i topics, 2 subscribed: %.1f%% wasted (expected %.1f%%)", SHARDS,
+			OTHERS + 2, 100.0 * stats.wasted / (stats.wasted + stats.msgs),
+			100 * lc_topics_waste(SHARDS, OTHERS + 2, 2));
+
+	/* unsubscribed */
+	lc_topics_filter(t, 1);
+	test_assert(!lc_topics_unsubscribe(t, "news/a"), "unsubscribe news/a");
+	test_assert(!lc_topics_unsubscribe(t, "news/b"), "unsubscribe news/b once");
+	send_all(tout, t, names, joined);
+	nanosleep(&ts, NULL);
+	test_assert(count(&got_a) == 2, "news/a unsubscribed");
+	test_assert(count(&got_b) == 3, "news/b still subscribed");
+
+	lc_socket_listen_cancel(sock);
+	lc_topics_free(tout);
+	lc_topics_free(t);
+	lc_topics_new(base, SHARDS); /* freed with ctx */
+	lc_ctx_free(lctx);
+}
+
+int main()
+{
+	test_name("lc_topics_new() - sharded topics");
+	test_waste();
+	test_topics();
+	return fails;
+}
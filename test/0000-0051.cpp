@@ -0,0 +1,123 @@
+extern "C" {
+#include "test.h"
+}
+#include <librecast/channel.hpp>
+
+using namespace librecast;
+using namespace librecast::literals;
+
+/* i % 251, as the BLAKE3 test vectors use */
+template <size_t N>
+struct pattern {
+	char s[N] = {};
+	constexpr pattern() { for (size_t i = 0; i < N; i++) s[i] = (char)(i % 251); }
+	constexpr std::string_view view() const { return std::string_view(s, N); }
+};
+
+constexpr pattern<100> p100;
+constexpr pattern<200> p200;
+constexpr pattern<1500> p1500;
+constexpr pattern<5000> p5000;
+
+/* name, then expected groups from reference BLAKE3 and BLAKE2b-256 */
+struct vector {
+	std::string_view name;
+	uint8_t blake3[16];
+	uint8_t blake2b[16];
+};
+
+constexpr vector vectors[] = {
+	{ "",
+	  {0xff, 0x1e, 0xd0, 0x3b, 0xf8, 0x6b, 0x93, 0x5f, 0xa3, 0x4d, 0x71, 0xad, 0x7e, 0xbb, 0x04, 0x9f},
+	  {0xff, 0x1e, 0x6d, 0x1f, 0x76, 0x1d, 0xdf, 0x9b, 0xdb, 0x4c, 0x9d, 0x6e, 0x53, 0x03, 0xeb, 0xd4} },
+	{ "news",
+	  {0xff, 0x1e, 0x9c, 0x2f, 0x07, 0xa0, 0x38, 0x17, 0x43, 0x9a, 0xd2, 0xe4, 0x23, 0x27, 0x08, 0xa1},
+	  {0xff, 0x1e, 0xd0, 0xa4, 0x48, 0xfe, 0xf8, 0x36, 0x21, 0x75, 0xdd, 0x0d, 0x9b, 0x97, 0x2b, 0x4b} },
+	{ "0000-0051/channel",
+	  {0xff, 0x1e, 0x6f, 0x73, 0x59, 0x14, 0xe0, 0x6d, 0xec, 0x05, 0xe7, 0xb8, 0xfd, 0xee, 0xb1, 0xf6},
+	  {0xff, 0x1e, 0xa5, 0xb1, 0x45, 0xa1, 0x29, 0xd4, 0xb2, 0xdb, 0x0c, 0x89, 0xcc, 0x1d, 0x59, 0x80} },
+	{ p100.view(), /* several BLAKE3 blocks */
+	  {0xff, 0x1e, 0xc4, 0x88, 0xce, 0xb7, 0xa2, 0xf0, 0x14, 0x5e, 0x54, 0x5e, 0x8e, 0x80, 0x02, 0xf6},
+	  {0xff, 0x1e, 0xee, 0x23, 0xff, 0x74, 0x8b, 0x6f, 0xe9, 0xe3, 0x83, 0x26, 0x0c, 0x7f, 0xcd, 0xb4} },
+	{ p200.view(), /* several BLAKE2b blocks */
+	  {0xff, 0x1e, 0xf8, 0x08, 0xdd, 0x65, 0x2d, 0x66, 0x1f, 0xe8, 0x02, 0x7c, 0x24, 0xd5, 0x81, 0x72},
+	  {0xff, 0x1e, 0x15, 0x8d, 0x67, 0x04, 0xd1, 0x31, 0xbc, 0x50, 0x30, 0xd5, 0x98, 0xfa, 0xd0, 0x40} },
+	{ p1500.view(), /* two BLAKE3 chunks */
+	  {0xff, 0x1e, 0x7a, 0x8a, 0xbc, 0x0d, 0x67, 0x5c, 0xf5, 0xd6, 0x5a, 0x1c, 0x08, 0x82, 0x4f, 0x4e},
+	  {0xff, 0x1e, 0x29, 0x99, 0x5e, 0x0e, 0x38, 0x39, 0x02, 0xb1, 0xe6, 0xd7, 0x4a, 0x23, 0x11, 0xaf} },
+	{ p5000.view(), /* five chunks - a tree three deep */
+	  {0xff, 0x1e, 0xb8, 0xdc, 0x25, 0x24, 0xb7, 0x1b, 0x57, 0xdf, 0x9a, 0x91, 0xea, 0xd0, 0xd0, 0xa1},
+	  {0xff, 0x1e, 0x08, 0x26, 0x40, 0x0c, 0x5d, 0xd3, 0xa4, 0x6a, 0x16, 0xe8, 0x59, 0xbb, 0xa1, 0xef} },
+};
+
+constexpr bool matches(const group &g, const uint8_t *expect)
+{
+	for (int i = 0; i < 16; i++) if (g[i] != expect[i]) return false;
+	return true;
+}
+
+template <typename H>
+constexpr bool check_vectors()
+{
+	for (const auto &v : vectors) {
+		const uint8_t *expect = std::is_same<H, detail::blake3>::value ? v.blake3 : v.blake2b;
+		if (!matches(group::hashed<H>(v.name), expect)) return false;
+	}
+	return true;
+}
+
+/* both hashes, at compile time */
+static_assert(check_vectors<detail::blake3>(), "constexpr BLAKE3 matches reference");
+static_assert(check_vectors<detail::blake2b>(), "constexpr BLAKE2b matches reference");
+
+constexpr group news = "news"_group;
+static_assert(news == group("news"), "literal");
+static_assert(news != group("sport"), "different names, different groups");
+
+constexpr std::string_view names[] = { "news", "sport", "weather", "traffic", "0000-0051/channel" };
+constexpr channel_map<5> chanmap(names);
+static_assert(chanmap.find(group("weather")) == 2, "channel_map finds weather");
+static_assert(chanmap.find(group("finance")) == -1, "channel_map misses finance");
+
+static int demux(const group &g)
+{
+	switch (g.key()) {
+	case "news"_group.key(): return 0;
+	case "sport"_group.key(): return 1;
+	default: return -1;
+	}
+}
+
+int main()
+{
+	lc_ctx_t *lctx;
+	lc_channel_t *chan, *chan2;
+	int diff = 0;
+
+	test_name("librecast/channel.hpp - constexpr channel addresses");
+
+	/* same as the library, whichever hash it was built with */
+	lctx = lc_ctx_new();
+	for (const auto &v : vectors) {
+		chan = lc_channel_nnew(lctx, (unsigned char *)v.name.data(), v.name.size());
+		if (group::from(*lc_channel_in6addr(chan)) != group(v.name)) diff++;
+		lc_channel_free(chan);
+	}
+	test_assert(!diff, "%i groups differ from lc_channel_nnew()", diff);
+#ifdef USE_LIBSODIUM
+	test_log("library hash: BLAKE2b");
+#else
+	test_log("library hash: BLAKE3");
+#endif
+
+	/* channel from a compile time group is the channel from its name */
+	chan = channel_init(lctx, news);
+	chan2 = lc_channel_new(lctx, (char *)"news");
+	test_assert(!memcmp(lc_channel_in6addr(chan), lc_channel_in6addr(chan2), sizeof(struct in6_addr)),
+			"channel_init() == lc_channel_new()");
+	test_assert(chanmap.find(*lc_channel_in6addr(chan2)) == 0, "channel_map::find(in6_addr)");
+	test_assert(demux(group::from(*lc_channel_in6addr(chan2))) == 0, "switch on key()");
+	lc_ctx_free(lctx);
+
+	return fails;
+}
@@ -0,0 +1,99 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <time.h>
+
+#define CHANNELS 100
+
+static int got[CHANNELS];
+static int got_sock, bad;
+
+static int count(int *n)
+{
+	return __atomic_load_n(n, __ATOMIC_RELAXED);
+}
+
+static void chan_msg(lc_message_t *msg, void *arg)
+{
+	int *n = arg;
+	int i = (int)(n - got);
+	char name[32];
+
+	/* arg is the one given for the channel the message arrived on */
+	snprintf(name, sizeof name, "0000-0052/%i", i);
+	if (msg->len != strlen(name) || memcmp(msg->data, name, msg->len))
+		__atomic_add_fetch(&bad, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(n, 1, __ATOMIC_RELAXED);
+}
+
+static void sock_msg(lc_message_t *msg)
+{
+	(void)msg;
+	__atomic_add_fetch(&got_sock, 1, __ATOMIC_RELAXED);
+}
+
+static void test_listen(int workers)
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock, *sout;
+	lc_channel_t *chan[CHANNELS], *cout[CHANNELS];
+	lc_message_t msg;
+	struct timespec ts = { .tv_nsec = 200000000 };
+	char name[32];
+	int total = 0, once = 1;
+
+	memset(got, 0, sizeof got);
+	got_sock = 0;
+
+	lctx = lc_ctx_new();
+	if (workers) test_assert(!lc_ctx_workers(lctx, workers, LC_WORKERS_CHANNEL), "lc_ctx_workers()");
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(lctx);
+	lc_socket_loop(sout, 1);
+	test_assert(lc_channel_listen(NULL, &chan_msg, NULL) == LC_ERROR_CHANNEL_REQUIRED,
+			"channel required");
+	for (int i = 0; i < CHANNELS; i++) {
+		snprintf(name, sizeof name, "0000-0052/%i", i);
+		chan[i] = lc_channel_new(lctx, name);
+		cout[i] = lc_channel_copy(lctx, chan[i]);
+		/* odd channels use the socket callback */
+		if (!(i % 2)) test_assert(!lc_channel_listen(chan[i], &chan_msg, &got[i]),
+				"lc_channel_listen(%i)", i);
+		lc_channel_bind(sock, chan[i]);
+		lc_channel_bind(sout, cout[i]);
+		lc_channel_join(chan[i]);
+	}
+	/* handler removed again */
+	lc_channel_listen(chan[2], NULL, NULL);
+
+	test_assert(!lc_socket_listen(sock, &sock_msg, NULL), "lc_socket_listen()");
+	test_assert(lc_channel_listen(chan[0], NULL, NULL) == LC_ERROR_SOCKET_LISTENING,
+			"socket listening");
+	for (int i = 0; i < CHANNELS; i++) {
+		snprintf(name, sizeof name, "0000-0052/%i", i);
+		lc_msg_init_data(&msg, name, strlen(name), NULL, NULL);
+		lc_msg_send(cout[i], &msg);
+	}
+	nanosleep(&ts, NULL);
+
+	for (int i = 0; i < CHANNELS; i += 2) {
+		if (i == 2) continue;
+		if (count(&got[i]) != 1) once = 0;
+		total += count(&got[i]);
+	}
+	test_assert(once, "each channel callback called once");
+	test_assert(count(&got[2]) == 0, "removed channel callback not called");
+	test_assert(total == CHANNELS / 2 - 1, "channel callbacks: %i", total);
+	test_assert(count(&got_sock) == CHANNELS / 2 + 1, "socket callback: %i", count(&got_sock));
+	test_assert(count(&bad) == 0, "channel callback arg");
+
+	lc_socket_listen_cancel(sock);
+	lc_ctx_free(lctx);
+}
+
+int main()
+{
+	test_name("lc_channel_listen() - per channel callbacks");
+	test_listen(0);
+	test_listen(4);
+	return fails;
+}
@@ -0,0 +1,150 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <time.h>
+
+#define CHANNELS 10000
+/* joins per socket are limited by net.core.optmem_max */
+#define PER_SOCK 2000
+#define SOCKS (CHANNELS / PER_SOCK)
+
+static int got;
+
+static int count(int *n)
+{
+	return __atomic_load_n(n, __ATOMIC_RELAXED);
+}
+
+static void msg_cb(lc_message_t *msg)
+{
+	(void)msg;
+	__atomic_add_fetch(&got, 1, __ATOMIC_RELAXED);
+}
+
+static int cmphex(const void *a, const void *b)
+{
+	return memcmp(a, b, 32);
+}
+
+/* how many of chan[] the kernel has joined on some interface, or -1 if it
+ * won't say (no /proc/net/igmp6) */
+static int joined(lc_channel_t *chan[], int n)
+{
+	static char grp[CHANNELS * 8][32];
+	char line[256], hex[33];
+	size_t ngrp = 0;
+	int found = 0;
+	FILE *f;
+
+	if (!(f = fopen("/proc/net/igmp6", "r"))) return -1;
+	while (fgets(line, sizeof line, f) && ngrp < sizeof grp / sizeof grp[0]) {
+		if (sscanf(line, "%*u %*s %32s", hex) == 1) memcpy(grp[ngrp++], hex, 32);
+	}
+	fclose(f);
+	qsort(grp, ngrp, 32, &cmphex);
+	for (int i = 0; i < n; i++) {
+		struct in6_addr *addr = lc_channel_in6addr(chan[i]);
+		for (int j = 0; j < 16; j++) sprintf(hex + 2 * j, "%02x", addr->s6_addr[j]);
+		if (bsearch(hex, grp, ngrp, 32, &cmphex)) found++;
+	}
+	return found;
+}
+
+static int nrc(int rc[], int n, int val)
+{
+	int c = 0;
+	for (int i = 0; i < n; i++) if (rc[i] == val) c++;
+	return c;
+}
+
+static void send_to(lc_channel_t *chan)
+{
+	lc_message_t msg;
+	lc_msg_init_data(&msg, "hello", 5, NULL, NULL);
+	lc_msg_send(chan, &msg);
+}
+
+int main()
+{
+	static char names[CHANNELS][32];
+	static char *pnames[CHANNELS];
+	static lc_channel_t *chan[CHANNELS];
+	static int rc[CHANNELS];
+	lc_ctx_t *lctx;
+	lc_socket_t *sock[SOCKS], *sout;
+	lc_channel_t *cout[2], *mixed[3];
+	struct timespec ts = { .tv_nsec = 200000000 };
+	int ok, n;
+
+	test_name("lc_channel_join_many() / lc_channel_part_many()");
+
+	lctx = lc_ctx_new();
+	for (int i = 0; i < SOCKS; i++) sock[i] = lc_socket_new(lctx);
+	sout = lc_socket_new(lctx);
+	lc_socket_loop(sout, 1);
+	for (int i = 0; i < CHANNELS; i++) {
+		snprintf(names[i], sizeof names[i], "0000-0053/%i", i);
+		pnames[i] = names[i];
+	}
+	test_assert(!lc_channel_new_many(lctx, pnames, CHANNELS, chan), "lc_channel_new_many()");
+	for (int i = 0; i < CHANNELS; i++) lc_channel_bind(sock[i / PER_SOCK], chan[i]);
+
+	/* per channel results */
+	mixed[0] = chan[0];
+	mixed[1] = NULL;
+	mixed[2] = lc_channel_new(lctx, "0000-0053/unbound");
+	test_assert(lc_channel_join_many(mixed, 3, rc) == LC_ERROR_CHANNEL_REQUIRED, "first error");
+	test_assert(rc[0] == 0, "bound channel joined");
+	test_assert(rc[1] == LC_ERROR_CHANNEL_REQUIRED, "NULL channel");
+	test_assert(rc[2] == LC_ERROR_SOCKET_REQUIRED, "unbound channel");
+	test_assert(lc_channel_part_many(mixed, 1, NULL) == 0, "rc is optional");
+
+	/* one at a time, as lc_channel_join_many() should be */
+	ok = 1;
+	for (int i = 0; i < CHANNELS; i++) if (lc_channel_join(chan[i])) ok = 0;
+	test_assert(ok, "lc_channel_join() x %i", CHANNELS);
+	n = joined(chan, CHANNELS);
+	test_assert(n == -1 || n == CHANNELS, "lc_channel_join(): %i channels joined in kernel", n);
+	for (int i = 0; i < CHANNELS; i++) lc_channel_part(chan[i]);
+	n = joined(chan, CHANNELS);
+	test_assert(n == -1 || n == 0, "lc_channel_part(): %i channels joined in kernel", n);
+
+	/* in one call */
+	test_assert(!lc_channel_join_many(chan, CHANNELS, rc), "lc_channel_join_many()");
+	n = nrc(rc, CHANNELS, 0);
+	test_assert(n == CHANNELS, "lc_channel_join_many(): %i of %i joined", n, CHANNELS);
+	n = joined(chan, CHANNELS);
+	test_assert(n == -1 || n == CHANNELS, "lc_channel_join_many(): %i channels joined in kernel", n);
+
+	/* again, every one fails */
+	test_assert(lc_channel_join_many(chan, CHANNELS, rc) == LC_ERROR_MCAST_JOIN,
+			"lc_channel_join_many() - already joined");
+	n = nrc(rc, CHANNELS, LC_ERROR_MCAST_JOIN);
+	test_assert(n == CHANNELS, "lc_channel_join_many(): %i of %i already joined", n, CHANNELS);
+
+	/* joined, so we receive */
+	cout[0] = lc_channel_copy(lctx, chan[0]);
+	cout[1] = lc_channel_copy(lctx, chan[CHANNELS - 1]);
+	lc_channel_bind(sout, cout[0]);
+	lc_channel_bind(sout, cout[1]);
+	for (int i = 0; i < SOCKS; i++)
+		test_assert(!lc_socket_listen(sock[i], &msg_cb, NULL), "lc_socket_listen()");
+	send_to(cout[0]);
+	send_to(cout[1]);
+	nanosleep(&ts, NULL);
+	test_assert(count(&got) == 2, "received on joined channels: %i", count(&got));
+
+	/* and after parting, we don't */
+	test_assert(!lc_channel_part_many(chan, CHANNELS, rc), "lc_channel_part_many()");
+	n = nrc(rc, CHANNELS, 0);
+	test_assert(n == CHANNELS, "lc_channel_part_many(): %i of %i parted", n, CHANNELS);
+	n = joined(chan, CHANNELS);
+	test_assert(n == -1 || n == 0, "lc_channel_part_many(): %i channels joined in kernel", n);
+	send_to(cout[0]);
+	send_to(cout[1]);
+	nanosleep(&ts, NULL);
+	test_assert(count(&got) == 2, "nothing received on parted channels: %i", count(&got));
+
+	for (int i = 0; i < SOCKS; i++) lc_socket_listen_cancel(sock[i]);
+	lc_ctx_free(lctx);
+	return fails;
+}
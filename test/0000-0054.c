@@ -0,0 +1,174 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <librecast/if.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAXIF 64
+#define CLOSES 200
+
+static char *flapname;
+static int flapping = 1;
+
+static int cached(lc_ctx_t *lctx, unsigned int idx)
+{
+	unsigned int ifx[MAXIF];
+	ssize_t n = lc_ctx_iflist(lctx, ifx, MAXIF);
+	for (ssize_t i = 0; i < n && i < MAXIF; i++) if (ifx[i] == idx) return 1;
+	return 0;
+}
+
+/* is group joined on interface idx? */
+static int joined(unsigned int idx, struct in6_addr *grp)
+{
+	char line[256], hex[33];
+	unsigned int i;
+	int found = 0;
+	FILE *f;
+
+	for (int j = 0; j < 16; j++) sprintf(hex + 2 * j, "%02x", grp->s6_addr[j]);
+	if (!(f = fopen("/proc/net/igmp6", "r"))) return -1;
+	while (fgets(line, sizeof line, f)) {
+		if (sscanf(line, "%u", &i) == 1 && i == idx && strstr(line, hex)) found = 1;
+	}
+	fclose(f);
+	return found;
+}
+
+/* is source filtered for group on interface idx? */
+static int filtered(unsigned int idx, struct in6_addr *grp, struct in6_addr *src)
+{
+	char line[256], dev[IFNAMSIZ], g[33], s[33], ghex[33], shex[33];
+	unsigned int i;
+	int found = 0;
+	FILE *f;
+
+	for (int j = 0; j < 16; j++) {
+		sprintf(ghex + 2 * j, "%02x", grp->s6_addr[j]);
+		sprintf(shex + 2 * j, "%02x", src->s6_addr[j]);
+	}
+	if (!(f = fopen("/proc/net/mcfilter6", "r"))) return -1;
+	while (fgets(line, sizeof line, f)) {
+		if (sscanf(line, "%u %15s %32s %32s", &i, dev, g, s) != 4) continue;
+		if (i == idx && !strcmp(g, ghex) && !strcmp(s, shex)) found = 1;
+	}
+	fclose(f);
+	return found;
+}
+
+/* wait up to 2s for want() == val */
+static int await(lc_ctx_t *lctx, unsigned int idx, struct in6_addr *grp, int val)
+{
+	struct timespec ts = { .tv_nsec = 10000000 };
+	for (int i = 0; i < 200; i++) {
+		if (cached(lctx, idx) == val && joined(idx, grp) == val) return 1;
+		nanosleep(&ts, NULL);
+	}
+	return 0;
+}
+
+/* take the interface down and up until told to stop, so the monitor is busy */
+static void *flap(void *arg)
+{
+	lc_ctx_t *lctx = arg;
+	while (__atomic_load_n(&flapping, __ATOMIC_ACQUIRE)) {
+		lc_link_set(lctx, flapname, 0);
+		lc_link_set(lctx, flapname, LC_IF_UP);
+	}
+	return NULL;
+}
+
+int main()
+{
+	char tapname[IFNAMSIZ] = {0};
+	lc_ctx_t *lctx;
+	lc_socket_t *sock;
+	lc_channel_t *chan, *parted, *ssm;
+	lc_range_t *range;
+	struct in6_addr band, src;
+	pthread_t flapper;
+	unsigned int idx;
+	int fd, detached = 1;
+
+	test_require_linux();
+	test_cap_require(CAP_NET_ADMIN);
+	test_name("lc_ctx_ifmonitor() - interface cache and monitor");
+
+	lctx = lc_ctx_new();
+	test_assert(lc_ctx_iflist(lctx, NULL, 0) == -1, "no cache");
+	test_assert(!lc_ctx_ifmonitor(lctx, 1), "lc_ctx_ifmonitor() - start");
+	test_assert(!lc_ctx_ifmonitor(lctx, 1), "lc_ctx_ifmonitor() - already running");
+	test_assert(lc_ctx_iflist(lctx, NULL, 0) >= 0, "interfaces cached: %zi",
+			lc_ctx_iflist(lctx, NULL, 0));
+
+	/* joined before the interface exists */
+	sock = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, "0000-0054");
+	parted = lc_channel_new(lctx, "0000-0054/parted");
+	lc_channel_bind(sock, chan);
+	lc_channel_bind(sock, parted);
+	test_assert(!lc_channel_join(chan), "lc_channel_join()");
+	test_assert(!lc_channel_join(parted), "lc_channel_join() - to part");
+	test_assert(!lc_channel_part(parted), "lc_channel_part()");
+	range = lc_range_new(chan);
+	lc_range_bind(sock, range);
+	test_assert(!lc_range_join(range, 42), "lc_range_join()");
+	lc_range_addr(range, 42, &band);
+	ssm = lc_channel_new(lctx, "0000-0054/ssm");
+	lc_channel_bind(sock, ssm);
+	inet_pton(AF_INET6, "2001:db8::1", &src);
+	test_assert(!lc_channel_join_source(ssm, &src), "lc_channel_join_source()");
+
+	/* tap with its fd open has carrier, so gets an IPv6 link local address */
+	fd = lc_tap_create(tapname);
+	test_assert(fd > 0, "lc_tap_create()");
+	idx = if_nametoindex(tapname);
+	test_assert(!lc_link_set(lctx, tapname, LC_IF_UP), "bring up %s", tapname);
+	test_assert(await(lctx, idx, lc_channel_in6addr(chan), 1), "channel joined on new interface");
+	test_assert(joined(idx, &band) == 1, "range band joined on new interface");
+	test_assert(joined(idx, lc_channel_in6addr(parted)) == 0, "parted channel not joined");
+	test_assert(filtered(idx, lc_channel_in6addr(ssm), &src) == 1, "source joined on new interface");
+
+	/* part and rejoin use the cache, which has the new interface */
+	test_assert(!lc_channel_part(chan), "lc_channel_part()");
+	test_assert(joined(idx, lc_channel_in6addr(chan)) == 0, "parted on new interface");
+	test_assert(!lc_channel_join(chan), "lc_channel_join() - again");
+	test_assert(joined(idx, lc_channel_in6addr(chan)) == 1, "joined on new interface");
+
+	/* sockets closed while the monitor moves their memberships */
+	flapname = tapname;
+	test_assert(!pthread_create(&flapper, NULL, &flap, lctx), "pthread_create()");
+	for (int i = 0; i < CLOSES; i++) {
+		lc_socket_t *s = lc_socket_new(lctx);
+		lc_range_t *r = lc_range_new(chan);
+		lc_channel_t *c = lc_channel_new(lctx, "0000-0054/close");
+		lc_socket_elastic(s, 0);
+		lc_channel_bind(s, c);
+		lc_range_bind(s, r);
+		lc_channel_join(c);
+		lc_range_join(r, i);
+		lc_socket_close(s);
+		if (lc_channel_socket(c) || lc_channel_join(c) != LC_ERROR_SOCKET_REQUIRED) detached = 0;
+		if (lc_range_join(r, i) != LC_ERROR_SOCKET_REQUIRED) detached = 0;
+		lc_range_free(r);
+		lc_channel_free(c);
+	}
+	__atomic_store_n(&flapping, 0, __ATOMIC_RELEASE);
+	pthread_join(flapper, NULL);
+	test_assert(detached, "channels and ranges detached from closed sockets");
+	test_assert(!lc_link_set(lctx, tapname, LC_IF_UP), "bring up %s", tapname);
+
+	/* interface goes away */
+	close(fd);
+	test_assert(await(lctx, idx, lc_channel_in6addr(chan), 0), "interface dropped from cache");
+
+	test_assert(!lc_ctx_ifmonitor(lctx, 0), "lc_ctx_ifmonitor() - stop");
+	test_assert(lc_ctx_iflist(lctx, NULL, 0) == -1, "cache gone");
+	test_assert(!lc_channel_part(chan), "lc_channel_part() - without cache");
+	lc_ctx_ifmonitor(lctx, 1); /* stopped by lc_ctx_free() */
+	lc_ctx_free(lctx);
+
+	return fails;
+}
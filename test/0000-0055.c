@@ -0,0 +1,146 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <time.h>
+
+#define CHANNELS 50
+#define URGENT 40 /* channels from here join with higher priority */
+#define SLOW 20
+#define RATE 100
+#define BURST 10
+#define FREED 1000
+
+static lc_channel_t *chan[CHANNELS + SLOW];
+static int order[CHANNELS + SLOW];
+static int done, bad;
+
+static int count(int *n)
+{
+	return __atomic_load_n(n, __ATOMIC_ACQUIRE);
+}
+
+static void joined_cb(lc_channel_t *c, int rc, void *arg)
+{
+	int i;
+	if (rc || arg != chan) __atomic_add_fetch(&bad, 1, __ATOMIC_RELAXED);
+	for (i = 0; i < CHANNELS + SLOW && chan[i] != c; i++);
+	order[__atomic_load_n(&done, __ATOMIC_RELAXED)] = i;
+	__atomic_add_fetch(&done, 1, __ATOMIC_RELEASE);
+}
+
+/* is group joined on any interface? */
+static int joined(lc_channel_t *c)
+{
+	struct in6_addr *grp = lc_channel_in6addr(c);
+	char line[256], hex[33];
+	int found = 0;
+	FILE *f;
+
+	for (int j = 0; j < 16; j++) sprintf(hex + 2 * j, "%02x", grp->s6_addr[j]);
+	if (!(f = fopen("/proc/net/igmp6", "r"))) return -1;
+	while (fgets(line, sizeof line, f)) if (strstr(line, hex)) found = 1;
+	fclose(f);
+	return found;
+}
+
+static double elapsed(struct timespec *t0)
+{
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+int main()
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock;
+	lc_join_stats_t stats;
+	struct timespec t0, ts = { .tv_nsec = 10000000 };
+	char name[32];
+	double t;
+	int late = 0;
+
+	test_name("lc_ctx_join_pace() - paced joins");
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	for (int i = 0; i < CHANNELS + SLOW; i++) {
+		snprintf(name, sizeof name, "0000-0055/%i", i);
+		chan[i] = lc_channel_new(lctx, name);
+		lc_channel_bind(sock, chan[i]);
+	}
+
+	/* not paced - joined now */
+	test_assert(!lc_channel_join(chan[0]), "lc_channel_join() - not paced");
+	test_assert(joined(chan[0]) == 1, "joined at once");
+	test_assert(!lc_channel_part(chan[0]), "lc_channel_part()");
+
+	test_assert(lc_ctx_join_pace(NULL, RATE, BURST, NULL, NULL) == LC_ERROR_CTX_REQUIRED, "ctx required");
+	test_assert(!lc_ctx_join_pace(lctx, RATE, BURST, &joined_cb, chan), "lc_ctx_join_pace()");
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < URGENT; i++) test_assert(!lc_channel_join(chan[i]), "queue %i", i);
+	test_assert(!lc_channel_part(chan[URGENT - 1]), "part queued channel");
+	for (int i = URGENT; i < CHANNELS; i++)
+		test_assert(!lc_channel_join_prio(chan[i], 5), "queue %i, prio 5", i);
+	while (count(&done) < CHANNELS - 1 && elapsed(&t0) < 5) nanosleep(&ts, NULL);
+	t = elapsed(&t0);
+	test_log("%i joins at %i/s, burst %i: %.3f s", CHANNELS - 1, RATE, BURST, t);
+	test_assert(count(&done) == CHANNELS - 1, "all joined: %i", count(&done));
+	test_assert(count(&bad) == 0, "join results and callback arg");
+	test_assert(t >= (double)(CHANNELS - 1 - BURST) / RATE * 0.9, "paced");
+
+	/* once the first burst is gone, higher priority joins go first */
+	for (int i = BURST + (CHANNELS - URGENT) + 1; i < CHANNELS - 1; i++)
+		if (order[i] >= URGENT) late++;
+	test_assert(late == 0, "priority order");
+	for (int i = 0; i < CHANNELS - 1; i++)
+		test_assert(order[i] != URGENT - 1, "parted channel not joined");
+	test_assert(joined(chan[0]) == 1 && joined(chan[CHANNELS - 1]) == 1, "joined");
+	test_assert(joined(chan[URGENT - 1]) == 0, "cancelled join");
+
+	lc_ctx_join_stats(lctx, &stats);
+	test_log("queued_max %zu, latency mean %.3f s, max %.3f s", stats.queued_max,
+			stats.latency / 1e9, stats.latency_max / 1e9);
+	test_assert(stats.joined == CHANNELS - 1, "stats.joined = %lu", stats.joined);
+	test_assert(stats.queued == 0, "stats.queued = %zu", stats.queued);
+	test_assert(stats.queued_max >= CHANNELS - 1 - BURST, "stats.queued_max = %zu", stats.queued_max);
+	test_assert(stats.latency_max >= stats.latency && stats.latency_max > 100000000,
+			"stats.latency_max");
+
+	/* channels freed with joins queued, or being applied, drop out */
+	test_assert(!lc_ctx_join_pace(lctx, RATE * 100, 1, NULL, NULL), "lc_ctx_join_pace() - fast");
+	for (int i = 0; i < FREED; i++) {
+		lc_channel_t *c = lc_channel_new(lctx, "0000-0055/freed");
+		lc_channel_bind(sock, c);
+		lc_channel_join(c);
+		lc_channel_free(c);
+	}
+	lc_ctx_join_stats(lctx, &stats);
+	test_assert(stats.queued == 0, "freed joins dequeued: %zu", stats.queued);
+
+	/* stop pacing - what's left joins now */
+	test_assert(!lc_ctx_join_pace(lctx, 1, 1, &joined_cb, chan), "lc_ctx_join_pace() - slow");
+	for (int i = CHANNELS; i < CHANNELS + SLOW; i++) lc_channel_join(chan[i]);
+	test_assert(!lc_ctx_join_pace(lctx, 0, 0, NULL, NULL), "lc_ctx_join_pace() - stop");
+	test_assert(count(&done) == CHANNELS - 1 + SLOW, "queued joined on stop: %i", count(&done));
+	test_assert(joined(chan[CHANNELS + SLOW - 1]) == 1, "joined");
+	lc_ctx_join_stats(lctx, &stats);
+	test_assert(stats.joined == 0, "no stats when not paced");
+
+	lc_ctx_free(lctx);
+
+	/* ctx freed with joins still queued */
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	test_assert(!lc_ctx_join_pace(lctx, 1, 1, NULL, NULL), "lc_ctx_join_pace() - slow");
+	for (int i = 0; i < SLOW; i++) {
+		snprintf(name, sizeof name, "0000-0055/queued/%i", i);
+		chan[i] = lc_channel_new(lctx, name);
+		lc_channel_bind(sock, chan[i]);
+		lc_channel_join(chan[i]);
+	}
+	lc_ctx_join_stats(lctx, &stats);
+	test_assert(stats.queued >= SLOW - 1, "joins queued: %zu", stats.queued);
+	lc_ctx_free(lctx);
+
+	return fails;
+}
@@ -0,0 +1,202 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <poll.h>
+#include <unistd.h>
+
+#define LIST 40 /* sources in a filter list - under the default mld_max_msf */
+
+static lc_socket_t *sock;
+static lc_channel_t *chan;
+static struct sockaddr_in6 src[2]; /* two local addresses to send from */
+static unsigned int ifx;
+
+/* find an interface with two IPv6 addresses to send from */
+static int find_sources(void)
+{
+	struct ifaddrs *ifaddr, *ifa;
+	int n = 0;
+
+	if (getifaddrs(&ifaddr) == -1) return 0;
+	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+		if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET6) continue;
+		if (!(ifa->ifa_flags & IFF_MULTICAST) || !(ifa->ifa_flags & IFF_UP)) continue;
+		if (n && if_nametoindex(ifa->ifa_name) != ifx) continue;
+		ifx = if_nametoindex(ifa->ifa_name);
+		memcpy(&src[n], ifa->ifa_addr, sizeof(struct sockaddr_in6));
+		if (++n == 2) break;
+	}
+	freeifaddrs(ifaddr);
+	return n == 2;
+}
+
+/* send one byte to chan from source i */
+static void send_from(int i)
+{
+	struct sockaddr_in6 *sa = lc_channel_sockaddr(chan);
+	struct sockaddr_in6 from = src[i];
+	int s, on = 1;
+	char c = 'A' + i;
+
+	s = socket(AF_INET6, SOCK_DGRAM, 0);
+	from.sin6_port = 0;
+	if (IN6_IS_ADDR_LINKLOCAL(&from.sin6_addr)) from.sin6_scope_id = ifx;
+	if (bind(s, (struct sockaddr *)&from, sizeof from) == -1) perror("bind");
+	setsockopt(s, IPPROTO_IPV6, IPV6_MULTICAST_IF, &ifx, sizeof ifx);
+	setsockopt(s, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &on, sizeof on);
+	if (sendto(s, &c, 1, 0, (struct sockaddr *)sa, sizeof(struct sockaddr_in6)) == -1)
+		perror("sendto");
+	close(s);
+}
+
+/* send from both sources, and return which arrived: bit i set = source i */
+static int received(void)
+{
+	struct pollfd fds = { .fd = lc_socket_fd(sock), .events = POLLIN };
+	char c;
+	int got = 0;
+
+	send_from(0);
+	send_from(1);
+	while (poll(&fds, 1, 100) > 0) {
+		if (lc_socket_recv(sock, &c, 1, MSG_DONTWAIT) == 1 && (c == 'A' || c == 'B'))
+			got |= 1 << (c - 'A');
+	}
+	return got;
+}
+
+/* sources filtered on ifx for chan, from /proc/net/mcfilter6.  If addr is not
+ * NULL, only count that source */
+static int filtered(struct in6_addr *addr)
+{
+	char line[256], dev[IFNAMSIZ], grp[33], hex[33], g[33], s[33];
+	unsigned int i;
+	int n = 0;
+	FILE *f;
+
+	for (int j = 0; j < 16; j++) sprintf(grp + 2 * j, "%02x", lc_channel_in6addr(chan)->s6_addr[j]);
+	if (addr) for (int j = 0; j < 16; j++) sprintf(hex + 2 * j, "%02x", addr->s6_addr[j]);
+	if (!(f = fopen("/proc/net/mcfilter6", "r"))) return -1;
+	while (fgets(line, sizeof line, f)) {
+		if (sscanf(line, "%u %15s %32s %32s", &i, dev, g, s) != 4) continue;
+		if (i != ifx || strcmp(g, grp)) continue;
+		if (!addr || !strcmp(s, hex)) n++;
+	}
+	fclose(f);
+	return n;
+}
+
+int main()
+{
+	lc_ctx_t *lctx;
+	struct in6_addr *a, *b, list[LIST + 1];
+	unsigned int max_msf = 64;
+	FILE *f;
+	int have;
+
+	test_require_linux();
+	test_name("lc_channel_join_source() / lc_channel_block_source() - source filtering");
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, "0000-0056");
+	test_assert(lc_channel_join_source(NULL, NULL) == LC_ERROR_CHANNEL_REQUIRED, "channel required");
+	test_assert(lc_channel_join_source(chan, &in6addr_loopback) == LC_ERROR_SOCKET_REQUIRED,
+			"socket required");
+	lc_channel_bind(sock, chan);
+	test_assert(lc_channel_join_source(chan, NULL) == LC_ERROR_INVALID_PARAMS, "source required");
+	test_assert(lc_channel_block_source(chan, &in6addr_loopback) == LC_ERROR_SOURCE_FILTER,
+			"block needs any source join");
+
+	have = find_sources();
+	if (!have) test_log("no interface with two IPv6 addresses - no delivery checks\n");
+	a = &src[0].sin6_addr;
+	b = &src[1].sin6_addr;
+	if (!have) {
+		inet_pton(AF_INET6, "2001:db8::a", a);
+		inet_pton(AF_INET6, "2001:db8::b", b);
+	}
+
+	/* include - source specific joins */
+	test_assert(!lc_channel_join_source(chan, a), "lc_channel_join_source() a");
+	test_assert(!lc_channel_join_source(chan, a), "lc_channel_join_source() a again");
+	if (have) {
+		test_assert(filtered(a) == 1, "a included");
+		test_assert(received() == 1, "only a received");
+	}
+	test_assert(lc_channel_join(chan) == LC_ERROR_SOURCE_FILTER, "no any source join");
+	test_assert(!lc_channel_join_source(chan, b), "lc_channel_join_source() b");
+	if (have) test_assert(received() == 3, "a and b received");
+	test_assert(!lc_channel_part_source(chan, a), "lc_channel_part_source() a");
+	test_assert(lc_channel_part_source(chan, a) == LC_ERROR_INVALID_PARAMS, "a not joined");
+	if (have) test_assert(received() == 2, "only b received");
+	test_assert(!lc_channel_part_source(chan, b), "lc_channel_part_source() b - last");
+	if (have) {
+		test_assert(filtered(NULL) == 0, "no filter");
+		test_assert(received() == 0, "group left");
+	}
+
+	/* exclude - any source join, blocking some */
+	test_assert(!lc_channel_join(chan), "lc_channel_join()");
+	test_assert(lc_channel_join_source(chan, a) == LC_ERROR_SOURCE_FILTER,
+			"no source join while joined for any source");
+	test_assert(!lc_channel_block_source(chan, a), "lc_channel_block_source() a");
+	if (have) {
+		test_assert(filtered(a) == 1, "a excluded");
+		test_assert(received() == 2, "a blocked");
+	}
+	test_assert(!lc_channel_unblock_source(chan, a), "lc_channel_unblock_source() a");
+	if (have) test_assert(received() == 3, "a unblocked");
+
+	/* whole lists at once, switching mode */
+	for (int i = 0; i < LIST; i++) {
+		inet_pton(AF_INET6, "2001:db8::", &list[i]);
+		list[i].s6_addr[15] = i % (LIST / 2); /* half are duplicates */
+	}
+	list[LIST] = *a;
+	test_assert(!lc_channel_filter(chan, LC_FILTER_INCLUDE, list, LIST + 1),
+			"lc_channel_filter() include");
+	if (have) {
+		test_assert(filtered(NULL) == LIST / 2 + 1, "%i sources included", LIST / 2 + 1);
+		test_assert(received() == 1, "only a received");
+	}
+	test_assert(!lc_channel_filter(chan, LC_FILTER_EXCLUDE, a, 1), "lc_channel_filter() exclude");
+	if (have) {
+		test_assert(filtered(NULL) == 1, "1 source excluded");
+		test_assert(received() == 2, "a blocked");
+	}
+	test_assert(!lc_channel_unblock_source(chan, a), "lc_channel_unblock_source() a");
+	test_assert(!lc_channel_filter(chan, LC_FILTER_INCLUDE, b, 1), "lc_channel_filter() include b");
+	if (have) test_assert(received() == 2, "only b received");
+
+	/* the kernel limits the list */
+	if ((f = fopen("/proc/sys/net/ipv6/mld_max_msf", "r"))) {
+		if (fscanf(f, "%u", &max_msf) != 1) max_msf = 64;
+		fclose(f);
+	}
+	if (max_msf < 1024) {
+		struct in6_addr *big = calloc(max_msf + 1, sizeof(struct in6_addr));
+		for (unsigned int i = 0; i <= max_msf; i++) {
+			inet_pton(AF_INET6, "2001:db8::", &big[i]);
+			big[i].s6_addr[14] = i >> 8;
+			big[i].s6_addr[15] = i & 0xff;
+		}
+		test_assert(lc_channel_filter(chan, LC_FILTER_INCLUDE, big, max_msf + 1)
+				== LC_ERROR_MCAST_JOIN, "more than mld_max_msf (%u) sources", max_msf);
+		free(big);
+		if (have) test_assert(received() == 2, "filter unchanged");
+	}
+
+	/* part drops the filter */
+	test_assert(!lc_channel_part(chan), "lc_channel_part()");
+	if (have) test_assert(filtered(NULL) == 0 && received() == 0, "group left");
+	test_assert(!lc_channel_join(chan), "lc_channel_join() - any source");
+	if (have) test_assert(received() == 3, "a and b received");
+	test_assert(!lc_channel_filter(chan, LC_FILTER_INCLUDE, NULL, 0), "empty include parts");
+	test_assert(lc_channel_unblock_source(chan, a) == LC_ERROR_SOURCE_FILTER, "not joined");
+
+	lc_ctx_free(lctx);
+	return fails;
+}
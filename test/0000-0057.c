@@ -0,0 +1,127 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <time.h>
+
+#define CHANNELS 12000 /* 100k works, but the kernel takes minutes to join that many */
+
+static int got;
+
+static int count(int *n)
+{
+	return __atomic_load_n(n, __ATOMIC_RELAXED);
+}
+
+static void msg_cb(lc_message_t *msg)
+{
+	(void)msg;
+	__atomic_add_fetch(&got, 1, __ATOMIC_RELAXED);
+}
+
+static double elapsed(struct timespec *t0)
+{
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1000.0 + (t1.tv_nsec - t0->tv_nsec) / 1000000.0;
+}
+
+/* send to channels 0, CHANNELS / 2 and CHANNELS - 1 */
+static void send_some(lc_channel_t *cout[3])
+{
+	struct timespec ts = { .tv_nsec = 200000000 };
+	lc_message_t msg;
+	for (int i = 0; i < 3; i++) {
+		lc_msg_init_data(&msg, "hello", 5, NULL, NULL);
+		lc_msg_send(cout[i], &msg);
+	}
+	nanosleep(&ts, NULL);
+}
+
+int main()
+{
+	static char names[CHANNELS][32];
+	static char *pnames[CHANNELS];
+	static lc_channel_t *chan[CHANNELS];
+	static int rc[CHANNELS];
+	lc_ctx_t *lctx;
+	lc_socket_t *plain, *sock, *sout;
+	lc_channel_t *cout[3];
+	lc_message_t msg;
+	struct timespec t0;
+	int limit, ok;
+
+	test_name("lc_socket_elastic() - memberships spill onto more kernel sockets");
+
+	lctx = lc_ctx_new();
+	plain = lc_socket_new(lctx);
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(lctx);
+	lc_socket_loop(sout, 1);
+	test_assert(lc_socket_elastic(NULL, 0) == LC_ERROR_SOCKET_REQUIRED, "socket required");
+	test_assert(lc_socket_elastic_count(plain) == 1, "one kernel socket");
+	for (int i = 0; i < CHANNELS; i++) {
+		snprintf(names[i], sizeof names[i], "0000-0057/%i", i);
+		pnames[i] = names[i];
+	}
+	test_assert(!lc_channel_new_many(lctx, pnames, CHANNELS, chan), "lc_channel_new_many()");
+
+	/* a plain socket runs out */
+	for (int i = 0; i < CHANNELS; i++) lc_channel_bind(plain, chan[i]);
+	lc_channel_join_many(chan, CHANNELS, rc);
+	for (limit = 0; limit < CHANNELS && !rc[limit]; limit++);
+	test_assert(limit < CHANNELS, "plain socket limit: %i", limit);
+	test_assert(rc[CHANNELS - 1] == LC_ERROR_MCAST_JOIN, "join fails past limit");
+	lc_channel_part_many(chan, limit, NULL);
+	test_log("plain socket: %i memberships\n", limit);
+
+	/* an elastic one doesn't */
+	test_assert(!lc_socket_elastic(sock, 0), "lc_socket_elastic()");
+	test_assert(!lc_socket_elastic(sock, 0), "lc_socket_elastic() - again");
+	for (int i = 0; i < CHANNELS; i++) lc_channel_bind(sock, chan[i]);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	test_assert(!lc_channel_join_many(chan, CHANNELS, rc), "lc_channel_join_many()");
+	ok = 1;
+	for (int i = 0; i < CHANNELS; i++) if (rc[i]) ok = 0;
+	test_assert(ok, "all %i channels joined", CHANNELS);
+	test_assert(lc_socket_elastic_count(sock) > CHANNELS / limit,
+			"kernel sockets: %i", lc_socket_elastic_count(sock));
+	test_log("elastic socket: %i channels on %i kernel sockets, joined in %.1f ms\n",
+			CHANNELS, lc_socket_elastic_count(sock), elapsed(&t0));
+	test_assert(lc_channel_join(chan[CHANNELS - 1]) != 0, "joined already");
+
+	/* one listener for all of them */
+	cout[0] = lc_channel_copy(lctx, chan[0]);
+	cout[1] = lc_channel_copy(lctx, chan[CHANNELS / 2]);
+	cout[2] = lc_channel_copy(lctx, chan[CHANNELS - 1]);
+	for (int i = 0; i < 3; i++) lc_channel_bind(sout, cout[i]);
+
+	/* read directly, from the last kernel socket opened */
+	lc_msg_init_data(&msg, "direct", 6, NULL, NULL);
+	lc_msg_send(cout[2], &msg);
+	lc_msg_init(&msg);
+	test_assert(lc_msg_recv_timeout(sock, &msg, 1000) > 0, "lc_msg_recv_timeout()");
+	test_assert(!memcmp(&msg.dst, lc_channel_in6addr(chan[CHANNELS - 1]), sizeof(struct in6_addr)),
+			"received on last channel");
+	lc_msg_free(&msg);
+	test_assert(lc_msg_recv_timeout(sock, &msg, 0) == -1 && errno == EAGAIN, "nothing more");
+
+	test_assert(!lc_socket_listen(sock, &msg_cb, NULL), "lc_socket_listen()");
+	test_assert(lc_socket_elastic(sock, 0) == LC_ERROR_SOCKET_LISTENING, "listening");
+	send_some(cout);
+	test_assert(count(&got) == 3, "received on every kernel socket: %i", count(&got));
+
+	/* parted, nothing received */
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	test_assert(!lc_channel_part_many(chan, CHANNELS, rc), "lc_channel_part_many()");
+	test_log("part %i channels: %.1f ms\n", CHANNELS, elapsed(&t0));
+	send_some(cout);
+	test_assert(count(&got) == 3, "nothing received on parted channels: %i", count(&got));
+
+	/* room again once parted */
+	test_assert(!lc_channel_join(chan[CHANNELS - 1]), "lc_channel_join() after part");
+	send_some(cout);
+	test_assert(count(&got) == 4, "received: %i", count(&got));
+
+	lc_socket_listen_cancel(sock);
+	lc_ctx_free(lctx);
+	return fails;
+}
@@ -0,0 +1,200 @@
+#include "test.h"
+#include <librecast/net.h>
+#include "../src/grpset.h"
+#include <arpa/inet.h>
+#include <time.h>
+
+#define BENCH_MAX 100000
+#define BENCH_LOOKUPS 200000
+#define BAND 42
+
+static lc_socket_t *sout;
+static int got;
+
+static void msg_cb(lc_message_t *msg)
+{
+	(void)msg;
+	__atomic_add_fetch(&got, 1, __ATOMIC_RELAXED);
+}
+
+static int count(void)
+{
+	return __atomic_load_n(&got, __ATOMIC_RELAXED);
+}
+
+static void grp(struct in6_addr *addr, unsigned int i)
+{
+	inet_pton(AF_INET6, "ff1e::", addr);
+	addr->s6_addr[10] = i >> 24;
+	addr->s6_addr[11] = i >> 16;
+	addr->s6_addr[12] = i >> 8;
+	addr->s6_addr[13] = i;
+}
+
+static void test_grpset(void)
+{
+	lc_grpset_t *set;
+	struct in6_addr a, b;
+	uint32_t val;
+	int ok = 1;
+
+	set = lc_grpset_new();
+	test_assert(set != NULL, "lc_grpset_new()");
+	grp(&a, 1);
+	grp(&b, 20000);
+	test_assert(lc_grpset_get(set, &a, &val) == 0, "not present");
+	test_assert(lc_grpset_ref(set, &a, 7) == 1, "lc_grpset_ref()");
+	test_assert(lc_grpset_ref(set, &a, 8) == 2, "lc_grpset_ref() - again");
+	test_assert(lc_grpset_get(set, &a, &val) == 2 && val == 7, "two references, first value");
+	test_assert(lc_grpset_unref(set, &a) == 1, "lc_grpset_unref()");
+	test_assert(lc_grpset_put(set, &a, 9) == 1, "lc_grpset_put() - present");
+	test_assert(lc_grpset_get(set, &a, &val) == 1 && val == 9, "value set, references kept");
+	test_assert(lc_grpset_unref(set, &a) == 0, "lc_grpset_unref() - last");
+	test_assert(lc_grpset_unref(set, &a) == -1, "lc_grpset_unref() - not present");
+	test_assert(lc_grpset_put(set, &b, 3) == 0, "lc_grpset_put() - added");
+	test_assert(lc_grpset_get(set, &b, NULL) == 1, "with one reference");
+
+	/* grow, then shrink again, removing every other group as we go */
+	for (unsigned int i = 0; i < 10000; i++) {
+		grp(&a, i);
+		if (lc_grpset_ref(set, &a, i) != 1) ok = 0;
+	}
+	test_assert(ok, "10000 added");
+	for (unsigned int i = 0; i < 10000; i += 2) {
+		grp(&a, i);
+		if (lc_grpset_unref(set, &a)) ok = 0;
+	}
+	test_assert(ok, "5000 removed");
+	for (unsigned int i = 0; i < 10000; i++) {
+		grp(&a, i);
+		if (lc_grpset_get(set, &a, &val) != (i & 1)) ok = 0;
+		else if ((i & 1) && val != i) ok = 0;
+	}
+	test_assert(ok, "rest found");
+	test_assert(lc_grpset_count(set) == 5001, "count = %zu", lc_grpset_count(set));
+	lc_grpset_free(set);
+}
+
+static double ns(struct timespec *t0)
+{
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_nsec - t0->tv_nsec);
+}
+
+/* lookups as made for each message received, where the kernel delivers
+ * groups the socket hasn't joined */
+static void test_benchmark(void)
+{
+	static struct in6_addr addr[BENCH_MAX];
+	lc_grpset_t *set;
+	struct in6_addr miss;
+	struct timespec t0;
+	double hit_ns, miss_ns;
+	uint32_t found = 0;
+
+	for (unsigned int i = 0; i < BENCH_MAX; i++) grp(&addr[i], i * 2654435761U);
+	for (unsigned int n = 10; n <= BENCH_MAX; n *= 10) {
+		set = lc_grpset_new();
+		for (unsigned int i = 0; i < n; i++) lc_grpset_ref(set, &addr[i], 0);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (unsigned int i = 0; i < BENCH_LOOKUPS; i++)
+			found += lc_grpset_get(set, &addr[(i * 7919U) % n], NULL);
+		hit_ns = ns(&t0) / BENCH_LOOKUPS;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (unsigned int i = 0; i < BENCH_LOOKUPS; i++) {
+			miss = addr[i % n];
+			miss.s6_addr[15] = 1;
+			found += lc_grpset_get(set, &miss, NULL);
+		}
+		miss_ns = ns(&t0) / BENCH_LOOKUPS;
+		test_assert(found == BENCH_LOOKUPS, "%u groups: every lookup found, no false matches", n);
+		test_log("%6u groups: %5.1f ns/hit, %5.1f ns/miss", n, hit_ns, miss_ns);
+		found = 0;
+		lc_grpset_free(set);
+	}
+}
+
+/* send a message on cout, and give it time to arrive */
+static void send_wait(lc_channel_t *cout)
+{
+	struct timespec ts = { .tv_nsec = 100000000 };
+	lc_message_t msg;
+
+	lc_msg_init_data(&msg, "hello", 5, NULL, NULL);
+	lc_msg_send(cout, &msg);
+	nanosleep(&ts, NULL);
+}
+
+static void test_shared(void)
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock;
+	lc_channel_t *base, *a, *b, *cout;
+	lc_range_t *range;
+	struct in6_addr src;
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	sout = lc_socket_new(lctx);
+	lc_socket_loop(sout, 1);
+	base = lc_channel_new(lctx, "0000-0058");
+	a = lc_channel_sideband(base, BAND);
+	b = lc_channel_copy(lctx, a);
+	cout = lc_channel_copy(lctx, a);
+	lc_channel_bind(sock, a);
+	lc_channel_bind(sock, b);
+	lc_channel_bind(sout, cout);
+	inet_pton(AF_INET6, "2001:db8::1", &src);
+	test_assert(!lc_socket_listen(sock, &msg_cb, NULL), "lc_socket_listen()");
+
+	/* two channels on one socket, one group */
+	test_assert(lc_channel_part(a) == LC_ERROR_MCAST_PART, "not joined");
+	test_assert(!lc_channel_join(a), "lc_channel_join() a");
+	test_assert(lc_channel_join(a) == LC_ERROR_MCAST_JOIN, "a joined already");
+	test_assert(!lc_channel_join(b), "lc_channel_join() b - same group");
+	send_wait(cout);
+	test_assert(count() == 1, "received once: %i", count());
+	test_assert(lc_channel_block_source(a, &src) == LC_ERROR_SOURCE_FILTER,
+			"no source filter on a shared membership");
+	test_assert(!lc_channel_part(a), "lc_channel_part() a");
+	send_wait(cout);
+	test_assert(count() == 2, "b still receives: %i", count());
+	test_assert(!lc_channel_part(b), "lc_channel_part() b");
+	send_wait(cout);
+	test_assert(count() == 2, "nothing received once both parted: %i", count());
+
+	/* a range band and a channel */
+	range = lc_range_new(base);
+	lc_range_bind(sock, range);
+	test_assert(!lc_channel_join(a), "lc_channel_join() a");
+	test_assert(!lc_range_join(range, BAND), "lc_range_join()");
+	test_assert(!lc_channel_part(a), "lc_channel_part() a");
+	send_wait(cout);
+	test_assert(count() == 3, "range still receives: %i", count());
+	test_assert(!lc_range_part(range, BAND), "lc_range_part()");
+	send_wait(cout);
+	test_assert(count() == 3, "nothing received once both parted: %i", count());
+
+	/* a source filter is the socket's, so isn't shared */
+	test_assert(!lc_channel_join_source(a, &src), "lc_channel_join_source() a");
+	test_assert(lc_channel_join(b) == LC_ERROR_SOURCE_FILTER, "b can't join filtered group");
+	test_assert(!lc_channel_part_source(a, &src), "lc_channel_part_source() a");
+	test_assert(!lc_channel_join(b), "lc_channel_join() b");
+	test_assert(lc_channel_join_source(a, &src) == LC_ERROR_SOURCE_FILTER,
+			"a can't filter shared group");
+	test_assert(!lc_channel_part(b), "lc_channel_part() b");
+
+	lc_socket_listen_cancel(sock);
+	lc_range_free(range);
+	lc_ctx_free(lctx);
+}
+
+int main()
+{
+	test_name("lc_grpset - refcounted socket group memberships");
+	test_grpset();
+	test_benchmark();
+	test_shared();
+	return fails;
+}
@@ -0,0 +1,129 @@
+#define _GNU_SOURCE
+#include "test.h"
+#include <librecast/net.h>
+#include <librecast/if.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TAPS 3
+
+static char tapname[TAPS][IFNAMSIZ];
+static unsigned int ifx[TAPS];
+static int tapfd[TAPS];
+
+static int cached(lc_ctx_t *lctx, unsigned int idx)
+{
+	unsigned int list[64];
+	ssize_t n = lc_ctx_iflist(lctx, list, 64);
+	for (ssize_t i = 0; i < n && i < 64; i++) if (list[i] == idx) return 1;
+	return 0;
+}
+
+static void disable_dad(char *ifname)
+{
+	char fname[128];
+	int fd;
+	snprintf(fname, sizeof fname, "/proc/sys/net/ipv6/conf/%s/accept_dad", ifname);
+	fd = open(fname, O_WRONLY);
+	test_assert(write(fd, "0", 1) == 1, "write");
+	close(fd);
+}
+
+/* create tap i, and wait up to 2s for the interface cache to have it */
+static int tap_new(lc_ctx_t *lctx, int i)
+{
+	struct timespec ts = { .tv_nsec = 10000000 };
+
+	tapfd[i] = lc_tap_create(tapname[i]);
+	test_assert(tapfd[i] > 0, "lc_tap_create()");
+	ifx[i] = if_nametoindex(tapname[i]);
+	disable_dad(tapname[i]); /* otherwise we need to sleep 2s for DAD */
+	test_assert(!lc_link_set(lctx, tapname[i], LC_IF_UP), "bring up %s", tapname[i]);
+	for (int j = 0; j < 200; j++) {
+		if (cached(lctx, ifx[i])) return 1;
+		nanosleep(&ts, NULL);
+	}
+	return 0;
+}
+
+/* did a frame carrying data go out of tap i?  Reads everything else (MLD, ND)
+ * out of the way */
+static int sent_on(int i, const char *data)
+{
+	struct pollfd fds = { .fd = tapfd[i], .events = POLLIN };
+	char buf[2048];
+	ssize_t len;
+	int found = 0;
+
+	for (int wait = 200; poll(&fds, 1, wait) > 0; wait = 20) {
+		if ((len = read(tapfd[i], buf, sizeof buf)) > 0 && memmem(buf, len, data, strlen(data)))
+			found = 1;
+	}
+	return found;
+}
+
+int main()
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *sock;
+	lc_channel_t *chan;
+	lc_message_t msg;
+	struct iovec iov;
+	struct msghdr mh = { .msg_iov = &iov, .msg_iovlen = 1 };
+	unsigned int zero = 0;
+	int taps;
+
+	test_require_linux();
+	test_cap_require(CAP_NET_ADMIN);
+	test_name("lc_socket_send_policy() - send out of every interface, or those chosen");
+
+	lctx = lc_ctx_new();
+	sock = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, "0000-0059");
+	lc_channel_bind(sock, chan);
+	test_assert(lc_socket_send_policy(NULL, LC_SEND_ALL, NULL, 0) == LC_ERROR_SOCKET_REQUIRED,
+			"socket required");
+	test_assert(lc_socket_send_policy(sock, LC_SEND_LIST, NULL, 0) == LC_ERROR_INVALID_PARAMS,
+			"list required");
+	test_assert(lc_socket_send_policy(sock, LC_SEND_LIST, &zero, 1) == LC_ERROR_INVALID_PARAMS,
+			"no interface 0");
+	test_assert(lc_socket_send_policy(sock, (lc_send_policy_t)42, NULL, 0) == LC_ERROR_INVALID_PARAMS,
+			"unknown policy");
+
+	test_assert(!lc_ctx_ifmonitor(lctx, 1), "lc_ctx_ifmonitor()");
+	for (int i = 0; i < TAPS - 1; i++) test_assert(tap_new(lctx, i), "%s cached", tapname[i]);
+
+	/* a list */
+	test_assert(!lc_socket_send_policy(sock, LC_SEND_LIST, ifx, 2), "lc_socket_send_policy() - list");
+	test_assert(lc_channel_send(chan, "list", 4, 0) == 4, "lc_channel_send() returns one copy");
+	test_assert(sent_on(0, "list") && sent_on(1, "list"), "sent out of both listed");
+	test_assert(!lc_socket_send_policy(sock, LC_SEND_LIST, &ifx[1], 1), "lc_socket_send_policy() - one");
+	lc_channel_send(chan, "one", 3, 0);
+	test_assert(!sent_on(0, "one") && sent_on(1, "one"), "sent out of the one listed");
+	iov.iov_base = "sendmsg";
+	iov.iov_len = 7;
+	test_assert(lc_channel_sendmsg(chan, &mh, 0) == 7, "lc_channel_sendmsg()");
+	test_assert(!sent_on(0, "sendmsg") && sent_on(1, "sendmsg"), "lc_channel_sendmsg() follows policy");
+
+	/* all, following interfaces as they come */
+	test_assert(!lc_socket_send_policy(sock, LC_SEND_ALL, NULL, 0), "lc_socket_send_policy() - all");
+	lc_msg_init_data(&msg, "every", 5, NULL, NULL);
+	test_assert(lc_msg_send(chan, &msg) > 0, "lc_msg_send()");
+	test_assert(sent_on(0, "every") && sent_on(1, "every"), "sent out of every interface");
+	test_assert(tap_new(lctx, TAPS - 1), "%s cached", tapname[TAPS - 1]);
+	lc_channel_send(chan, "newif", 5, 0);
+	test_assert(sent_on(0, "newif") && sent_on(TAPS - 1, "newif"), "sent out of new interface");
+
+	/* back to one copy, wherever the kernel sends it */
+	test_assert(!lc_socket_send_policy(sock, LC_SEND_DEFAULT, NULL, 0), "lc_socket_send_policy() - default");
+	test_assert(lc_channel_send(chan, "default", 7, 0) == 7, "lc_channel_send()");
+	taps = 0;
+	for (int i = 0; i < TAPS; i++) taps += sent_on(i, "default");
+	test_assert(taps <= 1, "sent once: %i", taps);
+
+	for (int i = 0; i < TAPS; i++) close(tapfd[i]);
+	lc_ctx_free(lctx);
+	return fails;
+}
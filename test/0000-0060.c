@@ -0,0 +1,77 @@
+#include "test.h"
+#include <librecast/net.h>
+#include <time.h>
+
+/* is group joined on any interface? */
+static int joined(lc_channel_t *c)
+{
+	struct in6_addr *grp = lc_channel_in6addr(c);
+	char line[256], hex[33];
+	int found = 0;
+	FILE *f;
+
+	for (int j = 0; j < 16; j++) sprintf(hex + 2 * j, "%02x", grp->s6_addr[j]);
+	if (!(f = fopen("/proc/net/igmp6", "r"))) return -1;
+	while (fgets(line, sizeof line, f)) if (strstr(line, hex)) found = 1;
+	fclose(f);
+	return found;
+}
+
+int main()
+{
+	lc_ctx_t *lctx;
+	lc_socket_t *s1, *s2;
+	lc_channel_t *chan, *queued;
+	lc_join_stats_t stats;
+	struct timespec ts = { .tv_nsec = 10000000 };
+
+	test_name("lc_channel_unbind() / lc_channel_bind() - joined channel moves socket");
+
+	lctx = lc_ctx_new();
+	s1 = lc_socket_new(lctx);
+	s2 = lc_socket_new(lctx);
+	chan = lc_channel_new(lctx, "0000-0060");
+
+	/* unbound, then bound to another socket */
+	lc_channel_bind(s1, chan);
+	test_assert(!lc_channel_join(chan), "lc_channel_join() - s1");
+	test_assert(joined(chan) != 0, "joined");
+	test_assert(!lc_channel_unbind(chan), "lc_channel_unbind()");
+	test_assert(joined(chan) == 0, "parted on unbind");
+	test_assert(lc_channel_part(chan) == LC_ERROR_SOCKET_REQUIRED, "unbound - no socket to part");
+	test_assert(!lc_channel_bind(s2, chan), "lc_channel_bind() - s2");
+	test_assert(lc_channel_part(chan) == LC_ERROR_MCAST_PART, "not joined on s2");
+	test_assert(!lc_channel_join(chan), "lc_channel_join() - s2");
+	test_assert(joined(chan) != 0, "joined on s2");
+
+	/* bound to another socket without unbinding */
+	test_assert(!lc_channel_bind(s1, chan), "lc_channel_bind() - back to s1");
+	test_assert(joined(chan) == 0, "parted from s2");
+	test_assert(!lc_channel_join(chan), "lc_channel_join() - s1 again");
+	test_assert(!lc_channel_part(chan), "lc_channel_part() - s1");
+	test_assert(joined(chan) == 0, "parted from s1");
+	test_assert(lc_channel_part(chan) == LC_ERROR_MCAST_PART, "nothing left to part");
+
+	/* a queued join is cancelled */
+	test_assert(!lc_ctx_join_pace(lctx, 1, 1, NULL, NULL), "lc_ctx_join_pace()");
+	queued = lc_channel_new(lctx, "0000-0060/queued");
+	lc_channel_bind(s1, chan);
+	lc_channel_bind(s1, queued);
+	lc_channel_join(chan); /* takes the one token */
+	for (int i = 0; i < 100; i++) {
+		lc_ctx_join_stats(lctx, &stats);
+		if (stats.joined) break;
+		nanosleep(&ts, NULL);
+	}
+	lc_channel_join(queued);
+	lc_ctx_join_stats(lctx, &stats);
+	test_assert(stats.queued == 1, "join queued: %zu", stats.queued);
+	lc_channel_unbind(queued);
+	lc_ctx_join_stats(lctx, &stats);
+	test_assert(stats.queued == 0, "queued join cancelled on unbind: %zu", stats.queued);
+	lc_channel_bind(s2, queued);
+	test_assert(lc_channel_part(queued) == LC_ERROR_MCAST_PART, "not joined on s2");
+
+	lc_ctx_free(lctx);
+	return fails;
+}